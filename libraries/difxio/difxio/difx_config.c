@@ -132,6 +132,7 @@ void fprintDifxConfig(FILE *fp, const DifxConfig *dc)
 	fprintf(fp, "    strideLength = %d\n", dc->strideLength);
 	fprintf(fp, "    xmacLength = %d\n", dc->xmacLength);
 	fprintf(fp, "    numBufferedFFTs = %d\n", dc->numBufferedFFTs);
+	fprintf(fp, "    xmacCS16 = %d\n", dc->xmacCS16);
 	fprintf(fp, "    pulsarId = %d\n", dc->pulsarId);
 	p0 = dc->pol[0] ? dc->pol[0] : ' ';
 	p1 = dc->pol[1] ? dc->pol[1] : ' ';
@@ -200,6 +201,7 @@ int isSameDifxConfig(const DifxConfig *dc1, const DifxConfig *dc2)
 	   dc1->strideLength != dc2->strideLength ||
 	   dc1->xmacLength != dc2->xmacLength ||
 	   dc1->numBufferedFFTs != dc2->numBufferedFFTs ||
+	   dc1->xmacCS16 != dc2->xmacCS16 ||
 	   dc1->pulsarId != dc2->pulsarId ||
 	   dc1->nPol != dc2->nPol ||
 	   dc1->doPolar != dc2->doPolar ||
@@ -400,6 +402,7 @@ void copyDifxConfig(DifxConfig *dest, const DifxConfig *src, const int *baseline
 	dest->strideLength = src->strideLength;
 	dest->xmacLength = src->xmacLength;
 	dest->numBufferedFFTs = src->numBufferedFFTs;
+	dest->xmacCS16 = src->xmacCS16;
 	if(pulsarIdRemap && src->pulsarId >= 0)
 	{
 		dest->pulsarId = pulsarIdRemap[src->pulsarId];
@@ -598,6 +601,11 @@ int writeDifxConfigArray(FILE *out, int nConfig, const DifxConfig *dc, const Dif
 		writeDifxLineInt(out, "ARRAY STRIDE LENGTH", config->strideLength);
 		writeDifxLineInt(out, "XMAC STRIDE LENGTH", config->xmacLength);
 		writeDifxLineInt(out, "NUM BUFFERED FFTS", config->numBufferedFFTs);
+		if(config->xmacCS16)
+		{
+			writeDifxLine(out, "XMAC PRECISION", "CS16");
+			++n;
+		}
 		if(config->doAutoCorr)
 		{
 			writeDifxLine(out, "WRITE AUTOCORRS", "TRUE");
@@ -1086,6 +1086,12 @@ static DifxInput *parseDifxInputConfigurationTable(DifxInput *D, const DifxParam
 		dc->strideLength   = atoi(DifxParametersvalue(ip, rows[5]));
 		dc->xmacLength     = atoi(DifxParametersvalue(ip, rows[6]));
 		dc->numBufferedFFTs= atoi(DifxParametersvalue(ip, rows[7]));
+		/* optional; if present it sits between NUM BUFFERED FFTS and WRITE AUTOCORRS */
+		r = DifxParametersfind(ip, rows[7], "XMAC PRECISION");
+		if(r > 0 && r < rows[8] && strcmp(DifxParametersvalue(ip, r), "CS16") == 0)
+		{
+			dc->xmacCS16 = 1;
+		}
 		dc->doAutoCorr     = abs(strcmp("FALSE", DifxParametersvalue(ip, rows[8])));
 		dc->nDatastream  = D->job->activeDatastreams;
 		dc->nBaseline    = D->job->activeBaselines;
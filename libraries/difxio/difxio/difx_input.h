@@ -50,6 +50,7 @@
 #define MAX_PHASED_ARRAY_TYPE_STRING_LENGTH	16
 #define MAX_PHASED_ARRAY_FORMAT_STRING_LENGTH	16
 #define MAX_TAPER_FUNCTION_STRING_LENGTH	16
+#define MAX_THREAD_PLACEMENT_STRING_LENGTH	8
 #define MAX_COMPATIBILITY_DESCRIPTION_LENGTH	64
 
 #define DIFXIO_FILENAME_LENGTH		PATH_MAX
@@ -264,6 +265,17 @@ enum TaperFunction
 extern const char taperFunctionNames[][MAX_TAPER_FUNCTION_STRING_LENGTH];
 
 
+/* keep this current with threadPlacementNames[] in difx_threads.c */
+enum ThreadPlacement
+{
+	ThreadPlacementNone = 0,	/* leave the threads to the scheduler [default] */
+	ThreadPlacementNuma,		/* keep the threads and their memory on the core process's NUMA node */
+
+	NumThreadPlacements		/* needs to be at end of list */
+};
+
+extern const char threadPlacementNames[][MAX_THREAD_PLACEMENT_STRING_LENGTH];
+
 /* FIXME: in future version, handle Frequency, EOP, ... MergeModes in more consistant manner, perhaps as a new structure rather than individual enums */
 
 /* keep this current with freqMergeModeNames in difx_freq.c */
@@ -388,6 +400,7 @@ typedef struct
 	int strideLength;	/* Must be integer divisor of number of channels */
 	int xmacLength;         /* Must be integer divisor of number of channels */
 	int numBufferedFFTs;    /* The number of FFTs to do in a row before XMAC'ing */
+	int xmacCS16;		/* >0 if spectra are packed to 16-bit complex for XMAC'ing (XMAC PRECISION = CS16) */
 	int pulsarId;		/* -1 if not pulsar */
 	int phasedArrayId;	/* -1 if not phased array mode */
 	int nPol;		/* number of pols in datastreams (1 or 2) */
@@ -718,6 +731,7 @@ typedef struct
 
 	int nCore;		/* from the .threads file, or zero if no file */
 	int *nThread;		/* [coreId]: how many threads to use on each core */
+	enum ThreadPlacement *threadPlacement;	/* [coreId]: how to place the threads of each core */
 
 	int nAntenna, nConfig, nRule, nFreq, nFreqUnsimplified, nFreqSet, nScan, nSource, nEOP, nFlag;
 	int nDatastream, nBaseline, nSpacecraft, nPulsar, nPhasedArray, nJob;
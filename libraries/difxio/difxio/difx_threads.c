@@ -32,6 +32,27 @@
 #include <string.h>
 #include "difxio/difx_input.h"
 
+const char threadPlacementNames[][MAX_THREAD_PLACEMENT_STRING_LENGTH] =
+{
+	"none",
+	"numa"
+};
+
+static enum ThreadPlacement stringToThreadPlacement(const char *str)
+{
+	enum ThreadPlacement p;
+
+	for(p = 0; p < NumThreadPlacements; ++p)
+	{
+		if(strcasecmp(str, threadPlacementNames[p]) == 0)
+		{
+			break;
+		}
+	}
+
+	return p;
+}
+
 void DifxInputAllocThreads(DifxInput *D, int nCore)
 {
 	if(!D)
@@ -46,12 +67,22 @@ void DifxInputAllocThreads(DifxInput *D, int nCore)
 		D->nThread = 0;
 		D->nCore = 0;
 	}
+	if(D->threadPlacement)
+	{
+		free(D->threadPlacement);
+		D->threadPlacement = 0;
+	}
 	if(nCore > 0)
 	{
 		D->nThread = (int *)calloc(nCore, sizeof(int));
-		if(D->nThread == 0)
+		D->threadPlacement = (enum ThreadPlacement *)calloc(nCore, sizeof(enum ThreadPlacement));
+		if(D->nThread == 0 || D->threadPlacement == 0)
 		{
 			fprintf(stderr, "Alloc error: DifxInputAllocThreads: nCore=%d\n", nCore);
+			free(D->nThread);
+			free(D->threadPlacement);
+			D->nThread = 0;
+			D->threadPlacement = 0;
 
 			return;
 		}
@@ -81,6 +112,7 @@ int DifxInputLoadThreads(DifxInput *D)
 	const int MaxLineLen = 100;
 	FILE *in;
 	char line[MaxLineLen+1];
+	char placement[MAX_THREAD_PLACEMENT_STRING_LENGTH];
 	char *rv;
 	int nCore, i, n;
 
@@ -143,8 +175,8 @@ int DifxInputLoadThreads(DifxInput *D)
 
 			return -1;
 		}
-		n = sscanf(line, "%d", &D->nThread[i]);
-		if(n != 1)
+		n = sscanf(line, "%d %7s", &D->nThread[i], placement);
+		if(n < 1)
 		{
 			fprintf(stderr, "Line %d of %s : format error\n", i+2, D->job->threadsFile);
 			fclose(in);
@@ -152,6 +184,15 @@ int DifxInputLoadThreads(DifxInput *D)
 
 			return -2;
 		}
+		if(n == 2)
+		{
+			D->threadPlacement[i] = stringToThreadPlacement(placement);
+			if(D->threadPlacement[i] == NumThreadPlacements)
+			{
+				fprintf(stderr, "Warning: line %d of %s : unknown thread placement %s; ignoring it\n", i+2, D->job->threadsFile, placement);
+				D->threadPlacement[i] = ThreadPlacementNone;
+			}
+		}
 	}
 
 	fclose(in);
@@ -197,7 +238,14 @@ int DifxInputWriteThreads(const DifxInput *D)
 	fprintf(out, "NUMBER OF CORES:    %d\n", D->nCore);
 	for(i = 0; i < D->nCore; ++i)
 	{
-		fprintf(out, "%d\n", D->nThread[i]);
+		if(D->threadPlacement && D->threadPlacement[i] != ThreadPlacementNone)
+		{
+			fprintf(out, "%d %s\n", D->nThread[i], threadPlacementNames[D->threadPlacement[i]]);
+		}
+		else
+		{
+			fprintf(out, "%d\n", D->nThread[i]);
+		}
 	}
 
 	fclose(out);
@@ -243,3 +243,212 @@ int DifxVisRecordfindnext(DifxVisRecord *vis, int baseline, int freqid,
 
 	return vis->visnum;
 }
+
+int DifxVisRecordseek(DifxVisRecord *vis, long long offset)
+{
+	if(vis->infile == stdin || fseeko(vis->infile, (off_t)offset, SEEK_SET) != 0)
+	{
+		fprintf(stderr, "Error: DifxVisRecordseek: cannot seek to byte %lld\n", offset);
+
+		return -1;
+	}
+
+	return 0;
+}
+
+int DifxVisIndexfilename(char *indexFilename, int maxLength, const char *visFilename)
+{
+	const char *base;
+	int v;
+
+	base = strrchr(visFilename, '/');
+	base = base ? base + 1 : visFilename;
+	if(strncmp(base, "DIFX_", 5) != 0)
+	{
+		return -1;
+	}
+
+	v = snprintf(indexFilename, maxLength, "%.*sINDEX_%s", (int)(base - visFilename), visFilename, base + 5);
+	if(v >= maxLength)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+DifxVisIndex *loadDifxVisIndex(const char *filename)
+{
+	DifxVisIndex *index;
+	FILE *in;
+	int allocIntegration = 0, allocEntry = 0;
+	int i, n;
+	unsigned int sync;
+	int version, mjd, nEntry;
+	double seconds;
+
+	in = fopen(filename, "r");
+	if(in == 0)
+	{
+		fprintf(stderr, "Cannot open %s\n", filename);
+
+		return 0;
+	}
+
+	index = (DifxVisIndex *)calloc(1, sizeof(DifxVisIndex));
+	if(index == 0)
+	{
+		fprintf(stderr, "loadDifxVisIndex : malloc error\n");
+		fclose(in);
+
+		return 0;
+	}
+
+	for(;;)
+	{
+		n  = fread(&sync, sizeof(unsigned int), 1, in);
+		n += fread(&version, sizeof(int), 1, in);
+		n += fread(&mjd, sizeof(int), 1, in);
+		n += fread(&nEntry, sizeof(int), 1, in);
+		n += fread(&seconds, sizeof(double), 1, in);
+		if(n != 5)
+		{
+			break;
+		}
+		if(sync != VISINDEX_SYNC_WORD || version != VISINDEX_VERSION || nEntry < 0)
+		{
+			fprintf(stderr, "Error: loadDifxVisIndex: got a sync of %x and version of %d in block %d of %s\n", sync, version, index->nIntegration, filename);
+
+			break;
+		}
+
+		if(index->nIntegration >= allocIntegration)
+		{
+			allocIntegration = allocIntegration ? 2*allocIntegration : 64;
+			index->integration = (DifxVisIndexIntegration *)realloc(index->integration, allocIntegration*sizeof(DifxVisIndexIntegration));
+		}
+		if(index->nEntry + nEntry > allocEntry)
+		{
+			allocEntry = allocEntry ? 2*allocEntry : 1024;
+			if(allocEntry < index->nEntry + nEntry)
+			{
+				allocEntry = index->nEntry + nEntry;
+			}
+			index->entry = (DifxVisIndexEntry *)realloc(index->entry, allocEntry*sizeof(DifxVisIndexEntry));
+		}
+		if(index->integration == 0 || index->entry == 0)
+		{
+			fprintf(stderr, "loadDifxVisIndex : malloc error\n");
+			fclose(in);
+			deleteDifxVisIndex(index);
+
+			return 0;
+		}
+
+		n = fread(index->entry + index->nEntry, sizeof(DifxVisIndexEntry), nEntry, in);
+		if(n != nEntry)
+		{
+			fprintf(stderr, "Warning: loadDifxVisIndex: %s ends part way through block %d\n", filename, index->nIntegration);
+
+			break;
+		}
+
+		index->integration[index->nIntegration].mjd = mjd;
+		index->integration[index->nIntegration].seconds = seconds;
+		index->integration[index->nIntegration].nEntry = nEntry;
+		++index->nIntegration;
+		index->nEntry += nEntry;
+	}
+
+	fclose(in);
+
+	/* the entry array has been reallocated along the way, so point into it only now */
+	n = 0;
+	for(i = 0; i < index->nIntegration; ++i)
+	{
+		index->integration[i].entry = index->entry + n;
+		n += index->integration[i].nEntry;
+	}
+
+	return index;
+}
+
+void deleteDifxVisIndex(DifxVisIndex *index)
+{
+	if(index)
+	{
+		if(index->integration)
+		{
+			free(index->integration);
+			index->integration = 0;
+		}
+		if(index->entry)
+		{
+			free(index->entry);
+			index->entry = 0;
+		}
+		free(index);
+	}
+}
+
+int DifxVisIndexfindtime(const DifxVisIndex *index, int mjd, double seconds)
+{
+	int lo = 0, hi = index->nIntegration, mid;
+	double t;
+
+	if(index->nIntegration == 0)
+	{
+		return 0;
+	}
+
+	t = (mjd - index->integration[0].mjd)*86400.0 + seconds;
+
+	/* integrations are written in time order, so bisect */
+	while(lo < hi)
+	{
+		mid = (lo + hi)/2;
+		if((index->integration[mid].mjd - index->integration[0].mjd)*86400.0 + index->integration[mid].seconds < t)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+const DifxVisIndexEntry *DifxVisIndexfind(const DifxVisIndex *index, int integration,
+	int baseline, int freqid, const char *pol)
+{
+	const DifxVisIndexIntegration *T;
+	int e;
+
+	if(integration < 0 || integration >= index->nIntegration)
+	{
+		return 0;
+	}
+
+	T = index->integration + integration;
+	for(e = 0; e < T->nEntry; ++e)
+	{
+		if(baseline >= 0 && baseline != T->entry[e].baseline)
+		{
+			continue;
+		}
+		if(pol && (pol[0] != T->entry[e].polpair[0] || pol[1] != T->entry[e].polpair[1]))
+		{
+			continue;
+		}
+		if(freqid >= 0 && freqid != T->entry[e].freqindex)
+		{
+			continue;
+		}
+
+		return T->entry + e;
+	}
+
+	return 0;
+}
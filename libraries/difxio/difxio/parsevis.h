@@ -49,6 +49,8 @@ extern "C" {
 
 #define VISRECORD_SYNC_WORD_DIFX1	(('B' << 24) + ('A' << 16) + ('S' << 8) + 'E')
 #define VISRECORD_SYNC_WORD_DIFX2	0xFF00FF00
+#define VISINDEX_SYNC_WORD		0xFF01FF01
+#define VISINDEX_VERSION		1
 
 
 typedef struct
@@ -85,6 +87,65 @@ int DifxVisRecordgetnext(DifxVisRecord *vis);
 int DifxVisRecordfindnext(DifxVisRecord *vis, int baseline, int freqid,
 	const char *pol);
 
+/* position the file so the next getnext reads the record at offset;
+ * return -1 on failure */
+int DifxVisRecordseek(DifxVisRecord *vis, long long offset);
+
+
+/* When mpifxcorr runs with DIFX_VIS_INDEX set, each DIFX_<mjd>_<sec>.sXXXX.bXXXX
+ * output file is accompanied by INDEX_<mjd>_<sec>.sXXXX.bXXXX.  For each
+ * integration that file holds a 24 byte block header (sync, version, mjd,
+ * number of entries, seconds as a double) followed by that many 32 byte
+ * entries laid out as DifxVisIndexEntry, in native byte order, so it can
+ * equally be read with loadDifxVisIndex() or memory mapped. */
+
+typedef struct
+{
+	long long offset;		/* byte offset of the record's sync word in the DIFX file */
+	int baseline;			/* The baseline number (256*A1 + A2, 1 indexed) */
+	int freqindex;			/* The index to the freq table */
+	int sourceindex;		/* The index to the source table */
+	int pulsarbin;			/* The pulsar bin */
+	int nchan;			/* number of channels in the record */
+	char polpair[2];		/* The polarisation pair (not terminated) */
+	char pad[2];
+} DifxVisIndexEntry;
+
+typedef struct
+{
+	int mjd;			/* The MJD integer day */
+	double seconds;			/* The seconds offset from mjd */
+	int nEntry;			/* number of records in this integration */
+	DifxVisIndexEntry *entry;	/* points into the index's entry array */
+} DifxVisIndexIntegration;
+
+typedef struct
+{
+	int nIntegration;
+	DifxVisIndexIntegration *integration;	/* in file (time) order */
+	int nEntry;
+	DifxVisIndexEntry *entry;		/* all entries, in file order */
+} DifxVisIndex;
+
+/* form the index file name belonging to a DIFX visibility file name;
+ * return -1 if the name does not look like a DIFX file or does not fit */
+int DifxVisIndexfilename(char *indexFilename, int maxLength, const char *visFilename);
+
+/* load a complete index file; incomplete trailing blocks are ignored */
+DifxVisIndex *loadDifxVisIndex(const char *filename);
+
+void deleteDifxVisIndex(DifxVisIndex *index);
+
+/* return the number of the first integration at or after mjd + seconds/86400,
+ * or index->nIntegration if there is none */
+int DifxVisIndexfindtime(const DifxVisIndex *index, int mjd, double seconds);
+
+/* find the record in an integration matching the given parameters; as for
+ * DifxVisRecordfindnext baseline or freqid < 0 and pol = 0 match anything.
+ * Return 0 if there is none */
+const DifxVisIndexEntry *DifxVisIndexfind(const DifxVisIndex *index, int integration,
+	int baseline, int freqid, const char *pol);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,119 @@
+/* Checks the INDEX_ file that mpifxcorr writes next to a DIFX_ visibility file
+ * when DIFX_VIS_INDEX is set: every indexed record is read back by seeking
+ * straight to it and its header compared with the index.  Optionally the
+ * records of one baseline (and band and polarisation) at or after a given time
+ * are printed, found through the index alone. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "difxio/difx_input.h"
+#include "difxio/parsevis.h"
+
+const char program[] = "testvisindex";
+const char version[] = "0.1";
+const char verdate[] = "20261018";
+
+int usage(const char *pgm)
+{
+	fprintf(stderr, "%s ver. %s   %s\n\n", program, version, verdate);
+	fprintf(stderr, "usage : %s <difx file> [<mjd> <seconds> <baseline> [<freqid> [<pol>]]]\n\n", pgm);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char indexFilename[DIFXIO_FILENAME_LENGTH];
+	DifxVisIndex *index;
+	DifxVisRecord *vis;
+	const DifxVisIndexEntry *E;
+	int i, e, maxChan = 1;
+	int nBad = 0;
+
+	if(argc < 2 || argc == 3 || argc == 4)
+	{
+		return usage(argv[0]);
+	}
+
+	if(DifxVisIndexfilename(indexFilename, DIFXIO_FILENAME_LENGTH, argv[1]) < 0)
+	{
+		fprintf(stderr, "%s is not a DIFX_ visibility file name\n", argv[1]);
+
+		return EXIT_FAILURE;
+	}
+
+	index = loadDifxVisIndex(indexFilename);
+	if(!index)
+	{
+		return EXIT_FAILURE;
+	}
+	for(e = 0; e < index->nEntry; ++e)
+	{
+		if(index->entry[e].nchan > maxChan)
+		{
+			maxChan = index->entry[e].nchan;
+		}
+	}
+
+	vis = newDifxVisRecord(argv[1], maxChan);
+	if(!vis)
+	{
+		deleteDifxVisIndex(index);
+
+		return EXIT_FAILURE;
+	}
+
+	for(i = 0; i < index->nIntegration; ++i)
+	{
+		const DifxVisIndexIntegration *T = index->integration + i;
+
+		for(e = 0; e < T->nEntry; ++e)
+		{
+			E = T->entry + e;
+			vis->nchan = E->nchan;
+			if(DifxVisRecordseek(vis, E->offset) < 0 || DifxVisRecordgetnext(vis) < 0 ||
+				vis->mjd != T->mjd || vis->seconds != T->seconds ||
+				vis->baseline != E->baseline || vis->freqindex != E->freqindex ||
+				vis->sourceindex != E->sourceindex || vis->pulsarbin != E->pulsarbin ||
+				vis->polpair[0] != E->polpair[0] || vis->polpair[1] != E->polpair[1])
+			{
+				if(nBad < 10)
+				{
+					fprintf(stderr, "Error: integration %d entry %d (baseline %d freq %d at byte %lld) does not match the record there\n", i, e, E->baseline, E->freqindex, E->offset);
+				}
+				++nBad;
+			}
+		}
+	}
+
+	printf("%s: %d integrations, %d records, %d mismatched\n", indexFilename, index->nIntegration, index->nEntry, nBad);
+
+	if(argc > 4 && nBad == 0)
+	{
+		int baseline = atoi(argv[4]);
+		int freqId = argc > 5 ? atoi(argv[5]) : -1;
+		const char *pol = argc > 6 ? argv[6] : 0;
+
+		for(i = DifxVisIndexfindtime(index, atoi(argv[2]), atof(argv[3])); i < index->nIntegration; ++i)
+		{
+			E = DifxVisIndexfind(index, i, baseline, freqId, pol);
+			if(E == 0)
+			{
+				continue;
+			}
+			vis->nchan = E->nchan;
+			DifxVisRecordseek(vis, E->offset);
+			if(DifxVisRecordgetnext(vis) < 0)
+			{
+				break;
+			}
+			printf("%d %12.6f  baseline %d  freq %d  pol %c%c  weight %f  vis[0] = %f %f\n", vis->mjd, vis->seconds, vis->baseline, vis->freqindex, vis->polpair[0], vis->polpair[1], vis->dataweight, creal(vis->visdata[0]), cimag(vis->visdata[0]));
+		}
+	}
+
+	deleteDifxVisRecord(vis);
+	deleteDifxVisIndex(index);
+
+	return nBad == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
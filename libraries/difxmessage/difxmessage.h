@@ -71,6 +71,19 @@ extern "C" {
 
 int MulticastSend(const char *group, int port, const char *message, int length);
 
+/* Optional send queue.  Once started, messages are copied to a queue of up to depth messages
+ * and sent in batches by a background thread, so senders do not wait on the network.  Messages
+ * that arrive when the queue is full are dropped, apart from severe and fatal alerts, which wait
+ * for the messages queued before them to be sent and are then sent directly.  Flush waits only for
+ * the messages queued before it was called.  Queued messages are still sent at exit.
+ * Setting env var DIFX_MESSAGE_SEND_QUEUE to a depth starts the queue in difxMessageInit(). */
+
+int difxMessageSendQueueStart(int depth);
+int difxMessageSendQueueFlush();
+int difxMessageSendQueueStop();
+int isDifxMessageSendQueueRunning();
+void difxMessageSendQueueStats(long long *nSent, long long *nDropped, long long *nBatch);
+
 /* functions for receive */
 
 int openMultiCastSocket(const char *group, int port);
@@ -192,6 +205,8 @@ enum DifxDiagnosticType
 	DIFX_DIAGNOSTIC_DATACONSUMED,
 	DIFX_DIAGNOSTIC_INPUTDATARATE,
 	DIFX_DIAGNOSTIC_NUMSUBINTSLOST,
+	DIFX_DIAGNOSTIC_COREUTILISATION,
+	DIFX_DIAGNOSTIC_PACKETSTATS,
 	NUM_DIFX_DIAGNOSTIC_TYPES	/* this needs to be the last line of enum */
 };
 
@@ -579,6 +594,16 @@ typedef struct
 	double microsec;
 	double rateMbps;
 	int bufferstatus[3];
+	int coreid;		/* mpi id of the core described by a CoreUtilisation message */
+	int queuedepth;		/* subints currently outstanding at that core */
+	int maxqueuedepth;	/* the most it may currently hold */
+	double subintspersec;
+	double utilisation;	/* throughput relative to the fastest core, 0 to 1 */
+	long long packets;	/* PacketStats: packets received by a network datastream in the last second */
+	long long packetslost;
+	long long packetsoutoforder;
+	long long packetsduplicate;
+	long long packetswrongsize;
 } DifxMessageDiagnostic;
 
 typedef struct
@@ -703,6 +728,8 @@ int difxMessageSendDifxDiagnosticMemoryUsage(long long membytes);
 int difxMessageSendDifxDiagnosticDataConsumed(long long bytes);
 int difxMessageSendDifxDiagnosticInputDatarate(double bytespersec);
 int difxMessageSendDifxDiagnosticNumSubintsLost(int numsubintslost);
+int difxMessageSendDifxDiagnosticCoreUtilisation(int coreid, int queuedepth, int maxqueuedepth, double subintspersec, double utilisation);
+int difxMessageSendDifxDiagnosticPacketStats(long long packets, long long lost, long long outoforder, long long duplicate, long long wrongsize);
 int difxMessageSendDifxParameter(const char *name, const char *value, int mpiDestination);
 int difxMessageSendDifxParameterTo(const char *name, const char *value, const char *to);
 int difxMessageSendDifxParameter1(const char *name, int index1, const char *value, int mpiDestination);
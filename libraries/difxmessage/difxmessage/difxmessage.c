@@ -152,7 +152,9 @@ const char DifxDiagnosticStrings[][24] =
 	"ProcessingTime",
 	"DataConsumed",
 	"InputDatarate",
-	"NumSubintsLost"
+	"NumSubintsLost",
+	"CoreUtilisation",
+	"PacketStats"
 };
 
 /* Note! Keep this in sync with enum DifxAlertLevel in difxmessage.h */
@@ -200,6 +200,12 @@ int difxMessageInitFull(int mpiId, const char *identifier, const char *published
 		return -1;
 	}
 
+	envstr = getenv("DIFX_MESSAGE_SEND_QUEUE");
+	if(envstr != 0 && difxMessageInUse && atoi(envstr) > 0)
+	{
+		difxMessageSendQueueStart(atoi(envstr));
+	}
+
 	/* send a message to prime the network for multicast */
 	//difxMessageSendDifxAlert("Initialized", DIFX_ALERT_LEVEL_VERBOSE);
 	
@@ -50,4 +50,7 @@ extern int difxBinaryLTAPort;
 extern int difxMessageInUse;
 extern int difxMessageUnicast;
 
+int MulticastSendSpaced(const char *group, int port, const char *message, int length, int minGap);
+int MulticastSendDirect(const char *group, int port, const char *message, int length);
+
 #endif
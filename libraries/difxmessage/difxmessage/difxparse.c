@@ -843,6 +843,46 @@ static void XMLCALL endElement(void *userData, const char *name)
 					{
 						G->body.diagnostic.microsec = atof(s);
 					}
+					else if(strcmp(elem, "coreId") == 0)
+					{
+						G->body.diagnostic.coreid = atoi(s);
+					}
+					else if(strcmp(elem, "queueDepth") == 0)
+					{
+						G->body.diagnostic.queuedepth = atoi(s);
+					}
+					else if(strcmp(elem, "maxQueueDepth") == 0)
+					{
+						G->body.diagnostic.maxqueuedepth = atoi(s);
+					}
+					else if(strcmp(elem, "subintsPerSec") == 0)
+					{
+						G->body.diagnostic.subintspersec = atof(s);
+					}
+					else if(strcmp(elem, "utilisation") == 0)
+					{
+						G->body.diagnostic.utilisation = atof(s);
+					}
+					else if(strcmp(elem, "packets") == 0)
+					{
+						G->body.diagnostic.packets = atoll(s);
+					}
+					else if(strcmp(elem, "packetsLost") == 0)
+					{
+						G->body.diagnostic.packetslost = atoll(s);
+					}
+					else if(strcmp(elem, "packetsOutOfOrder") == 0)
+					{
+						G->body.diagnostic.packetsoutoforder = atoll(s);
+					}
+					else if(strcmp(elem, "packetsDuplicate") == 0)
+					{
+						G->body.diagnostic.packetsduplicate = atoll(s);
+					}
+					else if(strcmp(elem, "packetsWrongSize") == 0)
+					{
+						G->body.diagnostic.packetswrongsize = atoll(s);
+					}
 					break;
 				case DIFX_MESSAGE_FILETRANSFER:
 					if(strcmp(elem, "origin") == 0 )
@@ -1260,6 +1300,16 @@ void difxMessageGenericPrint(const DifxMessageGeneric *G)
 		printf("    numBufElements = %d\n", G->body.diagnostic.bufferstatus[0]);
 		printf("    startBufElement = %d\n", G->body.diagnostic.bufferstatus[1]);
 		printf("    activeBufElements = %d\n", G->body.diagnostic.bufferstatus[2]);
+		printf("    coreId = %d\n", G->body.diagnostic.coreid);
+		printf("    queueDepth = %d\n", G->body.diagnostic.queuedepth);
+		printf("    maxQueueDepth = %d\n", G->body.diagnostic.maxqueuedepth);
+		printf("    subintsPerSec = %.3f\n", G->body.diagnostic.subintspersec);
+		printf("    utilisation = %.3f\n", G->body.diagnostic.utilisation);
+		printf("    packets = %lld\n", G->body.diagnostic.packets);
+		printf("    packetsLost = %lld\n", G->body.diagnostic.packetslost);
+		printf("    packetsOutOfOrder = %lld\n", G->body.diagnostic.packetsoutoforder);
+		printf("    packetsDuplicate = %lld\n", G->body.diagnostic.packetsduplicate);
+		printf("    packetsWrongSize = %lld\n", G->body.diagnostic.packetswrongsize);
 		break;
 	case DIFX_MESSAGE_START:
 		printf("    MPI wrapper = %s\n", G->body.start.mpiWrapper);
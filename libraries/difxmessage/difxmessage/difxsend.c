@@ -107,6 +107,12 @@ int difxMessageSend2(const char *message, int size)
 		return -1;
 	}
 
+	if(isDifxMessageSendQueueRunning())
+	{
+		/* the send thread keeps the minimum gap instead */
+		return MulticastSendSpaced(difxMessageGroup, difxMessagePort, message, size, MIN_SEND_GAP);
+	}
+
 	if(first)
 	{
 		first = 0;
@@ -264,7 +270,22 @@ int difxMessageSendDifxAlert(const char *alertMessage, int severity)
 			return -1;
 		}
 
-		difxMessageSend2(message, size);
+		if(severity <= DIFX_ALERT_LEVEL_SEVERE && isDifxMessageSendQueueRunning())
+		{
+			/* Severe and fatal alerts often precede an abort and must never be dropped from a full
+			 * queue, so send everything queued before them (but not after) and then send them directly */
+			struct timespec ts;
+
+			difxMessageSendQueueFlush();
+			ts.tv_sec = 0;
+			ts.tv_nsec = 1000*MIN_SEND_GAP;
+			nanosleep(&ts, 0);
+			MulticastSendDirect(difxMessageGroup, difxMessagePort, message, size);
+		}
+		else
+		{
+			difxMessageSend2(message, size);
+		}
 
 		/* Make sure all fatal errors go to the console */
 		if(severity == DIFX_ALERT_LEVEL_FATAL)
@@ -1553,6 +1574,88 @@ int difxMessageSendDifxDiagnosticNumSubintsLost(int numsubintslost)
 	return difxMessageSend2(message, size);
 }
 
+int difxMessageSendDifxDiagnosticCoreUtilisation(int coreid, int queuedepth, int maxqueuedepth, double subintspersec, double utilisation)
+{
+	char message[DIFX_MESSAGE_LENGTH];
+	char body[DIFX_MESSAGE_LENGTH];
+	int size;
+
+	size = snprintf(body, DIFX_MESSAGE_LENGTH,
+
+		"<difxDiagnostic>"
+		  "<diagnosticType>%s</diagnosticType>"
+		  "<coreId>%d</coreId>"
+		  "<queueDepth>%d</queueDepth>"
+		  "<maxQueueDepth>%d</maxQueueDepth>"
+		  "<subintsPerSec>%.3f</subintsPerSec>"
+		  "<utilisation>%.3f</utilisation>"
+		"</difxDiagnostic>",
+		DifxDiagnosticStrings[DIFX_DIAGNOSTIC_COREUTILISATION],
+		coreid, queuedepth, maxqueuedepth, subintspersec, utilisation);
+
+	if(size >= DIFX_MESSAGE_LENGTH)
+	{
+		fprintf(stderr, "difxMessageSendDifxDiagnostic: message body overflow (%d >= %d)\n", size, DIFX_MESSAGE_LENGTH);
+	
+		return -1;
+	}
+	
+	size = snprintf(message, DIFX_MESSAGE_LENGTH,
+		difxMessageXMLFormat,
+		DifxMessageTypeStrings[DIFX_MESSAGE_DIAGNOSTIC],
+		difxMessageSequenceNumber++, body);
+	
+	if(size >= DIFX_MESSAGE_LENGTH)
+	{
+		fprintf(stderr, "difxMessageSendDifxDiagnostic: message overflow (%d >= %d)\n", size, DIFX_MESSAGE_LENGTH);
+	
+		return -1;
+	}
+	
+	return difxMessageSend2(message, size);
+}
+
+int difxMessageSendDifxDiagnosticPacketStats(long long packets, long long lost, long long outoforder, long long duplicate, long long wrongsize)
+{
+	char message[DIFX_MESSAGE_LENGTH];
+	char body[DIFX_MESSAGE_LENGTH];
+	int size;
+
+	size = snprintf(body, DIFX_MESSAGE_LENGTH,
+
+		"<difxDiagnostic>"
+		  "<diagnosticType>%s</diagnosticType>"
+		  "<packets>%lld</packets>"
+		  "<packetsLost>%lld</packetsLost>"
+		  "<packetsOutOfOrder>%lld</packetsOutOfOrder>"
+		  "<packetsDuplicate>%lld</packetsDuplicate>"
+		  "<packetsWrongSize>%lld</packetsWrongSize>"
+		"</difxDiagnostic>",
+		DifxDiagnosticStrings[DIFX_DIAGNOSTIC_PACKETSTATS],
+		packets, lost, outoforder, duplicate, wrongsize);
+
+	if(size >= DIFX_MESSAGE_LENGTH)
+	{
+		fprintf(stderr, "difxMessageSendDifxDiagnostic: message body overflow (%d >= %d)\n", size, DIFX_MESSAGE_LENGTH);
+	
+		return -1;
+	}
+	
+	size = snprintf(message, DIFX_MESSAGE_LENGTH,
+		difxMessageXMLFormat,
+		DifxMessageTypeStrings[DIFX_MESSAGE_DIAGNOSTIC],
+		difxMessageSequenceNumber++, body);
+	
+	if(size >= DIFX_MESSAGE_LENGTH)
+	{
+		fprintf(stderr, "difxMessageSendDifxDiagnostic: message overflow (%d >= %d)\n", size, DIFX_MESSAGE_LENGTH);
+	
+		return -1;
+	}
+	
+	return difxMessageSend2(message, size);
+}
+
 int difxMessageSendDifxDiagnosticInputDatarate(double bytespersec)
 {
 	char message[DIFX_MESSAGE_LENGTH];
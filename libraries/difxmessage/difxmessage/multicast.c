@@ -26,38 +26,424 @@
 // $LastChangedDate: 2017-08-19 23:31:13 +0800 (六, 2017-08-19) $
 //
 //============================================================================
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	/* for sendmmsg() */
+#endif
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "../difxmessage.h"
+#include "difxmessageinternal.h"
 
-int MulticastSend(const char *group, int port, const char *message, int length)
+/* Messages are sent through one socket per process, opened on first use.
+ * Optionally they are instead put on a queue and sent by a background
+ * thread, several datagrams per system call, so the sender never waits on
+ * the network.  Each message remains one datagram, as receivers expect. */
+
+#define SEND_BATCH_SIZE		64	/* most datagrams sent by one sendmmsg() */
+
+typedef struct
+{
+	struct sockaddr_in addr;
+	int minGap;		/* [us] least time since the previous spaced message, or 0 */
+	int length;
+	int capacity;
+	char *data;
+} QueuedMessage;
+
+static pthread_mutex_t sendLock = PTHREAD_MUTEX_INITIALIZER;
+static int sendSock = -1;
+
+static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;		/* signaled when messages are queued or the queue is to stop */
+static pthread_cond_t queueDrainedCond = PTHREAD_COND_INITIALIZER;	/* signaled when messages have been sent */
+static pthread_t queueThread;
+static QueuedMessage *queue = 0;
+static int queueDepth = 0;
+static int queueHead = 0;	/* oldest message */
+static int queueCount = 0;	/* messages queued, including those being sent */
+static int queueRunning = 0;
+static int queueStop = 0;
+static long long queueNQueued = 0;	/* messages ever queued; the queue position of the next one */
+static long long queueNSent = 0;
+static long long queueNDropped = 0;
+static long long queueNBatch = 0;
+
+static int getSendSocket()
+{
+	unsigned char ttl=3;    /* time-to-live.  Max hops before discard */
+
+	if(sendSock >= 0)
+	{
+		return sendSock;
+	}
+
+	pthread_mutex_lock(&sendLock);
+	if(sendSock < 0)
+	{
+		int fd;
+
+		fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if(fd >= 0)
+		{
+			setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+			sendSock = fd;
+		}
+	}
+	pthread_mutex_unlock(&sendLock);
+
+	return sendSock;
+}
+
+static void setSendAddress(struct sockaddr_in *addr, const char *group, int port)
+{
+	memset(addr, 0, sizeof(struct sockaddr_in));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = inet_addr(group);
+	addr->sin_port = htons(port);
+}
+
+/* sends n queued messages starting at queue index start; returns the number sent */
+static int sendQueued(int fd, int start, int n)
+{
+	int i;
+#if defined(__linux__)
+	struct mmsghdr msgs[SEND_BATCH_SIZE];
+	struct iovec iovecs[SEND_BATCH_SIZE];
+	int nSent = 0;
+
+	memset(msgs, 0, n*sizeof(struct mmsghdr));
+	for(i = 0; i < n; ++i)
+	{
+		QueuedMessage *q = queue + (start + i) % queueDepth;
+
+		iovecs[i].iov_base = q->data;
+		iovecs[i].iov_len = q->length;
+		msgs[i].msg_hdr.msg_name = &q->addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msgs[i].msg_hdr.msg_iov = iovecs + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	while(nSent < n)
+	{
+		int v;
+
+		v = sendmmsg(fd, msgs + nSent, n - nSent, 0);
+		if(v <= 0)
+		{
+			/* skip the message that could not be sent */
+			++nSent;
+		}
+		else
+		{
+			nSent += v;
+		}
+	}
+#else
+	for(i = 0; i < n; ++i)
+	{
+		QueuedMessage *q = queue + (start + i) % queueDepth;
+
+		sendto(fd, q->data, q->length, 0, (struct sockaddr *)&q->addr, sizeof(struct sockaddr_in));
+	}
+#endif
+
+	return n;
+}
+
+static void *sendQueueThread(void *arg)
 {
-        struct sockaddr_in addr;
-        int fd, l;
-        unsigned char ttl=3;    /* time-to-live.  Max hops before discard */
+	struct timeval tLastSpaced;
+
+	gettimeofday(&tLastSpaced, 0);
+
+	for(;;)
+	{
+		int start, n, nSpaced, minGap, fd;
+
+		pthread_mutex_lock(&sendLock);
+		while(queueCount == 0 && !queueStop)
+		{
+			pthread_cond_wait(&queueCond, &sendLock);
+		}
+		if(queueCount == 0)
+		{
+			pthread_mutex_unlock(&sendLock);
+
+			break;
+		}
+
+		/* the batch ends before a second message that has to be spaced from the previous one */
+		start = queueHead;
+		nSpaced = 0;
+		minGap = 0;
+		for(n = 0; n < queueCount && n < SEND_BATCH_SIZE; ++n)
+		{
+			const QueuedMessage *q = queue + (start + n) % queueDepth;
+
+			if(q->minGap > 0)
+			{
+				if(nSpaced > 0)
+				{
+					break;
+				}
+				++nSpaced;
+				minGap = q->minGap;
+			}
+		}
+		pthread_mutex_unlock(&sendLock);
+
+		/* the messages of the batch are not touched by senders until removed from the queue below */
+		if(minGap > 0)
+		{
+			struct timeval tv;
+			int dt;
 
-        fd = socket(AF_INET, SOCK_DGRAM, 0);
-        if(fd < 0)
-        {
-                return -1;
-        }
+			gettimeofday(&tv, 0);
+			dt = 1000000*(tv.tv_sec - tLastSpaced.tv_sec) + (tv.tv_usec - tLastSpaced.tv_usec);
+			if(dt < minGap && dt >= 0)
+			{
+				struct timespec ts;
 
-        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+				ts.tv_sec = 0;
+				ts.tv_nsec = 1000*(minGap-dt);
+				nanosleep(&ts, 0);
+			}
+		}
+		fd = getSendSocket();
+		if(fd >= 0)
+		{
+			sendQueued(fd, start, n);
+		}
+		if(minGap > 0)
+		{
+			gettimeofday(&tLastSpaced, 0);
+		}
 
-        memset(&addr, 0, sizeof(addr));
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = inet_addr(group);
-        addr.sin_port = htons(port);
-        l = sendto(fd, message, length, 0, (struct sockaddr *)&addr, sizeof(addr));
+		pthread_mutex_lock(&sendLock);
+		queueHead = (queueHead + n) % queueDepth;
+		queueCount -= n;
+		queueNSent += n;
+		++queueNBatch;
+		pthread_cond_broadcast(&queueDrainedCond);
+		pthread_mutex_unlock(&sendLock);
+	}
+
+	return 0;
+}
 
-        close(fd);
+static void stopSendQueueAtExit()
+{
+	difxMessageSendQueueStop();
+}
 
-        return l;
+/* Starts sending messages from a queue of up to depth messages; when the queue is full, messages are dropped */
+int difxMessageSendQueueStart(int depth)
+{
+	static int atexitRegistered = 0;
+	int v;
+
+	if(depth <= 0)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&sendLock);
+	if(queueRunning)
+	{
+		pthread_mutex_unlock(&sendLock);
+
+		return 0;
+	}
+
+	queue = (QueuedMessage *)calloc(depth, sizeof(QueuedMessage));
+	if(!queue)
+	{
+		pthread_mutex_unlock(&sendLock);
+		fprintf(stderr, "Error: difxMessageSendQueueStart: cannot allocate queue of %d messages\n", depth);
+
+		return -1;
+	}
+	queueDepth = depth;
+	queueHead = 0;
+	queueCount = 0;
+	queueStop = 0;
+
+	v = pthread_create(&queueThread, 0, sendQueueThread, 0);
+	if(v != 0)
+	{
+		free(queue);
+		queue = 0;
+		queueDepth = 0;
+		pthread_mutex_unlock(&sendLock);
+		fprintf(stderr, "Error: difxMessageSendQueueStart: cannot start send thread\n");
+
+		return -1;
+	}
+	queueRunning = 1;
+	if(!atexitRegistered)
+	{
+		atexitRegistered = 1;
+		atexit(stopSendQueueAtExit);
+	}
+	pthread_mutex_unlock(&sendLock);
+
+	return 0;
+}
+
+/* Waits until the messages queued before the call have been sent; ones queued meanwhile are not waited for */
+int difxMessageSendQueueFlush()
+{
+	long long target;
+
+	pthread_mutex_lock(&sendLock);
+	target = queueNQueued;
+	while(queueRunning && queueNSent < target)
+	{
+		pthread_cond_wait(&queueDrainedCond, &sendLock);
+	}
+	pthread_mutex_unlock(&sendLock);
+
+	return 0;
+}
+
+/* Sends all queued messages, then returns to sending each message directly */
+int difxMessageSendQueueStop()
+{
+	int i;
+
+	pthread_mutex_lock(&sendLock);
+	if(!queueRunning)
+	{
+		pthread_mutex_unlock(&sendLock);
+
+		return 0;
+	}
+	queueStop = 1;
+	pthread_cond_signal(&queueCond);
+	pthread_mutex_unlock(&sendLock);
+
+	pthread_join(queueThread, 0);
+
+	pthread_mutex_lock(&sendLock);
+	queueRunning = 0;
+	for(i = 0; i < queueDepth; ++i)
+	{
+		free(queue[i].data);
+	}
+	free(queue);
+	queue = 0;
+	queueDepth = 0;
+	queueCount = 0;
+	pthread_cond_broadcast(&queueDrainedCond);
+	pthread_mutex_unlock(&sendLock);
+
+	return 0;
+}
+
+int isDifxMessageSendQueueRunning()
+{
+	return queueRunning;
+}
+
+void difxMessageSendQueueStats(long long *nSent, long long *nDropped, long long *nBatch)
+{
+	pthread_mutex_lock(&sendLock);
+	if(nSent)
+	{
+		*nSent = queueNSent;
+	}
+	if(nDropped)
+	{
+		*nDropped = queueNDropped;
+	}
+	if(nBatch)
+	{
+		*nBatch = queueNBatch;
+	}
+	pthread_mutex_unlock(&sendLock);
+}
+
+/* Sends, or queues, one message.  A queued message with minGap > 0 is sent at least minGap us after the previous such message. */
+int MulticastSendSpaced(const char *group, int port, const char *message, int length, int minGap)
+{
+	if(queueRunning)
+	{
+		QueuedMessage *q;
+
+		pthread_mutex_lock(&sendLock);
+		if(!queueRunning || queueStop)
+		{
+			pthread_mutex_unlock(&sendLock);
+		}
+		else if(queueCount >= queueDepth)
+		{
+			++queueNDropped;
+			pthread_mutex_unlock(&sendLock);
+
+			return -1;
+		}
+		else
+		{
+			q = queue + (queueHead + queueCount) % queueDepth;
+			if(q->capacity < length)
+			{
+				char *data;
+
+				data = (char *)realloc(q->data, length);
+				if(!data)
+				{
+					++queueNDropped;
+					pthread_mutex_unlock(&sendLock);
+
+					return -1;
+				}
+				q->data = data;
+				q->capacity = length;
+			}
+			memcpy(q->data, message, length);
+			q->length = length;
+			q->minGap = minGap;
+			setSendAddress(&q->addr, group, port);
+			++queueCount;
+			++queueNQueued;
+			pthread_cond_signal(&queueCond);
+			pthread_mutex_unlock(&sendLock);
+
+			return length;
+		}
+	}
+
+	return MulticastSendDirect(group, port, message, length);
+}
+
+/* Sends one message straight away through the persistent socket, bypassing the queue even if it is running */
+int MulticastSendDirect(const char *group, int port, const char *message, int length)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	fd = getSendSocket();
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	setSendAddress(&addr, group, port);
+
+	return sendto(fd, message, length, 0, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+int MulticastSend(const char *group, int port, const char *message, int length)
+{
+	return MulticastSendSpaced(group, port, message, length, 0);
 }
 
 
@@ -0,0 +1,181 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the DiFX developers                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "difxmessage.h"
+
+const char program[] = "testdifxmessagesendrate";
+const char version[] = "1.0";
+const char verdate[] = "20261018";
+
+const char defaultGroup[] = "127.0.0.1";
+const int defaultPort = 50299;
+
+void usage(const char *pgm)
+{
+	fprintf(stderr, "\n%s ver. %s   %s\n\n", program, version, verdate);
+	fprintf(stderr, "A program that measures the rate at which messages can be sent\n\n");
+	fprintf(stderr, "Usage: %s [<nMessage> [<messageSize> [<queueDepth>]]]\n\n", pgm);
+	fprintf(stderr, "<nMessage> is the number of messages to send in each test [100000]\n\n");
+	fprintf(stderr, "<messageSize> is the size of each message in bytes [500]\n\n");
+	fprintf(stderr, "<queueDepth> is the length of the send queue [1024]\n\n");
+	fprintf(stderr, "Messages go to DIFX_MESSAGE_GROUP/DIFX_MESSAGE_PORT if set, otherwise\n");
+	fprintf(stderr, "to %s/%d so that nothing leaves this machine.\n\n", defaultGroup, defaultPort);
+}
+
+static double now()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+
+	return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+/* how MulticastSend() used to send: a new socket for every message */
+static int sendWithNewSocket(const char *group, int port, const char *message, int length)
+{
+	struct sockaddr_in addr;
+	int fd, l;
+	unsigned char ttl=3;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr(group);
+	addr.sin_port = htons(port);
+	l = sendto(fd, message, length, 0, (struct sockaddr *)&addr, sizeof(addr));
+
+	close(fd);
+
+	return l;
+}
+
+static void report(const char *name, int nMessage, int nFail, int size, double t)
+{
+	printf("%-28s %8d messages in %7.3f s : %9.0f messages/s %8.1f MB/s  %d failed\n", name, nMessage, t, nMessage/t, 1.0e-6*nMessage*size/t, nFail);
+}
+
+int main(int argc, char **argv)
+{
+	const char *group = defaultGroup;
+	int port = defaultPort;
+	int nMessage = 100000;
+	int size = 500;
+	int depth = 1024;
+	char *message;
+	long long nSent, nDropped, nBatch;
+	double t0, t1, t2;
+	int i, nFail;
+
+	if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+	{
+		usage(argv[0]);
+
+		return EXIT_SUCCESS;
+	}
+	if(argc > 1)
+	{
+		nMessage = atoi(argv[1]);
+	}
+	if(argc > 2)
+	{
+		size = atoi(argv[2]);
+	}
+	if(argc > 3)
+	{
+		depth = atoi(argv[3]);
+	}
+	if(nMessage <= 0 || size <= 0 || size > 65000 || depth <= 0)
+	{
+		usage(argv[0]);
+
+		return EXIT_FAILURE;
+	}
+	if(getenv("DIFX_MESSAGE_GROUP") && getenv("DIFX_MESSAGE_PORT"))
+	{
+		group = getenv("DIFX_MESSAGE_GROUP");
+		port = atoi(getenv("DIFX_MESSAGE_PORT"));
+	}
+
+	message = (char *)malloc(size);
+	memset(message, 'x', size);
+
+	printf("Sending %d messages of %d bytes to %s/%d\n\n", nMessage, size, group, port);
+
+	nFail = 0;
+	t0 = now();
+	for(i = 0; i < nMessage; ++i)
+	{
+		if(sendWithNewSocket(group, port, message, size) != size)
+		{
+			++nFail;
+		}
+	}
+	report("socket per message", nMessage, nFail, size, now() - t0);
+
+	nFail = 0;
+	t0 = now();
+	for(i = 0; i < nMessage; ++i)
+	{
+		if(MulticastSend(group, port, message, size) != size)
+		{
+			++nFail;
+		}
+	}
+	report("persistent socket", nMessage, nFail, size, now() - t0);
+
+	difxMessageSendQueueStart(depth);
+	nFail = 0;
+	t0 = now();
+	for(i = 0; i < nMessage; ++i)
+	{
+		if(MulticastSend(group, port, message, size) != size)
+		{
+			++nFail;
+		}
+	}
+	t1 = now();
+	difxMessageSendQueueFlush();
+	t2 = now();
+	difxMessageSendQueueStats(&nSent, &nDropped, &nBatch);
+	difxMessageSendQueueStop();
+	report("queue (time to enqueue)", nMessage, nFail, size, t1 - t0);
+	report("queue (time until sent)", (int)nSent, 0, size, t2 - t0);
+	printf("\nQueue of %d: %Ld sent in %Ld batches, %Ld dropped because the queue was full\n", depth, nSent, nBatch, nDropped);
+
+	free(message);
+
+	return EXIT_SUCCESS;
+}
@@ -31,16 +31,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <sys/time.h>
 #include "../mark5access/mark5_stream.h"
 #include "config.h"
 
 const char program[] = "m5test";
 const char author[]  = "Walter Brisken";
-const char version[] = "1.4";
-const char verdate[] = "20191114";
+const char version[] = "1.6";
+const char verdate[] = "20261018";
 
 const int ChunkSize = 10000;
 
+/* the Mark5 fill pattern, as in blanker_mark5.c */
+#ifdef WORDS_BIGENDIAN
+#define MARK5_FILL_WORD64 0x4433221144332211ULL
+#else
+#define MARK5_FILL_WORD64 0x1122334411223344ULL
+#endif
+
 volatile int die = 0;
 
 typedef void (*sighandler_t)(int);
@@ -62,7 +70,8 @@ int usage(const char *pgm)
 	printf("%s ver. %s   %s  %s\n\n", program, version, author, verdate);
 	printf("A Mark5 tester.  Can verify VLBA, Mark3/4, Mark5B, and single-thread\n");
 	printf("VDIF formats using the\nmark5access library.\n\n");
-	printf("Usage : %s <file> <dataformat> [<offset>] [<report>]\n\n", pgm);
+	printf("Usage : %s <file> <dataformat> [<offset>] [<report>]\n", pgm);
+	printf("   or : %s --bulk [<dataformat> ...]\n\n", pgm);
 	printf("  <file> is the name of the input file\n\n");
 	printf("  <dataformat> should be of the form: <FORMAT>-<Mbps>-<nchan>-<nbit>, e.g.:\n");
 	printf("    VLBA1_2-256-8-2\n");
@@ -75,6 +84,10 @@ int usage(const char *pgm)
 	printf("    This allows you to specify rates that are not an integer Mbps value, such as 32/27 CODIF oversampling\n\n");
 	printf("  <offset> is number of bytes into file to start decoding\n\n");
 	printf("  <report> use 0 to report all timestamps, 1 to report once a second\n\n");
+	printf("  --bulk checks that the SIMD bulk decoders, and the decoders to bytes, give\n");
+	printf("    exactly the results of the lookup table decoders, on synthetic VDIF and\n");
+	printf("    Mark5B frames with blanking, and tabulates the throughput of each; a set of\n");
+	printf("    common modes is used if no <dataformat> (VDIF or Mark5B only) is given\n\n");
 
 	return EXIT_SUCCESS;
 }
@@ -200,6 +213,305 @@ int verify(const char *filename, const char *formatname, long long offset, int r
 	return 0;
 }
 
+static double now()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+
+	return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+/* Makes nframe frames of random data with headers, with some frames invalid or
+ * partly filled so that the blanking is exercised, and a blank frame after them */
+static unsigned char *makeframes(const struct mark5_stream *ms, int nframe)
+{
+	unsigned char *frames;
+	unsigned int *w;
+	int f, i;
+
+	frames = (unsigned char *)calloc(nframe+1, ms->framebytes);
+	for(f = 0; f < nframe; ++f)
+	{
+		unsigned char *frame = frames + f*ms->framebytes;
+		unsigned char *payload = frame + ms->payloadoffset;
+
+		for(i = 0; i < ms->databytes; ++i)
+		{
+			payload[i] = rand() >> 7;
+		}
+		w = (unsigned int *)frame;
+		if(ms->format == MK5_FORMAT_VDIF)
+		{
+			w[0] = (f % 7 == 3) ? 0x80000000 : 0;	/* invalid bit */
+			w[1] = f;
+			w[2] = ms->framebytes/8;
+			for(i = 1; i < ms->nchan; i *= 2)
+			{
+				w[2] += 1 << 24;
+			}
+			w[3] = (ms->nbit-1) << 26;
+			if(f % 11 == 5)	/* fill at the start blanks the frame */
+			{
+				*((unsigned long long *)payload) = MARK5_FILL_WORD64;
+			}
+		}
+		else
+		{
+			w[0] = 0xABADDEED;
+			w[1] = f & 0x7FFF;
+			if(f % 7 == 3)
+			{
+				frame[5] |= 0x80;	/* invalid bit */
+			}
+			if(f % 11 == 5)	/* fill at the end of the frame */
+			{
+				for(i = 8*(ms->databytes/16); i + 8 <= ms->databytes; i += 8)
+				{
+					*((unsigned long long *)(payload + i)) = MARK5_FILL_WORD64;
+				}
+			}
+			if(f % 13 == 6)	/* and at the start */
+			{
+				for(i = 0; i < 8*(ms->databytes/24); i += 8)
+				{
+					*((unsigned long long *)(payload + i)) = MARK5_FILL_WORD64;
+				}
+			}
+		}
+	}
+
+	return frames;
+}
+
+/* Returns the number of chunks differing between the two decoders */
+static int bulkcompare(const char *formatname, int nsamp, double mintime)
+{
+	struct mark5_stream *ms[2];
+	unsigned char *frames;
+	float **data[2];
+	int8_t **bytes = 0;
+	float levels[16];
+	double rate[3] = {0.0, 0.0, 0.0};
+	int prev, enable, p, c, n, i, nframe, totalsamples, ndiff = 0;
+
+	mark5_library_getoption(M5A_OPT_BULKDECODE, &prev);
+	for(p = 0; p < 2; ++p)
+	{
+		enable = p;
+		mark5_library_setoption(M5A_OPT_BULKDECODE, &enable);
+		ms[p] = new_mark5_stream(new_mark5_stream_unpacker(0), new_mark5_format_generic_from_string(formatname));
+	}
+	mark5_library_setoption(M5A_OPT_BULKDECODE, &prev);
+	if(!ms[0] || !ms[1])
+	{
+		fprintf(stderr, "Cannot make an unpacker for %s\n", formatname);
+
+		return 1;
+	}
+	if(ms[0]->format != MK5_FORMAT_VDIF && ms[0]->format != MK5_FORMAT_MARK5B)
+	{
+		fprintf(stderr, "%s is not VDIF or Mark5B: skipping\n", formatname);
+		delete_mark5_stream(ms[0]);
+		delete_mark5_stream(ms[1]);
+
+		return 0;
+	}
+	for(p = 0; p < 2; ++p)
+	{
+		/* so the frame time is not validated against the stream */
+		ms[p]->mjd = 0;
+	}
+
+	nframe = 4*1048576/ms[0]->framebytes + 2;
+	frames = makeframes(ms[0], nframe);
+	totalsamples = (nframe-1)*ms[0]->framesamples - nsamp;
+	for(p = 0; p < 2; ++p)
+	{
+		data[p] = (float **)malloc(ms[p]->nchan*sizeof(float *));
+		for(c = 0; c < ms[p]->nchan; ++c)
+		{
+			data[p][c] = (float *)malloc((nsamp+64)*sizeof(float));
+		}
+	}
+	if(mark5_stream_get_int8_levels(ms[1], levels) == 0)
+	{
+		bytes = (int8_t **)malloc(ms[1]->nchan*sizeof(int8_t *));
+		for(c = 0; c < ms[1]->nchan; ++c)
+		{
+			bytes[c] = (int8_t *)malloc(nsamp+64);
+		}
+	}
+
+	/* exactness, from unaligned starting samples right across the frames */
+	for(n = 0; n < totalsamples; n += nsamp + 5)
+	{
+		int r[2];
+
+		for(p = 0; p < 2; ++p)
+		{
+			for(c = 0; c < ms[p]->nchan; ++c)
+			{
+				memset(data[p][c], 0xFF, (nsamp+64)*sizeof(float));
+			}
+			r[p] = mark5_unpack_with_offset(ms[p], frames, n, data[p], nsamp);
+		}
+		for(c = 0; c < ms[0]->nchan; ++c)
+		{
+			if(memcmp(data[0][c], data[1][c], (nsamp+64)*sizeof(float)) != 0)
+			{
+				break;
+			}
+		}
+		if(r[0] != r[1] || c < ms[0]->nchan || ms[0]->readposition != ms[1]->readposition)
+		{
+			if(ndiff == 0)
+			{
+				printf("%s: decoders differ at sample %d (returned %d and %d)\n", formatname, n, r[0], r[1]);
+			}
+			++ndiff;
+		}
+		if(bytes)
+		{
+			r[1] = mark5_unpack_int8_with_offset(ms[1], frames, n, bytes, nsamp);
+			for(c = 0; c < ms[0]->nchan; ++c)
+			{
+				for(i = 0; i < nsamp; ++i)
+				{
+					if(levels[bytes[c][i] & 15] != data[0][c][i])
+					{
+						break;
+					}
+				}
+				if(i < nsamp)
+				{
+					break;
+				}
+			}
+			if(r[0] != r[1] || c < ms[0]->nchan || ms[0]->readposition != ms[1]->readposition)
+			{
+				if(ndiff == 0)
+				{
+					printf("%s: int8 decoder differs at sample %d (returned %d and %d)\n", formatname, n, r[0], r[1]);
+				}
+				++ndiff;
+			}
+		}
+	}
+
+	/* throughput, a chunk at a time as Mk5Mode does it */
+	for(p = 0; p < 2; ++p)
+	{
+		double t0, t;
+		long long decoded = 0;
+
+		t0 = now();
+		do
+		{
+			for(n = 0; n < totalsamples; n += nsamp)
+			{
+				mark5_unpack_with_offset(ms[p], frames, n, data[p], nsamp);
+				decoded += nsamp;
+			}
+			t = now() - t0;
+		} while(t < mintime);
+		rate[p] = decoded*ms[p]->nchan/(1.0e6*t);
+	}
+	if(bytes)
+	{
+		double t0, t;
+		long long decoded = 0;
+
+		t0 = now();
+		do
+		{
+			for(n = 0; n < totalsamples; n += nsamp)
+			{
+				mark5_unpack_int8_with_offset(ms[1], frames, n, bytes, nsamp);
+				decoded += nsamp;
+			}
+			t = now() - t0;
+		} while(t < mintime);
+		rate[2] = decoded*ms[1]->nchan/(1.0e6*t);
+	}
+
+	printf("%-24s %-6s %10.1f %10.1f %7.2fx", formatname, ms[0]->decode == ms[1]->decode ? "table" : "bulk",
+		rate[0], rate[1], rate[1]/rate[0]);
+	if(bytes)
+	{
+		printf(" %10.1f %7.2fx", rate[2], rate[2]/rate[0]);
+	}
+	else
+	{
+		printf(" %10s %8s", "-", "-");
+	}
+	printf("  %s\n", ndiff ? "DIFFER" : "exact");
+
+	for(p = 0; p < 2; ++p)
+	{
+		for(c = 0; c < ms[p]->nchan; ++c)
+		{
+			free(data[p][c]);
+		}
+		free(data[p]);
+	}
+	if(bytes)
+	{
+		for(c = 0; c < ms[1]->nchan; ++c)
+		{
+			free(bytes[c]);
+		}
+		free(bytes);
+	}
+	for(p = 0; p < 2; ++p)
+	{
+		delete_mark5_stream(ms[p]);
+	}
+	free(frames);
+
+	return ndiff;
+}
+
+int bulktest(int nformat, char **formats)
+{
+	const char *defaults[] =
+	{
+		"VDIF_8000-64-1-2", "VDIF_8000-128-2-2", "VDIF_8000-256-4-2", "VDIF_8000-512-8-2",
+		"VDIF_8000-1024-16-2", "VDIF_8000-2048-32-2", "VDIF_8000-64-3-2",
+		"VDIF_8000-32-1-1", "VDIF_8000-256-8-1", "VDIF_8000-512-16-1",
+		"VDIF_8000-128-1-4", "VDIF_8000-512-4-4", "VDIF_8000-2048-16-4", "VDIF_8000-256-1-8",
+		"Mark5B-64-1-2", "Mark5B-256-4-2", "Mark5B-512-8-2", "Mark5B-1024-16-2",
+		"Mark5B-256-8-1", "Mark5B-1024-32-1",
+		0
+	};
+	const int nsamp = 4096;
+	int f, enabled, nbad = 0;
+
+	mark5_library_getoption(M5A_OPT_BULKDECODE, &enabled);
+	if(!enabled)
+	{
+		printf("Note: bulk decoding is disabled (MARK5ACCESS_BULKDECODE=0 or no SSSE3)\n");
+	}
+	printf("Unpacking %d samples at a time; rates in Msamples/s summed over channels\n\n", nsamp);
+	printf("%-24s %-6s %10s %10s %8s %10s %8s  %s\n", "format", "path", "table", "bulk", "speedup", "int8", "speedup", "check");
+	if(nformat > 0)
+	{
+		for(f = 0; f < nformat; ++f)
+		{
+			nbad += bulkcompare(formats[f], nsamp, 0.3) ? 1 : 0;
+		}
+	}
+	else
+	{
+		for(f = 0; defaults[f]; ++f)
+		{
+			nbad += bulkcompare(defaults[f], nsamp, 0.3) ? 1 : 0;
+		}
+	}
+
+	return nbad > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int main(int argc, char **argv)
 {
 	long long offset = 0;
@@ -212,6 +524,11 @@ int main(int argc, char **argv)
 		return usage(argv[0]);
 	}
 
+	if(argc > 1 && strcmp(argv[1], "--bulk") == 0)
+	{
+		return bulktest(argc-2, argv+2);
+	}
+
 	if(argc == 2)
 	{
 		struct mark5_format *mf;
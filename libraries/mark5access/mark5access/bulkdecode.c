@@ -0,0 +1,647 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the DiFX developers                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bulkdecode.h"
+
+/* The SIMD kernels need SSSE3 (pshufb), which is checked for at run time,
+ * so the library itself can still be built for any x86 */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BULK_SSSE3
+#include <tmmintrin.h>
+#define SSSE3 __attribute__((target("ssse3")))
+#endif
+
+/* bytes expanded at a time when the channels need de-interleaving */
+#define BULK_BLOCKBYTES 512
+
+static int bulkdecode = -1;	/* -1 until first needed */
+
+static int cpu_supports_bulk_decode(void)
+{
+#ifdef BULK_SSSE3
+	return __builtin_cpu_supports("ssse3") ? 1 : 0;
+#else
+	return 0;
+#endif
+}
+
+int mark5_bulk_decode_enabled(void)
+{
+	if(bulkdecode < 0)
+	{
+		const char *e;
+
+		e = getenv("MARK5ACCESS_BULKDECODE");
+		if(e && atoi(e) == 0)
+		{
+			bulkdecode = 0;
+		}
+		else
+		{
+			bulkdecode = cpu_supports_bulk_decode();
+		}
+	}
+
+	return bulkdecode;
+}
+
+int mark5_bulk_decode_set(int enable)
+{
+	int previous;
+
+	previous = mark5_bulk_decode_enabled();
+	bulkdecode = (enable && cpu_supports_bulk_decode()) ? 1 : 0;
+
+	return previous;
+}
+
+int mark5_bulk_decoder_init(struct mark5_bulk_decoder *bd, int nchan, int nbit, const float *levels)
+{
+	int bits, ncode, k, j, b, rank;
+
+	if(nbit != 1 && nbit != 2 && nbit != 4)
+	{
+		return -1;
+	}
+	/* the channels must be 1, 2 or a multiple of 4 for the de-interleaving, and a group no larger than 8 bytes */
+	bits = nchan*nbit;
+	if(nchan < 1 || (nchan > 2 && nchan % 4 != 0) || (nchan & (nchan-1)) != 0 || bits > 64)
+	{
+		return -1;
+	}
+
+	bd->nchan = nchan;
+	bd->nbit = nbit;
+	bd->ssse3 = cpu_supports_bulk_decode();
+	if(bits >= 8)
+	{
+		bd->groupbytes = bits/8;
+		bd->groupsamples = 1;
+	}
+	else
+	{
+		bd->groupbytes = 1;
+		bd->groupsamples = 8/bits;
+	}
+	ncode = 1 << nbit;
+	for(k = 0; k < 16; ++k)
+	{
+		uint32_t u;
+
+		bd->levels[k] = (k < ncode) ? levels[k] : 0.0;
+		memcpy(&u, &bd->levels[k], sizeof(u));
+		for(b = 0; b < 4; ++b)
+		{
+			bd->planes[b][k] = (u >> (8*b)) & 0xFF;
+		}
+		bd->int8codes[k] = 0;
+		bd->int8levels[k] = 0.0;
+	}
+	for(k = 0; k < ncode; ++k)
+	{
+		rank = 0;
+		for(j = 0; j < ncode; ++j)
+		{
+			if(levels[j] < levels[k])
+			{
+				++rank;
+			}
+		}
+		bd->int8codes[k] = (nbit == 4) ? rank - 8 : 2*rank - (ncode - 1);
+		bd->int8levels[bd->int8codes[k] & 15] = levels[k];
+	}
+	for(k = 0; k < 256; ++k)
+	{
+		for(j = 0; j < 8/nbit; ++j)
+		{
+			bd->int8bytes[k][j] = bd->int8codes[(k >> (j*nbit)) & (ncode - 1)];
+		}
+	}
+
+	return 0;
+}
+
+/* codes in order, LSB first, to floats */
+static void expand_generic(const struct mark5_bulk_decoder *bd, const unsigned char *src, int nbytes, float *dst)
+{
+	int mask, n, j;
+
+	mask = (1 << bd->nbit) - 1;
+	for(n = 0; n < nbytes; ++n)
+	{
+		for(j = 0; j < 8; j += bd->nbit)
+		{
+			*dst = bd->levels[(src[n] >> j) & mask];
+			++dst;
+		}
+	}
+}
+
+/* and to bytes, a whole byte of codes at a time */
+static void expand_int8_generic(const struct mark5_bulk_decoder *bd, const unsigned char *src, int nbytes, int8_t *dst)
+{
+	int n, m;
+
+	m = 8/bd->nbit;
+	for(n = 0; n < nbytes; ++n)
+	{
+		memcpy(dst, bd->int8bytes[src[n]], m);
+		dst += m;
+	}
+}
+
+#ifdef BULK_SSSE3
+/* splits 16 bytes into 8/nbit vectors of 16 codes, one per byte, in sample order */
+static inline SSSE3 int split16(int nbit, __m128i v, __m128i *codes)
+{
+	__m128i m, c0, c1, c2, c3, c4, c5, c6, c7, a0, a1, a2, a3, b0, b1;
+
+	switch(nbit)
+	{
+	case 1:
+		m = _mm_set1_epi8(0x01);
+		c0 = _mm_and_si128(v, m);
+		c1 = _mm_and_si128(_mm_srli_epi16(v, 1), m);
+		c2 = _mm_and_si128(_mm_srli_epi16(v, 2), m);
+		c3 = _mm_and_si128(_mm_srli_epi16(v, 3), m);
+		c4 = _mm_and_si128(_mm_srli_epi16(v, 4), m);
+		c5 = _mm_and_si128(_mm_srli_epi16(v, 5), m);
+		c6 = _mm_and_si128(_mm_srli_epi16(v, 6), m);
+		c7 = _mm_and_si128(_mm_srli_epi16(v, 7), m);
+
+		/* bytes 0 to 7 */
+		a0 = _mm_unpacklo_epi8(c0, c1);
+		a1 = _mm_unpacklo_epi8(c2, c3);
+		a2 = _mm_unpacklo_epi8(c4, c5);
+		a3 = _mm_unpacklo_epi8(c6, c7);
+		b0 = _mm_unpacklo_epi16(a0, a1);
+		b1 = _mm_unpacklo_epi16(a2, a3);
+		codes[0] = _mm_unpacklo_epi32(b0, b1);
+		codes[1] = _mm_unpackhi_epi32(b0, b1);
+		b0 = _mm_unpackhi_epi16(a0, a1);
+		b1 = _mm_unpackhi_epi16(a2, a3);
+		codes[2] = _mm_unpacklo_epi32(b0, b1);
+		codes[3] = _mm_unpackhi_epi32(b0, b1);
+
+		/* bytes 8 to 15 */
+		a0 = _mm_unpackhi_epi8(c0, c1);
+		a1 = _mm_unpackhi_epi8(c2, c3);
+		a2 = _mm_unpackhi_epi8(c4, c5);
+		a3 = _mm_unpackhi_epi8(c6, c7);
+		b0 = _mm_unpacklo_epi16(a0, a1);
+		b1 = _mm_unpacklo_epi16(a2, a3);
+		codes[4] = _mm_unpacklo_epi32(b0, b1);
+		codes[5] = _mm_unpackhi_epi32(b0, b1);
+		b0 = _mm_unpackhi_epi16(a0, a1);
+		b1 = _mm_unpackhi_epi16(a2, a3);
+		codes[6] = _mm_unpacklo_epi32(b0, b1);
+		codes[7] = _mm_unpackhi_epi32(b0, b1);
+
+		return 8;
+	case 2:
+		m = _mm_set1_epi8(0x03);
+		c0 = _mm_and_si128(v, m);
+		c1 = _mm_and_si128(_mm_srli_epi16(v, 2), m);
+		c2 = _mm_and_si128(_mm_srli_epi16(v, 4), m);
+		c3 = _mm_and_si128(_mm_srli_epi16(v, 6), m);
+
+		a0 = _mm_unpacklo_epi8(c0, c1);
+		a1 = _mm_unpacklo_epi8(c2, c3);
+		codes[0] = _mm_unpacklo_epi16(a0, a1);
+		codes[1] = _mm_unpackhi_epi16(a0, a1);
+		a0 = _mm_unpackhi_epi8(c0, c1);
+		a1 = _mm_unpackhi_epi8(c2, c3);
+		codes[2] = _mm_unpacklo_epi16(a0, a1);
+		codes[3] = _mm_unpackhi_epi16(a0, a1);
+
+		return 4;
+	default:
+		m = _mm_set1_epi8(0x0F);
+		c0 = _mm_and_si128(v, m);
+		c1 = _mm_and_si128(_mm_srli_epi16(v, 4), m);
+
+		codes[0] = _mm_unpacklo_epi8(c0, c1);
+		codes[1] = _mm_unpackhi_epi8(c0, c1);
+
+		return 2;
+	}
+}
+
+/* looks up 16 codes, one per byte, in the byte planes and reassembles the floats */
+static inline SSSE3 void store16(const __m128i *p, __m128i codes, float *dst)
+{
+	__m128i b0, b1, b2, b3, lo, hi;
+
+	b0 = _mm_shuffle_epi8(p[0], codes);
+	b1 = _mm_shuffle_epi8(p[1], codes);
+	b2 = _mm_shuffle_epi8(p[2], codes);
+	b3 = _mm_shuffle_epi8(p[3], codes);
+
+	lo = _mm_unpacklo_epi8(b0, b1);
+	hi = _mm_unpacklo_epi8(b2, b3);
+	_mm_storeu_si128((__m128i *)dst,      _mm_unpacklo_epi16(lo, hi));
+	_mm_storeu_si128((__m128i *)(dst+4),  _mm_unpackhi_epi16(lo, hi));
+	lo = _mm_unpackhi_epi8(b0, b1);
+	hi = _mm_unpackhi_epi8(b2, b3);
+	_mm_storeu_si128((__m128i *)(dst+8),  _mm_unpacklo_epi16(lo, hi));
+	_mm_storeu_si128((__m128i *)(dst+12), _mm_unpackhi_epi16(lo, hi));
+}
+
+static SSSE3 void expand_ssse3(const struct mark5_bulk_decoder *bd, const unsigned char *src, int nbytes, float *dst)
+{
+	__m128i p[4], codes[8];
+	int k, n;
+
+	for(k = 0; k < 4; ++k)
+	{
+		p[k] = _mm_loadu_si128((const __m128i *)bd->planes[k]);
+	}
+
+	for(; nbytes >= 16; nbytes -= 16, src += 16)
+	{
+		n = split16(bd->nbit, _mm_loadu_si128((const __m128i *)src), codes);
+		for(k = 0; k < n; ++k, dst += 16)
+		{
+			store16(p, codes[k], dst);
+		}
+	}
+
+	expand_generic(bd, src, nbytes, dst);
+}
+
+static SSSE3 void expand_int8_ssse3(const struct mark5_bulk_decoder *bd, const unsigned char *src, int nbytes, int8_t *dst)
+{
+	__m128i t, codes[8];
+	int k, n;
+
+	t = _mm_loadu_si128((const __m128i *)bd->int8codes);
+
+	for(; nbytes >= 16; nbytes -= 16, src += 16)
+	{
+		n = split16(bd->nbit, _mm_loadu_si128((const __m128i *)src), codes);
+		for(k = 0; k < n; ++k, dst += 16)
+		{
+			_mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(t, codes[k]));
+		}
+	}
+
+	expand_int8_generic(bd, src, nbytes, dst);
+}
+
+/* time-major floats (sample t of channel c at src[t*nchan+c]) into the channels */
+static SSSE3 void deinterleave_ssse3(const float *src, int nchan, int ntime, float **data, int o)
+{
+	__m128 r0, r1, r2, r3;
+	int t = 0, c, q;
+
+	if(nchan == 2)
+	{
+		for(; t+4 <= ntime; t += 4)
+		{
+			r0 = _mm_loadu_ps(src + 2*t);
+			r1 = _mm_loadu_ps(src + 2*t + 4);
+			_mm_storeu_ps(data[0] + o + t, _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(data[1] + o + t, _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+	}
+	else if(nchan % 4 == 0)
+	{
+		for(; t+4 <= ntime; t += 4)
+		{
+			for(q = 0; q < nchan; q += 4)
+			{
+				r0 = _mm_loadu_ps(src + t*nchan + q);
+				r1 = _mm_loadu_ps(src + (t+1)*nchan + q);
+				r2 = _mm_loadu_ps(src + (t+2)*nchan + q);
+				r3 = _mm_loadu_ps(src + (t+3)*nchan + q);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(data[q]   + o + t, r0);
+				_mm_storeu_ps(data[q+1] + o + t, r1);
+				_mm_storeu_ps(data[q+2] + o + t, r2);
+				_mm_storeu_ps(data[q+3] + o + t, r3);
+			}
+		}
+	}
+	for(; t < ntime; ++t)
+	{
+		for(c = 0; c < nchan; ++c)
+		{
+			data[c][o+t] = src[t*nchan + c];
+		}
+	}
+}
+
+/* the same for bytes: for two channels a shuffle separates eight samples of each; for four a shuffle
+ * gathers the samples of each channel from four times, and a transpose of four of those brings sixteen
+ * consecutive samples of each channel together.  More channels are first split, four at a time, into
+ * scratch as if they were floats, and then as four */
+static SSSE3 void deinterleave_int8_ssse3(const int8_t *src, int nchan, int ntime, int8_t **data, int o, int8_t *scratch)
+{
+	__m128i m, v;
+	__m128 r[4];
+	int8_t *quads[16];	/* at most 64 channels */
+	int t = 0, c, q, k;
+
+	if(nchan == 2)
+	{
+		m = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+		for(; t+8 <= ntime; t += 8)
+		{
+			v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 2*t)), m);
+			_mm_storel_epi64((__m128i *)(data[0] + o + t), v);
+			_mm_storel_epi64((__m128i *)(data[1] + o + t), _mm_srli_si128(v, 8));
+		}
+	}
+	else if(nchan == 4)
+	{
+		m = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+		for(; t+16 <= ntime; t += 16)
+		{
+			for(k = 0; k < 4; ++k)
+			{
+				v = _mm_loadu_si128((const __m128i *)(src + 4*t + 16*k));
+				r[k] = _mm_castsi128_ps(_mm_shuffle_epi8(v, m));
+			}
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			for(k = 0; k < 4; ++k)
+			{
+				_mm_storeu_si128((__m128i *)(data[k] + o + t), _mm_castps_si128(r[k]));
+			}
+		}
+	}
+	else
+	{
+		/* the shuffles and moves of deinterleave_ssse3 do not alter the bits */
+		for(q = 0; q < nchan/4; ++q)
+		{
+			quads[q] = scratch + 4*q*ntime;
+		}
+		deinterleave_ssse3((const float *)src, nchan/4, ntime, (float **)quads, 0);
+		for(q = 0; q < nchan/4; ++q)
+		{
+			deinterleave_int8_ssse3(quads[q], 4, ntime, data + 4*q, o, 0);
+		}
+
+		return;
+	}
+	for(; t < ntime; ++t)
+	{
+		for(c = 0; c < nchan; ++c)
+		{
+			data[c][o+t] = src[t*nchan + c];
+		}
+	}
+}
+#endif
+
+static void expand(const struct mark5_bulk_decoder *bd, const unsigned char *src, int nbytes, float *dst)
+{
+#ifdef BULK_SSSE3
+	if(bd->ssse3)
+	{
+		expand_ssse3(bd, src, nbytes, dst);
+
+		return;
+	}
+#endif
+	expand_generic(bd, src, nbytes, dst);
+}
+
+static void expand_int8(const struct mark5_bulk_decoder *bd, const unsigned char *src, int nbytes, int8_t *dst)
+{
+#ifdef BULK_SSSE3
+	if(bd->ssse3)
+	{
+		expand_int8_ssse3(bd, src, nbytes, dst);
+
+		return;
+	}
+#endif
+	expand_int8_generic(bd, src, nbytes, dst);
+}
+
+static void deinterleave(const struct mark5_bulk_decoder *bd, const float *src, int ntime, float **data, int o)
+{
+	int t, c;
+
+#ifdef BULK_SSSE3
+	if(bd->ssse3)
+	{
+		deinterleave_ssse3(src, bd->nchan, ntime, data, o);
+
+		return;
+	}
+#endif
+	for(t = 0; t < ntime; ++t)
+	{
+		for(c = 0; c < bd->nchan; ++c)
+		{
+			data[c][o+t] = src[t*bd->nchan + c];
+		}
+	}
+}
+
+static void deinterleave_int8(const struct mark5_bulk_decoder *bd, const int8_t *src, int ntime, int8_t **data, int o, int8_t *scratch)
+{
+	int t, c;
+
+#ifdef BULK_SSSE3
+	if(bd->ssse3)
+	{
+		deinterleave_int8_ssse3(src, bd->nchan, ntime, data, o, scratch);
+
+		return;
+	}
+#endif
+	for(t = 0; t < ntime; ++t)
+	{
+		for(c = 0; c < bd->nchan; ++c)
+		{
+			data[c][o+t] = src[t*bd->nchan + c];
+		}
+	}
+}
+
+static void decode_groups(const struct mark5_bulk_decoder *bd, const unsigned char *src, int ngroups, void **out, int o)
+{
+	float block[BULK_BLOCKBYTES*8] __attribute__((aligned(16)));
+	float **data = (float **)out;
+	int n, maxgroups;
+
+	if(bd->nchan == 1)
+	{
+		expand(bd, src, ngroups*bd->groupbytes, data[0] + o);
+
+		return;
+	}
+
+	maxgroups = BULK_BLOCKBYTES/bd->groupbytes;
+	while(ngroups > 0)
+	{
+		n = ngroups < maxgroups ? ngroups : maxgroups;
+		expand(bd, src, n*bd->groupbytes, block);
+		deinterleave(bd, block, n*bd->groupsamples, data, o);
+		src += n*bd->groupbytes;
+		o += n*bd->groupsamples;
+		ngroups -= n;
+	}
+}
+
+static void decode_groups_int8(const struct mark5_bulk_decoder *bd, const unsigned char *src, int ngroups, void **out, int o)
+{
+	int8_t block[BULK_BLOCKBYTES*8] __attribute__((aligned(16)));
+	int8_t scratch[BULK_BLOCKBYTES*8] __attribute__((aligned(16)));
+	int8_t **data = (int8_t **)out;
+	int n, maxgroups;
+
+	if(bd->nchan == 1)
+	{
+		expand_int8(bd, src, ngroups*bd->groupbytes, data[0] + o);
+
+		return;
+	}
+
+	maxgroups = BULK_BLOCKBYTES/bd->groupbytes;
+	while(ngroups > 0)
+	{
+		n = ngroups < maxgroups ? ngroups : maxgroups;
+		expand_int8(bd, src, n*bd->groupbytes, block);
+		deinterleave_int8(bd, block, n*bd->groupsamples, data, o, scratch);
+		src += n*bd->groupbytes;
+		o += n*bd->groupsamples;
+		ngroups -= n;
+	}
+}
+
+static void zero_groups(const struct mark5_bulk_decoder *bd, int ngroups, void **out, int o)
+{
+	float **data = (float **)out;
+	int c;
+
+	for(c = 0; c < bd->nchan; ++c)
+	{
+		memset(data[c] + o, 0, ngroups*bd->groupsamples*sizeof(float));
+	}
+}
+
+static void zero_groups_int8(const struct mark5_bulk_decoder *bd, int ngroups, void **out, int o)
+{
+	int8_t **data = (int8_t **)out;
+	int c;
+
+	for(c = 0; c < bd->nchan; ++c)
+	{
+		memset(data[c] + o, 0, ngroups*bd->groupsamples);
+	}
+}
+
+/* walks the frames, decoding the valid groups of each span and zeroing the rest */
+static int bulk_decode(struct mark5_stream *ms, const struct mark5_bulk_decoder *bd, int nsamp, void **data, int (*frameinvalid)(const struct mark5_stream *ms),
+	void (*decodefunc)(const struct mark5_bulk_decoder *, const unsigned char *, int, void **, int),
+	void (*zerofunc)(const struct mark5_bulk_decoder *, int, void **, int))
+{
+	int g, t, i, o, n, lo, hi, left;
+	int first, last;	/* the valid groups of the span are [first, last) */
+	int nblank = 0;
+
+	g = bd->groupbytes;
+	t = bd->groupsamples;
+	i = ms->readposition;
+	o = 0;
+
+	for(left = (nsamp + t - 1)/t; left > 0; left -= n)
+	{
+		/* the span runs to the end of this frame, or of the request */
+		n = (ms->databytes - i + g - 1)/g;
+		if(n > left)
+		{
+			n = left;
+		}
+
+		/* a group is valid if its first byte is, as in the lookup table decoders */
+		first = last = 0;
+		if(!frameinvalid || !frameinvalid(ms))
+		{
+			lo = ms->blankzonestartvalid[0];
+			hi = ms->blankzoneendvalid[0];
+			first = lo <= i ? 0 : (lo - i + g - 1)/g;
+			last = hi <= i ? 0 : (hi - i + g - 1)/g;
+			if(first > n)
+			{
+				first = n;
+			}
+			if(last > n)
+			{
+				last = n;
+			}
+			if(last < first)
+			{
+				last = first;
+			}
+		}
+
+		if(first > 0)
+		{
+			zerofunc(bd, first, data, o);
+		}
+		if(last > first)
+		{
+			decodefunc(bd, ms->payload + i + first*g, last - first, data, o + first*t);
+		}
+		if(n > last)
+		{
+			zerofunc(bd, n - last, data, o + last*t);
+		}
+		nblank += n - (last - first);
+
+		i += n*g;
+		o += n*t;
+		if(i >= ms->databytes)
+		{
+			if(mark5_stream_next_frame(ms) < 0)
+			{
+				return -1;
+			}
+			i = 0;
+		}
+	}
+
+	ms->readposition = i;
+
+	return nsamp - t*nblank;
+}
+
+int mark5_bulk_decode(struct mark5_stream *ms, const struct mark5_bulk_decoder *bd, int nsamp, float **data, int (*frameinvalid)(const struct mark5_stream *ms))
+{
+	return bulk_decode(ms, bd, nsamp, (void **)data, frameinvalid, decode_groups, zero_groups);
+}
+
+int mark5_bulk_decode_int8(struct mark5_stream *ms, const struct mark5_bulk_decoder *bd, int nsamp, int8_t **data, int (*frameinvalid)(const struct mark5_stream *ms))
+{
+	return bulk_decode(ms, bd, nsamp, (void **)data, frameinvalid, decode_groups_int8, zero_groups_int8);
+}
@@ -0,0 +1,74 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by the DiFX developers                             *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/* Bulk decoding of formats whose samples are packed LSB first, channel
+ * after channel, into whole bytes (VDIF and Mark5B with 1, 2 or 4 bits and
+ * a power of two number of channels).  A frame is decoded a span at a time:
+ * the valid part of the frame is expanded to float with SIMD shuffles and
+ * de-interleaved into the channels, and the blanked parts are zeroed, rather
+ * than testing the blanking and looking up every byte.  The results are
+ * identical to those of the lookup table decoders.
+ *
+ * The same modes can be decoded to one signed byte per sample instead of a
+ * float: code k becomes int8codes[k], a small integer with the sign and rank
+ * of its level (+-1 for 1 bit, +-1 and +-3 for 2 bits and -8 to 7 for
+ * 4 bits), and int8levels[v & 15] is the float the lookup tables give for
+ * byte v.  Blanked samples are 0.
+ *
+ * This is private to the library.
+ */
+
+#ifndef __BULKDECODE_H__
+#define __BULKDECODE_H__
+
+#include "mark5access/mark5_stream.h"
+
+struct mark5_bulk_decoder
+{
+	int nchan;
+	int nbit;
+	int groupbytes;		/* bytes holding groupsamples samples of every channel */
+	int groupsamples;
+	int ssse3;		/* the CPU can run the SIMD kernels */
+	float levels[16];	/* the value of each nbit code */
+	unsigned char planes[4][16];	/* byte i of the float of each code, for shuffling */
+	int8_t int8codes[16];	/* the byte each nbit code decodes to */
+	float int8levels[16];	/* the value of each byte v, at v & 15 */
+	int8_t int8bytes[256][8];	/* the bytes each packed byte decodes to, without SIMD */
+};
+
+/* returns 1 if the bulk decoders should be used, 0 if not */
+int mark5_bulk_decode_enabled(void);
+
+/* 1 (default where the CPU allows, unless MARK5ACCESS_BULKDECODE=0 is set) to select bulk decoders for streams made later, 0 for lookup tables */
+int mark5_bulk_decode_set(int enable);
+
+/* sets up bd for the mode; returns 0 if it can be bulk decoded, -1 if not.  The float decoders should
+ * only be installed if mark5_bulk_decode_enabled() too; the int8 decoders need no SIMD */
+int mark5_bulk_decoder_init(struct mark5_bulk_decoder *bd, int nchan, int nbit, const float *levels);
+
+/* decodes nsamp samples from ms as the lookup table decoders do, walking frames with mark5_stream_next_frame;
+ * bytes before blankzonestartvalid[0] or from blankzoneendvalid[0] are blank, as are frames for which
+ * frameinvalid (if not 0) returns true */
+int mark5_bulk_decode(struct mark5_stream *ms, const struct mark5_bulk_decoder *bd, int nsamp, float **data, int (*frameinvalid)(const struct mark5_stream *ms));
+
+/* as mark5_bulk_decode, but to bytes */
+int mark5_bulk_decode_int8(struct mark5_stream *ms, const struct mark5_bulk_decoder *bd, int nsamp, int8_t **data, int (*frameinvalid)(const struct mark5_stream *ms));
+
+#endif
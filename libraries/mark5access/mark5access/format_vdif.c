@@ -45,6 +45,7 @@
 static unsigned char VDIF_FILL_BYTES[4] = { 0x44, 0x33, 0x22, 0x11 };
 
 #include "mark5access/mark5_stream.h"
+#include "bulkdecode.h"
 
 static const float HiMag = OPTIMAL_2BIT_HIGH;
 static const float FourBit1sigma = 2.95;
@@ -70,6 +71,7 @@ struct mark5_format_vdif
 	int frameheadersize;		/* 16 (legacy) or 32 (normal) */
 	int leapsecs;			/* relative to reference epoch of VDIF data */
 	int completesamplesperword;	/* number of samples for each channel in one 32-bit word */
+	struct mark5_bulk_decoder bulk;	/* used by vdif_decode_bulk */
 };
 
 static void initluts()
@@ -228,6 +230,25 @@ static int mark5_stream_frame_time_vdif(const struct mark5_stream *ms, int *mjd,
 
 /************************* decode routines **************************/
 
+/* replaces the decimation1 decoders below where bulkdecode.c supports the mode */
+static int vdif_decode_bulk(struct mark5_stream *ms, int nsamp, float **data)
+{
+	const struct mark5_format_vdif *v;
+
+	v = (const struct mark5_format_vdif *)(ms->formatdata);
+
+	return mark5_bulk_decode(ms, &v->bulk, nsamp, data, 0);
+}
+
+static int vdif_decode_int8(struct mark5_stream *ms, int nsamp, int8_t **data)
+{
+	const struct mark5_format_vdif *v;
+
+	v = (const struct mark5_format_vdif *)(ms->formatdata);
+
+	return mark5_bulk_decode_int8(ms, &v->bulk, nsamp, data, 0);
+}
+
 static int vdif_decode_1channel_1bit_decimation1(struct mark5_stream *ms, int nsamp, float **data)
 {
 	const unsigned char *buf;
@@ -2393,7 +2414,7 @@ static int vdif_decode_16channel_4bit_decimation1(struct mark5_stream *ms, int n
 		{
 			fp0 = fp1 = fp2 = fp3 = fp4 = fp5 = fp6 = fp7 = zeros;
 			nblank++;
-			i += 4;
+			i += 8;
 		}
 		else
 		{
@@ -7989,6 +8010,27 @@ struct mark5_format_generic *new_mark5_format_generalized_vdif(int framesperperi
 		
 		return 0;
 	    }
+
+	    /* the levels of each code, as in the lookup tables */
+	    if(f->decode != 0 && nbit <= 4)
+	    {
+		float levels[16];
+		int k;
+
+		for(k = 0; k < (1 << nbit); k++)
+		{
+			levels[k] = (nbit == 1) ? lut1bit[k][0] : (nbit == 2) ? lut2bit[k][0] : lut4bit[k][0];
+		}
+		if(mark5_bulk_decoder_init(&v->bulk, nchan, nbit, levels) == 0)
+		{
+			if(mark5_bulk_decode_enabled())
+			{
+				f->decode = vdif_decode_bulk;
+			}
+			f->decode_int8 = vdif_decode_int8;
+			memcpy(f->int8levels, v->bulk.int8levels, sizeof(f->int8levels));
+		}
+	    }
 	}
 	else
 	{
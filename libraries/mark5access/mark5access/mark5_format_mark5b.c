@@ -37,6 +37,7 @@
 #include <string.h>
 #include <math.h>
 #include "mark5access/mark5_stream.h"
+#include "bulkdecode.h"
 
 #define MK5B_PAYLOADSIZE 10000
 
@@ -49,6 +50,7 @@ struct mark5_format_mark5b
 {
 	int nbitstream;
 	int kday;	/* kilo-mjd: ie 51000, 52000, ... */
+	struct mark5_bulk_decoder bulk;	/* used by mark5b_decode_bulk */
 };
 
 static float lut1bit[256][8];
@@ -236,6 +238,31 @@ static int mark5_format_mark5b_fixmjd(struct mark5_stream *ms, int refmjd)
 
 /************************* decode routines **************************/
 
+/* the frame invalid bit of the header */
+static int mark5b_frame_invalid(const struct mark5_stream *ms)
+{
+	return (ms->payload[-11] & 0x80) ? 1 : 0;
+}
+
+/* replaces the decimation1 decoders below where bulkdecode.c supports the mode */
+static int mark5b_decode_bulk(struct mark5_stream *ms, int nsamp, float **data)
+{
+	const struct mark5_format_mark5b *m;
+
+	m = (const struct mark5_format_mark5b *)(ms->formatdata);
+
+	return mark5_bulk_decode(ms, &m->bulk, nsamp, data, mark5b_frame_invalid);
+}
+
+static int mark5b_decode_int8(struct mark5_stream *ms, int nsamp, int8_t **data)
+{
+	const struct mark5_format_mark5b *m;
+
+	m = (const struct mark5_format_mark5b *)(ms->formatdata);
+
+	return mark5_bulk_decode_int8(ms, &m->bulk, nsamp, data, mark5b_frame_invalid);
+}
+
 static int mark5b_decode_1bitstream_1bit_decimation1(struct mark5_stream *ms, int nsamp, float **data)
 {
 	const unsigned char *buf;
@@ -3245,5 +3272,26 @@ struct mark5_format_generic *new_mark5_format_mark5b(int Mbps, int nchan, int nb
 		return 0;
 	}
 
+	/* the levels of each code, as in the lookup tables */
+	if(decimation == 1)
+	{
+		float levels[4];
+		int k;
+
+		for(k = 0; k < (1 << nbit); ++k)
+		{
+			levels[k] = (nbit == 1) ? lut1bit[k][0] : lut2bit[k][0];
+		}
+		if(mark5_bulk_decoder_init(&m->bulk, nchan, nbit, levels) == 0)
+		{
+			if(mark5_bulk_decode_enabled())
+			{
+				f->decode = mark5b_decode_bulk;
+			}
+			f->decode_int8 = mark5b_decode_int8;
+			memcpy(f->int8levels, m->bulk.int8levels, sizeof(f->int8levels));
+		}
+	}
+
 	return f;
 }
@@ -42,6 +42,7 @@
 #include "config.h"
 
 #include "mark5access/mark5_stream.h"
+#include "bulkdecode.h"
 
 FILE* m5stderr = (FILE*)NULL;
 FILE* m5stdout = (FILE*)NULL;
@@ -101,6 +102,9 @@ int mark5_library_getoption(const int mk5option, void *result)
 		case M5A_OPT_STDERRFD:
 			*((FILE**)result) = m5stderr;
 			return sizeof(FILE*);
+		case M5A_OPT_BULKDECODE:
+			*((int*)result) = mark5_bulk_decode_enabled();
+			return sizeof(int);
 		default:
 			break;
 	}
@@ -129,6 +133,10 @@ int mark5_library_setoption(const int mk5option, void *value)
 			m5stderr = (FILE*)value;
 			rc = sizeof(FILE*);
 			break;
+		case M5A_OPT_BULKDECODE:
+			mark5_bulk_decode_set(*((int*)value));
+			rc = sizeof(int);
+			break;
 		default:
 			rc = -1;
 			break;		
@@ -240,6 +248,8 @@ static int set_format(struct mark5_stream *ms, const struct mark5_format_generic
 		ms->genheaders = f->genheaders;
 		ms->gettime = f->gettime;
 		ms->fixmjd = f->fixmjd;
+		ms->decode_int8 = f->decode_int8;
+		memcpy(ms->int8levels, f->int8levels, sizeof(ms->int8levels));
 		if(f->formatdatasize > 0)
 		{
 			ms->formatdata = malloc(f->formatdatasize);
@@ -1654,6 +1664,34 @@ int mark5_stream_decode(struct mark5_stream *ms, int nsamp, float **data)
 	return ms->decode(ms, nsamp, data);
 }
 
+int mark5_stream_decode_int8(struct mark5_stream *ms, int nsamp, int8_t **data)
+{
+	if(!ms || !ms->decode_int8)
+	{
+		return -1;
+	}
+	if(ms->readposition < 0)
+	{
+		return -1;
+	}
+	if(nsamp % ms->samplegranularity != 0)
+	{
+		return -1;
+	}
+	return ms->decode_int8(ms, nsamp, data);
+}
+
+int mark5_stream_get_int8_levels(const struct mark5_stream *ms, float *levels)
+{
+	if(!ms || !ms->decode_int8)
+	{
+		return -1;
+	}
+	memcpy(levels, ms->int8levels, sizeof(ms->int8levels));
+
+	return 0;
+}
+
 int mark5_stream_decode_double(struct mark5_stream *ms, int nsamp, double **data)
 {
 	double *d;
@@ -154,6 +154,10 @@ struct mark5_stream
 	 * to satisfy the matching validate function
 	 */
 	void (*genheaders)(const struct mark5_stream *ms, int n, unsigned char *where);
+
+	/* decoding to one signed byte per sample; 0 if the mode has no such decoder */
+	int (*decode_int8)(struct mark5_stream *ms, int nsamp, int8_t **data);
+	float int8levels[16];	/* the value of byte v is int8levels[v & 15] */
 };
 
 struct mark5_stream_generic
@@ -169,6 +173,7 @@ struct mark5_stream_generic
 typedef	int (*decodeFunc)(struct mark5_stream*, int, float**); 
 typedef	int (*complex_decodeFunc)(struct mark5_stream*, int, mark5_float_complex**); 
 typedef int (*countFunc)(struct mark5_stream *, int, unsigned int *); 
+typedef	int (*decodeInt8Func)(struct mark5_stream*, int, int8_t**);
   
 struct mark5_format_generic
 {
@@ -196,6 +201,8 @@ struct mark5_format_generic
 	int nbit;
 	int decimation;					/* decimationling factor */
 	void (*genheaders)(const struct mark5_stream *ms, int n, unsigned char *where);
+	decodeInt8Func decode_int8;			/* optional */
+	float int8levels[16];
 };
 
 void delete_mark5_stream_generic(struct mark5_stream_generic *s);
@@ -238,6 +245,16 @@ int mark5_stream_decode_double_complex(struct mark5_stream *ms, int nsamp, mark5
 
 int mark5_stream_count_high_states(struct mark5_stream *ms, int nsamp, unsigned int *highstates);
 
+/* Decoding to bytes, a quarter of the size of floats, for the modes the SIMD bulk decoders handle
+ * (VDIF and Mark5B with 1, 2 or 4 bits and 1, 2 or a multiple of 4 channels).  Each sample is a
+ * small integer: +-1 for 1 bit, +-1 or +-3 for 2 bits, -8 to 7 for 4 bits, or 0 if blanked, and
+ * mark5_stream_get_int8_levels gives the float the other decoders would return for it.  Return
+ * values are as for mark5_stream_decode; -1 if the mode cannot be decoded to bytes. */
+int mark5_stream_decode_int8(struct mark5_stream *ms, int nsamp, int8_t **data);
+
+/* fills levels[16] such that byte v decodes to levels[v & 15]; returns -1 if there is no int8 decoder */
+int mark5_stream_get_int8_levels(const struct mark5_stream *ms, float *levels);
+
 /* SPECIFIC STREAM TYPES */
 
 /*   Memory based stream */
@@ -260,6 +277,10 @@ int mark5_unpack(struct mark5_stream *ms, const void *packed, float **unpacked,
 
 int mark5_unpack_with_offset(struct mark5_stream *ms, const void *packed, int offsetsamples, float **unpacked, int nsamp);
 
+int mark5_unpack_int8(struct mark5_stream *ms, const void *packed, int8_t **unpacked, int nsamp);
+
+int mark5_unpack_int8_with_offset(struct mark5_stream *ms, const void *packed, int offsetsamples, int8_t **unpacked, int nsamp);
+
 int mark5_unpack_complex(struct mark5_stream *ms, const void *packed, mark5_float_complex **unpacked, int nsamp);
 
 int mark5_unpack_complex_with_offset(struct mark5_stream *ms, const void *packed, int offsetsamples, mark5_float_complex **unpacked, int nsamp);
@@ -394,6 +415,7 @@ int mark5_library_setoption(const int mk5option, void* value);
 
 #define M5A_OPT_STDOUTFD 1
 #define M5A_OPT_STDERRFD 2
+#define M5A_OPT_BULKDECODE 3	/* int: 1 to use SIMD bulk decoders where the mode and CPU allow (default unless MARK5ACCESS_BULKDECODE=0), 0 for lookup tables; applies to formats made afterwards */
 extern FILE* m5stderr;
 extern FILE* m5stdout;
 
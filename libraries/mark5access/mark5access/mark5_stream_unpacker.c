@@ -149,6 +149,40 @@ int mark5_unpack_with_offset(struct mark5_stream *ms, const void *packed, int of
 
 
 
+int mark5_unpack_int8(struct mark5_stream *ms, const void *packed, int8_t **unpacked, int nsamp)
+{
+	if(!ms->decode_int8)
+	{
+		return -1;
+	}
+
+	return mark5_unpack_int8_with_offset(ms, packed, 0, unpacked, nsamp);
+}
+
+int mark5_unpack_int8_with_offset(struct mark5_stream *ms, const void *packed, int offsetsamples, int8_t **unpacked, int nsamp)
+{
+	if(!ms->decode_int8)
+	{
+		return -1;
+	}
+	if(ms->next == mark5_stream_unpacker_next_noheaders)
+	{
+		ms->payload = (const unsigned char *)packed;
+		ms->blanker(ms);
+	}
+	else
+	{
+		//go back to previous frame so we can make use of next() and its validation
+		ms->frame = (const unsigned char *)packed + (offsetsamples/ms->framesamples)*ms->framebytes - ms->framebytes;
+		mark5_stream_next_frame(ms); //this also sets ms->payload()
+	}
+
+	/* set readposition to first desired sample */
+	ms->readposition = (offsetsamples % ms->framesamples)*ms->nchan*ms->nbit*ms->decimation/8;
+
+	return ms->decode_int8(ms, nsamp, unpacked);
+}
+
 int mark5_unpack_complex(struct mark5_stream *ms, const void *packed, mark5_float_complex **unpacked, int nsamp)
 {
 	if(ms->next == mark5_stream_unpacker_next_noheaders)
@@ -93,6 +93,7 @@ int main(int argc, char** argv)
     int    fdin;
     FILE*  fdout;
     struct stat st;
+    m6sg_iostat_t iost;
     struct timeval tstart;
     struct timeval tstop;
     double dT;
@@ -232,6 +233,12 @@ fprintf(stderr, "nrd=%zd nwr=%zd\n", nrd, nwr);
     fprintf(stderr, "Elapsed time %.2f seconds (excluding file open time); rate %.0f MB/s; %ld bytes copied.\n",
            dT, ((double)ncopied)/(1024.0*1024.0*dT), ncopied
     );
+    if (mark6_sg_iostat(fdin, &iost) == 0)
+    {
+        fprintf(stderr, "Read rate %.0f MB/s; readahead from %d disks %.0f MB/s aggregate.\n",
+               iost.read_rate, iost.nfiles, iost.prefetch_rate
+        );
+    }
 
     fclose(fdout);
     mark6_sg_close(fdin);
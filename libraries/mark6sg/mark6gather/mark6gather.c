@@ -797,7 +797,7 @@ int addMark6GathererFiles(Mark6Gatherer *m6g, int nFile, char **fileList)
 			int s;
 			for(s = 0; s < MARK6_BUFFER_SLOTS; ++s)
 			{
-				Mark6FileReadBlock(m6g->mk6Files + i, s);
+				Mark6FileReadBlock(m6g->mk6Files + startFile + i, s);
 			}
 
 			// get VSN from metadata
@@ -828,6 +828,7 @@ int addMark6GathererFiles(Mark6Gatherer *m6g, int nFile, char **fileList)
 		}
 	}
 	m6g->packetSize = m6g->mk6Files[0].packetSize;
+	m6g->slotHeapValid = 0;
 
 	return nBad;
 }
@@ -887,6 +888,8 @@ int closeMark6Gatherer(Mark6Gatherer *m6g)
 
 	free(m6g->activeVSN);
 
+	free(m6g->slotHeap);
+
 	free(m6g);
 
 	return 0;
@@ -953,86 +956,210 @@ int seekMark6Gather(Mark6Gatherer *m6g, off_t position)
 	free(seekThread);
 	free(S);
 
+	m6g->slotHeapValid = 0;
+
 	return 0;
 }
 
-int mark6Gather(Mark6Gatherer *m6g, void *buf, size_t count)
+static inline uint64_t packetFrame(const Mark6File *m6f, char *data)
 {
-	size_t n = 0;
+	if(m6f->packetFormat == M6SG_PACKET_FORMAT_VDIF)
+	{
+		return vdifFrame((vdif_header *)data);
+	}
+	else
+	{
+		return mark5bFrame(data);
+	}
+}
+
+static inline uint64_t heapSlotFrame(const Mark6Gatherer *m6g, int h)
+{
+	return m6g->mk6Files[h / MARK6_BUFFER_SLOTS].slot[h % MARK6_BUFFER_SLOTS].frame;
+}
+
+/* Slots are taken in order of frame; ties go to the lowest file, then the lowest slot */
+static inline int heapSlotBefore(const Mark6Gatherer *m6g, int a, int b)
+{
+	uint64_t fa, fb;
+
+	fa = heapSlotFrame(m6g, a);
+	fb = heapSlotFrame(m6g, b);
+
+	return (fa < fb || (fa == fb && a < b));
+}
 
-	count -= (count % m6g->packetSize);
+static void siftSlotHeap(Mark6Gatherer *m6g, int i)
+{
+	int *heap = m6g->slotHeap;
+	int h = heap[i];
 
-	while(n < count)
+	for(;;)
 	{
-		int v;
-		int f, s, fileIndex, slotIndex;
-		uint64_t lowestFrame;
-		Mark6File *F;
-		Mark6BufferSlot *slot;
+		int c;
+
+		c = 2*i + 1;
+		if(c >= m6g->nSlotHeap)
+		{
+			break;
+		}
+		if(c + 1 < m6g->nSlotHeap && heapSlotBefore(m6g, heap[c+1], heap[c]))
+		{
+			++c;
+		}
+		if(!heapSlotBefore(m6g, heap[c], h))
+		{
+			break;
+		}
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = h;
+}
+
+/* (Re)builds the heap from the slots holding data; needed after the slots are loaded other than by mark6Gather() */
+static int buildSlotHeap(Mark6Gatherer *m6g)
+{
+	int f, s, i;
+
+	m6g->slotHeap = (int *)realloc(m6g->slotHeap, m6g->nFile*MARK6_BUFFER_SLOTS*sizeof(int));
+	if(!m6g->slotHeap && m6g->nFile > 0)
+	{
+		fprintf(stderr, "Error: cannot allocate %d bytes for the gather heap\n", (int)(m6g->nFile*MARK6_BUFFER_SLOTS*sizeof(int)));
+		m6g->nSlotHeap = 0;
 
-		lowestFrame = 0;
-		fileIndex = -1;
-		slotIndex = -1;
+		return -1;
+	}
 
-		for(f = 0; f < m6g->nFile; ++f)
+	m6g->nSlotHeap = 0;
+	for(f = 0; f < m6g->nFile; ++f)
+	{
+		for(s = 0; s < MARK6_BUFFER_SLOTS; ++s)
 		{
-			for(s = 0; s < MARK6_BUFFER_SLOTS; ++s)
+			if(m6g->mk6Files[f].slot[s].payloadBytes > 0)
 			{
-				if(m6g->mk6Files[f].slot[s].payloadBytes > 0 && (fileIndex < 0 || m6g->mk6Files[f].slot[s].frame < lowestFrame))
-				{
-					lowestFrame = m6g->mk6Files[f].slot[s].frame;
-					fileIndex = f;
-					slotIndex = s;
-				}
+				m6g->slotHeap[m6g->nSlotHeap] = f*MARK6_BUFFER_SLOTS + s;
+				++m6g->nSlotHeap;
 			}
 		}
+	}
+	for(i = m6g->nSlotHeap/2 - 1; i >= 0; --i)
+	{
+		siftSlotHeap(m6g, i);
+	}
+	m6g->slotHeapValid = 1;
 
-		if(fileIndex < 0)
+	return 0;
+}
+
+static void reportFillData(int v)
+{
+	static int count = 0;
+
+	if(count < 10)
+	{
+		printf("Fill data encountered: %d bytes\n", v);
+		if(count == 9)
 		{
-			return n;
+			printf("Further fill data notices will not be printed.\n");
 		}
+	}
+	++count;
+}
+
+/* Packets are gathered in order of frame number, as a merge of the buffered blocks of all files.  The slot
+ * holding the next packet is the top of a heap.  Its packets are copied, as one run, for as long as they
+ * still come before the packets of every other slot, so a block is typically copied with one memcpy.
+ * Fill packets are skipped. */
+int mark6Gather(Mark6Gatherer *m6g, void *buf, size_t count)
+{
+	char *out = (char *)buf;
+	size_t n = 0;
+	int packetSize = m6g->packetSize;
 
-		F = &m6g->mk6Files[fileIndex];
-		slot = F->slot + slotIndex;
-		// don't gather fill data
-		v = checkFillData(slot->data + slot->index);
-		if(v == 0)
+	count -= (count % packetSize);
+
+	if(!m6g->slotHeapValid)
+	{
+		if(buildSlotHeap(m6g) < 0)
 		{
-			memcpy(buf, slot->data + slot->index, m6g->packetSize);
-			buf += m6g->packetSize;
-			n += m6g->packetSize;
+			return -1;
 		}
-		else
-		{
-			static int count = 0;
+	}
+
+	while(n < count && m6g->nSlotHeap > 0)
+	{
+		int h, next;
+		int runStart;
+		Mark6File *F;
+		Mark6BufferSlot *slot;
 
-			if(count < 10)
+		h = m6g->slotHeap[0];
+		F = &m6g->mk6Files[h / MARK6_BUFFER_SLOTS];
+		slot = F->slot + (h % MARK6_BUFFER_SLOTS);
+
+		/* the slot that would be next, were it not for this one */
+		next = -1;
+		if(m6g->nSlotHeap > 1)
+		{
+			next = m6g->slotHeap[1];
+			if(m6g->nSlotHeap > 2 && heapSlotBefore(m6g, m6g->slotHeap[2], next))
 			{
-				printf("Fill data encountered: %d bytes\n", v);
-				if(count == 9)
-				{
-					printf("Further fill data notices will not be printed.\n");
-				}
+				next = m6g->slotHeap[2];
 			}
-			++count;
-		}
-		slot->index += m6g->packetSize;
-		if(slot->index >= slot->payloadBytes)
-		{
-			Mark6FileReadBlock(F, slotIndex);
 		}
-		else
+
+		runStart = slot->index;
+		for(;;)
 		{
-			if(F->packetFormat == M6SG_PACKET_FORMAT_VDIF)
+			int v;
+
+			// don't gather fill data
+			v = checkFillData(slot->data + slot->index);
+			if(v != 0)
 			{
-				vdif_header *vh = (vdif_header *)(slot->data + slot->index);
-				slot->frame = vdifFrame(vh);
+				memcpy(out, slot->data + runStart, slot->index - runStart);
+				out += slot->index - runStart;
+				n += slot->index - runStart;
+				reportFillData(v);
+				slot->index += packetSize;
+				runStart = slot->index;
 			}
 			else
 			{
-				slot->frame = mark5bFrame(slot->data + slot->index);
+				slot->index += packetSize;
+			}
+			if(slot->index >= slot->payloadBytes)
+			{
+				break;
+			}
+			slot->frame = packetFrame(F, slot->data + slot->index);
+			if(n + (slot->index - runStart) >= count)
+			{
+				break;
+			}
+			if(next >= 0 && !heapSlotBefore(m6g, h, next))
+			{
+				break;
+			}
+		}
+		memcpy(out, slot->data + runStart, slot->index - runStart);
+		out += slot->index - runStart;
+		n += slot->index - runStart;
+
+		if(slot->index >= slot->payloadBytes)
+		{
+			if(Mark6FileReadBlock(F, h % MARK6_BUFFER_SLOTS) <= 0)
+			{
+				/* this slot is done: replace it with the last one */
+				--m6g->nSlotHeap;
+				m6g->slotHeap[0] = m6g->slotHeap[m6g->nSlotHeap];
 			}
 		}
+		if(m6g->nSlotHeap > 0)
+		{
+			siftSlotHeap(m6g, 0);
+		}
 	}
 
 	return n;
@@ -122,6 +122,11 @@ typedef struct
 	Mark6File *mk6Files;
 	int packetSize;
 	char *activeVSN;
+
+	/* merge state of mark6Gather(): a heap of the slots holding data, each as fileIndex*MARK6_BUFFER_SLOTS + slotIndex, ordered by frame */
+	int *slotHeap;
+	int nSlotHeap;
+	int slotHeapValid;			/* 0 if slotHeap must be rebuilt from the slots before the next gather */
 } Mark6Gatherer;
 
 
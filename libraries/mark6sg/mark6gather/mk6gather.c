@@ -33,12 +33,13 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <errno.h>
 #include "mark6gather.h"
 
 const char program[] = "mk6gather";
-const char version[] = "1.6";
-const char verdate[] = "20230623";
+const char version[] = "1.7";
+const char verdate[] = "20261018";
 
 const char defaultOutfile[] = "gather.out";
 
@@ -80,6 +81,8 @@ int main(int argc, char **argv)
 	long long int skipBytes = 0;
 	long long int maxBytes = 0;
 	long long int bytesWritten = 0;
+	struct timeval tstart, tstop, t0, t1;
+	double dT, dTGather = 0.0;
 
 	if(argc < 2)
 	{
@@ -261,11 +264,15 @@ fprintf(stderr, "Truncating existing file from %Ld to %Ld bytes\n", (long long i
 	}
 
 	buf = (char *)malloc(GatherSize);
+	gettimeofday(&tstart, NULL);
 	for(i = 0;; ++i)
 	{
 		int n;
 
+		gettimeofday(&t0, NULL);
 		n = mark6Gather(G, buf, GatherSize);
+		gettimeofday(&t1, NULL);
+		dTGather += (t1.tv_sec - t0.tv_sec) + 1e-6*(t1.tv_usec - t0.tv_usec);
 		if(n <= 0)
 		{
 			if(n != 0)
@@ -299,6 +306,14 @@ fprintf(stderr, "Truncating existing file from %Ld to %Ld bytes\n", (long long i
 	{
 		fclose(out);
 	}
+	gettimeofday(&tstop, NULL);
+
+	dT = (tstop.tv_sec - tstart.tv_sec) + 1e-6*(tstop.tv_usec - tstart.tv_usec);
+	if(dT > 0.0 && dTGather > 0.0)
+	{
+		fprintf(stderr, "%Ld bytes gathered in %.2f seconds: rate %.0f MB/s; %.2f seconds within mark6Gather(): gather rate %.0f MB/s\n",
+			bytesWritten, dT, bytesWritten/(1024.0*1024.0*dT), dTGather, bytesWritten/(1024.0*1024.0*dTGather));
+	}
 
 	closeMark6Gatherer(G);
 
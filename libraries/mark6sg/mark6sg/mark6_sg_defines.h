@@ -27,7 +27,7 @@
 //
 //============================================================================
 #ifndef MARK6_SG_DEFINES__H
-#define MARK6_SG_DEFINEL__H
+#define MARK6_SG_DEFINES__H
 
 #define MARK6_SG_MAXFILES           32
 #define MARK6_SG_ROOT_PATTERN       "/mnt/disks/[1-4]/[0-7]/data/"
@@ -81,6 +81,9 @@ static int vdif_packetsize_hint = 10000 + 32;
 
 static void* touch_next_blocks_thread(void* p_ioctx);
 static void* writer_thread(void* p_ioctx);
+static void   build_block_index(m6sg_virt_filedescr_t* vfd);
+static size_t find_block(const m6sg_virt_filedescr_t* vfd, off_t offset, size_t hint);
+static size_t find_file_block(const m6sg_virt_filedescr_t* vfd, int fid, size_t blk);
 
 void ioerror_noop_handler(int sig)
 {
@@ -253,6 +256,9 @@ int mark6_sg_open(const char *scanname, int flags)
         vfd->len = vfd->blks[vfd->nblocks-1].virtual_offset + vfd->blks[vfd->nblocks-1].datalen;
     }
 
+    // Index of the blocks in each file, for the readahead threads
+    build_block_index(vfd);
+
     // Trigger a preload of future mmap()'ed data in the background
 #if (USE_MMAP_POPULATE_LIKE_PREFETCH != 0)
     vfd->touch_terminate = 0;
@@ -493,6 +499,10 @@ int mark6_sg_close(int fd)
         }
         close(vfd->fds[i]);
     }
+    for (i = 0; i < MARK6_SG_MAXFILES; i++)
+    {
+        free(vfd->fblks[i]);
+    }
     pthread_mutex_destroy(&vfd->lock);
     free(vfd->filepathlist);
     free(vfd->filenamelist);
@@ -551,6 +561,7 @@ ssize_t mark6_sg_pread(int fd, void* buf, size_t count, off_t rdoffset)
     size_t nread = 0;
     size_t nremain = count;
     size_t blk;
+    struct timeval t_start, t_stop;
 
     // Catch some error conditions
     if ((fd < 0) || (fd >= MARK6_SG_VFS_MAX_OPEN_FILES))
@@ -570,8 +581,10 @@ ssize_t mark6_sg_pread(int fd, void* buf, size_t count, off_t rdoffset)
         return 0;
     }
 
-    // Perform read
-    blk = vfd->rdblock;
+    gettimeofday(&t_start, NULL);
+
+    // Perform read, starting from the block holding the offset
+    blk = find_block(vfd, rdoffset, vfd->rdblock);
     while ((nremain > 0) && (rdoffset < vfd->len))
     {
         size_t navail, nskip, nwanted;
@@ -580,15 +593,10 @@ ssize_t mark6_sg_pread(int fd, void* buf, size_t count, off_t rdoffset)
         off_t  blkstart = vfd->blks[blk].virtual_offset;
         off_t  blkstop  = blkstart + vfd->blks[blk].datalen;
 
-        // If current block is wrong, try others until finding correct one
-        if (rdoffset < blkstart)
-        {
-            blk = (blk + (vfd->nblocks - 1)) % vfd->nblocks; // "blk--" with wrap
-            continue;
-        }
+        // Blocks are contiguous, so the read continues in the next one
         if (rdoffset >= blkstop)
         {
-            blk = (blk + 1) % vfd->nblocks;
+            blk++;
             continue;
         }
 
@@ -625,6 +633,18 @@ ssize_t mark6_sg_pread(int fd, void* buf, size_t count, off_t rdoffset)
     vfd->rdblock = blk;
     vfd->rdoffset = rdoffset;
 
+    // Keep statistics
+    gettimeofday(&t_stop, NULL);
+    pthread_mutex_lock(&vfd->lock);
+    if (vfd->nread_total == 0)
+    {
+        vfd->t_firstread = t_start;
+    }
+    vfd->t_lastread = t_stop;
+    vfd->nread_total += nread;
+    vfd->read_seconds += (t_stop.tv_sec - t_start.tv_sec) + 1e-6*(t_stop.tv_usec - t_start.tv_usec);
+    pthread_mutex_unlock(&vfd->lock);
+
     // Report the current read position via multicast
 #if HAVE_DIFXMESSAGE
     if (1) {
@@ -977,6 +997,61 @@ int mark6_sg_fstat(int fd, struct stat *buf)
 }
 
 
+/**
+ * Get I/O statistics of a scan opened for reading:
+ * the bytes read and the rate of mark6_sg_read()/mark6_sg_pread(),
+ * and the bytes fetched ahead from each file of the fileset
+ * together with their aggregate bandwidth.
+ *
+ * In the style of 'man 2 fstat'.
+ */
+int mark6_sg_iostat(int fd, m6sg_iostat_t *buf)
+{
+    m6sg_virt_filedescr_t* vfd;
+    off_t nprefetched = 0;
+    int i;
+
+    // Catch some error conditions
+    if ((fd < 0) || (fd >= MARK6_SG_VFS_MAX_OPEN_FILES) || (buf == NULL))
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    vfd = m6sg_open_files_list.fd_list[fd];
+    if (!vfd->valid || (vfd->mode != O_RDONLY))
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    memset(buf, 0, sizeof(m6sg_iostat_t));
+    pthread_mutex_lock(&vfd->lock);
+    buf->nfiles = vfd->nfiles;
+    buf->nread = vfd->nread_total;
+    buf->read_seconds = vfd->read_seconds;
+    buf->elapsed_seconds = (vfd->t_lastread.tv_sec - vfd->t_firstread.tv_sec) + 1e-6*(vfd->t_lastread.tv_usec - vfd->t_firstread.tv_usec);
+    pthread_mutex_unlock(&vfd->lock);
+    for (i = 0; i < vfd->nfiles; i++)
+    {
+        buf->nprefetched[i] = vfd->nprefetched[i];
+        buf->prefetch_seconds[i] = vfd->prefetch_seconds[i];
+        nprefetched += buf->nprefetched[i];
+    }
+
+    if (buf->read_seconds > 0)
+    {
+        buf->read_rate = 1e-6*buf->nread/buf->read_seconds;
+    }
+    if (buf->elapsed_seconds > 0)
+    {
+        buf->prefetch_rate = 1e-6*nprefetched/buf->elapsed_seconds;
+    }
+
+    return 0;
+}
+
+
 /**
  * Return the packet size.
  */
@@ -1083,43 +1158,140 @@ const char* mark6_sg_active_msn(int fd, const char* new_label)
 ////// Local Functions ///////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Build the per-file block index of an opened scan.
+ * Blocks are sorted by virtual offset (i.e. block number), so the
+ * blocks of each file are listed in the order they will be read.
+ */
+static void build_block_index(m6sg_virt_filedescr_t* vfd)
+{
+    size_t blk;
+    int    fid;
+
+    for (fid = 0; fid < vfd->nfiles; fid++)
+    {
+        vfd->nfblks[fid] = 0;
+    }
+    for (blk = 0; blk < vfd->nblocks; blk++)
+    {
+        vfd->nfblks[vfd->blks[blk].file_id]++;
+    }
+    for (fid = 0; fid < vfd->nfiles; fid++)
+    {
+        vfd->fblks[fid] = (size_t*) malloc((vfd->nfblks[fid] + 1)*sizeof(size_t));
+        vfd->nfblks[fid] = 0;
+    }
+    for (blk = 0; blk < vfd->nblocks; blk++)
+    {
+        fid = vfd->blks[blk].file_id;
+        vfd->fblks[fid][vfd->nfblks[fid]++] = blk;
+    }
+}
+
+/**
+ * Return the block holding the virtual offset. The block at 'hint'
+ * and the one after it are tried first, as reads are mostly sequential,
+ * otherwise the block list is bisected. Offset must be less than vfd->len.
+ */
+static size_t find_block(const m6sg_virt_filedescr_t* vfd, off_t offset, size_t hint)
+{
+    size_t lo, hi;
+
+    if (hint < vfd->nblocks && offset >= vfd->blks[hint].virtual_offset)
+    {
+        if (offset < vfd->blks[hint].virtual_offset + vfd->blks[hint].datalen)
+        {
+            return hint;
+        }
+        if ((hint + 1) < vfd->nblocks && offset < vfd->blks[hint+1].virtual_offset + vfd->blks[hint+1].datalen)
+        {
+            return hint + 1;
+        }
+    }
+
+    // Last block starting at or before the offset
+    lo = 0;
+    hi = vfd->nblocks;
+    while ((hi - lo) > 1)
+    {
+        size_t mid = lo + (hi - lo)/2;
+        if (vfd->blks[mid].virtual_offset <= offset)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * Return the position in the block index of file 'fid' of the first
+ * block of that file at or after block 'blk', or vfd->nfblks[fid] if none.
+ */
+static size_t find_file_block(const m6sg_virt_filedescr_t* vfd, int fid, size_t blk)
+{
+    size_t lo = 0, hi = vfd->nfblks[fid];
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo)/2;
+        if (vfd->fblks[fid][mid] < blk)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
 void* touch_next_blocks_thread(void* p_ioctx)
 {
-    size_t blk = 0, blk_prev = -1;
-    off_t  off, off_stop;
+    size_t i, blk, blk_prev = -1, last;
+    off_t  off, off_begin, off_stop;
+    off_t  ra_start = 0, ra_stop = 0; // range of the file already fetched
     int    pagesz = getpagesize();
 
     io_thread_ctx_t*       ctx = (io_thread_ctx_t*)p_ioctx;
     m6sg_virt_filedescr_t* vfd = (m6sg_virt_filedescr_t*)(ctx->vfd);
+    const int              fid = ctx->file_id;
 
 #if !AVOID_MMAP
-    char* fdata = (char*)(vfd->fmmap[ctx->file_id]);
+    char* fdata = (char*)(vfd->fmmap[fid]);
+#else
+    const size_t chunksz = 1024*1024;
+    char* chunk = (char*)malloc(chunksz);
 #endif
 
-    if (m_m6sg_dbglevel>2) { fprintf(stderr, "START thread for file %2d inc %d\n", ctx->file_id, pagesz); }
+    if (m_m6sg_dbglevel>2) { fprintf(stderr, "START thread for file %2d inc %d\n", fid, pagesz); }
 
     // Run until terminated
     while (!vfd->touch_terminate)
     {
+        struct timeval t_start, t_stop;
 
         // Thread is dedicated to one file of the scatter-gather fileset,
-        // and touches a certain number of blocks that follow the current
-        // read position (FUSE virtual -> file offset) in the file.
+        // i.e. to one disk, and streams the blocks of that file which
+        // follow the current read position (FUSE virtual -> file offset)
+        // into the page cache, so all disks are busy at the same time.
 
-        for (blk = vfd->rdblock; blk < vfd->nblocks; blk++)
-        {
-            if ((vfd->blks[blk].file_id == ctx->file_id)) { break; }
-        }
-        if (blk >= vfd->nblocks)
+        i = find_file_block(vfd, fid, vfd->rdblock);
+        if (i >= vfd->nfblks[fid])
         {
             usleep(1000);
             continue;
         }
-        assert(vfd->blks[blk].file_id == ctx->file_id);
+        blk = vfd->fblks[fid][i];
+        assert(vfd->blks[blk].file_id == fid);
 
-        // Check if current read position (block) has changed.
-        // Note: checking if blk falls inside already pre-fetched window is for
-        //       some reason slower than just re-reading almost all blocks
+        // Check if current read position (block) has changed
         if (blk == blk_prev)
         {
             usleep(10);
@@ -1127,33 +1299,63 @@ void* touch_next_blocks_thread(void* p_ioctx)
         }
         blk_prev = blk;
 
-        // Do not care about block numbers; just touch the next blocks in current file
+        // The next blocks in current file; skip what was fetched already, unless the reader seeked elsewhere
+        last     = i + PREFETCH_NUM_BLOCKS_PER_FILE - 1;
+        last     = (last >= vfd->nfblks[fid]) ? vfd->nfblks[fid] - 1 : last;
         off      = vfd->blks[blk].file_offset;
         off     &= ~((off64_t)(pagesz - 1));
-        off_stop = off + vfd->blks[blk].datalen * PREFETCH_NUM_BLOCKS_PER_FILE;
-        off_stop = (off_stop > vfd->fsize[ctx->file_id]) ? vfd->fsize[ctx->file_id] : off_stop;
+        off_stop = vfd->blks[vfd->fblks[fid][last]].file_offset + vfd->blks[vfd->fblks[fid][last]].datalen;
+        off_stop = (off_stop > vfd->fsize[fid]) ? vfd->fsize[fid] : off_stop;
+        if ((off >= ra_start) && (off <= ra_stop))
+        {
+            off = ra_stop;
+        }
+        else
+        {
+            ra_start = off;
+            ra_stop  = off;
+        }
+        off_begin = off;
+
+        gettimeofday(&t_start, NULL);
         while (off < off_stop)
         {
             // Reference the data to cause page fault and a kernel
             // fetch of missing page from underlying mmap()'ed file.
             // Data is not actually used here. The pages cached by
             // kernel will however be available in future read() calls.
-            char dummy;
 #if !AVOID_MMAP
+            char dummy;
             dummy = fdata[off];
-#else
-            (void)pread(vfd->fds[ctx->file_id], &dummy, 1, off);
-#endif
             off += pagesz;
             if (m_m6sg_dbglevel>99) { printf("(printf to prevent optimizing away 'dummy') %c", dummy); }
+#else
+            size_t nwanted = ((off_stop - off) < chunksz) ? (off_stop - off) : chunksz;
+            ssize_t nrd = pread(vfd->fds[fid], chunk, nwanted, off);
+            if (nrd <= 0)
+            {
+                break;
+            }
+            off += nrd;
+#endif
+            ra_stop = off;
 
             // Cancel if we're running late relative to user
-            if ((blk + PREFETCH_NUM_BLOCKS_PER_FILE) < vfd->rdblock) break;
+            if (vfd->fblks[fid][last] < vfd->rdblock) break;
         }
-
+        gettimeofday(&t_stop, NULL);
+        if (ra_stop > off_begin)
+        {
+            vfd->nprefetched[fid] += ra_stop - off_begin;
+        }
+        vfd->prefetch_seconds[fid] += (t_stop.tv_sec - t_start.tv_sec) + 1e-6*(t_stop.tv_usec - t_start.tv_usec);
     }
 
-    if (m_m6sg_dbglevel>2) { fprintf(stderr, "EXIT thread for file %2d\n", ctx->file_id); }
+#if AVOID_MMAP
+    free(chunk);
+#endif
+
+    if (m_m6sg_dbglevel>2) { fprintf(stderr, "EXIT thread for file %2d\n", fid); }
 
     return NULL;
 }
@@ -39,10 +39,24 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "mark6_sg_defines.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// I/O statistics of a fileset opened for reading, see mark6_sg_iostat()
+typedef struct m6sg_iostat_tt {
+    int     nfiles;
+    off_t   nread;                             // bytes returned by mark6_sg_read() and mark6_sg_pread()
+    double  read_seconds;                      // time spent in those calls
+    double  read_rate;                         // nread/read_seconds in MB/s
+    double  elapsed_seconds;                   // time from the first to the latest read
+    off_t   nprefetched[MARK6_SG_MAXFILES];    // bytes fetched ahead of the reader from each file
+    double  prefetch_seconds[MARK6_SG_MAXFILES];
+    double  prefetch_rate;                     // aggregate readahead bandwidth of all files in MB/s, over elapsed_seconds
+} m6sg_iostat_t;
+
 // Library functions
 extern int     mark6_sg_open (const char *scanname, int flags);
 extern int     mark6_sg_creat(const char *scanname, mode_t ignored);
@@ -52,6 +66,7 @@ extern ssize_t mark6_sg_read (int fd, void* buf, size_t count);
 extern ssize_t mark6_sg_pread(int fd, void* buf, size_t count, off_t offset);
 extern off_t   mark6_sg_lseek(int fd, off_t offset, int whence);
 extern int     mark6_sg_fstat(int fd, struct stat *buf);
+extern int     mark6_sg_iostat(int fd, m6sg_iostat_t *buf);
 extern ssize_t mark6_sg_recvfile(int fd, int sd, size_t nitems, size_t itemlen);
 
 extern int     mark6_sg_packetsize(int fd);
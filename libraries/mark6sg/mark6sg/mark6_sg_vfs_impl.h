@@ -33,6 +33,7 @@
 #include "mark6_sg_utils.h"
 
 #include <pthread.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
 
@@ -76,11 +77,19 @@ typedef struct m6sg_virt_filedescr {
     size_t    framesize;
     pthread_mutex_t    lock;
     m6sg_blockmeta_t*  blks;
+    size_t*            fblks[MARK6_SG_MAXFILES];  // per-file block index: the indices into blks[] of the blocks in each file, ascending
+    size_t             nfblks[MARK6_SG_MAXFILES];
     io_thread_ctx_t    touch_ctxs[MARK6_SG_MAXFILES];
     volatile int       touch_terminate;
     io_thread_ctx_t    writer_ctxs[MARK6_SG_MAXFILES];
     writer_pool_t      writer_pool;
     volatile int       writers_terminate;
+    off_t              nread_total;        // I/O statistics, see mark6_sg_iostat()
+    double             read_seconds;
+    struct timeval     t_firstread;
+    struct timeval     t_lastread;
+    volatile off_t     nprefetched[MARK6_SG_MAXFILES];
+    volatile double    prefetch_seconds[MARK6_SG_MAXFILES];
 } m6sg_virt_filedescr_t;
 
 typedef struct m6sg_virt_open_files {
@@ -0,0 +1,367 @@
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+#include "asyncread.h"
+#include "alert.h"
+
+const size_t AsyncFileReader::DIRECT_ALIGNMENT;
+
+AsyncFileReader::AsyncFileReader(int queuedepth)
+  : queuedepth(queuedepth < 1 ? 1 : queuedepth), fd(-1), numpending(0), oldest(0), nextdispatch(0), numundispatched(0),
+    direct(false), stopping(false), nextoffset(0), startskip(0), ringfd(-1), sqring(0), cqring(0), sqes(0)
+{
+  requests.resize(this->queuedepth);
+  iovecs.resize(this->queuedepth);
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&workready, 0);
+  pthread_cond_init(&workdone, 0);
+
+  if(setupRing())
+    return;
+
+  //no io_uring: one thread per outstanding read
+  workers.resize(this->queuedepth);
+  for(int i=0;i<this->queuedepth;i++)
+  {
+    if(pthread_create(&workers[i], 0, AsyncFileReader::launchWorker, this) != 0)
+    {
+      cfatal << startl << "Cannot create the asynchronous read threads!" << endl;
+      workers.resize(i);
+      break;
+    }
+  }
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+  close();
+
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_broadcast(&workready);
+  pthread_mutex_unlock(&lock);
+  for(size_t i=0;i<workers.size();i++)
+    pthread_join(workers[i], 0);
+
+#ifdef HAVE_LINUX_IO_URING_H
+  if(ringfd >= 0)
+  {
+    munmap(sqes, sqesbytes);
+    if(cqring != sqring)
+      munmap(cqring, cqringbytes);
+    munmap(sqring, sqringbytes);
+    ::close(ringfd);
+  }
+#endif
+
+  pthread_cond_destroy(&workdone);
+  pthread_cond_destroy(&workready);
+  pthread_mutex_destroy(&lock);
+}
+
+bool AsyncFileReader::open(const char * filename, long long offset, bool direct)
+{
+  close();
+
+  this->direct = false;
+  if(direct)
+  {
+    fd = ::open(filename, O_RDONLY | O_DIRECT);
+    if(fd >= 0)
+      this->direct = true;
+    else
+      cwarn << startl << "Cannot open " << filename << " for direct reading (" << strerror(errno) << "); reading through the page cache instead" << endl;
+  }
+  if(fd < 0)
+  {
+    fd = ::open(filename, O_RDONLY);
+    if(fd < 0)
+    {
+      cerror << startl << "Cannot open " << filename << " for reading: " << strerror(errno) << endl;
+      return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+
+  startskip = offset % getAlignment();
+  nextoffset = offset - startskip;
+
+  return true;
+}
+
+void AsyncFileReader::close()
+{
+  while(numpending > 0)
+    waitOldest();
+  if(fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+void AsyncFileReader::submit(char * destination, size_t bytes)
+{
+  int index = (oldest + numpending) % queuedepth;
+  Request & r = requests[index];
+
+  if(numpending >= queuedepth)
+  {
+    csevere << startl << "AsyncFileReader::submit called with " << numpending << " reads already pending" << endl;
+    return;
+  }
+
+  r.destination = destination;
+  r.bytes = bytes;
+  r.offset = nextoffset;
+  r.result = 0;
+  r.done = false;
+  nextoffset += bytes;
+  numpending++;
+
+  if(ringfd >= 0)
+  {
+    submitToRing(index);
+  }
+  else
+  {
+    pthread_mutex_lock(&lock);
+    numundispatched++;
+    pthread_cond_signal(&workready);
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+long long AsyncFileReader::waitOldest()
+{
+  Request & r = requests[oldest];
+  long long result;
+
+  if(numpending == 0)
+    return -1;
+
+  if(ringfd >= 0)
+  {
+    while(!r.done)
+      reapRing(true);
+  }
+  else
+  {
+    pthread_mutex_lock(&lock);
+    while(!r.done)
+      pthread_cond_wait(&workdone, &lock);
+    pthread_mutex_unlock(&lock);
+  }
+
+  result = r.result;
+  oldest = (oldest + 1) % queuedepth;
+  numpending--;
+
+  return result;
+}
+
+void * AsyncFileReader::launchWorker(void * reader)
+{
+  ((AsyncFileReader *)reader)->worker();
+
+  return 0;
+}
+
+void AsyncFileReader::worker()
+{
+  int index;
+  long long got, n;
+
+  pthread_mutex_lock(&lock);
+  while(true)
+  {
+    while(!stopping && numundispatched == 0)
+      pthread_cond_wait(&workready, &lock);
+    if(stopping)
+      break;
+    index = nextdispatch;
+    nextdispatch = (nextdispatch + 1) % queuedepth;
+    numundispatched--;
+    Request & r = requests[index];
+    pthread_mutex_unlock(&lock);
+
+    got = 0;
+    while(got < (long long)r.bytes)
+    {
+      n = pread(fd, r.destination + got, r.bytes - got, r.offset + got);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n < 0)
+      {
+        cerror << startl << "Error reading " << r.bytes << " bytes at offset " << r.offset << ": " << strerror(errno) << endl;
+        got = -1;
+        break;
+      }
+      if(n == 0)
+        break;
+      got += n;
+    }
+
+    pthread_mutex_lock(&lock);
+    r.result = got;
+    r.done = true;
+    pthread_cond_broadcast(&workdone);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+//the ring is driven with the raw system calls so that liburing is not needed
+bool AsyncFileReader::setupRing()
+{
+  struct io_uring_params p;
+  int entries = 1;
+  char * sq, * cq;
+
+  while(entries < queuedepth)
+    entries *= 2;
+  memset(&p, 0, sizeof(p));
+  ringfd = syscall(__NR_io_uring_setup, entries, &p);
+  if(ringfd < 0)
+  {
+    cinfo << startl << "io_uring is not available (" << strerror(errno) << "); asynchronous reads will use a thread pool" << endl;
+    ringfd = -1;
+    return false;
+  }
+
+  sqringbytes = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  cqringbytes = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if(cqringbytes > sqringbytes)
+      sqringbytes = cqringbytes;
+    cqringbytes = sqringbytes;
+  }
+  sqesbytes = p.sq_entries*sizeof(struct io_uring_sqe);
+
+  sqring = mmap(0, sqringbytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+  if(sqring == MAP_FAILED)
+  {
+    ::close(ringfd);
+    ringfd = -1;
+    return false;
+  }
+  if(p.features & IORING_FEAT_SINGLE_MMAP)
+    cqring = sqring;
+  else
+    cqring = mmap(0, cqringbytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_CQ_RING);
+  sqes = (cqring == MAP_FAILED) ? MAP_FAILED : mmap(0, sqesbytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+  if(cqring == MAP_FAILED || sqes == MAP_FAILED)
+  {
+    if(cqring != MAP_FAILED && cqring != sqring)
+      munmap(cqring, cqringbytes);
+    munmap(sqring, sqringbytes);
+    ::close(ringfd);
+    ringfd = -1;
+    return false;
+  }
+
+  sq = (char *)sqring;
+  cq = (char *)cqring;
+  sqhead = (unsigned *)(sq + p.sq_off.head);
+  sqtail = (unsigned *)(sq + p.sq_off.tail);
+  sqmask = (unsigned *)(sq + p.sq_off.ring_mask);
+  sqarray = (unsigned *)(sq + p.sq_off.array);
+  cqhead = (unsigned *)(cq + p.cq_off.head);
+  cqtail = (unsigned *)(cq + p.cq_off.tail);
+  cqmask = (unsigned *)(cq + p.cq_off.ring_mask);
+  cqes = cq + p.cq_off.cqes;
+
+  return true;
+}
+
+void AsyncFileReader::submitToRing(int index)
+{
+  Request & r = requests[index];
+  unsigned tail = *sqtail;
+  unsigned slot = tail & *sqmask;
+  struct io_uring_sqe * sqe = (struct io_uring_sqe *)sqes + slot;
+
+  //READV rather than READ so that kernels from 5.1 on can be used
+  iovecs[index].iov_base = r.destination;
+  iovecs[index].iov_len = r.bytes;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = fd;
+  sqe->off = r.offset;
+  sqe->addr = (unsigned long)&iovecs[index];
+  sqe->len = 1;
+  sqe->user_data = index;
+  sqarray[slot] = slot;
+  __atomic_store_n(sqtail, tail + 1, __ATOMIC_RELEASE);
+
+  while(syscall(__NR_io_uring_enter, ringfd, 1, 0, 0, NULL, 0) < 0)
+  {
+    if(errno == EINTR)
+      continue;
+    if(errno == EAGAIN || errno == EBUSY)
+    {
+      //completion queue full: make room and try again
+      reapRing(false);
+      continue;
+    }
+    cerror << startl << "io_uring submission failed: " << strerror(errno) << endl;
+    r.result = -1;
+    r.done = true;
+    break;
+  }
+}
+
+void AsyncFileReader::reapRing(bool wait)
+{
+  unsigned head = *cqhead;
+  unsigned tail = __atomic_load_n(cqtail, __ATOMIC_ACQUIRE);
+  struct io_uring_cqe * cqe;
+
+  if(head == tail && wait)
+  {
+    if(syscall(__NR_io_uring_enter, ringfd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+      cerror << startl << "Waiting for io_uring completions failed: " << strerror(errno) << endl;
+    tail = __atomic_load_n(cqtail, __ATOMIC_ACQUIRE);
+  }
+
+  while(head != tail)
+  {
+    cqe = (struct io_uring_cqe *)cqes + (head & *cqmask);
+    Request & r = requests[cqe->user_data];
+    if(cqe->res < 0)
+    {
+      cerror << startl << "Error reading " << r.bytes << " bytes at offset " << r.offset << ": " << strerror(-cqe->res) << endl;
+      r.result = -1;
+    }
+    else
+    {
+      r.result = cqe->res;
+    }
+    r.done = true;
+    head++;
+  }
+  __atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+}
+#else
+bool AsyncFileReader::setupRing()
+{
+  return false;
+}
+
+void AsyncFileReader::submitToRing(int index)
+{
+}
+
+void AsyncFileReader::reapRing(bool wait)
+{
+}
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
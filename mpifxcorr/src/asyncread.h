@@ -0,0 +1,115 @@
+/** \file asyncread.h
+ *  \brief Sequential file reading with several reads in flight, optionally bypassing the page cache
+ *
+ * An AsyncFileReader reads a file from a given offset onwards in caller-sized pieces, keeping up to
+ * a fixed number of reads outstanding so that RAID sets and NVMe devices see a queue of requests
+ * rather than one at a time.  Reads are issued through io_uring where the kernel supports it and
+ * otherwise by a pool of threads calling pread().  The file is opened with O_DIRECT where the
+ * filesystem allows, in which case destinations, lengths and the starting offset must respect
+ * getAlignment(); the start is rounded down to satisfy this and getStartSkip() says by how much.
+ */
+
+#ifndef ASYNCREAD_H
+#define ASYNCREAD_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <vector>
+
+/**
+@class AsyncFileReader
+@brief Keeps a queue of sequential reads outstanding on one file at a time
+*/
+class AsyncFileReader{
+public:
+ /**
+  * Sets up the reader; no file is open yet
+  * @param queuedepth The largest number of reads to have outstanding at once
+  */
+  AsyncFileReader(int queuedepth);
+  ~AsyncFileReader();
+
+ /**
+  * Opens a file for reading from (approximately) the given offset
+  * @param filename The file to read
+  * @param offset The byte offset of the first wanted byte
+  * @param direct Try to bypass the page cache with O_DIRECT
+  * @return False if the file could not be opened
+  */
+  bool open(const char * filename, long long offset, bool direct);
+
+  ///Waits for any outstanding reads and closes the file
+  void close();
+
+  ///@return The alignment required of destinations and lengths (1 unless the file was opened with O_DIRECT)
+  inline size_t getAlignment() const { return direct ? DIRECT_ALIGNMENT : 1; }
+
+  ///@return The number of bytes before the wanted offset that the reads start at
+  inline long long getStartSkip() const { return startskip; }
+
+  ///@return True if reads go to the device directly rather than through the page cache
+  inline bool isDirect() const { return direct; }
+
+  ///@return True if io_uring is used, false if the thread pool is
+  inline bool usesIOUring() const { return ringfd >= 0; }
+
+  ///@return The number of reads submitted but not yet collected with waitOldest()
+  inline int pending() const { return numpending; }
+
+  ///@return The largest number of reads that may be pending
+  inline int getQueueDepth() const { return queuedepth; }
+
+ /**
+  * Queues a read of the next bytes of the file; there must be fewer than getQueueDepth() reads pending
+  * @param destination Where the data should go
+  * @param bytes The number of bytes to read
+  */
+  void submit(char * destination, size_t bytes);
+
+ /**
+  * Waits for the oldest pending read to finish; reads always complete in the order they were submitted
+  * @return The number of bytes read (less than requested at the end of the file) or -1 on error
+  */
+  long long waitOldest();
+
+  ///Alignment used for direct reads, enough for any current device's logical block size
+  static const size_t DIRECT_ALIGNMENT = 4096;
+
+private:
+  struct Request
+  {
+    char * destination;
+    size_t bytes;
+    long long offset;
+    long long result;
+    bool done;
+  };
+
+  bool setupRing();
+  void submitToRing(int index);
+  void reapRing(bool wait);
+  static void * launchWorker(void * reader);
+  void worker();
+
+  int queuedepth, fd, numpending, oldest, nextdispatch, numundispatched;
+  bool direct, stopping;
+  long long nextoffset, startskip;
+  std::vector<Request> requests;
+
+  //io_uring state (ringfd < 0 if not in use)
+  int ringfd;
+  void * sqring, * cqring, * sqes;
+  size_t sqringbytes, cqringbytes, sqesbytes;
+  unsigned * sqhead, * sqtail, * sqmask, * sqarray, * cqhead, * cqtail, * cqmask;
+  void * cqes;
+  std::vector<struct iovec> iovecs;
+
+  //thread pool state
+  std::vector<pthread_t> workers;
+  pthread_mutex_t lock;
+  pthread_cond_t workready, workdone;
+};
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
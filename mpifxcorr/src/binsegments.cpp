@@ -0,0 +1,30 @@
+#include "binsegments.h"
+
+int findBinSegments(const s32 * bins, int numchannels, int stridelength, BinSegment * segments, int * firstsegment)
+{
+  int numsegments = 0, stride = 0, strideend;
+
+  for(int xmacstart=0;xmacstart<numchannels;xmacstart+=stridelength)
+  {
+    firstsegment[stride++] = numsegments;
+    segments[numsegments].start = xmacstart;
+    segments[numsegments].bin = bins[xmacstart];
+    numsegments++;
+    strideend = (xmacstart + stridelength < numchannels) ? xmacstart + stridelength : numchannels;
+    for(int c=xmacstart+1;c<strideend;c++)
+    {
+      if(bins[c] != bins[c-1])
+      {
+        segments[numsegments].start = c;
+        segments[numsegments].bin = bins[c];
+        numsegments++;
+      }
+    }
+  }
+  firstsegment[stride] = numsegments;
+  segments[numsegments].start = numchannels;
+  segments[numsegments].bin = -1;
+
+  return numsegments;
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -0,0 +1,58 @@
+/** \file binsegments.h
+ *  \brief Runs of adjacent channels that fall in the same pulsar bin
+ */
+
+#ifndef BINSEGMENTS_H
+#define BINSEGMENTS_H
+
+#include "architecture.h"
+
+/**
+@struct BinSegment
+@brief A run of adjacent channels that Polyco::getBins put in the same pulsar bin
+
+Within one FFT the pulse phase varies smoothly across a band (it is set by the dispersion delay), so
+getBins assigns long runs of adjacent channels to the same bin.  Core finds the runs once per FFT and
+frequency, and can then cross-multiply each run straight into its bin's accumulator with one vector
+call instead of scattering the products channel by channel.  A run ends at the next segment's start.
+Strides where the runs are only a few channels long are still scattered (see useBinSegments).
+*/
+typedef struct {
+  int start;  ///< The first channel of the run
+  int bin;    ///< The bin of every channel in the run
+} BinSegment;
+
+/**
+ * The number of BinSegments findBinSegments may need, including the closing one
+ * @param numchannels The number of channels in the band
+ * @param stridelength The cross-multiply stride length
+ */
+inline int getMaxBinSegments(int numchannels, int stridelength) { return numchannels + (numchannels + stridelength - 1)/stridelength + 1; }
+
+/// The shortest mean run (in channels) for which a vector call per run beats adding channel by channel
+const int MIN_MEAN_BIN_SEGMENT_LENGTH = 8;
+
+/**
+ * Whether a stride is better cross-multiplied by runs than by multiplying it whole and adding each channel into its bin
+ * @param numsegments The number of runs in the stride
+ * @param numchannels The number of channels in the stride
+ */
+inline bool useBinSegments(int numsegments, int numchannels) { return numsegments*MIN_MEAN_BIN_SEGMENT_LENGTH <= numchannels; }
+
+/**
+ * Splits the channels of a band into runs of the same bin, also breaking them at the start of each
+ * cross-multiply stride so every run lies within one stride.  The segments of stride x are
+ * segments[firstsegment[x]] up to (not including) segments[firstsegment[x+1]], and a closing
+ * segment starting at numchannels follows the last run so every run's length is the difference
+ * between its start and the next one's
+ * @param bins The bin of each channel
+ * @param numchannels The number of channels in the band
+ * @param stridelength The cross-multiply stride length
+ * @param segments Filled with the runs; must have room for getMaxBinSegments(numchannels, stridelength)
+ * @param firstsegment Filled with the index of the first run of each stride, plus the closing segment; must have room for one more than the number of strides
+ * @return The number of runs (not counting the closing segment)
+ */
+int findBinSegments(const s32 * bins, int numchannels, int stridelength, BinSegment * segments, int * firstsegment);
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -86,6 +86,7 @@ Configuration::Configuration(const char * configfile, int id, MPI_Comm& comm, do
     cerror << startl << "DIFX_MTU was set to " << mtu << " - resetting to 9000 bytes (max)" << endl;
     mtu = 9000;
   }
+  setTransportFromEnvironment();
 
   //open the file
   istream * input = mpiGetFileContent(configfile);
@@ -127,6 +128,7 @@ Configuration::Configuration(const char * configfile, int id, double restartsec)
     cerror << startl << "DIFX_MTU was set to " << mtu << " - resetting to 9000 bytes (max)" << endl;
     mtu = 9000;
   }
+  setTransportFromEnvironment();
 
   //open the file
   istream * input = mpiGetFileContent(configfile);
@@ -203,6 +205,59 @@ istream* Configuration::mpiGetFileContent(const char* filename)
   return new stringstream(filecontent);
 }
 
+void Configuration::setTransportFromEnvironment()
+{
+  const int defaults[2] = { TRANSPORT_ISSEND, DEFAULT_CORE_QUEUE_EXTRA };
+  int settings[2] = { defaults[0], defaults[1] };
+  int mpierr;
+
+  if (mpiid == fxcorr::MANAGERID || !enableMpi)
+  {
+    char * difxtransport = getenv("DIFX_DATA_TRANSPORT");
+    if(difxtransport != 0)
+    {
+      if(strcmp(difxtransport, "persistent") == 0)
+        settings[0] = TRANSPORT_PERSISTENT;
+      else if(strcmp(difxtransport, "put") == 0)
+        settings[0] = TRANSPORT_PUT;
+      else if(strcmp(difxtransport, "shared") == 0)
+        settings[0] = TRANSPORT_SHARED;
+      else if(strcmp(difxtransport, "issend") != 0)
+        cerror << startl << "DIFX_DATA_TRANSPORT was set to " << difxtransport << " - must be issend, persistent, put or shared.  Using issend" << endl;
+    }
+    char * queueextra = getenv("DIFX_CORE_QUEUE_EXTRA");
+    if(queueextra != 0 && atoi(queueextra) >= 0)
+      settings[1] = atoi(queueextra);
+    else if(queueextra != 0)
+      cerror << startl << "DIFX_CORE_QUEUE_EXTRA was set to " << queueextra << " - using the default of " << defaults[1] << endl;
+  }
+
+  if (enableMpi)
+  {
+    mpierr = MPI_Bcast(settings, 2, MPI_INT, fxcorr::MANAGERID, mpicomm);
+    if (mpierr != MPI_SUCCESS)
+    {
+      cwarn << startl << "MPI_Bcast of the data transport settings returned MPI error #" << mpierr << " - using the defaults" << endl;
+      settings[0] = defaults[0];
+      settings[1] = defaults[1];
+    }
+  }
+  transport = (datatransport)settings[0];
+  corequeueextra = settings[1];
+}
+
+int Configuration::getCoreQueueExtraPool(int numcores) const
+{
+  int pool = databufferfactor/2 - numcores;
+
+  if(pool > corequeueextra*numcores)
+    pool = corequeueextra*numcores;
+  if(pool < 0)
+    pool = 0;
+
+  return pool;
+}
+
 void Configuration::parseConfiguration(istream* input)
 {
   sectionheader currentheader = INPUT_EOF;
@@ -471,6 +526,7 @@ Configuration::~Configuration()
   }
   delete [] baselinetable;
   delete [] numprocessthreads;
+  delete [] corethreadplacement;
 }
 
 int Configuration::genMk5FormatName(dataformat format, int nchan, double bw, int nbits, datasampling sampling, int framebytes, int decimationfactor, int alignmentseconds, int numthreads, char *formatname) const
@@ -897,6 +953,15 @@ int Configuration::getCNumProcessThreads(int corenum) const
   return numprocessthreads[numcoreconfs-1];
 }
 
+Configuration::threadplacement Configuration::getCThreadPlacement(int corenum) const
+{
+  if(numcoreconfs == 0)
+    return PLACEMENT_NONE;
+  if(corenum < numcoreconfs)
+    return corethreadplacement[corenum];
+  return corethreadplacement[numcoreconfs-1];
+}
+
 bool Configuration::stationUsed(int telescopeindex) const
 {
   bool toreturn = false;
@@ -1302,7 +1367,7 @@ void Configuration::processCommon(istream * input)
 
 bool Configuration::processConfig(istream * input)
 {
-  string line;
+  string line, key;
   int arraystridelenfrominputfile;
 
   maxnumpulsarbins = 0;
@@ -1350,13 +1415,37 @@ bool Configuration::processConfig(istream * input)
     configs[i].numbufferedffts = atoi(line.c_str());
     if(configs[i].numbufferedffts > maxnumbufferedffts)
       maxnumbufferedffts = configs[i].numbufferedffts;
-    getinputline(input, &line, "WRITE AUTOCORRS");
+    configs[i].xmacprec = XMACF32;
+    getinputkeyval(input, &key, &line);
+    if(key.find("XMAC PRECISION") != string::npos) //look for optional xmac precision
+    {
+      if(line == "CS16")
+        configs[i].xmacprec = XMACCS16;
+      else if(line != "F32")
+      {
+        if(mpiid == 0) //only write one copy of this error message
+          cerror << startl << "Unknown XMAC PRECISION '" << line << "' (case sensitive choices are F32 and CS16) - using F32" << endl;
+      }
+      getinputline(input, &line, "WRITE AUTOCORRS");
+    }
+    else if(key.find("WRITE AUTOCORRS") == string::npos)
+    {
+      if(mpiid == 0) //only write one copy of this error message
+        cfatal << startl << "Went looking for WRITE AUTOCORRS (or maybe XMAC PRECISION), but got " << key << endl;
+      return false;
+    }
     configs[i].writeautocorrs = ((line == "TRUE") || (line == "T") || (line == "true") || (line == "t"))?true:false;
     getinputline(input, &line, "PULSAR BINNING");
     configs[i].pulsarbin = ((line == "TRUE") || (line == "T") || (line == "true") || (line == "t"))?true:false;
     if(configs[i].pulsarbin)
     {
       getinputline(input, &configs[i].pulsarconfigfilename, "PULSAR CONFIG FILE");
+      if(configs[i].xmacprec == XMACCS16)
+      {
+        if(mpiid == 0) //only write one copy of this error message
+          cwarn << startl << "XMAC PRECISION CS16 is not supported with pulsar binning - config " << configs[i].name << " will use F32" << endl;
+        configs[i].xmacprec = XMACF32;
+      }
     }
     getinputline(input, &line, "PHASED ARRAY");
     configs[i].phasedarray = ((line == "TRUE") || (line == "T") || (line == "true") || (line == "t"))?true:false;
@@ -1829,6 +1918,7 @@ bool Configuration::processDatastreamTable(istream * input)
   //read in the core numthreads info
   istream * coreinput = mpiGetFileContent(coreconffilename.c_str());
   numcoreconfs = 0;
+  corethreadplacement = 0;
   if(coreinput == NULL)
   {
     cwarn << startl << "Could not open " << coreconffilename << " - will set all numthreads to 1!" << endl;
@@ -1838,9 +1928,11 @@ bool Configuration::processDatastreamTable(istream * input)
     getinputline(coreinput, &line, "NUMBER OF CORES");
     int maxlines = atoi(line.c_str());
     numprocessthreads = new int[maxlines]();
+    corethreadplacement = new threadplacement[maxlines];
     getline(*coreinput, line);
     for(int i=0;i<maxlines;i++)
     {
+      corethreadplacement[numcoreconfs] = PLACEMENT_NONE;
       if(coreinput->eof())
       {
         cerror << startl << "Hit the end of the file! Setting the numthread for Core " << i << " to 1" << endl;
@@ -1848,6 +1940,14 @@ bool Configuration::processDatastreamTable(istream * input)
       }
       else
       {
+        char placement[16];
+        if(sscanf(line.c_str(), "%*d %15s", placement) == 1)
+        {
+          if(strcmp(placement, "numa") == 0)
+            corethreadplacement[numcoreconfs] = PLACEMENT_NUMA;
+          else if(strcmp(placement, "none") != 0 && mpiid == 0)
+            cwarn << startl << "Unknown thread placement " << placement << " for Core " << i << " in " << coreconffilename << " - ignoring it" << endl;
+        }
         numprocessthreads[numcoreconfs++] = atoi(line.c_str());
         getline(*coreinput, line);
       }
@@ -3726,5 +3826,18 @@ Configuration::filechecklevel Configuration::getFileCheckLevel()
   }
 }
 
+bool Configuration::writeVisIndex()
+{
+  const char *v;
+
+  v = getenv("DIFX_VIS_INDEX");
+  if(v == 0)
+  {
+    return false;  // default
+  }
+
+  return (strcmp(v, "1") == 0 || strcasecmp(v, "TRUE") == 0 || strcasecmp(v, "YES") == 0);
+}
+
 
 // vim: shiftwidth=2:softtabstop=2:expandtab
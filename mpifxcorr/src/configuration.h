@@ -75,6 +75,15 @@ public:
   /// For certain FILE data types (e.g., VDIF), can influence peeking / seeking on open
   enum filechecklevel {FILECHECKNONE, FILECHECKSEEK, FILECHECKUNKNOWN};
 
+  /// Precision of the station spectra fed to the cross-multiply
+  enum xmacprecision {XMACF32, XMACCS16};
+
+  /// How data is moved from the Datastreams to the Cores
+  enum datatransport {TRANSPORT_ISSEND, TRANSPORT_PERSISTENT, TRANSPORT_PUT, TRANSPORT_SHARED};
+
+  /// Where a Core puts its processing threads and buffers (selected per Core in the .threads file)
+  enum threadplacement {PLACEMENT_NONE, PLACEMENT_NUMA};
+
   /// Constant for the TCP window size for monitoring
   static int MONITOR_TCP_WINDOWBYTES;
 
@@ -127,6 +136,19 @@ public:
   inline int getXmacStrideLength(int configindex) const { return configs[configindex].xmacstridelen; }
   inline int getRotateStrideLength(int configindex) const { return configs[configindex].rotatestridelen; }
   inline int getNumBufferedFFTs(int configindex) const { return configs[configindex].numbufferedffts; }
+ /**
+  * Returns the precision of the spectra used in the cross-multiply for this configuration (optional
+  * XMAC PRECISION key, F32 by default).  With CS16 each station spectrum in an xmac stride is scaled
+  * by Q/M (M being its largest component over the batch of buffered FFTs, Q = min(32767,
+  * sqrt((2^31-1)/(2*NUM BUFFERED FFTS)))) and rounded to 16 bit integers.  Products are accumulated
+  * exactly in 32 bit integers over the buffered FFTs and widened into the float results at the end
+  * of each stride.  The error in each cross product is then at most (2/Q + 1/(2Q^2))*M1*M2, e.g.
+  * 1.7e-4*M1*M2 with 8 buffered FFTs; for noise-like spectra the added noise is ~M/(sigma*Q*sqrt(12))
+  * of the thermal noise (~1e-4), a negligible loss of sensitivity.
+  * @param configindex The index of the configuration being used (from the table in the input file)
+  * @return XMACF32 or XMACCS16
+  */
+  inline xmacprecision getXmacPrecision(int configindex) const { return configs[configindex].xmacprec; }
   inline int getThreadResultLength(int configindex) const { return configs[configindex].threadresultlength; }
   inline int getCoreResultLength(int configindex) const { return configs[configindex].coreresultlength; }
   inline long long getMaxThreadResultLength() const { return maxthreadresultlength; }
@@ -157,6 +179,18 @@ public:
   inline bool matchingRecordedBand(int configindex, int configdatastreamindex, int datastreamfreqindex, int datastreamrecordedbandindex) const
     { return datastreamfreqindex == datastreamtable[configs[configindex].datastreamindices[configdatastreamindex]].recordedbandlocalfreqindices[datastreamrecordedbandindex]; }
   inline int getDDataBufferFactor() const { return databufferfactor; }
+  inline datatransport getDataTransport() const { return transport; }
+ /**
+  * Returns the total number of subints beyond Core::RECEIVE_RING_LENGTH that may be queued across all Cores.  The extra
+  * subints wait in the Datastream send buffers, so this is limited to half of those buffers
+  * @param numcores The number of Cores in the correlation
+  */
+  int getCoreQueueExtraPool(int numcores) const;
+ /**
+  * Returns the number of subints beyond Core::RECEIVE_RING_LENGTH that a single Core may have queued (0 if queueing is off)
+  * @param numcores The number of Cores in the correlation
+  */
+  inline int getCoreQueueExtra(int numcores) const { return (getCoreQueueExtraPool(numcores) > 0)?corequeueextra:0; }
   inline int getDNumDataSegments() const { return numdatasegments; }
   inline int isDMuxed(int configindex, int configdatastreamindex) const
     { return datastreamtable[configs[configindex].datastreamindices[configdatastreamindex]].ismuxed; }
@@ -518,6 +552,12 @@ public:
   */
  istream* mpiGetFileContent(const char* filename);
 
+ /**
+  * Reads the DIFX_DATA_TRANSPORT and DIFX_CORE_QUEUE_EXTRA environment variables.  When running under MPI the values
+  * seen by the FxManager are broadcast, since every process must agree on them
+  */
+  void setTransportFromEnvironment();
+
  /**
   * Read information from an input stream and store it internally into this object
   * @param input The input stream containing configuration information to be read
@@ -662,6 +702,16 @@ public:
   * @return The number of processing threads for the specified Core
   */
   int getCNumProcessThreads(int corenum) const;
+
+ /**
+  * A Core's line in the .threads file may follow the number of threads with the word "numa", in which
+  * case its processing threads are spread over (and pinned to) the NUMA nodes it may run on, each thread's
+  * scratch space is allocated on its own node, and the receive slots (which every thread reads) are
+  * interleaved over those nodes
+  * @param corenum The core id (indexed from 0->numcores-1)
+  * @return The thread and buffer placement for the specified Core
+  */
+  threadplacement getCThreadPlacement(int corenum) const;
   
  /**
   * @param telescopeindex The index of the telescope (from the table in the input file)
@@ -748,6 +798,12 @@ public:
 
   static filechecklevel getFileCheckLevel();
 
+ /**
+  * Whether a seekable index of each DiFX output file should be written alongside it (env var DIFX_VIS_INDEX)
+  * @return True if DIFX_VIS_INDEX is set to 1, TRUE or YES
+  */
+  static bool writeVisIndex();
+
 private:
   ///types of sections that can occur within an input file
   enum sectionheader {COMMON, CONFIG, RULE, FREQ, TELESCOPE, DATASTREAM, BASELINE, DATA, NETWORK, INPUT_EOF, UNKNOWN};
@@ -802,6 +858,7 @@ private:
     int xmacstridelen;
     int rotatestridelen;
     int numbufferedffts;
+    xmacprecision xmacprec;
     bool writeautocorrs;
     bool pulsarbin;
     bool phasedarray;
@@ -1096,6 +1153,9 @@ private:
   /// Constant for the default number of channels for visibilities sent to monitor (STA or LTA)
   static const int DEFAULT_MONITOR_NUMCHANNELS = 32;
 
+  /// Default for the extra subints a fast Core may queue (one less than Core::RECEIVE_RING_LENGTH)
+  static const int DEFAULT_CORE_QUEUE_EXTRA = 3;
+
   const int mpiid;
   MPI_Comm mpicomm;
   const bool enableMpi;
@@ -1109,12 +1169,14 @@ private:
   double restartseconds;
   int maxnumchannels, maxnumpulsarbins;
   long long maxthreadresultlength, maxcoreresultlength;
-  int maxnumbufferedffts, mtu;
+  int maxnumbufferedffts, mtu, corequeueextra;
+  datatransport transport;
   int stadumpchannels, ltadumpchannels;
   int numconfigs, numrules, baselinetablelength, telescopetablelength, datastreamtablelength, freqtablelength;
   long long estimatedbytes;
   string calcfilename, modelfilename, coreconffilename, outputfilename, jobname, obscode;
   int * numprocessthreads;
+  threadplacement * corethreadplacement;
   int * scanconfigindices;
   configdata * configs;
   ruledata * rules;
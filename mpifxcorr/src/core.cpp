@@ -28,7 +28,9 @@
 #include "core.h"
 #include "fxmanager.h"
 #include "alert.h"
+#include "fftcache.h"
 #include "config.h"
+#include <unistd.h>
 
 Core::Core(int id, Configuration * conf, int * dids, MPI_Comm rcomm)
   : mpiid(id), config(conf), return_comm(rcomm)
@@ -54,6 +56,76 @@ Core::Core(int id, Configuration * conf, int * dids, MPI_Comm rcomm)
   startmjd = config->getStartMJD();
   startseconds = config->getStartSeconds();
 
+  //work out the largest number of bands (recorded plus zoom) any datastream has, for indexing packed spectra
+  maxdatastreambands = 0;
+  for(int i=0;i<config->getNumConfigs();i++)
+  {
+    for(int j=0;j<numdatastreams;j++)
+    {
+      if(config->getDNumRecordedBands(i, j) + config->getDNumZoomBands(i, j) > maxdatastreambands)
+        maxdatastreambands = config->getDNumRecordedBands(i, j) + config->getDNumZoomBands(i, j);
+    }
+  }
+
+  //work out the cache budget for the tiled cross-multiply (0 means use the plain per-baseline loop)
+  char * xmactile = getenv("DIFX_XMAC_TILE_KB");
+  if(xmactile == 0)
+    xmactilebytes = DEFAULT_XMAC_TILE_KB*1024;
+  else
+    xmactilebytes = atoi(xmactile)*1024;
+  if(xmactilebytes < 0) {
+    cerror << startl << "DIFX_XMAC_TILE_KB was set to " << xmactile << " - using the default of " << DEFAULT_XMAC_TILE_KB << " kB" << endl;
+    xmactilebytes = DEFAULT_XMAC_TILE_KB*1024;
+  }
+  if(xmactilebytes > 0)
+    cverbose << startl << "Cross-multiply will be tiled over baselines with a " << xmactilebytes/1024 << " kB accumulator budget" << endl;
+  else
+    cverbose << startl << "Cross-multiply tiling is disabled - each baseline will be processed in turn" << endl;
+
+  //spectral kurtosis RFI excision is off unless a threshold is given
+  char * skenv = getenv("DIFX_SK_THRESHOLD");
+  skthreshold = skenv ? atof(skenv) : 0.0;
+  if(skthreshold < 0.0) {
+    cerror << startl << "DIFX_SK_THRESHOLD was set to " << skenv << " - spectral kurtosis RFI excision will not be done" << endl;
+    skthreshold = 0.0;
+  }
+  skenv = getenv("DIFX_SK_WINDOW");
+  skwindow = skenv ? atoi(skenv) : 0;
+  if(skwindow < 0 || (skwindow > 0 && skwindow < Mode::MIN_SK_WINDOW)) {
+    cwarn << startl << "DIFX_SK_WINDOW was set to " << skenv << " - spectral kurtosis will be estimated from at least " << Mode::MIN_SK_WINDOW << " FFTs" << endl;
+    skwindow = Mode::MIN_SK_WINDOW;
+  }
+  if(skthreshold > 0.0) {
+    if(skwindow > 0)
+      cinfo << startl << "Channels with a spectral kurtosis more than " << skthreshold << " sigma from 1 over " << skwindow << " FFTs (at most the buffered FFTs) will be excised" << endl;
+    else
+      cinfo << startl << "Channels with a spectral kurtosis more than " << skthreshold << " sigma from 1 over the buffered FFTs will be excised" << endl;
+  }
+
+  //write each autocorrelation average to a filterbank ring for streaming transient searches, if asked
+  filterbankring = 0;
+  char * fbenv = getenv("DIFX_FILTERBANK_RING");
+  if(fbenv != 0 && fbenv[0] != 0) {
+    int fbchannels = config->getSTADumpChannels(), fbslots = DEFAULT_FILTERBANK_SLOTS;
+    char * fbsize = getenv("DIFX_FILTERBANK_CHANNELS");
+    if(fbsize != 0 && atoi(fbsize) > 0)
+      fbchannels = atoi(fbsize);
+    fbsize = getenv("DIFX_FILTERBANK_SLOTS");
+    if(fbsize != 0 && atoi(fbsize) > 0)
+      fbslots = atoi(fbsize);
+    ostringstream fbfilename;
+    fbfilename << fbenv << "." << mpiid - numdatastreams - fxcorr::FIRSTTELESCOPEID;
+    filterbankring = new FilterbankRing(fbfilename.str().c_str(), fbslots, fbchannels);
+    if(filterbankring->initialisedOK()) {
+      cinfo << startl << "Filterbank spectra of up to " << fbchannels << " channels will be written to the " << fbslots << " record ring " << fbfilename.str() << endl;
+    }
+    else {
+      cerror << startl << "No filterbank spectra will be written" << endl;
+      delete filterbankring;
+      filterbankring = 0;
+    }
+  }
+
   //work out the biggest overhead from any of the active configurations
   maxguardratio = 1.0;
   databytes = config->getMaxDataBytes();
@@ -76,12 +148,69 @@ Core::Core(int id, Configuration * conf, int * dids, MPI_Comm rcomm)
   }
   databytes += overheadbytes;
 
+  //with the shared transport, map the data buffers of the Datastreams on this node (collective, matched in FxManager and DataStream)
+  transport = config->getDataTransport();
+  sharedsource = 0;
+  sharedcopy = 0;
+  sharedheld = 0;
+  numshared = 0;
+  if(transport == Configuration::TRANSPORT_SHARED)
+  {
+    MPI_Group worldgroup, nodegroup;
+    MPI_Aint sharedbytes;
+    int noderank, dispunit;
+    u8 * nobuffer;
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodecomm);
+    MPI_Win_allocate_shared(0, 1, MPI_INFO_NULL, nodecomm, &nobuffer, &sharedwindow);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, sharedwindow);
+    MPI_Comm_group(MPI_COMM_WORLD, &worldgroup);
+    MPI_Comm_group(nodecomm, &nodegroup);
+    sharedsource = new u8*[numdatastreams];
+    for(int i=0;i<numdatastreams;i++)
+    {
+      sharedsource[i] = 0;
+      MPI_Group_translate_ranks(worldgroup, 1, &dids[i], nodegroup, &noderank);
+      if(noderank == MPI_UNDEFINED)
+        continue;
+      MPI_Win_shared_query(sharedwindow, noderank, &sharedbytes, &dispunit, &sharedsource[i]);
+      if(sharedbytes == 0)
+        sharedsource[i] = 0;
+      else
+        numshared++;
+    }
+    MPI_Group_free(&worldgroup);
+    MPI_Group_free(&nodegroup);
+    sharedheld = new bool[RECEIVE_RING_LENGTH];
+    sharedcopy = new u8**[RECEIVE_RING_LENGTH];
+    for(int i=0;i<RECEIVE_RING_LENGTH;i++)
+    {
+      sharedheld[i] = false;
+      sharedcopy[i] = new u8*[numdatastreams];
+      for(int j=0;j<numdatastreams;j++)
+        sharedcopy[i][j] = 0;
+    }
+    cverbose << startl << "Core " << mpiid << " reads " << numshared << " of " << numdatastreams << " datastreams directly from shared memory" << endl;
+  }
+
+  //work out where the processing threads will run, if NUMA placement was asked for
+  numa = 0;
+  if(config->getCThreadPlacement(mpiid - numdatastreams - fxcorr::FIRSTTELESCOPEID) == Configuration::PLACEMENT_NUMA)
+  {
+    numa = new NumaTopology();
+    if(numa->getNumNodes() < 2)
+      cinfo << startl << "Core " << mpiid << " was asked for NUMA placement but can only run on one NUMA node (CPUs " << NumaTopology::describeCPUs(numa->getNodeCPUs(0)) << ") - threads will be pinned there" << endl;
+  }
+
   //allocate the send/receive circular buffer (length RECEIVE_RING_LENGTH)
+  //every processing thread reads every slot, so with NUMA placement the slots are interleaved over the nodes in use
   controllength = config->getMaxBlocksPerSend() + 4;
   procslots = new processslot[RECEIVE_RING_LENGTH];
   for(int i=0;i<RECEIVE_RING_LENGTH;i++)
   {
     procslots[i].results = vectorAlloc_cf32(maxcoreresultlength);
+    if(numa)
+      numa->interleave(procslots[i].results, maxcoreresultlength*sizeof(cf32));
     procslots[i].floatresults = (f32*)procslots[i].results;
     //set up the info for this slot, using the first configuration
     status = vectorZero_cf32(procslots[i].results, maxcoreresultlength);
@@ -124,14 +253,23 @@ Core::Core(int id, Configuration * conf, int * dids, MPI_Comm rcomm)
     procslots[i].databuffer = new u8*[numdatastreams];
     procslots[i].controlbuffer = new s32*[numdatastreams];
     procslots[i].keepprocessing = true;
+    procslots[i].threadsdonewithdata = 0;
     procslots[i].numpulsarbins = config->getNumPulsarBins(currentconfigindex);
     procslots[i].scrunchoutput = config->scrunchOutputOn(currentconfigindex);
     procslots[i].pulsarbin = config->pulsarBinOn(currentconfigindex);
     for(int j=0;j<numdatastreams;j++)
     {
-      procslots[i].databuffer[j] = vectorAlloc_u8(databytes);
+      //with the put transport the data lands in the window allocated below instead, and with the shared
+      //transport data from the Datastreams on this node is read where it lies
+      procslots[i].databuffer[j] = 0;
+      if(ownsDataBuffer(j))
+      {
+        procslots[i].databuffer[j] = vectorAlloc_u8(databytes);
+        if(numa)
+          numa->interleave(procslots[i].databuffer[j], databytes);
+        estimatedbytes += databytes;
+      }
       procslots[i].controlbuffer[j] = vectorAlloc_s32(controllength);
-      estimatedbytes += databytes;
       estimatedbytes += controllength*4;
     }
   }
@@ -159,12 +297,60 @@ Core::Core(int id, Configuration * conf, int * dids, MPI_Comm rcomm)
   for(int i=0;i<numdatastreams;i++)
     datastreamids[i] = dids[i];
 
+  //set up the persistent receives or the landing window, if one of those transports is in use
+  persistentdatarequests = 0;
+  persistentcontrolrequests = 0;
+  landingbuffer = 0;
+  landingdepth = 0;
+  numlanded = 0;
+  if(transport == Configuration::TRANSPORT_PERSISTENT)
+  {
+    persistentdatarequests = new MPI_Request*[RECEIVE_RING_LENGTH];
+    persistentcontrolrequests = new MPI_Request*[RECEIVE_RING_LENGTH];
+    for(int i=0;i<RECEIVE_RING_LENGTH;i++)
+    {
+      persistentdatarequests[i] = new MPI_Request[numdatastreams];
+      persistentcontrolrequests[i] = new MPI_Request[numdatastreams];
+      for(int j=0;j<numdatastreams;j++)
+      {
+        MPI_Recv_init(procslots[i].databuffer[j], databytes, MPI_UNSIGNED_CHAR, datastreamids[j], CR_PROCESSDATA, MPI_COMM_WORLD, &persistentdatarequests[i][j]);
+        MPI_Recv_init(procslots[i].controlbuffer[j], controllength, MPI_INT, datastreamids[j], CR_PROCESSCONTROL, MPI_COMM_WORLD, &persistentcontrolrequests[i][j]);
+      }
+    }
+    cverbose << startl << "Core " << mpiid << " is receiving data with persistent requests" << endl;
+  }
+  else if(transport == Configuration::TRANSPORT_PUT)
+  {
+    //one slot per subint the FxManager may have outstanding at this core, so a slot is never overwritten before its result is returned
+    int numprocs;
+    MPI_Comm_size(MPI_COMM_WORLD, &numprocs);
+    landingdepth = RECEIVE_RING_LENGTH + config->getCoreQueueExtra(numprocs - fxcorr::FIRSTTELESCOPEID - numdatastreams);
+    databytes = (databytes + 63) & ~63; //keep every slot cache line aligned
+    MPI_Aint landingbytes = LANDING_HEADER_BYTES + ((MPI_Aint)landingdepth)*numdatastreams*databytes;
+    perr = MPI_Win_allocate(landingbytes, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &landingbuffer, &landingwindow);
+    if(perr != MPI_SUCCESS)
+    {
+      cfatal << startl << "Core " << mpiid << " could not allocate a " << landingbytes/1048576 << " MB window for the put transport - aborting!!!" << endl;
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    estimatedbytes += landingbytes;
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, landingwindow);
+    ((s32 *)landingbuffer)[0] = databytes;
+    ((s32 *)landingbuffer)[1] = landingdepth;
+    ((s32 *)landingbuffer)[2] = numdatastreams;
+    MPI_Win_sync(landingwindow);
+    cverbose << startl << "Core " << mpiid << " exposes " << landingdepth << " slots of " << databytes << " bytes per datastream for the put transport" << endl;
+  }
+
   //initialise the binary message infrastructure
   difxMessageInitBinary();
 }
 
 const int Core::RECEIVE_RING_LENGTH = 4;
 const double Core::MINIMUM_FILTERBANK_WEIGHT = 0.333;
+const int Core::DEFAULT_XMAC_TILE_KB = 256;
+const int Core::DEFAULT_FILTERBANK_SLOTS = 16384;
+const int Core::LANDING_HEADER_BYTES = 64;
 
 Core::~Core()
 {
@@ -172,7 +358,8 @@ Core::~Core()
   {
     for(int j=0;j<numdatastreams;j++)
     {
-      vectorFree(procslots[i].databuffer[j]);
+      if(ownsDataBuffer(j))
+        vectorFree(procslots[i].databuffer[j]);
       vectorFree(procslots[i].controlbuffer[j]);
     }
     delete [] procslots[i].slotlocks;
@@ -193,6 +380,33 @@ Core::~Core()
   delete [] controlrequests;
   delete [] msgstatuses;
   delete [] datastreamids;
+  delete numa;
+  delete filterbankring;
+  if(persistentdatarequests)
+  {
+    for(int i=0;i<RECEIVE_RING_LENGTH;i++)
+    {
+      delete [] persistentdatarequests[i];
+      delete [] persistentcontrolrequests[i];
+    }
+    delete [] persistentdatarequests;
+    delete [] persistentcontrolrequests;
+  }
+  if(sharedsource)
+  {
+    for(int i=0;i<RECEIVE_RING_LENGTH;i++)
+    {
+      for(int j=0;j<numdatastreams;j++)
+      {
+        if(sharedcopy[i][j] != 0)
+          vectorFree(sharedcopy[i][j]);
+      }
+      delete [] sharedcopy[i];
+    }
+    delete [] sharedcopy;
+    delete [] sharedsource;
+    delete [] sharedheld;
+  }
 }
 
 
@@ -200,6 +414,9 @@ void Core::execute()
 {
   int perr, status, lastconfigindex, adjust, countdown, tounlock;
   bool terminate;
+  MPI_Request resultrequest;
+  MPI_Status resultstatus;
+  FFTPlanCacheStats fftstats;
   processthreadinfo * threadinfos = new processthreadinfo[numprocessthreads];
   pthread_attr_t attr;
 
@@ -268,6 +485,16 @@ void Core::execute()
   {
     threadinfos[i].thiscore = this;
     threadinfos[i].processthreadid = i;
+    if(numa)
+    {
+      //pin the thread before it starts, so everything it allocates is first touched on its own node
+      int node = numa->getNodeForThread(i, numprocessthreads);
+      perr = pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), numa->getNodeCPUs(node));
+      if(perr != 0)
+        cwarn << startl << "Could not pin Core " << mpiid << " processthread " << i << " to NUMA node " << numa->getNodeId(node) << " (" << perr << ")" << endl;
+      else
+        cinfo << startl << "Core " << mpiid << " processthread " << i << " is placed on NUMA node " << numa->getNodeId(node) << " (CPUs " << NumaTopology::describeCPUs(numa->getNodeCPUs(node)) << ")" << endl;
+    }
     perr = pthread_create(&processthreads[i], &attr, Core::launchNewProcessThread, (void *)(&threadinfos[i]));
     if(perr != 0)
       csevere << startl << "Error in launching Core " << mpiid << " processthread " << i << "!!!" << endl;
@@ -295,6 +522,10 @@ void Core::execute()
   }
 
   cverbose << startl << "Estimated memory usage by Core is now " << getEstimatedBytes()/(1024.0*1024.0) << " MB" << endl;
+  //the processing threads have made their Modes, so all the FFT plans needed so far exist
+  getFFTPlanCacheStats(&fftstats);
+  if(fftstats.plans > 0)
+    cinfo << startl << "Core " << mpiid << " made " << fftstats.plans << " FFT plans (" << fftstats.wisdomplans << " from wisdom) in " << fftstats.plantime << " s and reused them " << fftstats.reuses << " times, saving an estimated " << fftstats.savedtime << " s of startup" << endl;
   lastconfigindex = procslots[0].configindex;
   while(!terminate) //the data is valid, so keep processing
   {
@@ -309,7 +540,8 @@ void Core::execute()
       break;
 
     //send the results back
-    MPI_Ssend(procslots[numreceived%RECEIVE_RING_LENGTH].results, procslots[numreceived%RECEIVE_RING_LENGTH].coreresultlength*2, MPI_FLOAT, fxcorr::MANAGERID, procslots[numreceived%RECEIVE_RING_LENGTH].resultsvalid, return_comm);
+    MPI_Issend(procslots[numreceived%RECEIVE_RING_LENGTH].results, procslots[numreceived%RECEIVE_RING_LENGTH].coreresultlength*2, MPI_FLOAT, fxcorr::MANAGERID, procslots[numreceived%RECEIVE_RING_LENGTH].resultsvalid, return_comm, &resultrequest);
+    waitReleasingSharedData(1, &resultrequest, &resultstatus);
     if(procslots[numreceived%RECEIVE_RING_LENGTH].configindex != lastconfigindex)
     {
       cverbose << startl << "After config change, estimated memory usage by Core is " << getEstimatedBytes()/(1024.0*1024.0) << " MB" << endl;
@@ -359,8 +591,10 @@ void Core::execute()
       if(perr != 0)
         csevere << startl << "Error in Core " << mpiid << " attempt to unlock mutex" << (numreceived+i+adjust) % RECEIVE_RING_LENGTH << " of thread " << j << endl;
     }
+    releaseSharedData((numreceived+i+adjust)%RECEIVE_RING_LENGTH);
     //send the results
-    MPI_Ssend(procslots[(numreceived+i+adjust)%RECEIVE_RING_LENGTH].results, procslots[(numreceived+i+adjust)%RECEIVE_RING_LENGTH].coreresultlength*2, MPI_FLOAT, fxcorr::MANAGERID, procslots[(numreceived+i+adjust)%RECEIVE_RING_LENGTH].resultsvalid, return_comm);
+    MPI_Issend(procslots[(numreceived+i+adjust)%RECEIVE_RING_LENGTH].results, procslots[(numreceived+i+adjust)%RECEIVE_RING_LENGTH].coreresultlength*2, MPI_FLOAT, fxcorr::MANAGERID, procslots[(numreceived+i+adjust)%RECEIVE_RING_LENGTH].resultsvalid, return_comm, &resultrequest);
+    waitReleasingSharedData(1, &resultrequest, &resultstatus);
 
     countdown--;
   }
@@ -376,6 +610,33 @@ void Core::execute()
   }
   delete [] threadinfos;
 
+  //config changes may have made more plans; keep them for the next job on this node
+  saveFFTWisdom();
+
+  //release the transport resources; freeing the window is collective, matched in FxManager and DataStream
+  if(transport == Configuration::TRANSPORT_PERSISTENT)
+  {
+    for(int i=0;i<RECEIVE_RING_LENGTH;i++)
+    {
+      for(int j=0;j<numdatastreams;j++)
+      {
+        MPI_Request_free(&persistentdatarequests[i][j]);
+        MPI_Request_free(&persistentcontrolrequests[i][j]);
+      }
+    }
+  }
+  else if(transport == Configuration::TRANSPORT_PUT)
+  {
+    MPI_Win_unlock_all(landingwindow);
+    MPI_Win_free(&landingwindow);
+  }
+  else if(transport == Configuration::TRANSPORT_SHARED)
+  {
+    MPI_Win_unlock_all(sharedwindow);
+    MPI_Win_free(&sharedwindow);
+    MPI_Comm_free(&nodecomm);
+  }
+
 //  cinfo << startl << "CORE " << mpiid << " terminating" << endl;
 }
 
@@ -397,7 +658,7 @@ long long Core::getEstimatedBytes()
 
 void Core::loopprocess(int threadid)
 {
-  int perr, numprocessed, startblock, numblocks, lastconfigindex, numpolycos, maxchan, maxpolycos, stadumpchannels, strideplussteplen, maxrotatestrideplussteplength, maxxmaclength, slen;
+  int perr, numprocessed, startblock, numblocks, lastconfigindex, numpolycos, maxchan, maxpolycos, stadumpchannels, maxrotatestridelength, maxxmaclength, maxphasecentres;
   double sec;
   bool pulsarbin, somepulsarbin, somescrunch, dumpingsta, nowdumpingsta;
   processslot * currentslot;
@@ -407,6 +668,9 @@ void Core::loopprocess(int threadid)
   threadscratchspace * scratchspace = new threadscratchspace;
   scratchspace->shifterrorcount = 0;
   scratchspace->threadcrosscorrs = vectorAlloc_cf32(maxthreadresultlength);
+  //the rest of the scratch space is first touched by this (pinned) thread, but make sure of the biggest array
+  if(numa && scratchspace->threadcrosscorrs != NULL)
+    numa->bind(scratchspace->threadcrosscorrs, maxthreadresultlength*sizeof(cf32), numa->getNodeForThread(threadid, numprocessthreads));
   scratchspace->baselineweight = new f32***[config->getFreqTableLength()]();
   scratchspace->baselineshiftdecorr = new f32**[config->getFreqTableLength()]();
   if(scratchspace->threadcrosscorrs == NULL) {
@@ -416,6 +680,13 @@ void Core::loopprocess(int threadid)
 
   scratchspace->pulsarscratchspace=0;
   scratchspace->pulsaraccumspace=0;
+  scratchspace->xmacresultoffsets = new int[numbaselines];
+  scratchspace->xmacpackslots = new int[numdatastreams*maxdatastreambands*2];
+  scratchspace->xmacpackscales = vectorAlloc_f32(numdatastreams*maxdatastreambands*2);
+  scratchspace->xmacpacked = 0;
+  scratchspace->xmacpackedlength = 0;
+  scratchspace->threadid = threadid;
+  threadbytes[threadid] += 8*numdatastreams*maxdatastreambands*2;
   scratchspace->starecordbuffer = 0;
 
   pulsarbin = false;
@@ -424,25 +695,28 @@ void Core::loopprocess(int threadid)
   dumpingsta = false;
   maxpolycos = 0;
   maxchan = config->getMaxNumChannels();
-  slen = config->getRotateStrideLength(0);
-  maxrotatestrideplussteplength = slen + maxchan/slen;
+  maxrotatestridelength = config->getRotateStrideLength(0);
   maxxmaclength = config->getXmacStrideLength(0);
+  maxphasecentres = config->getMaxPhaseCentres(0);
   for(int i=1;i<config->getNumConfigs();i++)
   {
-    slen = config->getRotateStrideLength(i);
-    strideplussteplen = slen + maxchan/slen;
-    if(strideplussteplen > maxrotatestrideplussteplength)
-      maxrotatestrideplussteplength = strideplussteplen;
+    if(config->getRotateStrideLength(i) > maxrotatestridelength)
+      maxrotatestridelength = config->getRotateStrideLength(i);
     if(config->getXmacStrideLength(i) > maxxmaclength)
       maxxmaclength = config->getXmacStrideLength(i);
+    if(config->getMaxPhaseCentres(i) > maxphasecentres)
+      maxphasecentres = config->getMaxPhaseCentres(i);
   }
-  scratchspace->chanfreqs = vectorAlloc_f64(maxrotatestrideplussteplength);
-  scratchspace->rotator = vectorAlloc_cf32(maxrotatestrideplussteplength);
   scratchspace->rotated = vectorAlloc_cf32(maxchan);
   scratchspace->channelsums = vectorAlloc_cf32(maxchan);
-  scratchspace->argument = vectorAlloc_f32(3*maxrotatestrideplussteplength);
-  // FIXME: explicitly calculate "28" below.
-  threadbytes[threadid] += 16*maxchan + 28*maxrotatestrideplussteplength;
+  scratchspace->xmacintaccum = vectorAlloc_s32(2*maxxmaclength);
+  threadbytes[threadid] += 16*maxchan + 8*maxxmaclength;
+  scratchspace->phasecentrerotator = 0;
+  if(maxphasecentres > 1)
+  {
+    scratchspace->phasecentrerotator = new PhaseCentreRotator(maxrotatestridelength, maxxmaclength);
+    threadbytes[threadid] += 8*(maxrotatestridelength + maxxmaclength);
+  }
 
   //work out whether we'll need to do any pulsar binning, and work out the maximum # channels (and # polycos if applicable)
   for(int i=0;i<config->getNumConfigs();i++)
@@ -461,11 +735,12 @@ void Core::loopprocess(int threadid)
   if(somepulsarbin)
   {
     scratchspace->pulsarscratchspace = vectorAlloc_cf32(maxxmaclength);
+    threadbytes[threadid] += 8*maxxmaclength;
     if(somescrunch) //need separate accumulation space
     {
       scratchspace->pulsaraccumspace = new cf32******[config->getFreqTableLength()]();
     }
-    createPulsarVaryingSpace(scratchspace->pulsaraccumspace, &(scratchspace->bins), procslots[0].configindex, -1, threadid); //don't need to delete old space
+    createPulsarVaryingSpace(scratchspace->pulsaraccumspace, &(scratchspace->bins), &(scratchspace->binsegments), &(scratchspace->firstbinsegment), procslots[0].configindex, -1, threadid); //don't need to delete old space
   }
 
   //create the baselineweight and xmacstrideoffset arrays
@@ -548,7 +823,7 @@ void Core::loopprocess(int threadid)
       cinfo << startl << "Core " << mpiid << " threadid " << threadid << ": changing config to " << currentslot->configindex << endl;
       updateconfig(lastconfigindex, currentslot->configindex, threadid, startblock, numblocks, numpolycos, pulsarbin, modes, polycos, false);
       cinfo << startl << "Core " << mpiid << " threadid " << threadid << ": config changed successfully - pulsarbin is now " << pulsarbin << endl;
-      createPulsarVaryingSpace(scratchspace->pulsaraccumspace, &(scratchspace->bins), currentslot->configindex, lastconfigindex, threadid);
+      createPulsarVaryingSpace(scratchspace->pulsaraccumspace, &(scratchspace->bins), &(scratchspace->binsegments), &(scratchspace->firstbinsegment), currentslot->configindex, lastconfigindex, threadid);
       allocateConfigSpecificThreadArrays(scratchspace->baselineweight, scratchspace->baselineshiftdecorr, currentslot->configindex, lastconfigindex, threadid);
       lastconfigindex = currentslot->configindex;
     }
@@ -573,7 +848,7 @@ void Core::loopprocess(int threadid)
     }
     delete [] polycos;
     vectorFree(scratchspace->pulsarscratchspace);
-    createPulsarVaryingSpace(scratchspace->pulsaraccumspace, &(scratchspace->bins), -1,
+    createPulsarVaryingSpace(scratchspace->pulsaraccumspace, &(scratchspace->bins), &(scratchspace->binsegments), &(scratchspace->firstbinsegment), -1,
     procslots[(numprocessed+1)%RECEIVE_RING_LENGTH].configindex, threadid);
     if(somescrunch)
     {
@@ -581,11 +856,15 @@ void Core::loopprocess(int threadid)
     }
   }
   vectorFree(scratchspace->threadcrosscorrs);
-  vectorFree(scratchspace->chanfreqs);
-  vectorFree(scratchspace->rotator);
+  delete [] scratchspace->xmacresultoffsets;
+  delete [] scratchspace->xmacpackslots;
+  vectorFree(scratchspace->xmacpackscales);
+  if(scratchspace->xmacpacked != 0)
+    vectorFree(scratchspace->xmacpacked);
+  vectorFree(scratchspace->xmacintaccum);
   vectorFree(scratchspace->rotated);
   vectorFree(scratchspace->channelsums);
-  vectorFree(scratchspace->argument);
+  delete scratchspace->phasecentrerotator;
   if(scratchspace->starecordbuffer != 0) {
     free(scratchspace->starecordbuffer);
   }
@@ -597,13 +876,15 @@ void Core::loopprocess(int threadid)
 int Core::receivedata(int index, bool * terminate)
 {
   MPI_Status mpistatus;
+  MPI_Request offsetrequest;
   int perr;
 
   if(*terminate)
     return 0; //don't try to read, we've already finished
 
   //Get the instructions on the time offset from the FxManager node
-  MPI_Recv(&(procslots[index].offsets), 3, MPI_INT, fxcorr::MANAGERID, MPI_ANY_TAG, return_comm, &mpistatus);
+  MPI_Irecv(&(procslots[index].offsets), 3, MPI_INT, fxcorr::MANAGERID, MPI_ANY_TAG, return_comm, &offsetrequest);
+  waitReleasingSharedData(1, &offsetrequest, &mpistatus);
   if(mpistatus.MPI_TAG == CR_TERMINATE)
   {
     *terminate = true;
@@ -631,20 +912,95 @@ int Core::receivedata(int index, bool * terminate)
   }
 
   //now grab the data and delay info from the individual datastreams
-  for(int i=0;i<numdatastreams;i++)
+  if(transport == Configuration::TRANSPORT_PERSISTENT)
   {
-    //cinfo << startl << "Core is about to post receive request for datastream " << i << endl;
-    //get data
-    MPI_Irecv(procslots[index].databuffer[i], databytes, MPI_UNSIGNED_CHAR, datastreamids[i], CR_PROCESSDATA, MPI_COMM_WORLD, &datarequests[i]);
-    //also receive the offsets and rates
-    MPI_Irecv(procslots[index].controlbuffer[i], controllength, MPI_INT, datastreamids[i], CR_PROCESSCONTROL, MPI_COMM_WORLD, &controlrequests[i]);
+    //the receives were bound to this slot's buffers at startup, so just restart them
+    MPI_Startall(numdatastreams, persistentdatarequests[index]);
+    MPI_Startall(numdatastreams, persistentcontrolrequests[index]);
+    MPI_Waitall(numdatastreams, persistentdatarequests[index], msgstatuses);
+    for(int i=0;i<numdatastreams;i++)
+      MPI_Get_count(&(msgstatuses[i]), MPI_UNSIGNED_CHAR, &(procslots[index].datalengthbytes[i]));
+    MPI_Waitall(numdatastreams, persistentcontrolrequests[index], msgstatuses);
+  }
+  else if(transport == Configuration::TRANSPORT_PUT)
+  {
+    //the datastreams put the data straight into the next landing slot, then send the control array with the
+    //data length appended, which also tells us the data has arrived
+    for(int i=0;i<numdatastreams;i++)
+      MPI_Irecv(procslots[index].controlbuffer[i], controllength, MPI_INT, datastreamids[i], CR_PROCESSCONTROL, MPI_COMM_WORLD, &controlrequests[i]);
+    MPI_Waitall(numdatastreams, controlrequests, msgstatuses);
+    MPI_Win_sync(landingwindow);
+    for(int i=0;i<numdatastreams;i++)
+    {
+      int controlcount;
+      MPI_Get_count(&(msgstatuses[i]), MPI_INT, &controlcount);
+      procslots[index].datalengthbytes[i] = procslots[index].controlbuffer[i][controlcount-1];
+      procslots[index].databuffer[i] = landingbuffer + LANDING_HEADER_BYTES + ((numlanded%landingdepth)*numdatastreams + i)*databytes;
+    }
+    numlanded++;
+  }
+  else if(transport == Configuration::TRANSPORT_SHARED)
+  {
+    //Datastreams on this node send only the control array, with the offset and length of the data in their
+    //buffer appended; the others send the data as usual
+    for(int i=0;i<numdatastreams;i++)
+    {
+      datarequests[i] = MPI_REQUEST_NULL;
+      if(sharedsource[i] == 0)
+        MPI_Irecv(procslots[index].databuffer[i], databytes, MPI_UNSIGNED_CHAR, datastreamids[i], CR_PROCESSDATA, MPI_COMM_WORLD, &datarequests[i]);
+      MPI_Irecv(procslots[index].controlbuffer[i], controllength, MPI_INT, datastreamids[i], CR_PROCESSCONTROL, MPI_COMM_WORLD, &controlrequests[i]);
+    }
+    waitReleasingSharedData(numdatastreams, datarequests, msgstatuses);
+    for(int i=0;i<numdatastreams;i++)
+    {
+      if(sharedsource[i] == 0)
+        MPI_Get_count(&(msgstatuses[i]), MPI_UNSIGNED_CHAR, &(procslots[index].datalengthbytes[i]));
+    }
+    waitReleasingSharedData(numdatastreams, controlrequests, msgstatuses);
+    MPI_Win_sync(sharedwindow);
+    for(int i=0;i<numdatastreams;i++)
+    {
+      if(sharedsource[i] != 0)
+      {
+        int controlcount;
+        MPI_Get_count(&(msgstatuses[i]), MPI_INT, &controlcount);
+        procslots[index].datalengthbytes[i] = procslots[index].controlbuffer[i][controlcount-1];
+        if(procslots[index].controlbuffer[i][controlcount-2] >= 0)
+        {
+          procslots[index].databuffer[i] = sharedsource[i] + procslots[index].controlbuffer[i][controlcount-2];
+          continue;
+        }
+        //the Datastream was still filling part of this range, so it sent a copy instead
+        if(sharedcopy[index][i] == 0)
+        {
+          sharedcopy[index][i] = vectorAlloc_u8(databytes);
+          estimatedbytes += databytes;
+        }
+        procslots[index].databuffer[i] = sharedcopy[index][i];
+        MPI_Irecv(procslots[index].databuffer[i], databytes, MPI_UNSIGNED_CHAR, datastreamids[i], CR_PROCESSDATA, MPI_COMM_WORLD, &datarequests[i]);
+        waitReleasingSharedData(1, &datarequests[i], &mpistatus);
+      }
+    }
+    procslots[index].threadsdonewithdata = 0;
+    sharedheld[index] = (numshared > 0);
   }
+  else
+  {
+    for(int i=0;i<numdatastreams;i++)
+    {
+      //cinfo << startl << "Core is about to post receive request for datastream " << i << endl;
+      //get data
+      MPI_Irecv(procslots[index].databuffer[i], databytes, MPI_UNSIGNED_CHAR, datastreamids[i], CR_PROCESSDATA, MPI_COMM_WORLD, &datarequests[i]);
+      //also receive the offsets and rates
+      MPI_Irecv(procslots[index].controlbuffer[i], controllength, MPI_INT, datastreamids[i], CR_PROCESSCONTROL, MPI_COMM_WORLD, &controlrequests[i]);
+    }
 
-  //wait for everything to arrive, store the length of the messages
-  MPI_Waitall(numdatastreams, datarequests, msgstatuses);
-  for(int i=0;i<numdatastreams;i++)
-    MPI_Get_count(&(msgstatuses[i]), MPI_UNSIGNED_CHAR, &(procslots[index].datalengthbytes[i]));
-  MPI_Waitall(numdatastreams, controlrequests, msgstatuses);
+    //wait for everything to arrive, store the length of the messages
+    MPI_Waitall(numdatastreams, datarequests, msgstatuses);
+    for(int i=0;i<numdatastreams;i++)
+      MPI_Get_count(&(msgstatuses[i]), MPI_UNSIGNED_CHAR, &(procslots[index].datalengthbytes[i]));
+    MPI_Waitall(numdatastreams, controlrequests, msgstatuses);
+  }
 
   //lock the next slot, unlock the one we just finished with
   for(int i=0;i<numprocessthreads;i++)
@@ -653,6 +1009,8 @@ int Core::receivedata(int index, bool * terminate)
     if(perr != 0)
       csevere << startl << "CORE " << mpiid << " error trying lock mutex " << (index+1)%RECEIVE_RING_LENGTH << endl;
   }
+  //the processing threads are done with the next slot, so any Datastream data it refers to can be reused
+  releaseSharedData((index+1)%RECEIVE_RING_LENGTH);
 
   for(int i=0;i<numprocessthreads;i++)
   {
@@ -664,6 +1022,56 @@ int Core::receivedata(int index, bool * terminate)
   return 1;
 }
 
+void Core::releaseSharedData(int index)
+{
+  if(sharedheld == 0 || !sharedheld[index])
+    return;
+
+  for(int i=0;i<numdatastreams;i++)
+  {
+    //a copy is released by the Datastream as soon as it has been received
+    if(sharedsource[i] != 0 && procslots[index].databuffer[i] != sharedcopy[index][i])
+      MPI_Send(0, 0, MPI_INT, datastreamids[i], CR_RELEASEDATA, MPI_COMM_WORLD);
+  }
+  sharedheld[index] = false;
+}
+
+void Core::waitReleasingSharedData(int count, MPI_Request * requests, MPI_Status * statuses)
+{
+  int flag = 0;
+
+  if(numshared == 0)
+  {
+    MPI_Waitall(count, requests, statuses);
+    return;
+  }
+
+  //a Datastream may not be able to send anything more (to us, or to the Core the FxManager is waiting on) until
+  //we give back data we still hold, so keep releasing data as the processing threads finish with it - but don't
+  //take a CPU away from them while there is nothing to do
+  while(!flag)
+  {
+    MPI_Testall(count, requests, &flag, statuses);
+    if(!flag && releaseFinishedSharedData() == 0)
+      usleep(10);
+  }
+}
+
+int Core::releaseFinishedSharedData()
+{
+  int released = 0;
+
+  for(int i=0;i<RECEIVE_RING_LENGTH;i++)
+  {
+    if(sharedheld[i] && __sync_fetch_and_add(&(procslots[i].threadsdonewithdata), 0) == numprocessthreads)
+    {
+      releaseSharedData(i);
+      released++;
+    }
+  }
+  return released;
+}
+
 void Core::processdata(int index, int threadid, int startblock, int numblocks, Mode ** modes, Polyco * currentpolyco, threadscratchspace * scratchspace)
 {
 #ifndef NEUTERED_DIFX
@@ -673,7 +1081,7 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
   int acblockcount, maxacblocks, acshiftcount;
   int freqchannels;
   int xmacstridelength, xmacpasses, xmacstart, destbin, destchan, localfreqindex;
-  int dsfreqindex;
+  int dsfreqindex, l, seglength;
   char papol;
   double offsetmins, blockns;
   f32 bweight;
@@ -681,6 +1089,8 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
   const Mode * m1, * m2;
   const cf32 * vis1;
   const cf32 * vis2;
+  const BinSegment * segments;
+  const s32 * firstsegment;
   double sampletimens;
   int starttimens;
   int fftsize;
@@ -712,6 +1122,7 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
     modes[j]->setDumpKurtosis(scratchspace->dumpkurtosis);
     if(scratchspace->dumpkurtosis)
       modes[j]->zeroKurtosis();
+    modes[j]->setRFIExcision((skwindow > 0) ? skwindow : numBufferedFFTs, skthreshold);
     
     //reset pcal
     if(config->getDPhaseCalIntervalMHz(procslots[index].configindex, j) > 0)
@@ -808,6 +1219,8 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
         modes[j]->process(i, fftsubloop);
         numfftsprocessed++;
       }
+      //excise RFI before anything is cross-multiplied
+      modes[j]->exciseRFI(numfftsprocessed);
     }
 
     //if necessary, work out the pulsar bins
@@ -818,6 +1231,12 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
         i = fftloop*numBufferedFFTs + fftsubloop + startblock;
         offsetmins = ((double)i)*blockns/60000000000.0;
         currentpolyco->getBins(offsetmins, scratchspace->bins[fftsubloop]);
+        //group the channels into runs that fall in the same bin, for the cross-multiply below
+        for(int f=0;f<config->getFreqTableLength();f++)
+        {
+          if(config->isFrequencyUsed(procslots[index].configindex, f))
+            findBinSegments(scratchspace->bins[fftsubloop][f], config->getFNumChannels(f), xmacstridelength, scratchspace->binsegments[fftsubloop][f], scratchspace->firstbinsegment[fftsubloop][f]);
+        }
       }
     }
 
@@ -890,6 +1309,18 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
           if(xmacstrideremain < 0)
             continue;
 
+          //reduced precision if requested, otherwise tiled over baselines if enabled - pulsar binning is left to the plain loop below
+          if(config->getXmacPrecision(procslots[index].configindex) == Configuration::XMACCS16 && !procslots[index].pulsarbin)
+          {
+            resultindex = crossMultiplyCS16(index, f, xmacstart, xmacstrideremain, resultindex, fftloop*numBufferedFFTs + startblock, startblock+numblocks, modes, scratchspace);
+            continue;
+          }
+          if(xmactilebytes > 0 && !procslots[index].pulsarbin)
+          {
+            resultindex = crossMultiplyTiled(index, f, xmacstart, xmacstrideremain, resultindex, fftloop*numBufferedFFTs + startblock, startblock+numblocks, modes, scratchspace);
+            continue;
+          }
+
           //do the cross multiplication - gets messy for the pulsar binning
           for(int j=0;j<numbaselines;j++)
           {
@@ -921,44 +1352,67 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
                   weight1 = m1->getDataWeight(config->getBDataStream1RecordBandIndex(procslots[index].configindex, j, localfreqindex, p), fftsubloop);
                   weight2 = m2->getDataWeight(config->getBDataStream2RecordBandIndex(procslots[index].configindex, j, localfreqindex, p), fftsubloop);
 
-                  if(procslots[index].pulsarbin)
+                  if(procslots[index].pulsarbin && !useBinSegments(scratchspace->firstbinsegment[fftsubloop][f][x+1] - scratchspace->firstbinsegment[fftsubloop][f][x], xmacstrideremain))
                   {
-                    //multiply into scratch space
+                    //the runs are too short to be worth a vector call each, so multiply into scratch space
                     status = vectorMul_cf32(vis1, vis2, scratchspace->pulsarscratchspace, xmacstrideremain);
                     if(status != vecNoErr)
                       csevere << startl << "Error trying to xmac baseline " << j << " frequency " << localfreqindex << " polarisation product " << p << ", status " << status << endl;
 
-                    //if scrunching, add into temp accumulate space, otherwise add into normal space
-                    if(procslots[index].scrunchoutput)
+                    //then add each channel into its bin; if scrunching, into temp accumulate space, otherwise into normal space
+                    bweight = weight1*weight2/freqchannels;
+                    destchan = xmacstart;
+                    for(int l=0;l<xmacstrideremain;l++)
                     {
-                      bweight = weight1*weight2/freqchannels;
-                      destchan = xmacstart;
-                      for(int l=0;l<xmacstrideremain;l++)
+                      destbin = scratchspace->bins[fftsubloop][f][destchan++];
+                      if(procslots[index].scrunchoutput)
                       {
+                        if(binweights[destbin] == 0.0)
+                          continue;
                         //the first zero (the source slot) is because we are limiting to one pulsar ephemeris for now
-                        destbin = scratchspace->bins[fftsubloop][f][destchan];
                         scratchspace->pulsaraccumspace[f][x][j][0][p][destbin][l].re += scratchspace->pulsarscratchspace[l].re;
                         scratchspace->pulsaraccumspace[f][x][j][0][p][destbin][l].im += scratchspace->pulsarscratchspace[l].im;
                         scratchspace->baselineweight[f][0][j][p] += bweight*binweights[destbin];
-                        destchan++;
                       }
-                    }
-                    else
-                    {
-                      bweight = weight1*weight2/freqchannels;
-                      destchan = xmacstart;
-                      for(int l=0;l<xmacstrideremain;l++)
+                      else
                       {
-                        destbin = scratchspace->bins[fftsubloop][f][destchan];
-                        //cindex = resultindex + (scratchspace->bins[freqindex][destchan]*config->getBNumPolProducts(procslots[index].configindex,j,localfreqindex) + p)*(freqchannels+1) + destchan;
                         cindex = resultindex + (destbin*config->getBNumPolProducts(procslots[index].configindex,j,localfreqindex) + p)*xmacstridelength + l;
                         scratchspace->threadcrosscorrs[cindex].re += scratchspace->pulsarscratchspace[l].re;
                         scratchspace->threadcrosscorrs[cindex].im += scratchspace->pulsarscratchspace[l].im;
                         scratchspace->baselineweight[f][destbin][j][p] += bweight;
-                        destchan++;
                       }
                     }
                   }
+                  else if(procslots[index].pulsarbin)
+                  {
+                    //cross multiply each run of channels that share a bin straight into that bin
+                    segments = scratchspace->binsegments[fftsubloop][f];
+                    firstsegment = scratchspace->firstbinsegment[fftsubloop][f];
+                    bweight = weight1*weight2/freqchannels;
+                    for(int s=firstsegment[x];s<firstsegment[x+1];s++)
+                    {
+                      destbin = segments[s].bin;
+                      l = segments[s].start - xmacstart;
+                      seglength = segments[s+1].start - segments[s].start;
+                      if(procslots[index].scrunchoutput)
+                      {
+                        //bins that are gated out contribute nothing when the bins are scrunched together
+                        if(binweights[destbin] == 0.0)
+                          continue;
+                        //the first zero (the source slot) is because we are limiting to one pulsar ephemeris for now
+                        status = vectorAddProduct_cf32(&(vis1[l]), &(vis2[l]), &(scratchspace->pulsaraccumspace[f][x][j][0][p][destbin][l]), seglength);
+                        scratchspace->baselineweight[f][0][j][p] += bweight*binweights[destbin]*seglength;
+                      }
+                      else
+                      {
+                        cindex = resultindex + (destbin*config->getBNumPolProducts(procslots[index].configindex,j,localfreqindex) + p)*xmacstridelength + l;
+                        status = vectorAddProduct_cf32(&(vis1[l]), &(vis2[l]), &(scratchspace->threadcrosscorrs[cindex]), seglength);
+                        scratchspace->baselineweight[f][destbin][j][p] += bweight*seglength;
+                      }
+                      if(status != vecNoErr)
+                        csevere << startl << "Error trying to xmac baseline " << j << " frequency " << localfreqindex << " polarisation product " << p << " bin " << destbin << ", status " << status << endl;
+                    }
+                  }
                   else
                   {
                     //not pulsar binning, so this is nice and simple - just cross multiply accumulate
@@ -1120,6 +1574,9 @@ void Core::processdata(int index, int threadid, int startblock, int numblocks, M
 //end the cutout of processing in "Neutered DiFX"
 #endif
 
+  //the main thread may now give any data read directly from the Datastreams' shared memory back to them
+  __sync_fetch_and_add(&(procslots[index].threadsdonewithdata), 1);
+
   //grab the next slot lock
   perr = pthread_mutex_lock(&(procslots[(index+1)%RECEIVE_RING_LENGTH].slotlocks[threadid]));
   if(perr != 0)
@@ -1166,22 +1623,226 @@ void Core::copyPCalTones(int index, int threadid, Mode ** modes)
     csevere << startl << "PROCESSTHREAD " << mpiid << "/" << threadid << " error trying unlock pcal copy mutex!!!" << endl;
 }
 
+int Core::setXmacResultOffsets(int configindex, int freqindex, int resultindex, int * resultoffsets)
+{
+  int localfreqindex;
+  int xmacstridelength = config->getXmacStrideLength(configindex);
+
+  for(int j=0;j<numbaselines;j++)
+  {
+    localfreqindex = config->getBLocalFreqIndex(configindex, j, freqindex);
+    if(localfreqindex >= 0)
+    {
+      resultoffsets[j] = resultindex;
+      resultindex += config->getBNumPolProducts(configindex, j, localfreqindex)*xmacstridelength;
+    }
+    else
+      resultoffsets[j] = -1;
+  }
+
+  return resultindex;
+}
+
+int Core::crossMultiplyTiled(int index, int freqindex, int xmacstart, int xmacstrideremain, int resultindex, int firstfft, int lastfft, Mode ** modes, threadscratchspace * scratchspace)
+{
+  int status, localfreqindex, numpolproducts, xmacstridelength, numBufferedFFTs, configindex;
+  int tilestart, tileend, tilebytes, baselinebytes;
+  const Mode * m1, * m2;
+  const cf32 * vis1;
+  const cf32 * vis2;
+  int * resultoffsets = scratchspace->xmacresultoffsets;
+
+  configindex = procslots[index].configindex;
+  xmacstridelength = config->getXmacStrideLength(configindex);
+  numBufferedFFTs = config->getNumBufferedFFTs(configindex);
+  if(lastfft > firstfft + numBufferedFFTs)
+    lastfft = firstfft + numBufferedFFTs; //may not have to fully complete last fftloop
+
+  resultindex = setXmacResultOffsets(configindex, freqindex, resultindex, resultoffsets);
+  if(xmacstrideremain <= 0)
+    return resultindex; //nothing to multiply, but the (zero padded) output slots are still reserved
+
+  //walk through the baselines a tile at a time
+  tilestart = 0;
+  while(tilestart < numbaselines)
+  {
+    //grow the tile until its accumulators would exceed the cache budget (always at least one baseline)
+    tilebytes = 0;
+    tileend = tilestart;
+    while(tileend < numbaselines)
+    {
+      baselinebytes = 0;
+      if(resultoffsets[tileend] >= 0)
+        baselinebytes = config->getBNumPolProducts(configindex, tileend, config->getBLocalFreqIndex(configindex, tileend, freqindex))*xmacstrideremain*sizeof(cf32);
+      if(tileend > tilestart && tilebytes + baselinebytes > xmactilebytes)
+        break;
+      tilebytes += baselinebytes;
+      tileend++;
+    }
+
+    //with the FFTs outermost, each station spectrum stays in cache while it is used by all of its baselines in the tile
+    for(int i=firstfft;i<lastfft;i++)
+    {
+      int fftsubloop = i - firstfft;
+      for(int j=tilestart;j<tileend;j++)
+      {
+        if(resultoffsets[j] < 0)
+          continue;
+        localfreqindex = config->getBLocalFreqIndex(configindex, j, freqindex);
+        numpolproducts = config->getBNumPolProducts(configindex, j, localfreqindex);
+        m1 = modes[config->getBOrderedDataStream1Index(configindex, j)];
+        m2 = modes[config->getBOrderedDataStream2Index(configindex, j)];
+        for(int p=0;p<numpolproducts;p++)
+        {
+          vis1 = &(m1->getFreqs(config->getBDataStream1BandIndex(configindex, j, localfreqindex, p), fftsubloop)[xmacstart]);
+          vis2 = &(m2->getConjugatedFreqs(config->getBDataStream2BandIndex(configindex, j, localfreqindex, p), fftsubloop)[xmacstart]);
+          status = vectorAddProduct_cf32(vis1, vis2, &(scratchspace->threadcrosscorrs[resultoffsets[j]+p*xmacstridelength]), xmacstrideremain);
+          if(status != vecNoErr)
+            csevere << startl << "Error trying to xmac baseline " << j << " frequency " << localfreqindex << " polarisation product " << p << ", status " << status << endl;
+        }
+      }
+    }
+    tilestart = tileend;
+  }
+
+  return resultindex;
+}
+
+int Core::crossMultiplyCS16(int index, int freqindex, int xmacstart, int xmacstrideremain, int resultindex, int firstfft, int lastfft, Mode ** modes, threadscratchspace * scratchspace)
+{
+  int status, localfreqindex, numpolproducts, xmacstridelength, numBufferedFFTs, configindex;
+  int numffts, numslots, numkeys, packedlength, slot, slot1, slot2, ds1index, ds2index;
+  f32 maxabs, slotmax, quantlevel;
+  const cf32 * spectrum;
+  s16 * packed1;
+  s16 * packed2;
+  int * resultoffsets = scratchspace->xmacresultoffsets;
+  int * slots = scratchspace->xmacpackslots;
+
+  configindex = procslots[index].configindex;
+  xmacstridelength = config->getXmacStrideLength(configindex);
+  numBufferedFFTs = config->getNumBufferedFFTs(configindex);
+  if(lastfft > firstfft + numBufferedFFTs)
+    lastfft = firstfft + numBufferedFFTs; //may not have to fully complete last fftloop
+  numffts = lastfft - firstfft;
+
+  resultindex = setXmacResultOffsets(configindex, freqindex, resultindex, resultoffsets);
+  if(xmacstrideremain <= 0 || numffts <= 0)
+    return resultindex; //nothing to multiply, but the (zero padded) output slots are still reserved
+
+  //work out which station spectra are needed, giving each (datastream, band, conjugated or not) a slot
+  numkeys = numdatastreams*maxdatastreambands*2;
+  for(int k=0;k<numkeys;k++)
+    slots[k] = -1;
+  numslots = 0;
+  for(int j=0;j<numbaselines;j++)
+  {
+    if(resultoffsets[j] < 0)
+      continue;
+    localfreqindex = config->getBLocalFreqIndex(configindex, j, freqindex);
+    ds1index = config->getBOrderedDataStream1Index(configindex, j);
+    ds2index = config->getBOrderedDataStream2Index(configindex, j);
+    for(int p=0;p<config->getBNumPolProducts(configindex, j, localfreqindex);p++)
+    {
+      slot1 = (ds1index*maxdatastreambands + config->getBDataStream1BandIndex(configindex, j, localfreqindex, p))*2;
+      slot2 = (ds2index*maxdatastreambands + config->getBDataStream2BandIndex(configindex, j, localfreqindex, p))*2 + 1;
+      if(slots[slot1] < 0)
+        slots[slot1] = numslots++;
+      if(slots[slot2] < 0)
+        slots[slot2] = numslots++;
+    }
+  }
+
+  packedlength = numslots*numBufferedFFTs*2*xmacstridelength;
+  if(packedlength > scratchspace->xmacpackedlength)
+  {
+    if(scratchspace->xmacpacked != 0)
+      vectorFree(scratchspace->xmacpacked);
+    scratchspace->xmacpacked = vectorAlloc_s16(packedlength);
+    threadbytes[scratchspace->threadid] += 2*(packedlength - scratchspace->xmacpackedlength);
+    scratchspace->xmacpackedlength = packedlength;
+  }
+
+  //leave enough headroom that numffts products of two values of at most quantlevel can't overflow an s32
+  quantlevel = floor(sqrt(2147483647.0/(2.0*numffts)));
+  if(quantlevel > 32767)
+    quantlevel = 32767;
+
+  //pack each needed spectrum, scaled so its largest component over this batch of FFTs is quantlevel
+  for(int k=0;k<numkeys;k++)
+  {
+    slot = slots[k];
+    if(slot < 0)
+      continue;
+    slotmax = 0.0;
+    for(int fftsubloop=0;fftsubloop<numffts;fftsubloop++)
+    {
+      if(k%2 == 0)
+        spectrum = &(modes[k/(2*maxdatastreambands)]->getFreqs((k/2)%maxdatastreambands, fftsubloop)[xmacstart]);
+      else
+        spectrum = &(modes[k/(2*maxdatastreambands)]->getConjugatedFreqs((k/2)%maxdatastreambands, fftsubloop)[xmacstart]);
+      simdMaxAbs_32f((const f32*)spectrum, 2*xmacstrideremain, &maxabs);
+      if(maxabs > slotmax)
+        slotmax = maxabs;
+    }
+    scratchspace->xmacpackscales[slot] = (slotmax > 0.0)?quantlevel/slotmax:1.0;
+    for(int fftsubloop=0;fftsubloop<numffts;fftsubloop++)
+    {
+      if(k%2 == 0)
+        spectrum = &(modes[k/(2*maxdatastreambands)]->getFreqs((k/2)%maxdatastreambands, fftsubloop)[xmacstart]);
+      else
+        spectrum = &(modes[k/(2*maxdatastreambands)]->getConjugatedFreqs((k/2)%maxdatastreambands, fftsubloop)[xmacstart]);
+      simdConvertScale_32f16s((const f32*)spectrum, scratchspace->xmacpackscales[slot], &(scratchspace->xmacpacked[(slot*numBufferedFFTs + fftsubloop)*2*xmacstridelength]), 2*xmacstrideremain);
+    }
+  }
+
+  //integer accumulation over the buffered FFTs, widened into the float results once per stride
+  for(int j=0;j<numbaselines;j++)
+  {
+    if(resultoffsets[j] < 0)
+      continue;
+    localfreqindex = config->getBLocalFreqIndex(configindex, j, freqindex);
+    numpolproducts = config->getBNumPolProducts(configindex, j, localfreqindex);
+    ds1index = config->getBOrderedDataStream1Index(configindex, j);
+    ds2index = config->getBOrderedDataStream2Index(configindex, j);
+    for(int p=0;p<numpolproducts;p++)
+    {
+      slot1 = slots[(ds1index*maxdatastreambands + config->getBDataStream1BandIndex(configindex, j, localfreqindex, p))*2];
+      slot2 = slots[(ds2index*maxdatastreambands + config->getBDataStream2BandIndex(configindex, j, localfreqindex, p))*2 + 1];
+      packed1 = &(scratchspace->xmacpacked[slot1*numBufferedFFTs*2*xmacstridelength]);
+      packed2 = &(scratchspace->xmacpacked[slot2*numBufferedFFTs*2*xmacstridelength]);
+      vectorZero_s32(scratchspace->xmacintaccum, 2*xmacstrideremain);
+      for(int fftsubloop=0;fftsubloop<numffts;fftsubloop++)
+        simdAddProduct_16sc32sc(&(packed1[fftsubloop*2*xmacstridelength]), &(packed2[fftsubloop*2*xmacstridelength]), scratchspace->xmacintaccum, xmacstrideremain);
+      status = simdConvertScaleAdd_32s32f(scratchspace->xmacintaccum, (f32)(1.0/((double)scratchspace->xmacpackscales[slot1]*scratchspace->xmacpackscales[slot2])), (f32*)&(scratchspace->threadcrosscorrs[resultoffsets[j]+p*xmacstridelength]), 2*xmacstrideremain);
+      if(status != vecNoErr)
+        csevere << startl << "Error trying to xmac baseline " << j << " frequency " << localfreqindex << " polarisation product " << p << ", status " << status << endl;
+    }
+  }
+
+  return resultindex;
+}
+
 void Core::averageAndSendAutocorrs(int index, int threadid, double nsoffset, double nswidth, Mode ** modes, threadscratchspace * scratchspace)
 {
-  int maxproducts, resultindex, perr, status, bytecount, recordsize;
-  int freqindex, localfreqindex, parentfreqindex, numrecordedbands, chans_to_avg, freqchannels;
-  double minimumweight, stasamples;
-  float renormvalue;
+  int maxproducts, resultindex, perr, status, bytecount, recordsize, spectrumchannels;
+  int freqindex, localfreqindex, parentfreqindex, numrecordedbands, freqchannels;
+  long long recordnumber;
   bool datastreamsaveraged, writecrossautocorrs;
-  f32 * acdata;
   DifxMessageSTARecord * starecord;
+  FilterbankRecord * fbrecord;
 
   datastreamsaveraged = false;
   writecrossautocorrs = modes[0]->writeCrossAutoCorrs();
   maxproducts = config->getMaxProducts();
 
-  //if STA send needed but we can average datastream results in freq first, do so
-  if(scratchspace->dumpsta && config->getMinPostAvFreqChannels(procslots[index].configindex) >= config->getSTADumpChannels())
+  //if STA send or filterbank records needed but we can average datastream results in freq first, do so
+  spectrumchannels = 0;
+  if(scratchspace->dumpsta)
+    spectrumchannels = config->getSTADumpChannels();
+  if(filterbankring && filterbankring->getNumChannels() > spectrumchannels)
+    spectrumchannels = filterbankring->getNumChannels();
+  if(spectrumchannels > 0 && config->getMinPostAvFreqChannels(procslots[index].configindex) >= spectrumchannels)
   {
     for(int i=0;i<numdatastreams;i++) {
       modes[i]->averageFrequency();
@@ -1207,7 +1868,6 @@ void Core::averageAndSendAutocorrs(int index, int threadid, double nsoffset, dou
         starecord->coreindex = mpiid - (config->getNumDataStreams()+1);
         starecord->threadindex = threadid;
         sprintf(starecord->identifier, "%s", config->getJobName().substr(0,DIFX_MESSAGE_PARAM_LENGTH-1).c_str());
-        starecord->nChan = config->getSTADumpChannels();
         starecord->scan = procslots[index].offsets[0];
         starecord->sec = model->getScanStartSec(procslots[index].offsets[0], startmjd, startseconds) + procslots[index].offsets[1];
         starecord->ns = procslots[index].offsets[2] + int(nsoffset);
@@ -1216,42 +1876,11 @@ void Core::averageAndSendAutocorrs(int index, int threadid, double nsoffset, dou
           starecord->sec++;
         }
         starecord->nswidth = int(nswidth);
-        freqindex = config->getDRecordedFreqIndex(procslots[index].configindex, i, j);
-        freqchannels = config->getFNumChannels(freqindex);
-        stasamples = 0.001*nswidth*2*config->getFreqTableBandwidth(freqindex);
-        minimumweight = MINIMUM_FILTERBANK_WEIGHT*stasamples/(2*freqchannels);
-        if(modes[i]->getWeight(false, j) < minimumweight) {
-          continue; //dodgy packet, less than 1/3 of normal data, so don't send it
-        }
-
-        // normalise the STA data to maintain units of power spectral density. This means dividing by
-        // the number of channels (since we use an un-normalised FFT) and the number of integrations (i.e. time)
-        // which is the weight
-        renormvalue = 1.0/(2*freqchannels*modes[i]->getWeight(false, j));
-        
-        if(datastreamsaveraged) {
-          // if the data has been averaged above, then we need to adjust normalisation factor
-          // because channels are summed below, not averaged
-          renormvalue /= config->getFChannelsToAverage(freqindex);
-          freqchannels /= config->getFChannelsToAverage(freqindex);
-        }
-
-        // in the unlikely case that we want more STA channels than are actually present.
-        if (freqchannels < starecord->nChan)
-          starecord->nChan = freqchannels;
-        // how many channels to average here for STA dumps
-        chans_to_avg = freqchannels/starecord->nChan;
-
         starecord->bandindex = j;
-        acdata = (f32*)(modes[i]->getAutocorrelation(false, j));
-        for (int k=0;k<starecord->nChan;k++) {
-          starecord->data[k] = acdata[2*k*chans_to_avg];
-          for (int l=1;l<chans_to_avg;l++)
-            starecord->data[k] += acdata[2*(k*chans_to_avg+l)];
+        starecord->nChan = getFilterbankSpectrum(index, i, j, nswidth, config->getSTADumpChannels(), datastreamsaveraged, modes, starecord->data);
+        if(starecord->nChan == 0) {
+          continue; //dodgy packet, less than 1/3 of normal data, so don't send it
         }
-        status = vectorMulC_f32_I(renormvalue, starecord->data, starecord->nChan);
-        if(status != vecNoErr)
-          cerror << startl << "Error converting filterbank data from energy to power!" << endl;
         //cout << "About to send the binary message" << endl;
         bytecount += sizeof(DifxMessageSTARecord) + sizeof(f32)*starecord->nChan;
       }
@@ -1260,6 +1889,30 @@ void Core::averageAndSendAutocorrs(int index, int threadid, double nsoffset, dou
     //cout << "Finished doing some STA stuff" << endl;
   }
 
+  //if required, write the same spectra (at the ring's resolution) straight into the filterbank ring
+  //dodgy data still gets a record, with no channels, so readers know not to wait for it
+  if(filterbankring) {
+    for (int i=0;i<numdatastreams;i++) {
+      for (int j=0;j<config->getDNumRecordedBands(procslots[index].configindex, i);j++) {
+        freqindex = config->getDRecordedFreqIndex(procslots[index].configindex, i, j);
+        fbrecord = filterbankring->beginRecord(&recordnumber);
+        fbrecord->mjd = startmjd;
+        fbrecord->datastream = i;
+        fbrecord->seconds = startseconds + model->getScanStartSec(procslots[index].offsets[0], startmjd, startseconds) + procslots[index].offsets[1] + (procslots[index].offsets[2] + nsoffset)/1.0e9;
+        fbrecord->width = nswidth/1.0e9;
+        fbrecord->freq = config->getFreqTableFreq(freqindex);
+        fbrecord->bandwidth = config->getFreqTableBandwidth(freqindex);
+        fbrecord->band = j;
+        fbrecord->freqindex = freqindex;
+        fbrecord->lowersideband = config->getFreqTableLowerSideband(freqindex) ? 1 : 0;
+        fbrecord->polarisation = config->getDRecordedBandPol(procslots[index].configindex, i, j);
+        fbrecord->configindex = procslots[index].configindex;
+        fbrecord->numchannels = getFilterbankSpectrum(index, i, j, nswidth, filterbankring->getNumChannels(), datastreamsaveraged, modes, fbrecord->data);
+        filterbankring->commitRecord(fbrecord, recordnumber);
+      }
+    }
+  }
+
   //if required, average the datastreams down in frequency
   if(!datastreamsaveraged) {
     for(int i=0;i<numdatastreams;i++) {
@@ -1378,6 +2031,53 @@ void Core::averageAndSendAutocorrs(int index, int threadid, double nsoffset, dou
     csevere << startl << "PROCESSTHREAD " << mpiid << "/" << threadid << " error trying unlock acweight copy mutex!!!" << endl;
 }
 
+int Core::getFilterbankSpectrum(int index, int datastream, int band, double nswidth, int maxchannels, bool datastreamsaveraged, Mode ** modes, f32 * spectrum)
+{
+  int freqindex, freqchannels, numchannels, chans_to_avg, status;
+  double minimumweight, stasamples;
+  float renormvalue;
+  f32 * acdata;
+
+  freqindex = config->getDRecordedFreqIndex(procslots[index].configindex, datastream, band);
+  freqchannels = config->getFNumChannels(freqindex);
+  stasamples = 0.001*nswidth*2*config->getFreqTableBandwidth(freqindex);
+  minimumweight = MINIMUM_FILTERBANK_WEIGHT*stasamples/(2*freqchannels);
+  if(modes[datastream]->getWeight(false, band) < minimumweight) {
+    return 0; //dodgy packet, less than 1/3 of normal data
+  }
+
+  // normalise the STA data to maintain units of power spectral density. This means dividing by
+  // the number of channels (since we use an un-normalised FFT) and the number of integrations (i.e. time)
+  // which is the weight
+  renormvalue = 1.0/(2*freqchannels*modes[datastream]->getWeight(false, band));
+
+  if(datastreamsaveraged) {
+    // if the data has been averaged above, then we need to adjust normalisation factor
+    // because channels are summed below, not averaged
+    renormvalue /= config->getFChannelsToAverage(freqindex);
+    freqchannels /= config->getFChannelsToAverage(freqindex);
+  }
+
+  // in the unlikely case that we want more STA channels than are actually present.
+  numchannels = maxchannels;
+  if (freqchannels < numchannels)
+    numchannels = freqchannels;
+  // how many channels to average here for STA dumps
+  chans_to_avg = freqchannels/numchannels;
+
+  acdata = (f32*)(modes[datastream]->getAutocorrelation(false, band));
+  for (int k=0;k<numchannels;k++) {
+    spectrum[k] = acdata[2*k*chans_to_avg];
+    for (int l=1;l<chans_to_avg;l++)
+      spectrum[k] += acdata[2*(k*chans_to_avg+l)];
+  }
+  status = vectorMulC_f32_I(renormvalue, spectrum, numchannels);
+  if(status != vecNoErr)
+    cerror << startl << "Error converting filterbank data from energy to power!" << endl;
+
+  return numchannels;
+}
+
 void Core::averageAndSendKurtosis(int index, int threadid, double nsoffset, double nswidth, int numblocks, Mode ** modes, threadscratchspace * scratchspace)
 {
   int status, freqchannels, freqindex, recordsize, bytecount;
@@ -1608,11 +2308,11 @@ void Core::uvshiftAndAverage(int index, int threadid, double nsoffset, double ns
 void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffset, double nswidth, threadscratchspace * scratchspace, int freqindex, int baseline)
 {
   int status, perr, threadbinloop, threadindex, threadstart, numstrides;
-  int localfreqindex, targetfreqindex, freqchannels, targetfreqchannels, coreindex, coreoffset, corebinloop, channelinc, targetchannelinc, rotatorlength, coredest;
-  int antenna1index, antenna2index;
-  int rotatestridelen, rotatesperstride, xmacstridelen, xmaccopylen, xmacstrideremain, stridestoaverage, averagesperstride, averagelength, outchannelplacementpreavg;
-  double bandwidth, bandwidthoftarget, lofrequency, channelbandwidth, stepbandwidth;
-  double applieddelay, applieddelay1, applieddelay2, turns, edgeturns;
+  int localfreqindex, targetfreqindex, freqchannels, targetfreqchannels, coreindex, coreoffset, corebinloop, channelinc, targetchannelinc, coredest;
+  int antenna1index, antenna2index, numphasecentres, phasecentrestride;
+  int rotatestridelen, xmacstridelen, xmacstrideremain, stridestoaverage, averagesperstride, averagelength, outchannelplacementpreavg;
+  double bandwidth, bandwidthoftarget, lofrequency, channelbandwidth;
+  double applieddelay1, applieddelay2;
   double delaywindow, maxphasechange, timesmeardecorr, delaydecorr;
   double pointingcentredelay1approx[2];
   double pointingcentredelay2approx[2];
@@ -1620,8 +2320,8 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
   double ** phasecentredelay2 = 0;
   double ** differentialdelay = 0;
   cf32* srcpointer;
+  bool rotate;
 
-  applieddelay = 0.0;
   delaywindow = config->getFNumChannels(freqindex)/(config->getFreqTableBandwidth(freqindex)); //max lag (plus and minus)
   localfreqindex = config->getBLocalFreqIndex(procslots[index].configindex, baseline, freqindex);
   xmacstridelen = config->getXmacStrideLength(procslots[index].configindex);
@@ -1683,7 +2383,6 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
   bandwidthoftarget = config->getFreqTableBandwidth(targetfreqindex);
   lofrequency = config->getFreqTableFreq(freqindex);
   stridestoaverage = channelinc/xmacstridelen;
-  rotatesperstride = xmacstridelen/rotatestridelen;
   if(stridestoaverage == 0)
     stridestoaverage = 1;
   averagesperstride = xmacstridelen/channelinc;
@@ -1697,26 +2396,14 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
   assert(targetfreqchannels == (int)(0.5 + (bandwidthoftarget / bandwidth)*freqchannels));
   assert(targetchannelinc == channelinc); // required for the old striding logic to work out... TODO?: allow multi-stage averaging?
 
-  rotatorlength = rotatestridelen+numstrides*rotatesperstride;
-  stepbandwidth = rotatestridelen*channelbandwidth;
-  if(model->getNumPhaseCentres(procslots[index].offsets[0]) > 1)
+  numphasecentres = model->getNumPhaseCentres(procslots[index].offsets[0]);
+  if(numphasecentres > 1)
   {
+    //channel n of the band is at lofrequency + firstchanneloffset + n*channelbandwidth
     if(config->getFreqTableLowerSideband(freqindex))
-    {
-      for(int c=0;c<rotatestridelen;c++)
-        scratchspace->chanfreqs[c] = -(rotatestridelen-(c+1))*channelbandwidth;
-      for(int c=0;c<numstrides*rotatesperstride;c++)
-        scratchspace->chanfreqs[rotatestridelen+c] = -(numstrides*rotatesperstride-(c+1))*stepbandwidth;
-    }
+      scratchspace->phasecentrerotator->setBand(lofrequency, -(numstrides*xmacstridelen-1)*channelbandwidth, channelbandwidth, rotatestridelen);
     else
-    {
-      for(int c=0;c<rotatestridelen;c++) {
-        scratchspace->chanfreqs[c] = c*channelbandwidth;
-      }
-      for(int c=0;c<numstrides*rotatesperstride;c++) {
-        scratchspace->chanfreqs[rotatestridelen+c] = c*stepbandwidth;
-      }
-    }
+      scratchspace->phasecentrerotator->setBand(lofrequency, 0.0, channelbandwidth, rotatestridelen);
   }
 
   //lock the mutex for this segment of the copying
@@ -1726,59 +2413,32 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
 
   //get index into procslot::results[<out>] to concatenate spectra of phase centers, bins, and polzns there
   coreindex = config->getCoreResultBaselineOffset(procslots[index].configindex, freqindex, baseline);
+  //successive phase centres' output areas; note we stride by 'targetfreqchannels'>='freqchannels' since current freq may be nested within wider freq
+  phasecentrestride = corebinloop*config->getBNumPolProducts(procslots[index].configindex,baseline,localfreqindex)*targetfreqchannels/targetchannelinc;
+
+  threadstart = config->getThreadResultFreqOffset(procslots[index].configindex, freqindex) + config->getThreadResultBaselineOffset(procslots[index].configindex, freqindex, baseline);
+  //cout << "Threadstart is " << threadstart << " since threadresultfreqoffset is " << config->getThreadResultFreqOffset(procslots[index].configindex, freqindex) << endl;
+  //cout << "Core striding infos are: numXmac=" << config->getNumXmacStrides(procslots[index].configindex, freqindex) << " xmacLen=" << xmacstridelen <<
+  //        ", first bin avgs " << outchannelplacementpreavg % averagelength << "/" << averagelength << " values" << endl;
 
   //collect spectra data from threadcrosscorrs etc, do the multi-phasecenter rotation (if necessary), spectral averaging (if necessary) and concatenation to Core procslot::results[]
-  for(int s=0;s<model->getNumPhaseCentres(procslots[index].offsets[0]);s++)
+  //each centre's output is written in order, while this baseline's visibilities stay in cache from one centre to the next
+  for(int s=0;s<numphasecentres;s++)
   {
-    if(model->getNumPhaseCentres(procslots[index].offsets[0]) > 1)
+    rotate = false;
+    if(numphasecentres > 1)
     {
-      //work out the correct rotator for this frequency and phase centre
-      //cout << "phasecentredelay1[" << s << "] is " << phasecentredelay1[s][1] << endl;
-      //cout << "phasecentredelay2[" << s << "] is " << phasecentredelay2[s][1] << endl;
-      //cout << "pointingcentredelay1 is " << pointingcentredelay1 << endl;
-      //cout << "pointingcentredelay2 is " << pointingcentredelay2 << endl;
-      //applieddelay1 = phasecentredelay1[s][1] - pointingcentredelay1approx[1];
-      //applieddelay2 = phasecentredelay2[s][1] - pointingcentredelay2approx[1];
-      //make correction for geometric rate over the shifted sample range
-      //applieddelay1 += applieddelay1*pointingcentredelay1approx[0];
-      //applieddelay2 += applieddelay2*pointingcentredelay2approx[0];
-      //cout << "Applied delay is " << applieddelay2 - applieddelay1 << ", correction is " << applieddelay2 - applieddelay1 - saveddelay << endl;
-      //applieddelay = applieddelay2 - applieddelay1;
-      applieddelay = differentialdelay[s][1];
-      if(fabs(applieddelay) > 1.0e-20)
-      {
-        edgeturns = applieddelay*lofrequency;
-        edgeturns -= floor(edgeturns);
-        for(int r=0;r<rotatestridelen;r++)
-        {
-          turns = applieddelay*scratchspace->chanfreqs[r] + edgeturns;
-          scratchspace->argument[r] = (turns-floor(turns))*TWO_PI;
-        }
-        for(int r=rotatestridelen;r<rotatorlength;r++)
-        {
-          turns = applieddelay*scratchspace->chanfreqs[r];
-          scratchspace->argument[r] = (turns-floor(turns))*TWO_PI;
-        }
-        status = vectorSinCos_f32(scratchspace->argument, &(scratchspace->argument[rotatorlength]), &(scratchspace->argument[2*rotatorlength]), rotatorlength);
-        if(status != vecNoErr)
-          csevere << startl << "Error in phase shift, sin/cos!!!" << status << endl;
-        status = vectorRealToComplex_f32(&(scratchspace->argument[2*rotatorlength]), &(scratchspace->argument[rotatorlength]), scratchspace->rotator, rotatorlength);
-        if(status != vecNoErr)
-          csevere << startl << "Error in phase shift, real to complex!!!" << status << endl;
-      }
+      scratchspace->phasecentrerotator->setDelay(differentialdelay[s][1]);
+      rotate = scratchspace->phasecentrerotator->isShifted();
     }
-
-    threadstart = config->getThreadResultFreqOffset(procslots[index].configindex, freqindex) + config->getThreadResultBaselineOffset(procslots[index].configindex, freqindex, baseline);
-    //cout << "Threadstart is " << threadstart << " since threadresultfreqoffset is " << config->getThreadResultFreqOffset(procslots[index].configindex, freqindex) << endl;
-    //cout << "Core striding infos are: numXmac=" << config->getNumXmacStrides(procslots[index].configindex, freqindex) << " xmacLen=" << xmacstridelen <<
-    //        ", first bin avgs " << outchannelplacementpreavg % averagelength << "/" << averagelength << " values" << endl;
-
     for(int x=0;x<config->getNumXmacStrides(procslots[index].configindex, freqindex);x++)
     {
       threadindex = threadstart+x*config->getCompleteStrideLength(procslots[index].configindex, freqindex);
       xmacstrideremain = std::min(freqchannels-x*xmacstridelen, xmacstridelen);
       // if(xmacstrideremain <= 0) // note: since getNumXmacStrides() is a rounded-up value, there may be {xmaclen x '0'} to be concatenated per baseline to keep consistent with Configuration-assigned offsets
       //    break;
+      if(rotate)
+        scratchspace->phasecentrerotator->generate(x*xmacstridelen, xmacstridelen);
       for(int b=0;b<threadbinloop;b++)
       {
         for(int k=0;k<config->getBNumPolProducts(procslots[index].configindex,baseline,localfreqindex);k++)
@@ -1787,44 +2447,31 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
             coreoffset = ((b*config->getBNumPolProducts(procslots[index].configindex,baseline,localfreqindex)+k)*targetfreqchannels + x*xmacstridelen)/targetchannelinc;
           else
             coreoffset = (k*targetfreqchannels + x*xmacstridelen)/targetchannelinc;
-          if(model->getNumPhaseCentres(procslots[index].offsets[0]) > 1 && fabs(applieddelay) > 1.0e-20)
-          {
-            if(procslots[index].pulsarbin && procslots[index].scrunchoutput)
-              srcpointer = scratchspace->pulsaraccumspace[freqindex][x][baseline][0][k][b];
-            else
-              srcpointer = &(scratchspace->threadcrosscorrs[threadindex]);
-            //cout << "About to rotate from threadindex " << threadindex << " (cf max thread result length " << config->getMaxThreadResultLength() << ") for which the 10th offset re value is " << scratchspace->threadcrosscorrs[threadindex+10].re << endl;
-            for(int r=0;r<rotatesperstride;r++)
-            {
-              //atrotate = (r + x*rotatesperstride)*rotatestridelength;
-              //TODO / FIXME(?): introduce rotatestridelenremain instead of rotatestridelen
-              status = vectorMul_cf32(scratchspace->rotator, &(srcpointer[r*rotatestridelen]), &(scratchspace->rotated[r*rotatestridelen]), rotatestridelen);
-              if(status != vecNoErr)
-                csevere << startl << "Error in phase shift, multiplication1!!!" << status << endl;
-              status = vectorMulC_cf32_I(scratchspace->rotator[rotatestridelen+r+x*rotatesperstride], &(scratchspace->rotated[r*rotatestridelen]), rotatestridelen);
-              if(status != vecNoErr)
-                csevere << startl << "Error in phase shift, multiplication2!!!" << status << endl;
-            }
-            srcpointer = scratchspace->rotated;
-          }
+          if(procslots[index].pulsarbin && procslots[index].scrunchoutput)
+            srcpointer = scratchspace->pulsaraccumspace[freqindex][x][baseline][0][k][b];
           else
-          {
-            if(procslots[index].pulsarbin && procslots[index].scrunchoutput)
-              srcpointer = scratchspace->pulsaraccumspace[freqindex][x][baseline][0][k][b];
-            else
-              srcpointer = &(scratchspace->threadcrosscorrs[threadindex]);
-          }
+            srcpointer = &(scratchspace->threadcrosscorrs[threadindex]);
 
-          //spectrally average (or not) and accumulate from the designated pointer to the main result buffer
-          coredest = coreindex+coreoffset;
+          //rotate (if necessary), spectrally average (or not) and accumulate from the designated pointer to the main result buffer
+          coredest = coreindex + s*phasecentrestride + coreoffset;
           if(channelinc == 1) //this frequency is not averaged
           {
-            status = vectorAdd_cf32_I(srcpointer, &(procslots[index].results[coredest]), xmacstrideremain);
+            if(rotate)
+              status = vectorAddProduct_cf32(srcpointer, scratchspace->phasecentrerotator->getRotator(), &(procslots[index].results[coredest]), xmacstrideremain);
+            else
+              status = vectorAdd_cf32_I(srcpointer, &(procslots[index].results[coredest]), xmacstrideremain);
             if(status != vecNoErr)
               cerror << startl << "Error trying to copy frequency index " << freqindex << "-->" << targetfreqindex << ", baseline " << baseline << " when not averaging in frequency" << endl;
           }
           else //this frequency *is* averaged - deal with it
           {
+            if(rotate)
+            {
+              status = vectorMul_cf32(scratchspace->phasecentrerotator->getRotator(), srcpointer, scratchspace->rotated, xmacstrideremain);
+              if(status != vecNoErr)
+                csevere << startl << "Error in phase shift, multiplication!!!" << status << endl;
+              srcpointer = scratchspace->rotated;
+            }
             // Outputbands -- modified averaging step, to work for N:1 mapping; original d260 only works as-is for 1:1 mapping
             // TODO: xmacstride=2 avg=2 works, but xmacstride=2 avg=4 does not (even with d260 orignal code) - something with the striding must be buggy? maybe rotatestridelen?
 #if 1
@@ -1854,7 +2501,7 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
             }
 #else
             // DTrunk 07/2022, D260 -- original implementation (apart of 'cerror') of the averaging step, works as-is only for 1:1 outputbands
-            coredest = coreindex+coreoffset;
+            coredest = coreindex + s*phasecentrestride + coreoffset;
             for(int l=0;l<averagesperstride;l++)
             {
               //status = vectorMean_cf32(srcpointer + l*channelinc, channelinc, &(scratchspace->channelsums[l]), vecAlgHintFast);
@@ -1874,9 +2521,6 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
         }//for(getBNumPolProducts)
       }//for(bin)
     }//for(getNumXmacStrides)
-
-    //stride to next Phase Center output area; note we stride by 'targetfreqchannels'>='freqchannels' since current freq may be nested within wider freq
-    coreindex += corebinloop*config->getBNumPolProducts(procslots[index].configindex,baseline,localfreqindex)*targetfreqchannels/targetchannelinc;
   }//for(getNumPhaseCentres)
 
   //unlock the mutex for this segment of the copying
@@ -1938,7 +2582,7 @@ void Core::uvshiftAndAverageBaselineFreq(int index, int threadid, double nsoffse
   }
 }
 
-void Core::createPulsarVaryingSpace(cf32******* pulsaraccumspace, s32**** bins, int newconfigindex, int oldconfigindex, int threadid)
+void Core::createPulsarVaryingSpace(cf32******* pulsaraccumspace, s32**** bins, BinSegment**** binsegments, s32**** firstbinsegment, int newconfigindex, int oldconfigindex, int threadid)
 {
   int status, freqchannels, localfreqindex;
 
@@ -1955,11 +2599,18 @@ void Core::createPulsarVaryingSpace(cf32******* pulsaraccumspace, s32**** bins,
 	  freqchannels = config->getFNumChannels(f);
 	  vectorFree((*bins)[i][f]);
           threadbytes[threadid] -= 4*freqchannels;
+          delete [] (*binsegments)[i][f];
+          delete [] (*firstbinsegment)[i][f];
+          threadbytes[threadid] -= sizeof(BinSegment)*getMaxBinSegments(freqchannels, config->getXmacStrideLength(oldconfigindex)) + 4*(config->getNumXmacStrides(oldconfigindex, f) + 1);
 	}
       }
       delete [] (*bins)[i];
+      delete [] (*binsegments)[i];
+      delete [] (*firstbinsegment)[i];
     }
     delete [] *bins;
+    delete [] *binsegments;
+    delete [] *firstbinsegment;
     cdebug << startl << "Finished deleting old bins..." << endl;
     if(config->scrunchOutputOn(oldconfigindex))
     {
@@ -2004,9 +2655,13 @@ void Core::createPulsarVaryingSpace(cf32******* pulsaraccumspace, s32**** bins,
   if(newconfigindex >= 0 && config->pulsarBinOn(newconfigindex))
   {
     *bins = new s32**[config->getNumBufferedFFTs(newconfigindex)];
+    *binsegments = new BinSegment**[config->getNumBufferedFFTs(newconfigindex)];
+    *firstbinsegment = new s32**[config->getNumBufferedFFTs(newconfigindex)];
     for(int i=0;i<config->getNumBufferedFFTs(newconfigindex);i++)
     {
       (*bins)[i] = new s32*[config->getFreqTableLength()];
+      (*binsegments)[i] = new BinSegment*[config->getFreqTableLength()];
+      (*firstbinsegment)[i] = new s32*[config->getFreqTableLength()];
       for(int f=0;f<config->getFreqTableLength();f++)
       {
         if(config->isFrequencyUsed(newconfigindex, f))
@@ -2014,6 +2669,9 @@ void Core::createPulsarVaryingSpace(cf32******* pulsaraccumspace, s32**** bins,
 	  freqchannels = config->getFNumChannels(f);
           (*bins)[i][f] = vectorAlloc_s32(freqchannels);
 	  threadbytes[threadid] += 4*freqchannels;
+          (*binsegments)[i][f] = new BinSegment[getMaxBinSegments(freqchannels, config->getXmacStrideLength(newconfigindex))];
+          (*firstbinsegment)[i][f] = new s32[config->getNumXmacStrides(newconfigindex, f) + 1];
+          threadbytes[threadid] += sizeof(BinSegment)*getMaxBinSegments(freqchannels, config->getXmacStrideLength(newconfigindex)) + 4*(config->getNumXmacStrides(newconfigindex, f) + 1);
 	}
       }
     }
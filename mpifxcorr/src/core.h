@@ -32,6 +32,10 @@
 #include "configuration.h"
 #include "mode.h"
 #include "difxmessage.h"
+#include "numautil.h"
+#include "binsegments.h"
+#include "filterbankring.h"
+#include "phasecentrerotator.h"
 #include <pthread.h>
 
 /**
@@ -73,6 +77,16 @@ public:
   /// The minimum weight for filterbank STA data to be sent
   static const double MINIMUM_FILTERBANK_WEIGHT;
 
+  /// The default number of records in the filterbank ring (DIFX_FILTERBANK_RING), overridden by DIFX_FILTERBANK_SLOTS
+  static const int DEFAULT_FILTERBANK_SLOTS;
+
+  /// The default cache budget (kB) for a tile of baseline accumulators in the cross-multiply; overridden by DIFX_XMAC_TILE_KB
+  static const int DEFAULT_XMAC_TILE_KB;
+
+  /// With the put transport, the bytes at the start of a Core's landing window that describe its layout to the
+  /// Datastreams: slot stride in bytes, number of slots and number of datastreams, as three ints
+  static const int LANDING_HEADER_BYTES;
+
 protected:
  /** 
   * Launches a new processing thread, which will work on a portion of the time slice every time an element in the circular buffer is processed
@@ -105,6 +119,7 @@ private:
     pthread_mutex_t bweightcopylock;
     pthread_mutex_t acweightcopylock;
     pthread_mutex_t pcalcopylock;
+    int threadsdonewithdata; //shared transport: processing threads finished with the Datastream data (atomic)
   } processslot;
 
   ///Structure containing all of the pointers to scratch space for a single thread
@@ -113,13 +128,20 @@ private:
     f32 *** baselineshiftdecorr; //[freq][baseline][phasecentre]
     cf32 * threadcrosscorrs;
     s32 *** bins; //[fftsubloop][freq][channel]
-    cf32* pulsarscratchspace;
+    cf32* pulsarscratchspace; //[channel] products of one xmac stride, when its runs of channels are short
+    BinSegment *** binsegments; //[fftsubloop][freq][segment] runs of channels in the same bin, from bins
+    s32 *** firstbinsegment; //[fftsubloop][freq][xmacstride] index of the first run of each stride in binsegments
+    int * xmacresultoffsets; //[baseline] offset into threadcrosscorrs for the current freq/xmac stride, -1 if baseline doesn't use this freq
+    int * xmacpackslots; //[datastream][band][conjugated] slot in xmacpacked, -1 if not needed (CS16 xmac precision only)
+    f32 * xmacpackscales; //[slot] factor by which the packed spectra were scaled
+    s16 * xmacpacked; //[slot][fftsubloop][2*xmacstridelength] spectra for the current freq/xmac stride, packed to 16 bit complex
+    s32 * xmacintaccum; //[2*xmacstridelength] exact integer accumulator for one baseline/polproduct
+    int xmacpackedlength;
+    int threadid; //the processing thread owning this scratch space, for its threadbytes
     cf32******* pulsaraccumspace; //[freq][stride][baseline][source][polproduct][bin][channel]
-    f64 * chanfreqs;
     cf32 * rotated;
-    cf32 * rotator;
     cf32 * channelsums;
-    f32 * argument;
+    PhaseCentreRotator * phasecentrerotator; //rotators for multiple phase centres, 0 if no configuration has more than one
     int shifterrorcount;
     DifxMessageSTARecord * starecordbuffer;
     bool dumpsta;
@@ -136,11 +158,13 @@ private:
   * Allocates or deallocates the required scratch space for pulsar binning which varies with config
   * @param pulsaraccumspace The array of scratch space [freq][xmacstride][baseline][src][pol][bin][chan]
   * @param bins Pointer to the array for bins
+  * @param binsegments Pointer to the array for the runs of channels in the same bin [fftsubloop][freq][segment]
+  * @param firstbinsegment Pointer to the array for the first run of each xmac stride [fftsubloop][freq][xmacstride]
   * @param newconfigindex The index of the config which is to be used
   * @param oldconfigindex The index of the config which was previously being used
   * @param threadid The thread for which this will be done
   */
-  void createPulsarVaryingSpace(cf32******* pulsaraccumspace, s32**** bins, int newconfigindex, int oldconfigindex, int threadid);
+  void createPulsarVaryingSpace(cf32******* pulsaraccumspace, s32**** bins, BinSegment**** binsegments, s32**** firstbinsegment, int newconfigindex, int oldconfigindex, int threadid);
 
  /**
   * Allocates or deallocates the required space for thread-specific arrays which vary in size with config
@@ -166,6 +190,35 @@ private:
   */
   int receivedata(int index, bool * terminate);
 
+ /**
+  * With the shared transport, tells the Datastreams on this node that the data held in the given slot has been
+  * processed, so they may reuse that part of their buffer
+  * @param index The index in the circular send/receive buffer whose processing has just finished
+  */
+  void releaseSharedData(int index);
+
+ /**
+  * With the shared transport, releases the Datastream data of any slot that every processing thread has finished
+  * with.  Called while waiting on receives, since a Datastream may need that space back before it can send
+  * @return The number of slots released
+  */
+  int releaseFinishedSharedData();
+
+ /**
+  * Waits for MPI requests to complete.  With the shared transport, Datastream data is released as the processing
+  * threads finish with it while waiting
+  * @param count The number of requests
+  * @param requests The requests to wait on
+  * @param statuses Filled with the status of each request
+  */
+  void waitReleasingSharedData(int count, MPI_Request * requests, MPI_Status * statuses);
+
+ /**
+  * Whether data from a Datastream is received into this Core's own ring slot buffers, rather than read from a window
+  * @param datastreamindex The index of the Datastream
+  */
+  inline bool ownsDataBuffer(int datastreamindex) const { return transport != Configuration::TRANSPORT_PUT && (sharedsource == 0 || sharedsource[datastreamindex] == 0); }
+
  /**
   * Processes a single thread's section of a single subintegration
   * @param index The index in the circular send/receive buffer to be processed
@@ -179,7 +232,55 @@ private:
   void processdata(int index, int threadid, int startblock, int numblocks, Mode ** modes, Polyco * currentpolyco, threadscratchspace * scratchspace);
 
  /**
-  * Averages the autocorrelations down, sends off STA dumps down a socket if required and copies to coreresults
+  * Cross-multiplies and accumulates one xmac stride of one frequency for all baselines (non-pulsar-binned case only).
+  * Baselines are grouped into tiles whose accumulators fit within xmactilebytes, and within a tile the loop over buffered
+  * FFTs is outermost, so that each station's spectrum is brought into cache once and multiplied against all its partners
+  * in the tile.  The results land at exactly the same offsets (and are summed in the same order) as the per-baseline loop.
+  * @param index The index in the circular send/receive buffer to be processed
+  * @param freqindex The frequency (from the frequency table) to process
+  * @param xmacstart The first channel of this xmac stride
+  * @param xmacstrideremain The number of channels in this xmac stride
+  * @param resultindex The offset in threadcrosscorrs of the first baseline for this frequency and stride
+  * @param firstfft The index of the first FFT in this batch of buffered FFTs
+  * @param lastfft One past the index of the last valid FFT
+  * @param modes The Mode objects which hold the station-based results
+  * @param scratchspace Space for all of the intermediate results for this thread
+  * @return The offset in threadcrosscorrs after the last baseline for this frequency and stride
+  */
+  int crossMultiplyTiled(int index, int freqindex, int xmacstart, int xmacstrideremain, int resultindex, int firstfft, int lastfft, Mode ** modes, threadscratchspace * scratchspace);
+
+ /**
+  * As for crossMultiplyTiled, but for configurations with XMAC PRECISION = CS16.  The station spectra for this
+  * stride are packed once into 16 bit complex (each scaled to its own peak over the batch of buffered FFTs),
+  * the products are summed exactly in 32 bit integers over the buffered FFTs, and only then widened and added
+  * into the float results.  See Configuration::getXmacPrecision for the accuracy bound.
+  * @param index The index in the circular send/receive buffer to be processed
+  * @param freqindex The frequency (from the frequency table) to process
+  * @param xmacstart The first channel of this xmac stride
+  * @param xmacstrideremain The number of channels in this xmac stride
+  * @param resultindex The offset in threadcrosscorrs of the first baseline for this frequency and stride
+  * @param firstfft The index of the first FFT in this batch of buffered FFTs
+  * @param lastfft One past the index of the last valid FFT
+  * @param modes The Mode objects which hold the station-based results
+  * @param scratchspace Space for all of the intermediate results for this thread
+  * @return The offset in threadcrosscorrs after the last baseline for this frequency and stride
+  */
+  int crossMultiplyCS16(int index, int freqindex, int xmacstart, int xmacstrideremain, int resultindex, int firstfft, int lastfft, Mode ** modes, threadscratchspace * scratchspace);
+
+ /**
+  * Works out where each baseline's results for one frequency and xmac stride go in threadcrosscorrs,
+  * advancing the result index exactly as the per-baseline cross-multiply loop does
+  * @param configindex The configuration in use
+  * @param freqindex The frequency (from the frequency table) being processed
+  * @param resultindex The offset in threadcrosscorrs of the first baseline
+  * @param resultoffsets Filled with the offset for each baseline (-1 if the baseline does not use this frequency)
+  * @return The offset in threadcrosscorrs after the last baseline
+  */
+  int setXmacResultOffsets(int configindex, int freqindex, int resultindex, int * resultoffsets);
+
+ /**
+  * Averages the autocorrelations down, sends off STA dumps down a socket and writes filterbank records to the ring if required,
+  * and copies to coreresults
   * @param index The index in the circular send/receive buffer to be processed
   * @param threadid The id of the thread which is doing the processing
   * @param nsoffset The offset from start of subintegration
@@ -189,6 +290,20 @@ private:
   */
   void averageAndSendAutocorrs(int index, int threadid, double nsoffset, double nswidth, Mode ** modes, threadscratchspace * scratchspace);
 
+ /**
+  * Fills in the power spectral density of one band's autocorrelation, summed down to at most the given number of channels
+  * @param index The index in the circular send/receive buffer being processed
+  * @param datastream The datastream index
+  * @param band The recorded band index within the datastream
+  * @param nswidth The width of the dump in nanoseconds
+  * @param maxchannels The most channels wanted
+  * @param datastreamsaveraged Whether the Modes have already averaged their autocorrelations in frequency
+  * @param modes The Mode objects which have the autocorrelation results
+  * @param spectrum Filled with the spectrum
+  * @return The number of channels filled in, or 0 if the band has too little valid data to be worth using
+  */
+  int getFilterbankSpectrum(int index, int datastream, int band, double nswidth, int maxchannels, bool datastreamsaveraged, Mode ** modes, f32 * spectrum);
+
  /**
   * Averages the kurtosis down and sends off as a series of STA dumps down a socket
   * @param index The index in the circular send/receive buffer to be processed
@@ -210,7 +325,8 @@ private:
   void copyPCalTones(int index, int threadid, Mode ** modes);
 
  /**
-  * Does any uvshifting necessary and averages down in frequency into the coreresults
+  * Does any uvshifting necessary and averages down in frequency into the coreresults.  The rotators for
+  * each phase centre come from a PhaseCentreRotator, and are applied with one multiply-accumulate per stride
   * @param index The index in the circular send/receive buffer to be processed
   * @param threadid The id of the thread which is doing the processing
   * @param nsoffset The offset from start of subintegration (for calculating UV shifts)
@@ -221,7 +337,8 @@ private:
   void uvshiftAndAverage(int index, int threadid, double nsoffset, double nswidth, Polyco * currentpolyco, threadscratchspace * scratchspace);
 
  /**
-  * Does any uvshifting necessary and averages down in frequency into the coreresults
+  * Does any uvshifting necessary and averages down in frequency into the coreresults.  The rotators for
+  * each phase centre come from a PhaseCentreRotator, and are applied with one multiply-accumulate per stride
   * @param index The index in the circular send/receive buffer to be processed
   * @param threadid The id of the thread which is doing the processing
   * @param nsoffset The offset from start of subintegration (for calculating UV shifts)
@@ -253,7 +370,28 @@ private:
   MPI_Request * datarequests;
   MPI_Request * controlrequests;
   MPI_Status * msgstatuses;
+  //the persistent and put transports: receive requests bound to each ring slot, and the window data is put into
+  Configuration::datatransport transport;
+  MPI_Request ** persistentdatarequests;
+  MPI_Request ** persistentcontrolrequests;
+  MPI_Win landingwindow;
+  u8 * landingbuffer;
+  int landingdepth;
+  long long numlanded;
+  //the shared transport: the buffer of each Datastream on this node (0 for the others), and which slots refer to them
+  MPI_Comm nodecomm;
+  MPI_Win sharedwindow;
+  u8 ** sharedsource;
+  u8 *** sharedcopy;  //[slot][datastream], received into when the data wasn't final in the Datastream buffer (allocated on first use)
+  bool * sharedheld;
+  int numshared;
+  //NUMA placement of the processing threads and buffers (0 if not requested in the .threads file)
+  NumaTopology * numa;
   int numdatastreams, numbaselines, databytes, controllength, numreceived, numcomplete, currentconfigindex, numprocessthreads, maxthreadresultlength;
+  int xmactilebytes, maxdatastreambands;
+  int skwindow;       //FFTs per spectral kurtosis estimate for RFI excision (DIFX_SK_WINDOW, 0 for the whole buffer)
+  float skthreshold;  //SK deviation, in standard deviations, beyond which channels are excised (DIFX_SK_THRESHOLD, 0 for no excision)
+  FilterbankRing * filterbankring;  //autocorrelation spectra for streaming transient searches (DIFX_FILTERBANK_RING, 0 if not wanted)
   long long maxcoreresultlength;
   int startmjd, startseconds;
   long long estimatedbytes;
@@ -25,7 +25,10 @@
 //
 //============================================================================
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <sstream>
+#include <sys/time.h>
 #include "datamuxer.h"
 #include "vdifio.h"
 #include "alert.h"
@@ -46,9 +49,27 @@
 #define PRAGMA_OMP(args) /**/                                                            
 #endif                      
 
+static double muxclock()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+//passes the worker number to the new thread along with the muxer
+struct MuxWorkerStart
+{
+  DataMuxer * muxer;
+  int worker;
+};
+
 DataMuxer::DataMuxer(const Configuration * conf, int dsindex, int id, int nthreads, int sbytes)
   : config(conf), datastreamindex(dsindex), mpiid(id), numthreads(nthreads), segmentbytes(sbytes)
 {
+  char * muxworkersenv = getenv("DIFX_MUX_WORKERS");
+
   demuxbuffer = vectorAlloc_u8(segmentbytes*DEMUX_BUFFER_FACTOR);
   estimatedbytes += segmentbytes*DEMUX_BUFFER_FACTOR;
   threadbuffers = new u8*[numthreads];
@@ -60,10 +81,66 @@ DataMuxer::DataMuxer(const Configuration * conf, int dsindex, int id, int nthrea
     estimatedbytes += segmentbytes*DEMUX_BUFFER_FACTOR/numthreads;
   }
   resetcounters();
+
+  nummuxworkers = 1;
+  if(muxworkersenv)
+  {
+    nummuxworkers = atoi(muxworkersenv);
+    if(nummuxworkers < 1 || nummuxworkers > MAX_MUX_WORKERS)
+    {
+      cwarn << startl << "DIFX_MUX_WORKERS was set to " << muxworkersenv << "; must be between 1 and " << MAX_MUX_WORKERS << ", so demultiplexing on the datastream thread alone" << endl;
+      nummuxworkers = 1;
+    }
+  }
+  muxworktask = 0;
+  muxworkitems = 0;
+  muxworkgeneration = 0;
+  muxworkersbusy = 0;
+  muxworkersstop = false;
+  muxworkerbytes = new long long[nummuxworkers];
+  muxworkerseconds = new double[nummuxworkers];
+  for(int i=0;i<nummuxworkers;i++)
+  {
+    muxworkerbytes[i] = 0;
+    muxworkerseconds[i] = 0.0;
+  }
+  muxreporttime = muxclock();
+  pthread_mutex_init(&muxworklock, NULL);
+  pthread_cond_init(&muxworkready, NULL);
+  pthread_cond_init(&muxworkdone, NULL);
+  muxworkerthreads = new pthread_t[nummuxworkers];
+  for(int i=1;i<nummuxworkers;i++)
+  {
+    MuxWorkerStart * start = new MuxWorkerStart;
+    start->muxer = this;
+    start->worker = i;
+    if(pthread_create(&muxworkerthreads[i], NULL, DataMuxer::launchMuxWorker, start) != 0)
+    {
+      cerror << startl << "Could not start mux worker thread " << i << "; demultiplexing with " << i << " thread(s)" << endl;
+      delete start;
+      nummuxworkers = i;
+      break;
+    }
+  }
+  if(nummuxworkers > 1)
+    cinfo << startl << "DataMuxer: each segment is demultiplexed by " << nummuxworkers << " threads" << endl;
 }
 
 DataMuxer::~DataMuxer()
 {
+  pthread_mutex_lock(&muxworklock);
+  muxworkersstop = true;
+  pthread_cond_broadcast(&muxworkready);
+  pthread_mutex_unlock(&muxworklock);
+  for(int i=1;i<nummuxworkers;i++)
+    pthread_join(muxworkerthreads[i], NULL);
+  pthread_cond_destroy(&muxworkdone);
+  pthread_cond_destroy(&muxworkready);
+  pthread_mutex_destroy(&muxworklock);
+  delete [] muxworkerthreads;
+  delete [] muxworkerbytes;
+  delete [] muxworkerseconds;
+
   for(int i=0;i<numthreads;i++)
   {
     vectorFree(threadbuffers[i]);
@@ -72,6 +149,107 @@ DataMuxer::~DataMuxer()
   vectorFree(demuxbuffer);
 }
 
+void * DataMuxer::launchMuxWorker(void * start)
+{
+  MuxWorkerStart * s = (MuxWorkerStart *)start;
+  DataMuxer * muxer = s->muxer;
+  int worker = s->worker;
+
+  delete s;
+  muxer->muxWorkerLoop(worker);
+
+  return 0;
+}
+
+void DataMuxer::muxWorkerLoop(int worker)
+{
+  int generation = 0;
+
+  pthread_mutex_lock(&muxworklock);
+  while(true)
+  {
+    while(!muxworkersstop && muxworkgeneration == generation)
+      pthread_cond_wait(&muxworkready, &muxworklock);
+    if(muxworkersstop)
+      break;
+    generation = muxworkgeneration;
+    pthread_mutex_unlock(&muxworklock);
+
+    doMuxShare(worker);
+
+    pthread_mutex_lock(&muxworklock);
+    if(--muxworkersbusy == 0)
+      pthread_cond_signal(&muxworkdone);
+  }
+  pthread_mutex_unlock(&muxworklock);
+}
+
+void DataMuxer::doMuxShare(int worker)
+{
+  int first = (int)(((long long)muxworkitems*worker)/nummuxworkers);
+  int last = (int)(((long long)muxworkitems*(worker+1))/nummuxworkers);
+  double t0;
+
+  if(first >= last)
+    return;
+  t0 = muxclock();
+  muxworkerbytes[worker] += doMuxWork(muxworktask, first, last);
+  muxworkerseconds[worker] += muxclock() - t0;
+}
+
+void DataMuxer::runMuxWorkers(int task, int count)
+{
+  if(count <= 0)
+    return;
+
+  muxworktask = task;
+  muxworkitems = count;
+  if(nummuxworkers == 1)
+  {
+    doMuxShare(0);
+    return;
+  }
+
+  pthread_mutex_lock(&muxworklock);
+  muxworkersbusy = nummuxworkers - 1;
+  muxworkgeneration++;
+  pthread_cond_broadcast(&muxworkready);
+  pthread_mutex_unlock(&muxworklock);
+
+  doMuxShare(0);
+
+  pthread_mutex_lock(&muxworklock);
+  while(muxworkersbusy > 0)
+    pthread_cond_wait(&muxworkdone, &muxworklock);
+  pthread_mutex_unlock(&muxworklock);
+}
+
+long long DataMuxer::doMuxWork(int task, int first, int last)
+{
+  return 0;
+}
+
+void DataMuxer::reportMuxRate()
+{
+  double now = muxclock();
+  double elapsed = now - muxreporttime;
+  long long totalbytes = 0;
+  std::ostringstream rates;
+
+  if(elapsed < MUX_REPORT_INTERVAL)
+    return;
+
+  for(int i=0;i<nummuxworkers;i++)
+  {
+    totalbytes += muxworkerbytes[i];
+    rates << " " << (muxworkerseconds[i] > 0.0 ? muxworkerbytes[i]/(1.0e6*muxworkerseconds[i]) : 0.0);
+    muxworkerbytes[i] = 0;
+    muxworkerseconds[i] = 0.0;
+  }
+  cinfo << startl << "DataMuxer: demultiplexed " << totalbytes/(1.0e6*elapsed) << " MB/s with " << nummuxworkers << " thread(s); MB/s while busy for each:" << rates.str() << endl;
+  muxreporttime = now;
+}
+
 void DataMuxer::resetcounters()
 {
   readcount = 0;
@@ -114,7 +292,11 @@ VDIFMuxer::VDIFMuxer(const Configuration * conf, int dsindex, int id, int nthrea
   activemask = (1<<bitspersample) - 1;
   threadindexmap = new int[numthreads];
   bufferframefull = new bool*[numthreads];
-  threadwords = new unsigned int[numthreads];
+  copysource = new const u8*[readframes];
+  copydestination = new u8*[readframes];
+  turnprocessindex = new int[readframes/numthreads];
+  turnoutputframe = new int[readframes/numthreads];
+  turnoutputbuffer = 0;
   for(int i=0;i<numthreads;i++) {
     threadindexmap[i] = tmap[i];
     bufferframefull[i] = new bool[numthreadbufframes];
@@ -129,7 +311,10 @@ VDIFMuxer::~VDIFMuxer()
     delete [] bufferframefull[i];
   }
   delete [] bufferframefull;
-  delete [] threadwords;
+  delete [] copysource;
+  delete [] copydestination;
+  delete [] turnprocessindex;
+  delete [] turnoutputframe;
   delete [] threadindexmap;
 }
 
@@ -162,7 +347,7 @@ bool VDIFMuxer::initialise()
   wordsperoutputframe = wordsperinputframe*numthreads;
   samplesperinputword = samplesperframe/wordsperinputframe;
   samplesperoutputword = samplesperinputword/numthreads;
-  if(samplesperoutputword == 0) {
+  if(samplesperoutputword == 0 || numthreads > MAX_MUX_THREADS) {
     cfatal << startl << "Too many threads/too high bit resolution - can't fit one complete timestep in a 32 bit word! Aborting." << endl;
     return false;
   }
@@ -179,6 +364,12 @@ bool VDIFMuxer::initialise()
     cinfo << startl << "Using optimized VDIF corner turner: cornerturn_2thread_2bit" << endl;
     cornerturn = &VDIFMuxer::cornerturn_2thread_2bit;
   }
+  else if (cornerTurnMakePlan(&cornerturnplan, numthreads, bitspersample) && simdGetLevel() > SIMD_GENERIC) {
+    // the vectorised swap network beats the specialised 4 to 16 thread 2-bit turners below on one core
+    cinfo << startl << "Using optimized VDIF corner turner: cornerturn_simd (" << simdLevelName(simdGetLevel()) << ")" << endl;
+    cornerturnkernel = cornerTurnGetKernel(simdGetLevel());
+    cornerturn = &VDIFMuxer::cornerturn_simd;
+  }
   else if (numthreads == 4 && bitspersample == 2) {
     cinfo << startl << "Using optimized VDIF corner turner: cornerturn_4thread_2bit" << endl;
     cornerturn = &VDIFMuxer::cornerturn_4thread_2bit;
@@ -191,6 +382,11 @@ bool VDIFMuxer::initialise()
     cinfo << startl << "Using optimized VDIF corner turner: cornerturn_16thread_2bit" << endl;
     cornerturn = &VDIFMuxer::cornerturn_16thread_2bit;
   }
+  else if (cornerturnplan.numthreads == numthreads) {
+    cinfo << startl << "Using optimized VDIF corner turner: cornerturn_simd (" << simdLevelName(SIMD_GENERIC) << ")" << endl;
+    cornerturnkernel = cornerTurnGetKernel(SIMD_GENERIC);
+    cornerturn = &VDIFMuxer::cornerturn_simd;
+  }
   else {
     cwarn << startl << "Using generic VDIF corner turner; performance may suffer" << endl;
     cornerturn = &VDIFMuxer::cornerturn_generic;
@@ -254,6 +450,7 @@ void VDIFMuxer::cornerturn_generic(u8 * outputbuffer, int processindex, int outp
 {
   unsigned int copyword;
   unsigned int * outputwordptr;
+  unsigned int threadwords[MAX_MUX_THREADS];
   
   //loop over all the samples and copy them in
   copyword = 0;
@@ -275,6 +472,16 @@ void VDIFMuxer::cornerturn_generic(u8 * outputbuffer, int processindex, int outp
 
   
 
+void VDIFMuxer::cornerturn_simd(u8 * outputbuffer, int processindex, int outputframecount)
+{
+  // Any power of two threads with 1 to 16 bits per sample, using the kernel for the selected SIMD level
+  const u8 * threadframes[MAX_MUX_THREADS];
+
+  for(int j=0;j<numthreads;j++)
+    threadframes[j] = threadbuffers[j] + processindex*inputframebytes + VDIF_HEADER_BYTES;
+  cornerturnkernel(outputbuffer + outputframecount*outputframebytes + VDIF_HEADER_BYTES, threadframes, wordsperinputframe, &cornerturnplan);
+}
+
 void VDIFMuxer::cornerturn_1thread(u8 * outputbuffer, int processindex, int outputframecount)
 {
   // Trivial case of 1 thread: just a copy
@@ -318,7 +525,7 @@ void VDIFMuxer::cornerturn_2thread_2bit(u8 * outputbuffer, int processindex, int
   int i, n;
   n = wordsperoutputframe;
 
-PRAGMA_OMP(parallel private(i,x) shared(chunk,outputwordptr,t0,t1,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i,x) shared(chunk,outputwordptr,t0,t1,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -379,7 +586,7 @@ void VDIFMuxer::cornerturn_4thread_2bit(u8 * outputbuffer, int processindex, int
   int i, n;
   n = wordsperoutputframe;
 
-PRAGMA_OMP(parallel private(i,x) shared(chunk,outputwordptr,t0,t1,t2,t3,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i,x) shared(chunk,outputwordptr,t0,t1,t2,t3,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -437,7 +644,7 @@ void VDIFMuxer::cornerturn_8thread_2bit(u8 * outputbuffer, int processindex, int
   union { unsigned int y1; u8 b1[4]; };
   union { unsigned int y2; u8 b2[4]; };
 
-PRAGMA_OMP(parallel private(i,x1,x2,y1,y2,b1,b2) shared(chunk,outputwordptr,t0,t1,t2,t3,t4,t5,t6,t7,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i,x1,x2,y1,y2,b1,b2) shared(chunk,outputwordptr,t0,t1,t2,t3,t4,t5,t6,t7,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -511,7 +718,7 @@ void VDIFMuxer::cornerturn_16thread_2bit(u8 * outputbuffer, int processindex, in
   union { unsigned int y3; u8 b3[4]; };
   union { unsigned int y4; u8 b4[4]; };
 
-PRAGMA_OMP(parallel private(i,x1,x2,x3,x4,y1,y2,y3,y4,b1,b2,b3,b4) shared(chunk,outputwordptr,t0,t1,t2,t3,t4,t5,t6,t7,t8,t9,t10,t11,t12,t13,t14,t15,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i,x1,x2,x3,x4,y1,y2,y3,y4,b1,b2,b3,b4) shared(chunk,outputwordptr,t0,t1,t2,t3,t4,t5,t6,t7,t8,t9,t10,t11,t12,t13,t14,t15,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -553,7 +760,7 @@ void VDIFMuxer::cornerturn_2thread_merge(u8 * outputbuffer, int processindex, in
   int i, n;
   n = wordsperoutputframe*2;
 
-PRAGMA_OMP(parallel private(i) shared(chunk,outputbyteptr,t0,t1,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i) shared(chunk,outputbyteptr,t0,t1,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -578,7 +785,7 @@ void VDIFMuxer::cornerturn_4thread_merge(u8 * outputbuffer, int processindex, in
   int i, n;
   n = wordsperoutputframe;
 
-PRAGMA_OMP(parallel private(i) shared(chunk,outputbyteptr,t0,t1,t2,t3,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i) shared(chunk,outputbyteptr,t0,t1,t2,t3,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -609,7 +816,7 @@ void VDIFMuxer::cornerturn_8thread_merge(u8 * outputbuffer, int processindex, in
   int i, n;
   n = wordsperoutputframe/2;
 
-PRAGMA_OMP(parallel private(i) shared(chunk,outputbyteptr,t0,t1,t2,t3,t4,t5,t6,t7,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i) shared(chunk,outputbyteptr,t0,t1,t2,t3,t4,t5,t6,t7,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -652,7 +859,7 @@ void VDIFMuxer::cornerturn_16thread_merge(u8 * outputbuffer, int processindex, i
   int i, n;
   n = wordsperoutputframe/4;
 
-PRAGMA_OMP(parallel private(i) shared(chunk,outputbyteptr,t0,t1,t2,t3,t4,t5,t6,t7,n))
+PRAGMA_OMP(parallel if(nummuxworkers == 1) private(i) shared(chunk,outputbyteptr,t0,t1,t2,t3,t4,t5,t6,t7,n))
   {
 PRAGMA_OMP(for schedule(dynamic,chunk) nowait)
     for(i = 0; i < n; ++i)
@@ -681,13 +888,15 @@ int VDIFMuxer::multiplex(u8 * outputbuffer)
 {
   vdif_header * header;
   vdif_header * copyheader;
-  int outputframecount, processindex;
+  int outputframecount, processindex, numturns;
   bool foundframe;
+  double t0 = muxclock();
 
   outputframecount = 0;
+  numturns = 0;
   lastskipframes = skipframes;
 
-  //loop over one read's worth of data
+  //loop over one read's worth of data, writing the headers and listing the frames to corner turn
   for(int f=0;f<readframes/numthreads;f++) {
     //rearrange one frame
     processindex = processframenumber % (readframes*DEMUX_BUFFER_FACTOR/numthreads);
@@ -700,8 +909,15 @@ int VDIFMuxer::multiplex(u8 * outputbuffer)
       setVDIFFrameBytes(header, outputframebytes);
       setVDIFThreadID(header, 0);
 
-      // call the corner turning function.  gotta love this syntax!
-      (this->*cornerturn)(outputbuffer, processindex, outputframecount);
+      if(nummuxworkers == 1) {
+        //working alone, so turn the frame straight away rather than listing it for the workers
+        (this->*cornerturn)(outputbuffer, processindex, outputframecount);
+      }
+      else {
+        turnprocessindex[numturns] = processindex;
+        turnoutputframe[numturns] = outputframecount;
+        numturns++;
+      }
 
       outputframecount++;
     }
@@ -758,6 +974,17 @@ int VDIFMuxer::multiplex(u8 * outputbuffer)
     }
     processframenumber++;
   }
+
+  //the thread buffer frames just marked free are only refilled by the next deinterlace, so are safe until this returns
+  if(nummuxworkers == 1) {
+    muxworkerbytes[0] += (long long)outputframecount*outputframebytes;
+    muxworkerseconds[0] += muxclock() - t0;
+  }
+  else {
+    turnoutputbuffer = outputbuffer;
+    runMuxWorkers(CORNER_TURN, numturns);
+  }
+  reportMuxRate();
   
   return outputframecount*outputframebytes;
 }
@@ -768,11 +995,14 @@ bool VDIFMuxer::deinterlace(int validbytes)
   int frameoffset, frameindex, threadindex;
   long long currentframenumber;
   bool found;
+  int numcopies;
   double bufferratio;
+  double t0 = muxclock();
   vdif_header * inputptr;
 
   //cout << "Deinterlacing: deinterlacecount is " << deinterlacecount << endl;
   //cout << "Will start from " << (deinterlacecount%DEMUX_BUFFER_FACTOR)*readframes << " frames in" << endl;
+  numcopies = 0;
   for(int i=0;i<validbytes/inputframebytes;i++) {
     inputptr = (vdif_header*)(demuxbuffer + i*inputframebytes + (deinterlacecount%DEMUX_BUFFER_FACTOR)*readframes*inputframebytes);
 
@@ -836,13 +1066,47 @@ bool VDIFMuxer::deinterlace(int validbytes)
     frameindex = (int)(currentframenumber % numthreadbufframes);
     if (bufferframefull[threadindex][frameindex]) {
       cwarn << startl << "Frame at index " << frameindex << " (which was count " << currentframenumber << ") was already full for thread " << threadindex << " - probably a major time gap in the file, which is not supported.  Numthreadbufframes is " << numthreadbufframes << endl;
+      //the copies listed so far may include one to this frame, and the later copy must win
+      runMuxWorkers(COPY_FRAMES, numcopies);
+      numcopies = 0;
+    }
+    if(nummuxworkers == 1) {
+      memcpy(threadbuffers[threadindex] + frameindex*framebytes, inputptr, inputframebytes);
+      muxworkerbytes[0] += inputframebytes;
+    }
+    else {
+      copysource[numcopies] = (const u8 *)inputptr;
+      copydestination[numcopies] = threadbuffers[threadindex] + frameindex*framebytes;
+      numcopies++;
     }
-    memcpy(threadbuffers[threadindex] + frameindex*framebytes, inputptr, framebytes);
     bufferframefull[threadindex][frameindex] = true;
   }
+  if(nummuxworkers == 1)
+    muxworkerseconds[0] += muxclock() - t0;
+  else
+    runMuxWorkers(COPY_FRAMES, numcopies);
   deinterlacecount++;
 
   return true;
 }
 
+long long VDIFMuxer::doMuxWork(int task, int first, int last)
+{
+  long long bytes = 0;
+
+  if(task == COPY_FRAMES) {
+    for(int i=first;i<last;i++)
+      memcpy(copydestination[i], copysource[i], inputframebytes);
+    bytes = (long long)(last - first)*inputframebytes;
+  }
+  else if(task == CORNER_TURN) {
+    // call the corner turning function.  gotta love this syntax!
+    for(int i=first;i<last;i++)
+      (this->*cornerturn)(turnoutputbuffer, turnprocessindex[i], turnoutputframe[i]);
+    bytes = (long long)(last - first)*outputframebytes;
+  }
+
+  return bytes;
+}
+
 // vim: shiftwidth=2:softtabstop=2:expandtab
@@ -27,7 +27,9 @@
 #ifndef DATAMUXER_H
 #define DATAMUXER_H
 
+#include <pthread.h>
 #include "configuration.h"
+#include "vdifcornerturn.h"
 
 /**
 @class DataMuxer
@@ -36,6 +38,10 @@
 Provides a buffer for data in one (demultiplexed) VLBI data format, and translates that data into a multiplexed format and stores it in a provided buffer.  
 This is a virtual superclass for specific instantiations.
 
+The copying and corner turning can be shared among a small pool of worker threads (DIFX_MUX_WORKERS, counting the datastream
+thread itself, default 1) so that one datastream can use more than one core.  Each segment is still complete when multiplex returns.
+With a single thread the frames are copied and turned as they are found, without first being listed.
+
 @author Adam Deller
 */
 class DataMuxer{
@@ -135,8 +141,37 @@ public:
 
   ///constants
   static const int DEMUX_BUFFER_FACTOR = 4;
+  static const int MAX_MUX_WORKERS = 64;
+  static const int MUX_REPORT_INTERVAL = 30; // seconds
+
+ /**
+  * Accessor method for the number of threads sharing the demultiplexing
+  * @return The number of threads, including the datastream thread, that copy and corner turn each segment
+  */
+  inline int getNumMuxWorkers() const { return nummuxworkers; }
 
 protected:
+ /**
+  * Shares a task out among the mux workers, the calling thread taking the first share, and waits for all of them to finish
+  * @param task Identifies the task to doMuxWork
+  * @param count The number of items to divide up
+  */
+  void runMuxWorkers(int task, int count);
+
+ /**
+  * Does one share of a task handed out by runMuxWorkers.  Called on several threads at once, so must only touch its own items
+  * @param task The task
+  * @param first The first item to do
+  * @param last One after the last item to do
+  * @return The number of bytes produced, for the throughput report
+  */
+  virtual long long doMuxWork(int task, int first, int last);
+
+ /**
+  * Logs the throughput of each mux worker, at most once every MUX_REPORT_INTERVAL seconds
+  */
+  void reportMuxRate();
+
   ///additional buffers
   u8 * demuxbuffer;
   u8** threadbuffers;
@@ -146,6 +181,21 @@ protected:
   const Configuration * config;
   long long readcount, muxcount, deinterlacecount, estimatedbytes, skipframes, lastskipframes;
   int datastreamindex, mpiid, numthreads, segmentbytes;
+
+  ///worker pool; worker 0 is the calling thread, the others wait for muxworkgeneration to change
+  int nummuxworkers, muxworktask, muxworkitems, muxworkgeneration, muxworkersbusy;
+  bool muxworkersstop;
+  pthread_t * muxworkerthreads;
+  pthread_mutex_t muxworklock;
+  pthread_cond_t muxworkready, muxworkdone;
+  long long * muxworkerbytes;  // [nummuxworkers], since the last report
+  double * muxworkerseconds;   // [nummuxworkers], busy time since the last report
+  double muxreporttime;
+
+private:
+  static void * launchMuxWorker(void * muxer);
+  void muxWorkerLoop(int worker);
+  void doMuxShare(int worker);
 };
 
 /**
@@ -222,19 +272,41 @@ protected:
   */
   virtual int multiplex(u8 * outputbuffer);
 
+  ///tasks for the mux workers
+  enum MuxTask {COPY_FRAMES, CORNER_TURN};
+
+ /**
+  * Copies frames into the thread buffers or corner turns output frames, for the mux workers
+  * @param task COPY_FRAMES or CORNER_TURN
+  * @param first The first item of the list made by deinterlace or multiplex
+  * @param last One after the last item
+  * @return The number of bytes written
+  */
+  virtual long long doMuxWork(int task, int first, int last);
+
+  ///most threads that can be corner turned: a 32 bit word must hold one sample from each
+  static const int MAX_MUX_THREADS = 32;
+
   ///other variables
   int  *  threadindexmap;     // [numthreads]
-  unsigned int * threadwords; // [numthreads]
   bool ** bufferframefull;    // [numthreads][numbufferframes]
+  const u8 ** copysource;     // [readframes] frames found by deinterlace ...
+  u8 ** copydestination;      // [readframes] ... and where they go
+  int * turnprocessindex;     // [readframes/numthreads] frames with data from all threads, found by multiplex ...
+  int * turnoutputframe;      // [readframes/numthreads] ... and where they go in turnoutputbuffer
+  u8 * turnoutputbuffer;
   int inputframebytes, outputframebytes, readframes, framespersecond, bitspersample, numthreadbufframes;
   int refframemjd, refframesecond, refframenumber;
   int samplesperframe, wordsperinputframe, wordsperoutputframe, samplesperinputword, samplesperoutputword;
   unsigned int copyword, activemask;
   long long processframenumber;
   void (VDIFMuxer::*cornerturn)(u8 * outputbuffer, int processindex, int outputframecount);
+  CornerTurnPlan cornerturnplan;
+  CornerTurnKernel cornerturnkernel;
 
 private:
   void cornerturn_generic(u8 * outputbuffer, int processindex, int outputframecount);
+  void cornerturn_simd(u8 * outputbuffer, int processindex, int outputframecount);
   void cornerturn_1thread(u8 * outputbuffer, int processindex, int outputframecount);
   void cornerturn_2thread_2bit(u8 * outputbuffer, int processindex, int outputframecount);
   void cornerturn_4thread_2bit(u8 * outputbuffer, int processindex, int outputframecount);
@@ -75,6 +75,15 @@ DataStream::DataStream(const Configuration * conf, int snum, int id, int ncores,
   raw = false;
   lastvalidsegment = 0;
   verbose = false;
+  transport = config->getDataTransport();
+  landingstride = 0;
+  landingdepth = 0;
+  numputs = 0;
+  pendingputs = 0;
+  numpendingputs = 0;
+  sendring = 0;
+  nextsendslot = 0;
+  coresharesnode = 0;
 
   // Early defaults that may change during ::initialise()
   portnumber = config->getDPortNumber(0, streamnum);
@@ -100,7 +109,8 @@ DataStream::DataStream(const Configuration * conf, int snum, int id, int ncores,
 DataStream::~DataStream()
 {
   closefile();
-  vectorFree(databuffer);
+  if(transport != Configuration::TRANSPORT_SHARED)
+    vectorFree(databuffer);
   for(int i=0;i<numdatasegments;i++)
   {
     delete [] bufferinfo[i].datarequests;
@@ -112,6 +122,28 @@ DataStream::~DataStream()
     delete [] bufferinfo[i].controlbuffer;
   }
   delete [] coreids;
+  if(landingstride)
+  {
+    delete [] landingstride;
+    delete [] landingdepth;
+    delete [] numputs;
+    delete [] pendingputs;
+  }
+  if(sendring)
+  {
+    for(int i=0;i<Core::RECEIVE_RING_LENGTH;i++)
+    {
+      vectorFree(sendring[i].data);
+      vectorFree(sendring[i].control);
+      delete [] sendring[i].databytes;
+      delete [] sendring[i].controllength;
+      delete [] sendring[i].datarequests;
+      delete [] sendring[i].controlrequests;
+    }
+    delete [] sendring;
+  }
+  if(coresharesnode)
+    delete [] coresharesnode;
   delete [] bufferlock;
   delete [] bufferinfo;
   delete [] filesread;
@@ -147,7 +179,10 @@ void DataStream::initialise()
       overflowbytes = currentoverflowbytes;
   }
   cinfo << startl << "About to allocate " << bufferbytes << " + " << overflowbytes << " bytes in datastream databuffer" << endl;
-  databuffer = vectorAlloc_u8(bufferbytes + overflowbytes + 4); // a couple extra for mark5 case
+  if(transport == Configuration::TRANSPORT_SHARED)
+    allocateSharedBuffer(bufferbytes + overflowbytes + 4);
+  else
+    databuffer = vectorAlloc_u8(bufferbytes + overflowbytes + 4); // a couple extra for mark5 case
   estimatedbytes += bufferbytes + overflowbytes + 8;
   if(databuffer == NULL) {
     cfatal << startl << "Datastream " << mpiid << " could not allocate databuffer (length " << bufferbytes + overflowbytes << ") - aborting!!!" << endl;
@@ -230,7 +265,51 @@ void DataStream::initialise()
     bufferinfo[i].controlrequests = new MPI_Request[maxsendspersegment];
     bufferinfo[i].controlbuffer = new s32*[maxsendspersegment];
     for(int j=0;j<maxsendspersegment;j++)
-      bufferinfo[i].controlbuffer[j] = vectorAlloc_s32(config->getMaxBlocksPerSend()/FLAGS_PER_INT + 4);
+      bufferinfo[i].controlbuffer[j] = vectorAlloc_s32(config->getMaxBlocksPerSend()/FLAGS_PER_INT + 6); //two spare for the put and shared transports
+  }
+
+  //join in creating the Cores' landing window if the put transport is in use (this is collective)
+  if(transport == Configuration::TRANSPORT_PUT)
+  {
+    u8 * nobuffer;
+    MPI_Win_allocate(0, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &nobuffer, &landingwindow);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, landingwindow);
+    landingstride = new int[numcores];
+    landingdepth = new int[numcores];
+    numputs = new long long[numcores];
+    for(int i=0;i<numcores;i++)
+    {
+      landingstride[i] = 0;
+      landingdepth[i] = 0;
+      numputs[i] = 0;
+    }
+    pendingputs = new pendingput[Core::RECEIVE_RING_LENGTH];
+    numpendingputs = 0;
+  }
+
+  //stage the data for the persistent transport in a fixed ring of buffers, so each send need only be created once
+  if(transport == Configuration::TRANSPORT_PERSISTENT)
+  {
+    sendring = new sendslot[Core::RECEIVE_RING_LENGTH];
+    for(int i=0;i<Core::RECEIVE_RING_LENGTH;i++)
+    {
+      sendring[i].data = vectorAlloc_u8(overflowbytes);
+      sendring[i].control = vectorAlloc_s32(config->getMaxBlocksPerSend()/FLAGS_PER_INT + 6);
+      sendring[i].lastcore = -1;
+      sendring[i].databytes = new int[numcores];
+      sendring[i].controllength = new int[numcores];
+      sendring[i].datarequests = new MPI_Request[numcores];
+      sendring[i].controlrequests = new MPI_Request[numcores];
+      for(int j=0;j<numcores;j++)
+      {
+        sendring[i].databytes[j] = 0;
+        sendring[i].controllength[j] = 0;
+        sendring[i].datarequests[j] = MPI_REQUEST_NULL;
+        sendring[i].controlrequests[j] = MPI_REQUEST_NULL;
+      }
+      estimatedbytes += overflowbytes + 4*(config->getMaxBlocksPerSend()/FLAGS_PER_INT + 6);
+    }
+    nextsendslot = 0;
   }
 
 #ifdef DIFX_STRICTMUTEX
@@ -260,7 +339,7 @@ void DataStream::execute()
   controlstatuses = new MPI_Status[maxsendspersegment];
   MPI_Request msgrequest;
   MPI_Status msgstatus;
-  int targetcore, status, action, startpos, bufferremaining, perr;
+  int targetcore, status, action, startpos, bufferremaining, perr, received;
   int receiveinfo[4];
   time_t currentseconds, lastseconds;
 
@@ -284,8 +363,16 @@ void DataStream::execute()
       sendDiagnostics();
     }
 
-    //wait til the message has been received
-    MPI_Wait(&msgrequest, &msgstatus);
+    //wait til the message has been received, completing any puts while there is nothing else to do
+    received = 0;
+    if(numpendingputs > 0)
+    {
+      MPI_Test(&msgrequest, &received, &msgstatus);
+      if(!received)
+        completePendingPuts();
+    }
+    if(!received)
+      MPI_Wait(&msgrequest, &msgstatus);
 
     //store what the message tells us to do
     action = msgstatus.MPI_TAG;
@@ -315,20 +402,20 @@ void DataStream::execute()
       if(bufferinfo[atsegment].controlbuffer[bufferinfo[atsegment].numsent][1] == Mode::INVALID_SUBINT)
       {
         //bad or no data, don't waste time sending full length of junk
-        MPI_Issend(&databuffer[startpos], 1, MPI_UNSIGNED_CHAR, targetcore, CR_PROCESSDATA, MPI_COMM_WORLD, &(bufferinfo[atsegment].datarequests[bufferinfo[atsegment].numsent]));
-        MPI_Issend(bufferinfo[atsegment].controlbuffer[bufferinfo[atsegment].numsent], bufferinfo[atsegment].controllength, MPI_INT, targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, &(bufferinfo[atsegment].controlrequests[bufferinfo[atsegment].numsent]));
+        sendToCore(targetcore, &databuffer[startpos], 1, bufferinfo[atsegment].controlbuffer[bufferinfo[atsegment].numsent], bufferinfo[atsegment].controllength, &(bufferinfo[atsegment].datarequests[bufferinfo[atsegment].numsent]), &(bufferinfo[atsegment].controlrequests[bufferinfo[atsegment].numsent]));
       }
       else
       {
         //data is ok
-        MPI_Issend(&databuffer[startpos], bufferinfo[atsegment].sendbytes, MPI_UNSIGNED_CHAR, targetcore, CR_PROCESSDATA, MPI_COMM_WORLD, &(bufferinfo[atsegment].datarequests[bufferinfo[atsegment].numsent]));
-        MPI_Issend(bufferinfo[atsegment].controlbuffer[bufferinfo[atsegment].numsent], bufferinfo[atsegment].controllength, MPI_INT, targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, &(bufferinfo[atsegment].controlrequests[bufferinfo[atsegment].numsent]));
+        sendToCore(targetcore, &databuffer[startpos], bufferinfo[atsegment].sendbytes, bufferinfo[atsegment].controlbuffer[bufferinfo[atsegment].numsent], bufferinfo[atsegment].controllength, &(bufferinfo[atsegment].datarequests[bufferinfo[atsegment].numsent]), &(bufferinfo[atsegment].controlrequests[bufferinfo[atsegment].numsent]));
       }
 
       bufferinfo[atsegment].numsent++;
       if(bufferinfo[atsegment].numsent >= maxsendspersegment) //can occur at the start when many come from segment 0
       {
         //wait til everything has sent so we can reset the requests and go again
+        if(hasPendingPuts(atsegment))
+          completePendingPuts();
         MPI_Waitall(maxsendspersegment, bufferinfo[atsegment].datarequests, datastatuses);
         MPI_Waitall(maxsendspersegment, bufferinfo[atsegment].controlrequests, controlstatuses);
         bufferinfo[atsegment].numsent = 0;
@@ -343,6 +430,8 @@ void DataStream::execute()
   }
 
   //wait on all the sends
+  if(numpendingputs > 0)
+    completePendingPuts();
   for(int i=0;i<numdatasegments;i++)
   {
     if(bufferinfo[i].numsent > 0)
@@ -352,6 +441,30 @@ void DataStream::execute()
       bufferinfo[i].numsent = 0;
     }
   }
+  if(transport == Configuration::TRANSPORT_PERSISTENT)
+  {
+    for(int i=0;i<Core::RECEIVE_RING_LENGTH;i++)
+    {
+      for(int j=0;j<numcores;j++)
+      {
+        if(sendring[i].datarequests[j] != MPI_REQUEST_NULL)
+        {
+          MPI_Wait(&(sendring[i].datarequests[j]), MPI_STATUS_IGNORE);
+          MPI_Request_free(&(sendring[i].datarequests[j]));
+        }
+        if(sendring[i].controlrequests[j] != MPI_REQUEST_NULL)
+        {
+          MPI_Wait(&(sendring[i].controlrequests[j]), MPI_STATUS_IGNORE);
+          MPI_Request_free(&(sendring[i].controlrequests[j]));
+        }
+      }
+    }
+  }
+  if(transport == Configuration::TRANSPORT_PUT)
+  {
+    MPI_Win_unlock_all(landingwindow);
+    MPI_Win_free(&landingwindow);
+  }
   perr = pthread_cond_signal(&readcond);
   if(perr != 0)
     csevere << startl << "DataStream mainthread " << mpiid << " cannot signal read thread to wake up!!!" << endl;
@@ -369,6 +482,15 @@ void DataStream::execute()
   if(perr != 0)
     csevere << startl << "Error in closing telescope " << mpiid << " readerthread!!!" << endl;
 
+  //all Cores have released the data they were reading from our buffer, so it can go (collective, matched in Core and FxManager)
+  if(transport == Configuration::TRANSPORT_SHARED)
+  {
+    MPI_Win_unlock_all(sharedwindow);
+    MPI_Win_free(&sharedwindow);
+    MPI_Comm_free(&nodecomm);
+    databuffer = 0;
+  }
+
   delete [] datastatuses;
   delete [] controlstatuses;
   cverbose << startl << "Datastream " << mpiid << " terminating" << endl;
@@ -644,6 +766,172 @@ void DataStream::sendDiagnostics()
   difxMessageSendDifxDiagnosticDataConsumed(consumedbytes);
 }
 
+void DataStream::allocateSharedBuffer(int bytes)
+{
+  MPI_Group worldgroup, nodegroup;
+  int noderank, perr;
+
+  //every process on this node takes part; only the Datastreams contribute memory
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodecomm);
+  perr = MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, nodecomm, &databuffer, &sharedwindow);
+  if(perr != MPI_SUCCESS)
+  {
+    cfatal << startl << "Datastream " << mpiid << " could not allocate a shared databuffer (length " << bytes << ") - aborting!!!" << endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, sharedwindow);
+
+  //work out which Cores can see it
+  MPI_Comm_group(MPI_COMM_WORLD, &worldgroup);
+  MPI_Comm_group(nodecomm, &nodegroup);
+  coresharesnode = new bool[numcores];
+  for(int i=0;i<numcores;i++)
+  {
+    MPI_Group_translate_ranks(worldgroup, 1, &coreids[i], nodegroup, &noderank);
+    coresharesnode[i] = (noderank != MPI_UNDEFINED);
+  }
+  MPI_Group_free(&worldgroup);
+  MPI_Group_free(&nodegroup);
+}
+
+void DataStream::sendToCore(int targetcore, u8 * data, int bytes, s32 * control, int ncontrol, MPI_Request * datarequest, MPI_Request * controlrequest)
+{
+  int coreindex;
+  s32 layout[3];
+  MPI_Aint displacement;
+  sendslot * slot;
+
+  switch(transport)
+  {
+    case Configuration::TRANSPORT_PERSISTENT:
+      for(coreindex=0;coreindex<numcores;coreindex++)
+      {
+        if(coreids[coreindex] == targetcore)
+          break;
+      }
+      //reuse the oldest staging buffer once its last send has gone; the Cores have persistent receives posted
+      //on their ring slots, so that is normally long since complete
+      slot = &(sendring[nextsendslot]);
+      nextsendslot = (nextsendslot + 1)%Core::RECEIVE_RING_LENGTH;
+      if(slot->lastcore >= 0)
+      {
+        MPI_Wait(&(slot->datarequests[slot->lastcore]), MPI_STATUS_IGNORE);
+        MPI_Wait(&(slot->controlrequests[slot->lastcore]), MPI_STATUS_IGNORE);
+      }
+      vectorCopy_u8(data, slot->data, bytes);
+      vectorCopy_s32(control, slot->control, ncontrol);
+      if(slot->databytes[coreindex] != bytes)
+      {
+        if(slot->datarequests[coreindex] != MPI_REQUEST_NULL)
+          MPI_Request_free(&(slot->datarequests[coreindex]));
+        MPI_Send_init(slot->data, bytes, MPI_UNSIGNED_CHAR, targetcore, CR_PROCESSDATA, MPI_COMM_WORLD, &(slot->datarequests[coreindex]));
+        slot->databytes[coreindex] = bytes;
+      }
+      if(slot->controllength[coreindex] != ncontrol)
+      {
+        if(slot->controlrequests[coreindex] != MPI_REQUEST_NULL)
+          MPI_Request_free(&(slot->controlrequests[coreindex]));
+        MPI_Send_init(slot->control, ncontrol, MPI_INT, targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, &(slot->controlrequests[coreindex]));
+        slot->controllength[coreindex] = ncontrol;
+      }
+      MPI_Start(&(slot->datarequests[coreindex]));
+      MPI_Start(&(slot->controlrequests[coreindex]));
+      slot->lastcore = coreindex;
+      //the data has been copied out, so the databuffer segment does not have to wait for this send
+      *datarequest = MPI_REQUEST_NULL;
+      *controlrequest = MPI_REQUEST_NULL;
+      break;
+    case Configuration::TRANSPORT_PUT:
+      for(coreindex=0;coreindex<numcores;coreindex++)
+      {
+        if(coreids[coreindex] == targetcore)
+          break;
+      }
+      if(landingdepth[coreindex] == 0)
+      {
+        //first put to this Core: fetch the layout of its landing window
+        MPI_Get(layout, 3, MPI_INT, targetcore, 0, 3, MPI_INT, landingwindow);
+        MPI_Win_flush(targetcore, landingwindow);
+        landingstride[coreindex] = layout[0];
+        landingdepth[coreindex] = layout[1];
+        if(layout[2] != config->getNumDataStreams() || layout[1] <= 0)
+        {
+          cfatal << startl << "Datastream " << mpiid << " found an inconsistent landing window at core " << targetcore << " - aborting!!!" << endl;
+          MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+      }
+      if(bytes > landingstride[coreindex])
+      {
+        cfatal << startl << "Datastream " << mpiid << " needs to send " << bytes << " bytes but core " << targetcore << " only has room for " << landingstride[coreindex] << " - aborting!!!" << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+      //the FxManager never has more subints outstanding at a Core than it has slots, so this one is free
+      displacement = Core::LANDING_HEADER_BYTES + ((numputs[coreindex]%landingdepth[coreindex])*config->getNumDataStreams() + streamnum)*(MPI_Aint)landingstride[coreindex];
+      numputs[coreindex]++;
+      MPI_Put(data, bytes, MPI_UNSIGNED_CHAR, targetcore, displacement, bytes, MPI_UNSIGNED_CHAR, landingwindow);
+      *datarequest = MPI_REQUEST_NULL;
+      //the control array, with the data length appended, tells the Core the data is in place - so it can only go
+      //once the put has been flushed, which is left until the main thread would otherwise wait
+      control[ncontrol] = bytes;
+      *controlrequest = MPI_REQUEST_NULL;
+      if(numpendingputs == Core::RECEIVE_RING_LENGTH)
+        completePendingPuts();
+      pendingputs[numpendingputs].targetcore = targetcore;
+      pendingputs[numpendingputs].segment = atsegment;
+      pendingputs[numpendingputs].control = control;
+      pendingputs[numpendingputs].ncontrol = ncontrol+1;
+      pendingputs[numpendingputs].controlrequest = controlrequest;
+      numpendingputs++;
+      break;
+    case Configuration::TRANSPORT_SHARED:
+      for(coreindex=0;coreindex<numcores;coreindex++)
+      {
+        if(coreids[coreindex] == targetcore)
+          break;
+      }
+      if(!coresharesnode[coreindex])
+      {
+        MPI_Issend(data, bytes, MPI_UNSIGNED_CHAR, targetcore, CR_PROCESSDATA, MPI_COMM_WORLD, datarequest);
+        MPI_Issend(control, ncontrol, MPI_INT, targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, controlrequest);
+        break;
+      }
+      if(!isDataFinal(data - databuffer, bytes))
+      {
+        //the read thread may still write into this range, so the Core must not read it in place: send a copy,
+        //and tell the Core so with a negative offset
+        control[ncontrol] = -1;
+        control[ncontrol+1] = bytes;
+        MPI_Issend(data, bytes, MPI_UNSIGNED_CHAR, targetcore, CR_PROCESSDATA, MPI_COMM_WORLD, datarequest);
+        MPI_Isend(control, ncontrol+2, MPI_INT, targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, controlrequest);
+        break;
+      }
+      //the Core reads the data straight out of our buffer, so only tell it where to look.  The section may not
+      //be reused until the Core says it has finished processing, so that notice stands in for the data send
+      MPI_Win_sync(sharedwindow);
+      control[ncontrol] = (s32)(data - databuffer);
+      control[ncontrol+1] = bytes;
+      MPI_Irecv(0, 0, MPI_INT, targetcore, CR_RELEASEDATA, MPI_COMM_WORLD, datarequest);
+      MPI_Isend(control, ncontrol+2, MPI_INT, targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, controlrequest);
+      break;
+    default:
+      MPI_Issend(data, bytes, MPI_UNSIGNED_CHAR, targetcore, CR_PROCESSDATA, MPI_COMM_WORLD, datarequest);
+      MPI_Issend(control, ncontrol, MPI_INT, targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, controlrequest);
+      break;
+  }
+}
+
+bool DataStream::isDataFinal(int startpos, int bytes)
+{
+  int endbytes = startpos + bytes - atsegment*readbytes;
+
+  //the main thread holds the locks on this segment and the next, so their valid data has been read in full
+  if(endbytes <= bufferinfo[atsegment].validbytes)
+    return true;
+  if(bufferinfo[atsegment].validbytes < readbytes)
+    return false;
+  return endbytes - readbytes <= bufferinfo[(atsegment+1)%numdatasegments].validbytes;
+}
+
 void set_abstime(struct timespec *abstime, double timeout) {
   int status;
 
@@ -2108,6 +2396,24 @@ void DataStream::waitForBuffer(int buffersegment)
   }
 }
 
+void DataStream::completePendingPuts()
+{
+  MPI_Win_flush_all(landingwindow);
+  for(int i=0;i<numpendingputs;i++)
+    MPI_Isend(pendingputs[i].control, pendingputs[i].ncontrol, MPI_INT, pendingputs[i].targetcore, CR_PROCESSCONTROL, MPI_COMM_WORLD, pendingputs[i].controlrequest);
+  numpendingputs = 0;
+}
+
+bool DataStream::hasPendingPuts(int segment)
+{
+  for(int i=0;i<numpendingputs;i++)
+  {
+    if(pendingputs[i].segment == segment)
+      return true;
+  }
+  return false;
+}
+
 void DataStream::waitForSendComplete()
 {
   int perr, dfinished, cfinished;
@@ -2118,6 +2424,8 @@ void DataStream::waitForSendComplete()
 
   if(bufferinfo[waitsegment].numsent > 0)
   {
+    if(hasPendingPuts(waitsegment))
+      completePendingPuts();
     if(testonly) // we only need to test, we're close enough that we can afford to go one segment further ahead
     {
       MPI_Testall(bufferinfo[waitsegment].numsent, bufferinfo[waitsegment].datarequests, &dfinished, datastatuses);
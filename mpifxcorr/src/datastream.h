@@ -122,6 +122,27 @@ protected:
     // controlbuffer[][3..] is a packed bitfield of flags, one per "fft" with 30 (FLAGS_PER_INT) bits used per elemen
   } readinfo;
 
+  /// With the persistent transport, one of a ring of buffers each subint is staged in before being sent, along with the
+  /// persistent sends of the buffer to each Core (created on first use, and again if the length changes)
+  typedef struct {
+    u8 * data;
+    s32 * control;
+    int lastcore;                   // index of the Core the slot was last sent to, or -1
+    int * databytes;                // per Core: the length the data send was created with, or 0
+    int * controllength;            // per Core: the length the control send was created with, or 0
+    MPI_Request * datarequests;
+    MPI_Request * controlrequests;
+  } sendslot;
+
+  /// With the put transport, a subint whose data has been put but not yet flushed, so its control array is still to go
+  typedef struct {
+    int targetcore;
+    int segment;
+    s32 * control;
+    int ncontrol;
+    MPI_Request * controlrequest;
+  } pendingput;
+
 
  /** 
   * Launches a new reading thread, that will read from a file on disk and populate the databuffer as fast as possible
@@ -330,9 +351,50 @@ protected:
   void waitForBuffer(int buffersegment);
 
  /**
-  * Sends some diagnostics info using difxmessage
+  * Sends some diagnostics info using difxmessage (once per second); derived classes may add their own
+  */
+  virtual void sendDiagnostics();
+
+ /**
+  * Allocates databuffer in a window shared with the other processes on this node, for the shared transport.  Collective
+  * @param bytes The length of the buffer
+  */
+  void allocateSharedBuffer(int bytes);
+
+ /**
+  * Sends one subint of data and its control array to a Core, using the transport chosen in the Configuration
+  * @param targetcore The MPI id of the Core
+  * @param data The start of the data to send
+  * @param bytes The number of bytes of data
+  * @param control The control array; with the put and shared transports it must have room for two more ints
+  * @param ncontrol The length of the control array
+  * @param datarequest Set to the request for the data send (MPI_REQUEST_NULL if the transfer has already completed,
+  *                    or with the shared transport the receive of the Core's notice that it has finished with the data)
+  * @param controlrequest Set to the request for the control send
+  */
+  void sendToCore(int targetcore, u8 * data, int bytes, s32 * control, int ncontrol, MPI_Request * datarequest, MPI_Request * controlrequest);
+
+ /**
+  * With the put transport, flushes all outstanding puts and sends the control arrays that tell the Cores the data has landed.
+  * Called whenever the main thread would otherwise block, or before the segment data was put from can be reused
+  */
+  void completePendingPuts();
+
+ /**
+  * Whether any put from the given segment of the databuffer has yet to be flushed
+  * @param segment The segment index
+  * @return True if completePendingPuts must be called before the segment's sends can complete
+  */
+  bool hasPendingPuts(int segment);
+
+ /**
+  * Whether a range of the databuffer starting in the current segment holds only data that the read thread has
+  * finished with.  The part of a segment beyond its valid bytes may still be filled in while the next segment is read
+  * @param startpos The index in the databuffer of the first byte
+  * @param bytes The number of bytes
+  * @return True if no byte of the range can change before the segment is reused
   */
-  void sendDiagnostics();
+  bool isDataFinal(int startpos, int bytes);
 
   //local variables
   string stationname;
@@ -353,6 +415,22 @@ protected:
   pthread_mutex_t outstandingsendlock;
   MPI_Status * datastatuses;
   MPI_Status * controlstatuses;
+  //for the put transport: the window the Cores expose, each Core's slot stride, slot count and number of subints put so far,
+  //and the puts waiting for the next flush
+  Configuration::datatransport transport;
+  MPI_Win landingwindow;
+  int * landingstride;
+  int * landingdepth;
+  long long * numputs;
+  pendingput * pendingputs;
+  int numpendingputs;
+  //for the persistent transport: the ring of staging buffers and the next one to use
+  sendslot * sendring;
+  int nextsendslot;
+  //for the shared transport: databuffer is a window shared with the other processes on this node, and which Cores can read it
+  MPI_Comm nodecomm;
+  MPI_Win sharedwindow;
+  bool * coresharesnode;
 };
 
 #endif
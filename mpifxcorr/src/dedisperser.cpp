@@ -0,0 +1,211 @@
+#include <math.h>
+#include <string.h>
+#include "dedisperser.h"
+#include "alert.h"
+
+const double StreamDedisperser::DISPERSION_CONSTANT = 4.148808e3;
+
+StreamDedisperser::StreamDedisperser(int numchannels, const double * chanfreqs, double tsamp, int numdms, const double * dms, int numsubbands, int dmspergroup, int blocklength)
+  : numchannels(numchannels), numdms(numdms), numsubbands(numsubbands), dmspergroup(dmspergroup), blocklength(blocklength),
+    maxintradelay(0), maxinterdelay(0), inputbase(0), subbandbase(0), numfilled(0), numadded(0),
+    subbandstart(0), intradelay(0), interdelay(0), input(0), subbands(0), output(0), initialisedok(false)
+{
+  double topfreq, groupdm, * subbandtop;
+  int slides;
+
+  if(numchannels < 1 || numdms < 1 || blocklength < 1 || tsamp <= 0.0)
+  {
+    cerror << startl << "Cannot dedisperse " << numchannels << " channels at " << numdms << " DMs in blocks of " << blocklength << " samples of " << tsamp << " s" << endl;
+    numgroups = 0;
+    return;
+  }
+  for(int d=0;d<numdms;d++)
+  {
+    if(dms[d] < 0.0)
+    {
+      cerror << startl << "Cannot dedisperse at a negative DM (" << dms[d] << ")" << endl;
+      numgroups = 0;
+      return;
+    }
+  }
+  if(this->numsubbands < 1)
+    this->numsubbands = 1;
+  if(this->numsubbands > numchannels)
+    this->numsubbands = numchannels;
+  if(this->dmspergroup < 1)
+    this->dmspergroup = 1;
+  numsubbands = this->numsubbands;
+  dmspergroup = this->dmspergroup;
+  numgroups = (numdms + dmspergroup - 1)/dmspergroup;
+
+  //split the channels into subbands and find the top of each
+  subbandstart = new int[numsubbands+1];
+  subbandtop = new double[numsubbands];
+  topfreq = chanfreqs[0];
+  for(int s=0;s<=numsubbands;s++)
+    subbandstart[s] = (int)(((long long)s*numchannels)/numsubbands);
+  for(int s=0;s<numsubbands;s++)
+  {
+    subbandtop[s] = chanfreqs[subbandstart[s]];
+    for(int c=subbandstart[s];c<subbandstart[s+1];c++)
+    {
+      if(chanfreqs[c] > subbandtop[s])
+        subbandtop[s] = chanfreqs[c];
+    }
+    if(subbandtop[s] > topfreq)
+      topfreq = subbandtop[s];
+  }
+
+  //dedisperse within each subband at the mean DM of each group, and shift the subbands at every DM
+  intradelay = new int*[numgroups];
+  for(int g=0;g<numgroups;g++)
+  {
+    int last = (g+1)*dmspergroup < numdms ? (g+1)*dmspergroup : numdms;
+    groupdm = 0.0;
+    for(int d=g*dmspergroup;d<last;d++)
+      groupdm += dms[d];
+    groupdm /= last - g*dmspergroup;
+    intradelay[g] = new int[numchannels];
+    for(int s=0;s<numsubbands;s++)
+    {
+      for(int c=subbandstart[s];c<subbandstart[s+1];c++)
+      {
+        //rounding each delay from the top of the band, so a group of one DM gets exactly the rounded delay
+        intradelay[g][c] = (int)floor(DISPERSION_CONSTANT*groupdm*(1.0/(chanfreqs[c]*chanfreqs[c]) - 1.0/(topfreq*topfreq))/tsamp + 0.5) -
+                           (int)floor(DISPERSION_CONSTANT*groupdm*(1.0/(subbandtop[s]*subbandtop[s]) - 1.0/(topfreq*topfreq))/tsamp + 0.5);
+        if(intradelay[g][c] > maxintradelay)
+          maxintradelay = intradelay[g][c];
+      }
+    }
+  }
+  interdelay = new int*[numdms];
+  for(int d=0;d<numdms;d++)
+  {
+    interdelay[d] = new int[numsubbands];
+    for(int s=0;s<numsubbands;s++)
+    {
+      interdelay[d][s] = (int)floor(DISPERSION_CONSTANT*dms[d]*(1.0/(subbandtop[s]*subbandtop[s]) - 1.0/(topfreq*topfreq))/tsamp + 0.5);
+      if(interdelay[d][s] > maxinterdelay)
+        maxinterdelay = interdelay[d][s];
+    }
+  }
+  delete [] subbandtop;
+  maxdelay = maxintradelay + maxinterdelay;
+
+  //keep enough history that it only needs sliding back once its length in new samples has been used
+  slides = (maxintradelay + blocklength - 1)/blocklength;
+  inputlength = maxintradelay + blocklength*(slides > 1 ? slides : 1);
+  slides = (maxinterdelay + blocklength - 1)/blocklength;
+  subbandlength = maxinterdelay + blocklength*(slides > 1 ? slides : 1);
+  input = vectorAlloc_f32((size_t)numchannels*inputlength);
+  subbands = vectorAlloc_f32((size_t)numgroups*numsubbands*subbandlength);
+  output = vectorAlloc_f32((size_t)numdms*blocklength);
+  if(input == 0 || subbands == 0 || output == 0)
+  {
+    cerror << startl << "Cannot allocate " << ((size_t)numchannels*inputlength + (size_t)numgroups*numsubbands*subbandlength)*sizeof(f32)/1048576 << " MB of dedispersion history" << endl;
+    return;
+  }
+  vectorZero_f32(input, numchannels*inputlength);
+  vectorZero_f32(subbands, numgroups*numsubbands*subbandlength);
+  vectorZero_f32(output, numdms*blocklength);
+  initialisedok = true;
+}
+
+StreamDedisperser::~StreamDedisperser()
+{
+  for(int g=0;g<numgroups;g++)
+    delete [] intradelay[g];
+  delete [] intradelay;
+  if(interdelay)
+  {
+    for(int d=0;d<numdms;d++)
+      delete [] interdelay[d];
+  }
+  delete [] interdelay;
+  delete [] subbandstart;
+  if(input)
+    vectorFree(input);
+  if(subbands)
+    vectorFree(subbands);
+  if(output)
+    vectorFree(output);
+}
+
+bool StreamDedisperser::addSpectrum(const f32 * spectrum)
+{
+  f32 * dest = input + inputbase + maxintradelay + numfilled;
+
+  for(int c=0;c<numchannels;c++)
+    dest[(size_t)c*inputlength] = spectrum[c];
+  numadded++;
+  if(++numfilled < blocklength)
+    return false;
+
+  dedisperseBlock();
+  numfilled = 0;
+
+  return true;
+}
+
+int StreamDedisperser::getDelay(int dmindex, int channel) const
+{
+  int s = 0;
+
+  while(subbandstart[s+1] <= channel)
+    s++;
+
+  return intradelay[dmindex/dmspergroup][channel] + interdelay[dmindex][s];
+}
+
+void StreamDedisperser::dedisperseBlock()
+{
+  f32 * dest;
+  vecStatus status;
+
+  //stage 1: dedisperse the channels of each subband to its top, once per group of DMs
+  for(int g=0;g<numgroups;g++)
+  {
+    for(int s=0;s<numsubbands;s++)
+    {
+      dest = subbands + ((size_t)g*numsubbands + s)*subbandlength + subbandbase + maxinterdelay;
+      vectorZero_f32(dest, blocklength);
+      for(int c=subbandstart[s];c<subbandstart[s+1];c++)
+      {
+        status = vectorAdd_f32_I(input + (size_t)c*inputlength + inputbase + intradelay[g][c], dest, blocklength);
+        if(status != vecNoErr)
+          csevere << startl << "Error dedispersing channel " << c << ", status " << status << endl;
+      }
+    }
+  }
+
+  //stage 2: shift the subbands into line for each DM and add them up
+  for(int d=0;d<numdms;d++)
+  {
+    const f32 * groupsubbands = subbands + (size_t)(d/dmspergroup)*numsubbands*subbandlength + subbandbase;
+    dest = output + (size_t)d*blocklength;
+    vectorZero_f32(dest, blocklength);
+    for(int s=0;s<numsubbands;s++)
+    {
+      status = vectorAdd_f32_I(groupsubbands + (size_t)s*subbandlength + interdelay[d][s], dest, blocklength);
+      if(status != vecNoErr)
+        csevere << startl << "Error summing subband " << s << " at DM index " << d << ", status " << status << endl;
+    }
+  }
+
+  //move on, sliding the histories back once they are used up
+  inputbase += blocklength;
+  if(inputbase + maxintradelay + blocklength > inputlength)
+  {
+    for(int c=0;c<numchannels;c++)
+      memmove(input + (size_t)c*inputlength, input + (size_t)c*inputlength + inputbase, maxintradelay*sizeof(f32));
+    inputbase = 0;
+  }
+  subbandbase += blocklength;
+  if(subbandbase + maxinterdelay + blocklength > subbandlength)
+  {
+    for(int i=0;i<numgroups*numsubbands;i++)
+      memmove(subbands + (size_t)i*subbandlength, subbands + (size_t)i*subbandlength + subbandbase, maxinterdelay*sizeof(f32));
+    subbandbase = 0;
+  }
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -0,0 +1,98 @@
+/** \file dedisperser.h
+ *  \brief Streaming incoherent dedispersion of a filterbank over many trial DMs
+ *
+ * Spectra are added one time sample at a time; every block of samples, a time series for each trial
+ * DM is produced for a block that ended the largest dispersion delay earlier, so the latency is fixed.
+ * The subband algorithm is used: the channels of each subband are first dedispersed (to the top of
+ * the subband) at one DM per group of trial DMs, and the subbands are then shifted and summed for each
+ * trial DM in the group.  That costs channels*groups + subbands*DMs additions per sample instead of
+ * channels*DMs, at the price of a little smearing within the subbands for the DMs in a group furthest
+ * from its centre.  With one DM per group, or one channel per subband, the result is exact.
+ *
+ * Both stages add whole blocks of contiguous samples at a time with the vector kernels, reading from
+ * per-channel (and per-subband) histories that are slid back only once every few blocks.
+ */
+
+#ifndef DEDISPERSER_H
+#define DEDISPERSER_H
+
+#include "architecture.h"
+
+/**
+@class StreamDedisperser
+@brief Dedisperses a stream of spectra at many trial DMs with a fixed latency
+*/
+class StreamDedisperser{
+public:
+ /**
+  * Works out the delays and allocates the histories
+  * @param numchannels The number of channels in each spectrum
+  * @param chanfreqs The centre frequency of each channel (MHz), increasing or decreasing (subbands are runs of adjacent channels)
+  * @param tsamp The time between spectra (s)
+  * @param numdms The number of trial DMs
+  * @param dms The trial DMs (pc/cm^3, not negative), best given in increasing order so the groups are compact
+  * @param numsubbands The number of subbands (groups of adjacent channels)
+  * @param dmspergroup The number of adjacent trial DMs that share the dedispersion within subbands
+  * @param blocklength The number of samples output for each DM at a time
+  */
+  StreamDedisperser(int numchannels, const double * chanfreqs, double tsamp, int numdms, const double * dms, int numsubbands, int dmspergroup, int blocklength);
+  ~StreamDedisperser();
+
+ /**
+  * Adds the next spectrum
+  * @param spectrum The value of each channel, in the order given to the constructor
+  * @return True if this completed a block, and getDedispersed() now holds a new block of output
+  */
+  bool addSpectrum(const f32 * spectrum);
+
+ /**
+  * The latest block of output for one trial DM: the sum over channels, each delayed by its dispersion
+  * delay at that DM relative to the highest frequency, for getBlockLength() samples from getOutputStart()
+  */
+  inline const f32 * getDedispersed(int dmindex) const { return output + (size_t)dmindex*blocklength; }
+
+ /**
+  * The number of the spectrum (counting the first added as 0) that the first sample of the latest output
+  * block lines up with at the highest frequency.  It is negative for the first few blocks, whose output
+  * is built from incomplete sums (the earlier spectra at the lower frequencies were never seen)
+  */
+  inline long long getOutputStart() const { return numadded - blocklength - maxdelay; }
+
+  ///@return The number of spectra between a spectrum being added and the output it contributes to at the highest DM
+  inline int getMaxDelay() const { return maxdelay; }
+
+  ///@return The number of samples per DM in each output block
+  inline int getBlockLength() const { return blocklength; }
+
+  ///@return The number of trial DMs
+  inline int getNumDMs() const { return numdms; }
+
+  ///@return The delay (in samples) of channel c at trial DM d, as applied (intra-subband plus subband delay)
+  int getDelay(int dmindex, int channel) const;
+
+  ///@return False if the parameters made no sense or the histories could not be allocated
+  inline bool initialisedOK() const { return initialisedok; }
+
+  ///The dispersion constant (s MHz^2 cm^3/pc)
+  static const double DISPERSION_CONSTANT;
+
+private:
+  void dedisperseBlock();
+
+  int numchannels, numdms, numsubbands, dmspergroup, numgroups, blocklength;
+  int maxintradelay, maxinterdelay, maxdelay;
+  int inputlength, subbandlength;   //samples of history kept per channel and per subband
+  int inputbase, subbandbase;       //where the oldest sample still needed sits in each history
+  int numfilled;
+  long long numadded;
+  int * subbandstart;   //[subband+1] first channel of each subband
+  int ** intradelay;    //[group][channel] delay relative to the top of the channel's subband at the group's DM
+  int ** interdelay;    //[dm][subband] delay of the top of each subband relative to the top of the band
+  f32 * input;          //[channel][inputlength]
+  f32 * subbands;       //[group][subband][subbandlength]
+  f32 * output;         //[dm][blocklength]
+  bool initialisedok;
+};
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
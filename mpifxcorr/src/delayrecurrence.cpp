@@ -0,0 +1,34 @@
+#include "delayrecurrence.h"
+
+DelayRecurrence::DelayRecurrence()
+{
+  poly[0] = poly[1] = poly[2] = 0.0;
+  currentindex = -2;
+  stepssinceresync = 0;
+  start = centre = end = slope = 0.0;
+  startdiff = centrediff = seconddiff = 0.0;
+}
+
+void DelayRecurrence::setPolynomial(const f64 * polynomial)
+{
+  poly[0] = polynomial[0];
+  poly[1] = polynomial[1];
+  poly[2] = polynomial[2];
+  currentindex = -2; //force a resync, whatever index comes next
+}
+
+void DelayRecurrence::resync(int index)
+{
+  f64 x = index;
+
+  currentindex = index;
+  stepssinceresync = 0;
+  start = evaluate(x);
+  centre = evaluate(x + 0.5);
+  end = evaluate(x + 1.0);
+  slope = poly[1] + 2.0*poly[0]*x;
+  startdiff = end - start;
+  centrediff = evaluate(x + 1.5) - centre;
+  seconddiff = 2.0*poly[0];
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
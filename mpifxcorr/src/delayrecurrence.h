@@ -0,0 +1,78 @@
+/** \file delayrecurrence.h
+ *  \brief Incremental evaluation of the quadratic delay interpolator across consecutive FFTs
+ */
+
+#ifndef DELAYRECURRENCE_H
+#define DELAYRECURRENCE_H
+
+#include "architecture.h"
+
+/**
+@class DelayRecurrence
+@brief Steps the delay polynomial of a Mode from one FFT to the next by forward differencing
+
+Mode::setOffsets obtains a quadratic interpolator delay(x) = p[0]*x^2 + p[1]*x + p[2] (x in FFTs from
+the start of the subint, delay in microseconds) and Mode::process needs the delay at the start, centre and
+end of each FFT, plus the slope at its start.  The FFTs of a subint are processed in order by each thread,
+so instead of evaluating the polynomial three times per FFT this class carries the values and their first
+differences forward, adding the constant second difference at each step.  Every RESYNC_INTERVAL steps
+(and whenever the index is not the successor of the previous one) the values are evaluated exactly again,
+so the accumulated rounding error stays bounded at a few ulp of the delay.
+*/
+class DelayRecurrence{
+public:
+  DelayRecurrence();
+
+ /**
+  * Loads a new delay polynomial; the next call to moveTo will evaluate it exactly
+  * @param polynomial The coefficients p[0] (quadratic), p[1] (linear), p[2] (constant)
+  */
+  void setPolynomial(const f64 * polynomial);
+
+ /**
+  * Positions the generator at the given FFT index, stepping incrementally if possible
+  * @param index The FFT index within the subint
+  */
+  inline void moveTo(int index)
+  {
+    if(index == currentindex + 1 && stepssinceresync < RESYNC_INTERVAL)
+    {
+      currentindex = index;
+      stepssinceresync++;
+      start = end;
+      centre += centrediff;
+      startdiff += seconddiff;
+      centrediff += seconddiff;
+      end = start + startdiff;
+      slope += seconddiff;
+    }
+    else
+      resync(index);
+  }
+
+  ///@return The delay at the start of the current FFT
+  inline f64 delayAtStart() const { return start; }
+  ///@return The delay at the centre of the current FFT
+  inline f64 delayAtCentre() const { return centre; }
+  ///@return The delay at the end of the current FFT (ie the start of the next)
+  inline f64 delayAtEnd() const { return end; }
+  ///@return The rate of change of the delay (per FFT) at the start of the current FFT
+  inline f64 slopeAtStart() const { return slope; }
+
+  ///@return The value of the polynomial at an arbitrary point, evaluated directly
+  inline f64 evaluate(f64 x) const { return poly[0]*x*x + poly[1]*x + poly[2]; }
+
+  ///Maximum number of incremental steps before the values are recomputed exactly
+  static const int RESYNC_INTERVAL = 32;
+
+private:
+  void resync(int index);
+
+  f64 poly[3];
+  int currentindex, stepssinceresync;
+  f64 start, centre, end, slope;
+  f64 startdiff, centrediff, seconddiff;
+};
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
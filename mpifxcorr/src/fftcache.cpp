@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include "architecture.h"
+#include "fftcache.h"
+#include "alert.h"
+
+//only the FFTW build has a planner worth caching; cuFFTW (the GPU build) has no wisdom,
+//so it keeps making its own plans in architecture.h
+#if (ARCH == GENERIC) && defined(FFTW3_H)
+#define FFT_PLAN_CACHE 1
+#else
+#define FFT_PLAN_CACHE 0
+#endif
+
+static FFTPlanCacheStats cachestats = {0, 0, 0, 0.0, 0.0};
+
+#if FFT_PLAN_CACHE
+
+typedef struct {
+  int type, len, inalign, outalign;
+} FFTPlanKey;
+
+typedef struct {
+  fftwf_plan plan;
+  double plantime;
+} FFTPlanEntry;
+
+static bool operator<(const FFTPlanKey & a, const FFTPlanKey & b)
+{
+  if(a.type != b.type) return a.type < b.type;
+  if(a.len != b.len) return a.len < b.len;
+  if(a.inalign != b.inalign) return a.inalign < b.inalign;
+  return a.outalign < b.outalign;
+}
+
+static std::map<FFTPlanKey, FFTPlanEntry> plancache;
+static bool wisdomchecked = false;
+static const char * wisdomfile = 0;
+static bool wisdomdirty = false;
+
+//a plan may only be executed on arrays with the same alignment as those it was made with
+static int bufferAlignment(const void * buffer)
+{
+  uintptr_t address = (uintptr_t)buffer;
+  int alignment = 1;
+
+  while(alignment < 64 && (address & alignment) == 0)
+    alignment <<= 1;
+
+  return alignment;
+}
+
+static double monotonicSeconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+//called with FFTinitMutex held, before the first plan is made
+static void loadFFTWisdom()
+{
+  wisdomchecked = true;
+  wisdomfile = getenv("DIFX_FFTW_WISDOM");
+  if(wisdomfile == 0 || wisdomfile[0] == 0)
+  {
+    wisdomfile = 0;
+    return;
+  }
+  if(access(wisdomfile, R_OK) != 0)
+    cverbose << startl << "FFTW wisdom file " << wisdomfile << " does not exist yet; it will be created" << endl;
+  else if(fftwf_import_wisdom_from_filename(wisdomfile) == 0)
+    cwarn << startl << "Could not import FFTW wisdom from " << wisdomfile << " - it will be overwritten" << endl;
+  else
+    cverbose << startl << "Imported FFTW wisdom from " << wisdomfile << endl;
+}
+
+static fftwf_plan makeFFTPlan(genericFFTPlanType type, int len, void * in, void * out, unsigned int flags)
+{
+  switch(type)
+  {
+    case GEN_FFT_R2C:
+      return fftwf_plan_dft_r2c_1d(len, (f32 *)in, (fftwf_complex *)out, flags);
+    case GEN_FFT_C2R:
+      return fftwf_plan_dft_c2r_1d(len, (fftwf_complex *)in, (f32 *)out, flags);
+    case GEN_FFT_C2C:
+      return fftwf_plan_dft_1d(len, (fftwf_complex *)in, (fftwf_complex *)out, FFTW_FORWARD, flags);
+  }
+  return 0;
+}
+
+fftwf_plan genericGetFFTPlan(genericFFTPlanType type, int len, void * in, void * out)
+{
+  FFTPlanKey key;
+  FFTPlanEntry entry;
+  std::map<FFTPlanKey, FFTPlanEntry>::iterator it;
+  double t0;
+
+  key.type = type;
+  key.len = len;
+  key.inalign = bufferAlignment(in);
+  key.outalign = bufferAlignment(out);
+
+  pthread_mutex_lock(&FFTinitMutex);
+  if(!wisdomchecked)
+    loadFFTWisdom();
+  it = plancache.find(key);
+  if(it != plancache.end())
+  {
+    cachestats.reuses++;
+    cachestats.savedtime += it->second.plantime;
+    pthread_mutex_unlock(&FFTinitMutex);
+    return it->second.plan;
+  }
+
+  t0 = monotonicSeconds();
+  entry.plan = 0;
+  if(wisdomfile)
+  {
+    //measured plans are worth having once the measurement is remembered between jobs
+    entry.plan = makeFFTPlan(type, len, in, out, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    if(entry.plan)
+      cachestats.wisdomplans++;
+    else
+    {
+      entry.plan = makeFFTPlan(type, len, in, out, FFTW_MEASURE);
+      wisdomdirty = true;
+    }
+  }
+  else
+    entry.plan = makeFFTPlan(type, len, in, out, FFTW_ESTIMATE);
+  entry.plantime = monotonicSeconds() - t0;
+  if(entry.plan)
+  {
+    plancache[key] = entry;
+    cachestats.plans++;
+    cachestats.plantime += entry.plantime;
+  }
+  pthread_mutex_unlock(&FFTinitMutex);
+
+  return entry.plan;
+}
+
+#endif
+
+void getFFTPlanCacheStats(FFTPlanCacheStats * stats)
+{
+#if FFT_PLAN_CACHE
+  pthread_mutex_lock(&FFTinitMutex);
+  *stats = cachestats;
+  pthread_mutex_unlock(&FFTinitMutex);
+#else
+  *stats = cachestats;
+#endif
+}
+
+bool saveFFTWisdom()
+{
+  bool ok = true;
+#if FFT_PLAN_CACHE
+  char tmpname[PATH_MAX];
+
+  pthread_mutex_lock(&FFTinitMutex);
+  if(wisdomfile && wisdomdirty)
+  {
+    //write then rename, so that other processes on this node never see a partial file
+    snprintf(tmpname, PATH_MAX, "%s.%d", wisdomfile, getpid());
+    if(fftwf_export_wisdom_to_filename(tmpname) == 0 || rename(tmpname, wisdomfile) != 0)
+    {
+      cwarn << startl << "Could not write FFTW wisdom to " << wisdomfile << endl;
+      unlink(tmpname);
+      ok = false;
+    }
+    else
+    {
+      cverbose << startl << "Wrote FFTW wisdom to " << wisdomfile << endl;
+      wisdomdirty = false;
+    }
+  }
+  pthread_mutex_unlock(&FFTinitMutex);
+#endif
+
+  return ok;
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
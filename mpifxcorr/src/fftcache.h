@@ -0,0 +1,47 @@
+/** \file fftcache.h
+ *  \brief Process-wide cache of FFTW plans (and FFTW wisdom) for the generic (non-IPP) build
+ *
+ * Every Mode - one per datastream, configuration and processing thread - and every PCal
+ * extractor needs FFTs of the same handful of lengths.  In the generic build the
+ * vectorInit[FD]FT* functions in architecture.h obtain their plans from this cache, so each
+ * plan is made only once per transform type, length and buffer alignment and is then shared
+ * by all specs; each spec executes it on its own buffers through FFTW's thread safe new-array
+ * interface.  Plans are kept for the life of the process, so a configuration change that
+ * deletes and recreates the Modes does not plan again.
+ *
+ * If the environment variable DIFX_FFTW_WISDOM names a file, wisdom is imported from it before
+ * the first plan is made, plans are measured rather than estimated, and any new wisdom is
+ * written back (atomically, so several processes on one node may share the file) when
+ * saveFFTWisdom() is called.  Later jobs on the same node then skip the planning.
+ *
+ * In the IPP build there is nothing to cache; the statistics are all zero and saveFFTWisdom()
+ * does nothing.
+ */
+
+#ifndef FFTCACHE_H
+#define FFTCACHE_H
+
+/// Running totals for the process-wide FFT plan cache
+typedef struct {
+  int plans;          ///< Distinct plans made
+  int wisdomplans;    ///< Of those, the number that were made directly from imported wisdom
+  int reuses;         ///< Number of times an existing plan was handed out instead of planning
+  double plantime;    ///< Seconds spent in the FFTW planner
+  double savedtime;   ///< Estimated planner seconds saved by reusing plans
+} FFTPlanCacheStats;
+
+/**
+ * Copies the current cache totals
+ * @param stats Filled in with the totals so far
+ */
+void getFFTPlanCacheStats(FFTPlanCacheStats * stats);
+
+/**
+ * Writes the accumulated FFTW wisdom back to the DIFX_FFTW_WISDOM file, if one is in use and
+ * any plans were made that did not come from it
+ * @return True unless the wisdom file could not be written
+ */
+bool saveFFTWisdom();
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
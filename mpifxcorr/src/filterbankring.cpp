@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "filterbankring.h"
+#include "alert.h"
+
+const char FilterbankRing::MAGIC[8] = { 'D', 'I', 'F', 'X', 'F', 'B', 'R', 0 };
+const int FilterbankRing::RING_VERSION;
+const int FilterbankRing::HEADER_BYTES;
+
+FilterbankRing::FilterbankRing(const char * filename, int numslots, int numchannels)
+  : filename(filename), numslots(numslots), numchannels(numchannels), mappedbytes(0), mapping(0), header(0), initialisedok(false)
+{
+  int fd;
+
+  slotbytes = sizeof(FilterbankRecord) + numchannels*sizeof(f32);
+  slotbytes = (slotbytes + HEADER_BYTES - 1) - (slotbytes + HEADER_BYTES - 1)%HEADER_BYTES;
+  if(numslots < 1 || numchannels < 1)
+  {
+    cerror << startl << "Cannot make a filterbank ring of " << numslots << " records of " << numchannels << " channels" << endl;
+    return;
+  }
+
+  //write to a new file and rename it into place, so a reader never sees a half-made ring
+  std::string tempname = this->filename + ".new";
+  fd = open(tempname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+  {
+    cerror << startl << "Cannot create filterbank ring " << tempname << " : " << strerror(errno) << endl;
+    return;
+  }
+  mappedbytes = HEADER_BYTES + (size_t)numslots*slotbytes;
+  if(ftruncate(fd, mappedbytes) != 0 || !map(fd, true))
+  {
+    cerror << startl << "Cannot size filterbank ring " << tempname << " to " << mappedbytes << " bytes : " << strerror(errno) << endl;
+    close(fd);
+    unlink(tempname.c_str());
+    return;
+  }
+  close(fd);
+
+  header->version = RING_VERSION;
+  header->numslots = numslots;
+  header->numchannels = numchannels;
+  header->slotbytes = slotbytes;
+  header->claimed = 0;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(header->magic, MAGIC, sizeof(MAGIC));
+  if(rename(tempname.c_str(), filename) != 0)
+  {
+    cerror << startl << "Cannot rename " << tempname << " to " << filename << " : " << strerror(errno) << endl;
+    unlink(tempname.c_str());
+    return;
+  }
+  initialisedok = true;
+}
+
+FilterbankRing::FilterbankRing(const char * filename)
+  : filename(filename), numslots(0), numchannels(0), slotbytes(0), mappedbytes(0), mapping(0), header(0), initialisedok(false)
+{
+  struct stat st;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0)
+  {
+    cerror << startl << "Cannot open filterbank ring " << filename << " : " << strerror(errno) << endl;
+    return;
+  }
+  if(fstat(fd, &st) != 0 || st.st_size < HEADER_BYTES)
+  {
+    cerror << startl << filename << " is not a filterbank ring" << endl;
+    close(fd);
+    return;
+  }
+  mappedbytes = st.st_size;
+  if(!map(fd, false))
+  {
+    cerror << startl << "Cannot map filterbank ring " << filename << " : " << strerror(errno) << endl;
+    close(fd);
+    return;
+  }
+  close(fd);
+  if(memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != RING_VERSION ||
+     (size_t)HEADER_BYTES + (size_t)header->numslots*header->slotbytes > mappedbytes)
+  {
+    cerror << startl << filename << " is not a version " << RING_VERSION << " filterbank ring" << endl;
+    return;
+  }
+  numslots = header->numslots;
+  numchannels = header->numchannels;
+  slotbytes = header->slotbytes;
+  initialisedok = true;
+}
+
+FilterbankRing::~FilterbankRing()
+{
+  if(mapping)
+    munmap(mapping, mappedbytes);
+}
+
+bool FilterbankRing::map(int fd, bool writable)
+{
+  void * m = mmap(0, mappedbytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+  if(m == MAP_FAILED)
+    return false;
+  mapping = (char *)m;
+  header = (RingHeader *)mapping;
+
+  return true;
+}
+
+FilterbankRecord * FilterbankRing::beginRecord(long long * number)
+{
+  FilterbankRecord * record;
+
+  *number = __atomic_fetch_add(&(header->claimed), 1, __ATOMIC_RELAXED);
+  record = slot(*number);
+  //readers of the previous occupant of this slot will see it change
+  __atomic_store_n(&(record->sequence), -(*number + 1), __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  return record;
+}
+
+void FilterbankRing::commitRecord(FilterbankRecord * record, long long number)
+{
+  __atomic_store_n(&(record->sequence), number + 1, __ATOMIC_RELEASE);
+}
+
+int FilterbankRing::read(long long number, FilterbankRecord * record) const
+{
+  const FilterbankRecord * source = slot(number);
+  long long sequence, check;
+  int channels;
+
+  sequence = __atomic_load_n(&(source->sequence), __ATOMIC_ACQUIRE);
+  if(sequence != number + 1)
+    return (sequence > number + 1 || -sequence > number + 1) ? READ_OVERWRITTEN : READ_PENDING;
+  memcpy(record, source, sizeof(FilterbankRecord));
+  channels = record->numchannels;
+  if(channels < 0 || channels > numchannels)
+    channels = 0;
+  memcpy(record->data, source->data, channels*sizeof(f32));
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  check = __atomic_load_n(&(source->sequence), __ATOMIC_RELAXED);
+  if(check != sequence)
+    return READ_OVERWRITTEN;
+  record->numchannels = channels;
+
+  return READ_OK;
+}
+
+long long FilterbankRing::getNumClaimed() const
+{
+  return __atomic_load_n(&(header->claimed), __ATOMIC_ACQUIRE);
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
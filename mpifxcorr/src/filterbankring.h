@@ -0,0 +1,134 @@
+/** \file filterbankring.h
+ *  \brief A memory-mapped ring of filterbank spectra shared between a Core and transient search programs
+ *
+ * Each Core process can write the band-averaged autocorrelation spectrum of every datastream and
+ * recorded band, at the autocorrelation averaging time, into a ring of fixed-size records in a file
+ * (normally under /dev/shm).  Readers such as utils/dedisperse_stream map the same file and follow
+ * the writer with bounded latency; a reader that falls more than the ring length behind loses the
+ * oldest records rather than holding up the correlation.  Writers never wait for readers.
+ *
+ * Every record carries a sequence number which the writer makes negative while the record is being
+ * filled and sets to (record number + 1) once it is complete, so a reader can tell whether the slot
+ * it copied held the record it wanted, a record that is still being written, or a later one.
+ */
+
+#ifndef FILTERBANKRING_H
+#define FILTERBANKRING_H
+
+#include <string>
+#include "architecture.h"
+
+/**
+@struct FilterbankRecord
+@brief One filterbank spectrum (one datastream, one recorded band, one autocorrelation average)
+
+Channel c of an upper sideband band is centred at freq + (c+0.5)*bandwidth/numchannels MHz, and of a
+lower sideband band at freq - (c+0.5)*bandwidth/numchannels MHz.  A record with no channels marks data
+that was missing or too sparse to use.
+*/
+typedef struct {
+  long long sequence;  ///< Record number + 1 once complete; negative while being written
+  int mjd;             ///< The MJD that seconds is counted from (the job start MJD)
+  int datastream;      ///< The datastream index
+  double seconds;      ///< The centre of the averaging interval, in seconds after the start of mjd
+  double width;        ///< The length of the averaging interval in seconds
+  double freq;         ///< The band edge frequency (MHz), as in the frequency table
+  double bandwidth;    ///< The bandwidth (MHz)
+  int band;            ///< The recorded band index within the datastream
+  int freqindex;       ///< The frequency table index
+  int lowersideband;   ///< 1 if the channels run downward from freq
+  char polarisation;   ///< The polarisation of the band
+  char pad[3];
+  int numchannels;     ///< The number of channels that follow (up to the ring's channel count)
+  int configindex;     ///< The configuration in force
+  f32 data[0];         ///< The power spectral density of each channel
+} FilterbankRecord;
+
+/**
+@class FilterbankRing
+@brief Writer or reader of a FilterbankRecord ring file
+*/
+class FilterbankRing{
+public:
+  ///Possible results of read()
+  enum ReadStatus { READ_OK = 0, READ_PENDING = 1, READ_OVERWRITTEN = 2 };
+
+ /**
+  * Creates (or recreates) a ring file for writing
+  * @param filename The file to create
+  * @param numslots The number of records the ring holds
+  * @param numchannels The largest number of channels in a record
+  */
+  FilterbankRing(const char * filename, int numslots, int numchannels);
+
+ /**
+  * Maps an existing ring file for reading
+  * @param filename The file written by a Core
+  */
+  FilterbankRing(const char * filename);
+
+  ~FilterbankRing();
+
+ /**
+  * Claims the next record to fill in; several threads may write at once
+  * @param number Set to the number of the record claimed, to be passed to commitRecord
+  * @return The record, with room for getNumChannels() channels
+  */
+  FilterbankRecord * beginRecord(long long * number);
+
+  ///Marks a record obtained from beginRecord as complete
+  void commitRecord(FilterbankRecord * record, long long number);
+
+ /**
+  * Copies a record out of the ring
+  * @param number The record number wanted
+  * @param record Filled with the record; must have room for getRecordBytes() bytes
+  * @return READ_OK, READ_PENDING if it has not been completed yet, or READ_OVERWRITTEN if it is already gone
+  */
+  int read(long long number, FilterbankRecord * record) const;
+
+  ///@return The number of records claimed by writers so far (some may still be being written)
+  long long getNumClaimed() const;
+
+  ///@return False if the file could not be created or mapped, or is not a ring
+  inline bool initialisedOK() const { return initialisedok; }
+
+  ///@return The largest number of channels in a record
+  inline int getNumChannels() const { return numchannels; }
+
+  ///@return The number of records the ring holds
+  inline int getNumSlots() const { return numslots; }
+
+  ///@return The size of a record including its channels
+  inline int getRecordBytes() const { return slotbytes; }
+
+  ///@return The ring file name
+  inline const std::string & getFilename() const { return filename; }
+
+private:
+  typedef struct {
+    char magic[8];
+    int version;
+    int numslots;
+    int numchannels;
+    int slotbytes;
+    long long claimed;
+  } RingHeader;
+
+  static const char MAGIC[8];
+  static const int RING_VERSION = 1;
+  static const int HEADER_BYTES = 64;   //the header is padded to a cache line, as is each record
+
+  inline FilterbankRecord * slot(long long number) const { return (FilterbankRecord *)(mapping + HEADER_BYTES + (number % numslots)*slotbytes); }
+  bool map(int fd, bool writable);
+
+  std::string filename;
+  int numslots, numchannels, slotbytes;
+  size_t mappedbytes;
+  char * mapping;
+  RingHeader * header;
+  bool initialisedok;
+};
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
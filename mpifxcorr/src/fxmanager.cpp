@@ -65,6 +65,8 @@ void catch_pipe(int sig_num)
 
 using namespace std;
 
+const double FxManager::LAGGING_CORE_UTILISATION = 0.75;
+const double FxManager::CORE_RATE_SMOOTHING = 0.2;
 const string FxManager::CIRCULAR_POL_NAMES[4] = {"RR", "LL", "RL", "LR"};
 const string FxManager::LL_CIRCULAR_POL_NAMES[4] = {"LL", "RR", "LR", "RL"};
 const string FxManager::LINEAR_POL_NAMES[4] = {"XX", "YY", "XY", "YX"};
@@ -73,7 +75,8 @@ FxManager::FxManager(Configuration * conf, int ncores, int * dids, int * cids, i
   : config(conf), return_comm(rcomm), numcores(ncores), mpiid(id), visibilityconfigok(true), monitor(mon), hostname(hname), monitor_skip(monitor_skip), monitorport(port)
 {
   bool startskip;
-  int perr, minchans, confresultbytes, todiskbufferlen;
+  int perr, minchans, confresultbytes, todiskbufferlen, autocorrbytes, writeblocks, writesync;
+  char * writeenv;
   double headerbloatfactor;
   const string * polnames;
   pthread_attr_t attr;
@@ -140,13 +143,44 @@ FxManager::FxManager(Configuration * conf, int ncores, int * dids, int * cids, i
       todiskbufferlen = int(1.02*confresultbytes*headerbloatfactor); //a little extra margin to be sure
   }
 
-  todiskbuffer = (char*)vectorAlloc_u8(todiskbufferlen);
-  if(!todiskbuffer)
+  //autocorrelations are formatted after the cross-correlations, into a part of their own
+  autocorrbytes = 0;
+  for(int i=0;i<config->getNumConfigs();i++)
+  {
+    confresultbytes = 0;
+    for(int j=0;j<numdatastreams;j++)
+      confresultbytes += 2*config->getDNumTotalBands(i, j)*(config->getMaxNumChannels()*8 + Visibility::HEADER_BYTES);
+    if(confresultbytes > autocorrbytes)
+      autocorrbytes = confresultbytes;
+  }
+
+  //formatted integrations are written out by a thread of their own, writeblocks at a time
+  writeblocks = DEFAULT_WRITE_BLOCKS;
+  writeenv = getenv("DIFX_WRITE_BLOCKS");
+  if(writeenv != 0)
   {
-    cfatal << "Failed to allocate " << todiskbufferlen << " bytes in fxmanager for 'todiskbuffer' output writer buffer" << endl;
+    writeblocks = atoi(writeenv);
+    if(writeblocks < 1)
+    {
+      cwarn << startl << "DIFX_WRITE_BLOCKS was set to " << writeenv << "; using " << DEFAULT_WRITE_BLOCKS << endl;
+      writeblocks = DEFAULT_WRITE_BLOCKS;
+    }
+  }
+  writesync = 0;
+  writeenv = getenv("DIFX_WRITE_SYNC");
+  if(writeenv != 0)
+    writesync = atoi(writeenv);
+  viswriter = new VisWriter(writeblocks, (long long)todiskbufferlen + autocorrbytes, writesync);
+  if(!viswriter->initialisedOK())
+  {
+    cfatal << startl << "Failed to set up the visibility output writer (" << writeblocks << " blocks of " << todiskbufferlen + autocorrbytes << " bytes) - aborting!!!" << endl;
     MPI_Abort(MPI_COMM_WORLD, 1);
   }
-  estimatedbytes += todiskbufferlen;
+  estimatedbytes += (long long)writeblocks*(todiskbufferlen + autocorrbytes);
+  if(writesync > 0)
+    cinfo << startl << "Visibility output is queued in " << writeblocks << " blocks of " << (todiskbufferlen + autocorrbytes)/1048576.0 << " MB and synced to disk every " << writesync << " integrations" << endl;
+  else
+    cinfo << startl << "Visibility output is queued in " << writeblocks << " blocks of " << (todiskbufferlen + autocorrbytes)/1048576.0 << " MB" << endl;
   datastreamids = new int[numdatastreams];
   coreids = new int[numcores];
   corecounts = new int[numcores];
@@ -157,16 +191,36 @@ FxManager::FxManager(Configuration * conf, int ncores, int * dids, int * cids, i
     corecounts[i] = 0;
     recentcorecounts[i] = 0;
   }
-  coretimes = new int**[Core::RECEIVE_RING_LENGTH];
+
+  //work out how many subints beyond Core::RECEIVE_RING_LENGTH a fast core may have queued
+  maxcoreextra = config->getCoreQueueExtra(numcores);
+  extracreditpool = config->getCoreQueueExtraPool(numcores);
+  if(maxcoreextra > 0)
+    cinfo << startl << "Cores may queue up to " << maxcoreextra << " extra subints each, " << extracreditpool << " in total, shared according to their throughput" << endl;
+  else
+    cinfo << startl << "Extra subint queueing is disabled - each core will have " << Core::RECEIVE_RING_LENGTH << " subints outstanding" << endl;
+  maxcoredepth = Core::RECEIVE_RING_LENGTH + maxcoreextra;
+  totaloutstanding = 0;
+  receivessincerebalance = 0;
+
+  coretimes = new int**[maxcoredepth];
   numsent = new int[numcores];
-  extrareceived = new int[numcores];
+  numreceived = new int[numcores];
+  outstanding = new int[numcores];
+  coredepthlimit = new int[numcores];
+  coreinterval = new double[numcores];
+  lastreceivetime = new double[numcores];
   for(int i=0;i<numcores;i++)
   {
     numsent[i] = 0;
-    extrareceived[i] = 0;
+    numreceived[i] = 0;
+    outstanding[i] = 0;
+    coredepthlimit[i] = Core::RECEIVE_RING_LENGTH;
+    coreinterval[i] = 0.0;
+    lastreceivetime[i] = 0.0;
     coreids[i] = cids[i];
   }
-  for(int i=0;i<Core::RECEIVE_RING_LENGTH;i++)
+  for(int i=0;i<maxcoredepth;i++)
   {
     coretimes[i] = new int*[numcores];
     for(int j=0;j<numcores;j++)
@@ -184,7 +238,7 @@ FxManager::FxManager(Configuration * conf, int ncores, int * dids, int * cids, i
     polnames = LINEAR_POL_NAMES;
   for(int i=0;i<config->getVisBufferLength();i++)
   {
-    visbuffer[i] = new Visibility(config, i, config->getVisBufferLength(), todiskbuffer, todiskbufferlen, config->getExecuteSeconds(), initscan, initsec, initns, polnames);
+    visbuffer[i] = new Visibility(config, i, config->getVisBufferLength(), viswriter, todiskbufferlen, config->getExecuteSeconds(), initscan, initsec, initns, polnames);
     pthread_mutex_init(&(bufferlock[i]), NULL);
     islocked[i] = false;
     if(!visbuffer[i]->configuredOK()) { //problem with finding a polyco, probably
@@ -225,6 +279,20 @@ FxManager::FxManager(Configuration * conf, int ncores, int * dids, int * cids, i
 
   lastsource = numdatastreams;
 
+  //the put transport needs every process to take part in creating the Cores' landing window
+  if(config->getDataTransport() == Configuration::TRANSPORT_PUT)
+  {
+    u8 * nobuffer;
+    MPI_Win_allocate(0, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &nobuffer, &landingwindow);
+  }
+  //and the shared transport needs every process on a node to take part in creating that node's shared window
+  if(config->getDataTransport() == Configuration::TRANSPORT_SHARED)
+  {
+    u8 * nobuffer;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodecomm);
+    MPI_Win_allocate_shared(0, 1, MPI_INFO_NULL, nodecomm, &nobuffer, &sharedwindow);
+  }
+
   // Launch a thread to send monitoring data
   if (monitor) {
     pthread_cond_init(&monitorcond, NULL);
@@ -249,7 +317,7 @@ FxManager::FxManager(Configuration * conf, int ncores, int * dids, int * cids, i
 
 FxManager::~FxManager()
 {
-  for(int i=0;i<Core::RECEIVE_RING_LENGTH;i++)
+  for(int i=0;i<maxcoredepth;i++)
   {
     for(int j=0;j<numcores;j++)
       delete [] coretimes[i][j];
@@ -259,8 +327,12 @@ FxManager::~FxManager()
   delete [] numsent;
   delete [] datastreamids;
   delete [] coreids;
-  delete [] extrareceived;
-  vectorFree(todiskbuffer);
+  delete [] numreceived;
+  delete [] outstanding;
+  delete [] coredepthlimit;
+  delete [] coreinterval;
+  delete [] lastreceivetime;
+  delete viswriter;
   vectorFree(resultbuffer);
   for(int i=0;i<config->getVisBufferLength();i++)
     delete visbuffer[i];
@@ -310,7 +382,7 @@ void FxManager::terminate()
  */
 void FxManager::execute()
 {
-  int perr;
+  int perr, coreindex;
   long long sendcount = 0;
 
   cinfo << startl << "Hello World, I am the FxManager" << endl;
@@ -342,8 +414,15 @@ void FxManager::execute()
         senddata[0] = coreids[((int)sendcount)%numcores];
         sendData(senddata, ((int)sendcount)%numcores);
       }
-      else { //normal receive/resend
-        receiveData(true);
+      else { //send to a core with spare queue credit if there is one, otherwise receive and resend
+        coreindex = pickCore();
+        if(coreindex >= 0) {
+          senddata[0] = coreids[coreindex];
+          sendData(senddata, coreindex);
+        }
+        else {
+          while(!receiveData(true)) {}
+        }
       }
       sendcount++;
       if(sendcount == Core::RECEIVE_RING_LENGTH*numcores) //just finished "filling up"
@@ -363,14 +442,15 @@ void FxManager::execute()
   terminate();
   
   //receive the final data from each core
-  for(int i=0;i<Core::RECEIVE_RING_LENGTH;i++)
+  while(totaloutstanding > 0)
+    receiveData(false);
+  reportCoreUtilisation();
+  if(config->getDataTransport() == Configuration::TRANSPORT_PUT)
+    MPI_Win_free(&landingwindow);
+  if(config->getDataTransport() == Configuration::TRANSPORT_SHARED)
   {
-    for(int j=0;j<numcores;j++) {
-      if(sendcount==0)
-        break;
-      receiveData(false);
-      sendcount--;
-    }
+    MPI_Win_free(&sharedwindow);
+    MPI_Comm_free(&nodecomm);
   }
   
   //ensure the thread writes out all waiting visibilities
@@ -394,6 +474,7 @@ void FxManager::execute()
   perr = pthread_join(writethread, NULL);
   if(perr != 0)
     csevere << startl << "Error in closing writethread!!!" << endl;
+  viswriter->drain();
 
   if (monitor) {
     perr = pthread_join(monthread, NULL);
@@ -411,13 +492,16 @@ void FxManager::sendData(int data[], int coreindex)
 
   for(int j=0;j<numdatastreams;j++)
   {
-    //send the commands to the Datastreams
-    MPI_Ssend(data, 4, MPI_INT, datastreamids[j], DS_PROCESS, MPI_COMM_WORLD);
+    //send the commands to the Datastreams.  Not synchronous: a Datastream may be waiting for a Core that has
+    //subints queued to take its data, and that Core can only do so once we have received its next result
+    MPI_Send(data, 4, MPI_INT, datastreamids[j], DS_PROCESS, MPI_COMM_WORLD);
   }
-  coretimes[numsent[coreindex]%Core::RECEIVE_RING_LENGTH][coreindex][0] = data[1];
-  coretimes[numsent[coreindex]%Core::RECEIVE_RING_LENGTH][coreindex][1] = data[2];
-  coretimes[numsent[coreindex]%Core::RECEIVE_RING_LENGTH][coreindex][2] = data[3];
+  coretimes[numsent[coreindex]%maxcoredepth][coreindex][0] = data[1];
+  coretimes[numsent[coreindex]%maxcoredepth][coreindex][1] = data[2];
+  coretimes[numsent[coreindex]%maxcoredepth][coreindex][2] = data[3];
   numsent[coreindex]++;
+  outstanding[coreindex]++;
+  totaloutstanding++;
   data[3] += (nsincrement%1000000000);
   data[2] += (nsincrement/1000000000);
   if(data[3] >= 1000000000)
@@ -428,11 +512,11 @@ void FxManager::sendData(int data[], int coreindex)
   //cinfo << startl << "FXMANAGER has finished sending data" << endl;
 }
 
-void FxManager::receiveData(bool resend)
+bool FxManager::receiveData(bool resend)
 {
   MPI_Status mpistatus;
-  int sourcecore, sourceid=0, visindex, perr, infoindex;
-  bool viscomplete;
+  int sourcecore, sourceid=0, visindex=-1, perr, infoindex, nextcore;
+  bool viscomplete, sent=false;
   double scantime;
   int i, flag, subintscan;
 
@@ -470,29 +554,35 @@ void FxManager::receiveData(bool resend)
 
   corecounts[sourceid]++;
   recentcorecounts[sourceid]++;
-  infoindex = (numsent[sourceid]+extrareceived[sourceid])%Core::RECEIVE_RING_LENGTH;
-  if(numsent[sourceid] < Core::RECEIVE_RING_LENGTH)
-    infoindex = extrareceived[sourceid];
+  infoindex = numreceived[sourceid]%maxcoredepth;
   subintscan = coretimes[infoindex][sourceid][0];
   scantime = coretimes[infoindex][sourceid][1] + coretimes[infoindex][sourceid][2]/1000000000.0;
 
-  //put the data in the appropriate slot
-  if(mpistatus.MPI_TAG == CR_VALIDVIS) // the data is valid
-  {
-    //find where it belongs
+  //find where it belongs
+  if(mpistatus.MPI_TAG == CR_VALIDVIS)
     visindex = locateVisIndex(sourceid);
 
-    //immediately get some more data heading to that node
-    if(resend)
-    {
-      senddata[0] = sourcecore;
-      sendData(senddata, sourceid);
-    }
-    else
+  //acknowledge that we have received from this core
+  numreceived[sourceid]++;
+  outstanding[sourceid]--;
+  totaloutstanding--;
+  updateCoreRate(sourceid);
+
+  //immediately get some more data heading out
+  if(resend)
+  {
+    nextcore = pickCore();
+    if(nextcore >= 0)
     {
-      //still need to acknowledge that we have received from this core
-      extrareceived[sourceid]++;
+      senddata[0] = coreids[nextcore];
+      sendData(senddata, nextcore);
+      sent = true;
     }
+  }
+
+  //put the data in the appropriate slot
+  if(mpistatus.MPI_TAG == CR_VALIDVIS) // the data is valid
+  {
     if (visindex < 0)
       cwarn << startl << "Stale data was received from core " << sourceid << " regarding scan " << subintscan << ", time " << scantime << " seconds - it will be ignored!!!" << endl;
     else
@@ -528,14 +618,145 @@ void FxManager::receiveData(bool resend)
   else
   {
     cwarn << startl << "Invalid data was received from core " << sourcecore << " regarding scan " << subintscan << ", offset " << scantime << " seconds" << endl;
+  }
+
+  return sent;
+}
+
+int FxManager::pickCore()
+{
+  int best = -1;
+  double cost, bestcost = 0.0, meaninterval = 0.0;
+  int numknown = 0;
+
+  //a core below the ring length is holding its results until it gets more data, so it always comes first
+  for(int c=0;c<numcores;c++)
+  {
+    if(outstanding[c] < Core::RECEIVE_RING_LENGTH && (best < 0 || outstanding[c] < outstanding[best]))
+      best = c;
+  }
+  if(best >= 0 || totaloutstanding >= Core::RECEIVE_RING_LENGTH*numcores + extracreditpool)
+    return best;
 
-    //immediately get some more data heading to that node
-    if(resend)
+  //otherwise pick the core expected to finish a new subint soonest; cores with no estimate yet get the mean
+  for(int c=0;c<numcores;c++)
+  {
+    if(coreinterval[c] > 0.0)
     {
-      senddata[0] = sourcecore;
-      sendData(senddata, sourceid);
+      meaninterval += coreinterval[c];
+      numknown++;
     }
   }
+  meaninterval = (numknown > 0)?meaninterval/numknown:1.0;
+  for(int c=0;c<numcores;c++)
+  {
+    if(outstanding[c] >= coredepthlimit[c])
+      continue;
+    cost = (outstanding[c]+1)*((coreinterval[c] > 0.0)?coreinterval[c]:meaninterval);
+    if(best < 0 || cost < bestcost)
+    {
+      best = c;
+      bestcost = cost;
+    }
+  }
+
+  return best;
+}
+
+void FxManager::updateCoreRate(int coreindex)
+{
+  double now = MPI_Wtime();
+
+  if(lastreceivetime[coreindex] > 0.0)
+  {
+    if(coreinterval[coreindex] > 0.0)
+      coreinterval[coreindex] += CORE_RATE_SMOOTHING*(now - lastreceivetime[coreindex] - coreinterval[coreindex]);
+    else
+      coreinterval[coreindex] = now - lastreceivetime[coreindex];
+  }
+  lastreceivetime[coreindex] = now;
+
+  if(++receivessincerebalance >= numcores)
+  {
+    rebalanceCores();
+    receivessincerebalance = 0;
+  }
+}
+
+void FxManager::rebalanceCores()
+{
+  int remaining, fastest, extra;
+  double maxrate = 0.0;
+  bool * granted;
+
+  if(extracreditpool == 0)
+    return;
+
+  for(int c=0;c<numcores;c++)
+  {
+    if(coreinterval[c] > 0.0 && 1.0/coreinterval[c] > maxrate)
+      maxrate = 1.0/coreinterval[c];
+  }
+  if(maxrate == 0.0)
+    return; //no estimates yet
+
+  //hand out the credit fastest core first; cores lagging well behind the fastest get none, and lose any they had
+  granted = new bool[numcores];
+  for(int c=0;c<numcores;c++)
+  {
+    granted[c] = false;
+    coredepthlimit[c] = Core::RECEIVE_RING_LENGTH;
+  }
+  remaining = extracreditpool;
+  while(remaining > 0)
+  {
+    fastest = -1;
+    for(int c=0;c<numcores;c++)
+    {
+      if(granted[c] || coreinterval[c] <= 0.0 || 1.0/(coreinterval[c]*maxrate) < LAGGING_CORE_UTILISATION)
+        continue;
+      if(fastest < 0 || coreinterval[c] < coreinterval[fastest])
+        fastest = c;
+    }
+    if(fastest < 0)
+      break;
+    extra = (remaining < maxcoreextra)?remaining:maxcoreextra;
+    coredepthlimit[fastest] += extra;
+    remaining -= extra;
+    granted[fastest] = true;
+  }
+  delete [] granted;
+}
+
+void FxManager::reportCoreUtilisation()
+{
+  double maxrate = 0.0, rate, utilisation, minutilisation = 1.0, meanutilisation = 0.0;
+  int minutilisationindex = 0, numextra = 0;
+
+  for(int c=0;c<numcores;c++)
+  {
+    if(coreinterval[c] > 0.0 && 1.0/coreinterval[c] > maxrate)
+      maxrate = 1.0/coreinterval[c];
+  }
+  if(maxrate == 0.0)
+    return;
+
+  for(int c=0;c<numcores;c++)
+  {
+    rate = (coreinterval[c] > 0.0)?1.0/coreinterval[c]:0.0;
+    utilisation = rate/maxrate;
+    if(utilisation < minutilisation)
+    {
+      minutilisation = utilisation;
+      minutilisationindex = c;
+    }
+    meanutilisation += utilisation/numcores;
+    if(coredepthlimit[c] > Core::RECEIVE_RING_LENGTH)
+      numextra++;
+    cverbose << startl << "Core " << c << " (MPI id " << coreids[c] << ") is processing " << rate << " subints/s, utilisation " << utilisation << ", with " << outstanding[c] << "/" << coredepthlimit[c] << " subints queued" << endl;
+    difxMessageSendDifxDiagnosticCoreUtilisation(coreids[c], outstanding[c], coredepthlimit[c], rate, utilisation);
+  }
+  cinfo << startl << "Min/Mean core utilisation relative to the fastest core is " << minutilisation << "/" << meanutilisation << ", mincoreindex is " << minutilisationindex << ", " << numextra << " cores currently hold extra queue credit" << endl;
 }
 
 void FxManager::printSummary(int visindex)
@@ -547,6 +768,11 @@ void FxManager::printSummary(int visindex)
   cinfo << startl << numvis << "/" << config->getVisBufferLength() << " visibilities locked for accumulation, most recent index is " << newestlockedvis << endl;
   numvis = (oldestlockedvis+config->getVisBufferLength()-writesegment)%config->getVisBufferLength();
   cverbose << startl << numvis << "/" << config->getVisBufferLength() << " visibilities ready to write out from " << writesegment << endl;
+  numvis = viswriter->getNumQueued();
+  if(numvis > 1)
+    cinfo << startl << numvis << "/" << viswriter->getNumBlocks() << " formatted integrations are waiting to be written to disk" << endl;
+  else
+    cverbose << startl << numvis << "/" << viswriter->getNumBlocks() << " formatted integrations are waiting to be written to disk" << endl;
 
   visbufferduration = inttime*config->getVisBufferLength();
   minsubints = MAX_S32;
@@ -592,6 +818,7 @@ void FxManager::printSummary(int visindex)
       recentcorecounts[c] = 0;
     }
     cinfo << startl << "Min/Mean/Max number of subints processed in last " << visbufferduration << " seconds is " << minsubints << "/" << meansubints << "/" << maxsubints << ", mincoreindex is " << minsubintindex << ", maxcoreindex is " << maxsubintindex << endl;
+    reportCoreUtilisation();
   }
 }
 
@@ -649,8 +876,16 @@ void FxManager::initialiseOutput()
           output.open(filename, ios::trunc);
           output.close();
         }
+        if(Configuration::writeVisIndex()) {
+          //an index left over from an earlier run would point into the wrong file
+          sprintf(filename, "%s/INDEX_%05d_%06d.s%04d.b%04d", config->getOutputFilename().c_str(), config->getStartMJD(), config->getStartSeconds(), s, b);
+          output.open(filename, ios::trunc);
+          output.close();
+        }
       }
     }
+    if(Configuration::writeVisIndex())
+      cinfo << startl << "DIFX_VIS_INDEX is set: an INDEX_ file will be written alongside each DIFX_ output file" << endl;
 
     //write comments at top of pcal files
     visbuffer[0]->initialisePcalFiles();
@@ -717,9 +952,7 @@ int FxManager::locateVisIndex(int coreid)
   Visibility * vis;
 
   vblength = config->getVisBufferLength();
-  infoindex = (numsent[coreid]+extrareceived[coreid]) % Core::RECEIVE_RING_LENGTH;
-  if(numsent[coreid] < Core::RECEIVE_RING_LENGTH)
-    infoindex = extrareceived[coreid];
+  infoindex = numreceived[coreid] % maxcoredepth;
 
   corescan = coretimes[infoindex][coreid][0];
   coresec = coretimes[infoindex][coreid][1];
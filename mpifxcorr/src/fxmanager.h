@@ -96,9 +96,12 @@ protected:
   
 private:
   //constants
+  static const double LAGGING_CORE_UTILISATION;
+  static const double CORE_RATE_SMOOTHING;
   static const string CIRCULAR_POL_NAMES[4];
   static const string LL_CIRCULAR_POL_NAMES[4];
   static const string LINEAR_POL_NAMES[4];
+  static const int DEFAULT_WRITE_BLOCKS = 2; //one integration being formatted while the previous one is written
 
   //methods
  /** 
@@ -109,10 +112,32 @@ private:
   void sendData(int data[], int coreindex);
 
  /** 
-  * Receives one short-term accumulated result from a Core, and optionally arranges for some more data to be sent to this Core
-  * @param resend Whether to call sendData to get more data sent immediately to this Core
+  * Receives one short-term accumulated result from a Core, and optionally arranges for some more data to be sent to whichever Core
+  * pickCore then chooses (usually the one that just returned its result)
+  * @param resend Whether to call sendData to get more data sent immediately
+  * @return Whether more data was sent
   */
-  void receiveData(bool resend);
+  bool receiveData(bool resend);
+ /**
+  * Chooses the Core that should get the next subintegration: a Core that has fallen below Core::RECEIVE_RING_LENGTH outstanding
+  * subintegrations always comes first (it cannot return results until refilled), otherwise the Core with spare queue credit that
+  * is expected to finish the new subintegration soonest
+  * @return The Core index, or -1 if every Core has used all of its queue credit
+  */
+  int pickCore();
+ /**
+  * Updates the running estimate of the time a Core takes per subintegration, after a result has been received from it
+  * @param coreindex The Core index (to the coreids array)
+  */
+  void updateCoreRate(int coreindex);
+ /**
+  * Hands out the extra queue credit (beyond Core::RECEIVE_RING_LENGTH) to the fastest Cores, withdrawing it from any that lag
+  */
+  void rebalanceCores();
+ /**
+  * Logs and multicasts the throughput, utilisation and queue depth of each Core
+  */
+  void reportCoreUtilisation();
 
  /** 
   * Locates the Visibility that the most recent data to have arrived should go to
@@ -159,12 +184,21 @@ private:
   int * corecounts;
   int * recentcorecounts;
   int * numsent;
-  int * extrareceived;
+  int * numreceived;
   int *** coretimes;
+  //scheduling state: subints outstanding at each core, the most each may currently have, and the seconds each takes per subint
+  int * outstanding;
+  int * coredepthlimit;
+  double * coreinterval;
+  double * lastreceivetime;
+  int maxcoreextra, extracreditpool, maxcoredepth, totaloutstanding, receivessincerebalance;
+  MPI_Win landingwindow; //only used (collectively) with the put transport
+  MPI_Comm nodecomm; //only used (collectively) with the shared transport
+  MPI_Win sharedwindow;
   bool monitor;
   char * hostname;
   cf32 * resultbuffer;
-  char * todiskbuffer;
+  VisWriter * viswriter;
   Visibility ** visbuffer;
   pthread_mutex_t * bufferlock, startlock;
   bool * islocked;
@@ -88,12 +88,37 @@ Mk5Mode::Mk5Mode(Configuration * conf, int confindex, int dsindex, int recordedb
           }
         }
       }
+
+      //where the fringe rotation is the only reader of the unpacked samples, unpack to a byte per sample
+      //rather than a float, for a quarter of the memory traffic; DIFX_UNPACK_BYTES=0 turns this off
+      char * bytesenv = getenv("DIFX_UNPACK_BYTES");
+      if(!usecomplex && fringerotationorder > 0 && !perbandweights && mark5stream->samplegranularity == 1 && config->getDPhaseCalIntervalMHz(confindex, dsindex) == 0 && !(bytesenv && atoi(bytesenv) == 0) && mark5_stream_get_int8_levels(mark5stream, unpackedbytelevels) == 0)
+      {
+        unpackedbytearrays = new s8*[nrecordedbands];
+        for(int i = 0; i < nrecordedbands; ++i)
+        {
+          //the decoder works in whole bytes of the packed data, so may run up to 7 samples past the end
+          unpackedbytearrays[i] = (s8*)vectorAlloc_u8(unpacksamples + 8);
+          estimatedbytes += unpacksamples + 8;
+          //the float arrays Mode made for the unpacked samples are never used, so give them back
+          vectorFree(unpackedarrays[i]);
+          unpackedarrays[i] = 0;
+          estimatedbytes -= sizeof(f32)*unpacksamples;
+        }
+        cverbose << startl << "Mk5Mode will unpack " << formatname << " to bytes" << endl;
+      }
     }
   }
 }
 
 Mk5Mode::~Mk5Mode()
 {
+  if(unpackedbytearrays)
+  {
+    for(int i = 0; i < numrecordedbands; ++i)
+      vectorFree((u8*)unpackedbytearrays[i]);
+    delete [] unpackedbytearrays;
+  }
   delete_mark5_stream(mark5stream);
   if(invalid)
   {
@@ -121,6 +146,10 @@ float Mk5Mode::unpack(int sampleoffset, int subloopindex)
       }
     }
   }
+  else if(unpackedbytearrays)
+  {
+    goodsamples = mark5_unpack_int8_with_offset(mark5stream, data, unpackstartsamples, (int8_t**)unpackedbytearrays, samplestounpack);
+  }
   else
   {
     goodsamples = mark5_unpack_with_offset(mark5stream, data, unpackstartsamples, unpackedarrays, samplestounpack);
@@ -74,7 +74,7 @@ class Mk5Mode : public Mode
 
   protected:
  /** 
-   * Uses mark5access library to unpack multiplexed, quantised data into the separate float arrays
+   * Uses mark5access library to unpack multiplexed, quantised data into the separate float arrays (or byte arrays, where the mode allows)
    * @return The fraction of samples returned
    * @param sampleoffset The offset in number of time samples into the data array
    * @param subloopindex The "subloop" index that is currently being unpacked for (need to know to save weights in the right place)
@@ -35,6 +35,7 @@
 
 //using namespace std;
 const float Mode::TINY = 0.000000001;
+const int Mode::MIN_SK_WINDOW;
 
 #if (ARCH == GENERIC)
 pthread_mutex_t FFTinitMutex = PTHREAD_MUTEX_INITIALIZER;
@@ -76,6 +77,14 @@ Mode::Mode(Configuration * conf, int confindex, int dsindex, int recordedbandcha
     dataweight[i] = 0.0;
   }
   perbandweights = 0;
+  skwindow = 0;
+  numskwindows = 0;
+  skthreshold = 0.0;
+  skcount = 0;
+  sks1 = 0;
+  sks2 = 0;
+  skweights = 0;
+  unpackedbytearrays = 0;
   model = config->getModel();
   initok = true;
   intclockseconds = int(floor(config->getDClockCoeff(configindex, dsindex, 0)/1000000.0 + 0.5));
@@ -406,7 +415,6 @@ Mode::Mode(Configuration * conf, int confindex, int dsindex, int recordedbandcha
     s1 = 0;
     s2 = 0;
     sk = 0;
-    kscratch = 0;
   }
   // Phase cal stuff
   PCal::setMinFrequencyResolution(1e6);
@@ -463,6 +471,7 @@ Mode::Mode(Configuration * conf, int confindex, int dsindex, int recordedbandcha
 
 Mode::~Mode()
 {
+  freeRFIExcision();
   if(perbandweights)
   {
     for(int i=0;i<config->getNumBufferedFFTs(configindex);++i)
@@ -605,7 +614,6 @@ Mode::~Mode()
     delete [] s1;
     delete [] s2;
     delete [] sk;
-    vectorFree(kscratch);
   }
 
   if (linear2circular) {
@@ -648,13 +656,18 @@ float Mode::unpack(int sampleoffset, int subloopindex)
 
 void Mode::process(int index, int subloopindex)  //frac sample error is in microseconds 
 {
-  double phaserotation, averagedelay, nearestsampletime, starttime, lofreq, walltimesecs, fracwalltime, fftcentre, d0, d1, d2, fraclooffset;
+  double phaserotation, averagedelay, nearestsampletime, starttime, lofreq, walltimesecs, fracwalltime, d0, d1, d2, fraclooffset;
   f32 phaserotationfloat, fracsampleerror;
   int status, count, nearestsample, integerdelay, RcpIndex, LcpIndex, intwalltime;
   cf32* fftptr;
+  const cf32* spectrum;
+  const cf32* fracsamprotator;
   f32* currentstepchannelfreqs;
   f32* currentsubchannelfreqs;
   int indices[10];
+  int skw;
+  f32 * ks1;
+  f32 * ks2;
   bool looff, isfraclooffset;
   //cout << "For Mode of datastream " << datastreamindex << ", index " << index << ", validflags is " << validflags[index/FLAGS_PER_INT] << ", after shift you get " << ((validflags[index/FLAGS_PER_INT] >> (index%FLAGS_PER_INT)) & 0x01) << endl;
 
@@ -683,8 +696,8 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
     return; //don't process crap data
   }
 
-  fftcentre = index+0.5;
-  averagedelay = interpolator[0]*fftcentre*fftcentre + interpolator[1]*fftcentre + interpolator[2];
+  delaymodel.moveTo(index);
+  averagedelay = delaymodel.delayAtCentre();
   fftstartmicrosec = index*fftchannels*sampletime; //CHRIS CHECK
   starttime = (offsetseconds-datasec)*1000000.0 + (static_cast<long long>(offsetns) - static_cast<long long>(datans))/1000.0 + fftstartmicrosec - averagedelay;
   nearestsample = int(starttime/sampletime + 0.5);
@@ -793,9 +806,9 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
       integerdelay = static_cast<int>(averagedelay);
       break;
     case 1: //linear
-      d0 = interpolator[0]*index*index + interpolator[1]*index + interpolator[2];
-      d1 = interpolator[0]*(index+0.5)*(index+0.5) + interpolator[1]*(index+0.5) + interpolator[2];
-      d2 = interpolator[0]*(index+1)*(index+1) + interpolator[1]*(index+1) + interpolator[2];
+      d0 = delaymodel.delayAtStart();
+      d1 = delaymodel.delayAtCentre();
+      d2 = delaymodel.delayAtEnd();
       a = d2-d0;
       b = d0 + (d1 - (a*0.5 + d0))/3.0;
       integerdelay = static_cast<int>(b);
@@ -813,8 +826,8 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
       break;
     case 2: //quadratic
       a = interpolator[0];
-      b = interpolator[1] + index*interpolator[0]*2.0;
-      c = interpolator[2] + index*interpolator[1] + index*index*interpolator[0];
+      b = delaymodel.slopeAtStart();
+      c = delaymodel.delayAtStart();
       integerdelay = int(c);
       c -= integerdelay;
 
@@ -1150,6 +1163,7 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
       if(config->matchingRecordedBand(configindex, datastreamindex, i, j))
       {
         indices[count++] = j;
+        spectrum = fftoutputs[j][subloopindex];
         switch(fringerotationorder) {
           case 0: //post-F
             if (usecomplex) {
@@ -1187,11 +1201,14 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
               //status = vectorCopy_cf32(&unpackedcomplexarrays[j][nearestsample - unpackstartsamples], complexunpacked, fftchannels);
               if (status != vecNoErr)
                 csevere << startl << "Error in complex fringe rotation" << endl;
+            } else if (unpackedbytearrays) {
+              //level lookup, real->complex conversion and fringe rotation in one pass, reading a byte per sample
+              status = simdMulLevels_8s32fc(&(unpackedbytearrays[j][nearestsample - unpackstartsamples]), unpackedbytelevels, complexrotator, complexunpacked, fftchannels);
+              if(status != vecNoErr)
+                csevere << startl << "Error in fringe rotation!!!" << status << endl;
             } else {
-              status = vectorRealToComplex_f32(&(unpackedarrays[j][nearestsample - unpackstartsamples]), NULL, complexunpacked, fftchannels);
-              if (status != vecNoErr)
-                csevere << startl << "Error in real->complex conversion" << endl;
-              status = vectorMul_cf32_I(complexrotator, complexunpacked, fftchannels);
+              //real->complex conversion and fringe rotation in one pass
+              status = vectorMul_f32cf32(&(unpackedarrays[j][nearestsample - unpackstartsamples]), complexrotator, complexunpacked, fftchannels);
               if(status != vecNoErr)
               	csevere << startl << "Error in fringe rotation!!!" << status << endl;
             }
@@ -1225,7 +1242,8 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
                 }
               }
               else {
-                status = vectorCopy_cf32(&(fftd[recordedbandchannels]), fftoutputs[j][subloopindex], recordedbandchannels);
+                //no copy needed: the frac sample correction reads the spectrum straight out of fftd
+                spectrum = &(fftd[recordedbandchannels]);
               }
             }
             else {
@@ -1235,7 +1253,7 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
                 status = vectorCopy_cf32(fftd, &fftoutputs[j][subloopindex][recordedbandchannels/2], recordedbandchannels/2);
                 status = vectorCopy_cf32(&fftd[recordedbandchannels/2], fftoutputs[j][subloopindex], recordedbandchannels/2);
               } else {
-                status = vectorCopy_cf32(fftd, fftoutputs[j][subloopindex], recordedbandchannels);
+                spectrum = fftd;
               }
             }
             if(status != vecNoErr)
@@ -1243,7 +1261,8 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
             break;
         }
 
-	// At this point in the code the array fftoutputs[j] contains complex-valued voltage spectra with the following properties:
+	// At this point in the code the array spectrum (which is either fftoutputs[j] or the relevant part of fftd)
+	// contains complex-valued voltage spectra with the following properties:
 	//
 	// 1. The zero element corresponds to the lowest sky frequency.  That is:
 	//    fftoutputs[j][0] = Local Oscillator Frequency              (for Upper Sideband)
@@ -1257,45 +1276,36 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
 	// 3. The last element of the array corresponds to the highest sky frequency minus the spectral resolution.
 	//    (i.e., the first element beyond the array bound corresponds to the highest sky frequency)
 
-        if(dumpkurtosis) //do the necessary accumulation
+        //work out where the power sums for the kurtosis go: the excision window if excising (from where
+        //they are added into the dumped kurtosis later), else straight into the dumped kurtosis
+        ks1 = 0;
+        ks2 = 0;
+        if(skwindow > 0)
         {
-          status = vectorMagnitude_cf32(fftoutputs[j][subloopindex], kscratch, recordedbandchannels);
-          if(status != vecNoErr)
-            csevere << startl << "Error taking kurtosis magnitude!" << endl;
-          status = vectorSquare_f32_I(kscratch, recordedbandchannels);
-          if(status != vecNoErr)
-            csevere << startl << "Error in first kurtosis square!" << endl;
-          status = vectorAdd_f32_I(kscratch, s1[j], recordedbandchannels);
-          if(status != vecNoErr)
-            csevere << startl << "Error in kurtosis s1 accumulation!" << endl;
-          status = vectorSquare_f32_I(kscratch, recordedbandchannels);
-          if(status != vecNoErr)
-            csevere << startl << "Error in second kurtosis square!" << endl;
-          status = vectorAdd_f32_I(kscratch, s2[j], recordedbandchannels);
-          if(status != vecNoErr)
-            csevere << startl << "Error in kurtosis s2 accumulation!" << endl;
+          if(!perbandweights || perbandweights[subloopindex][j] > 0.0)
+          {
+            skw = subloopindex/skwindow;
+            ks1 = sks1[skw][j];
+            ks2 = sks2[skw][j];
+            skcount[skw][j]++;
+          }
+        }
+        else if(dumpkurtosis)
+        {
+          ks1 = s1[j];
+          ks2 = s2[j];
         }
 
-        //do the frac sample correct (+ phase shifting if applicable, + fringe rotate if its post-f)
-	if (deltapoloffsets==false || config->getDRecordedBandPol(configindex, datastreamindex, j)=='R') {
-	  status = vectorMul_cf32_I(fracsamprotatorA, fftoutputs[j][subloopindex], recordedbandchannels);
-	} else {
-	  status = vectorMul_cf32_I(fracsamprotatorB, fftoutputs[j][subloopindex], recordedbandchannels);
-	}
-	if(status != vecNoErr)
-	  csevere << startl << "Error in application of frac sample correction!!!" << status << endl;
-
-        //do the conjugation
-        status = vectorConj_cf32(fftoutputs[j][subloopindex], conjfftoutputs[j][subloopindex], recordedbandchannels);
-        if(status != vecNoErr)
-          csevere << startl << "Error in conjugate!!!" << status << endl;
+        //do the frac sample correct (+ phase shifting if applicable, + fringe rotate if its post-f), the conjugation,
+        //the kurtosis accumulation and (unless it has to wait for linear to circular conversion) the autocorrelation,
+        //skipping the Nyquist channel
+        if (deltapoloffsets==false || config->getDRecordedBandPol(configindex, datastreamindex, j)=='R')
+          fracsamprotator = fracsamprotatorA;
+        else
+          fracsamprotator = fracsamprotatorB;
+        correctAndConjugate(spectrum, fracsamprotator, fftoutputs[j][subloopindex], conjfftoutputs[j][subloopindex], linear2circular?0:autocorrelations[0][j], ks1, ks2);
 
 	if (!linear2circular) {
-	  //do the autocorrelation (skipping Nyquist channel)
-	  status = vectorAddProduct_cf32(fftoutputs[j][subloopindex], conjfftoutputs[j][subloopindex], autocorrelations[0][j], recordedbandchannels);
-	  if(status != vecNoErr)
-	    csevere << startl << "Error in autocorrelation!!!" << status << endl;
-
 	  //store the weight for the autocorrelations
           if(perbandweights)
           {
@@ -1396,6 +1406,40 @@ void Mode::process(int index, int subloopindex)  //frac sample error is in micro
   }
 }
 
+void Mode::correctAndConjugate(const cf32 * spectrum, const cf32 * fracsamprotator, cf32 * fftout, cf32 * conjfftout, cf32 * autocorr, f32 * ks1, f32 * ks2)
+{
+  int status, tilechannels;
+
+  for(int k=0;k<recordedbandchannels;k+=CORRECTION_TILE_CHANNELS)
+  {
+    tilechannels = recordedbandchannels - k;
+    if(tilechannels > CORRECTION_TILE_CHANNELS)
+      tilechannels = CORRECTION_TILE_CHANNELS;
+    if(ks1)
+    {
+      //the correction has unit magnitude, so the power can be taken before it is applied
+      status = simdAddPowerMoments_32fc(&(spectrum[k]), &(ks1[k]), &(ks2[k]), tilechannels);
+      if(status != vecNoErr)
+        csevere << startl << "Error in kurtosis accumulation!!!" << status << endl;
+    }
+    if(spectrum == fftout)
+      status = vectorMul_cf32_I(&(fracsamprotator[k]), &(fftout[k]), tilechannels);
+    else
+      status = vectorMul_cf32(&(fracsamprotator[k]), &(spectrum[k]), &(fftout[k]), tilechannels);
+    if(status != vecNoErr)
+      csevere << startl << "Error in application of frac sample correction!!!" << status << endl;
+    status = vectorConj_cf32(&(fftout[k]), &(conjfftout[k]), tilechannels);
+    if(status != vecNoErr)
+      csevere << startl << "Error in conjugate!!!" << status << endl;
+    if(autocorr)
+    {
+      status = vectorAddProduct_cf32(&(fftout[k]), &(conjfftout[k]), &(autocorr[k]), tilechannels);
+      if(status != vecNoErr)
+        csevere << startl << "Error in autocorrelation!!!" << status << endl;
+    }
+  }
+}
+
 void Mode::averageFrequency()
 {
   cf32 tempsum;
@@ -1502,7 +1546,6 @@ void Mode::zeroKurtosis()
     s1 = new f32*[numrecordedbands];
     s2 = new f32*[numrecordedbands];
     sk = new f32*[numrecordedbands];
-    kscratch = vectorAlloc_f32(recordedbandchannels);
     for(int i=0;i<numrecordedbands;i++)
     {
       s1[i] = vectorAlloc_f32(recordedbandchannels);
@@ -1522,6 +1565,177 @@ void Mode::zeroKurtosis()
   }
 }
 
+void Mode::setRFIExcision(int window, float threshold)
+{
+  int numbufferedffts = config->getNumBufferedFFTs(configindex);
+
+  if(window <= 0 || !(threshold > 0.0))
+  {
+    freeRFIExcision();
+    return;
+  }
+  if(window < MIN_SK_WINDOW)
+    window = MIN_SK_WINDOW;
+  if(window > numbufferedffts)
+    window = numbufferedffts;
+  skthreshold = threshold;
+  if(window == skwindow)
+    return;
+
+  freeRFIExcision();
+  skwindow = window;
+  numskwindows = (numbufferedffts + skwindow - 1)/skwindow;
+  skcount = new int*[numskwindows];
+  sks1 = new f32**[numskwindows];
+  sks2 = new f32**[numskwindows];
+  for(int w=0;w<numskwindows;w++)
+  {
+    skcount[w] = new int[numrecordedbands];
+    sks1[w] = new f32*[numrecordedbands];
+    sks2[w] = new f32*[numrecordedbands];
+    for(int b=0;b<numrecordedbands;b++)
+    {
+      skcount[w][b] = 0;
+      sks1[w][b] = vectorAlloc_f32(recordedbandchannels);
+      sks2[w][b] = vectorAlloc_f32(recordedbandchannels);
+      vectorZero_f32(sks1[w][b], recordedbandchannels);
+      vectorZero_f32(sks2[w][b], recordedbandchannels);
+    }
+  }
+  skweights = new f32*[numbufferedffts];
+  for(int i=0;i<numbufferedffts;i++)
+    skweights[i] = new f32[numrecordedbands];
+}
+
+void Mode::freeRFIExcision()
+{
+  for(int w=0;w<numskwindows;w++)
+  {
+    for(int b=0;b<numrecordedbands;b++)
+    {
+      vectorFree(sks1[w][b]);
+      vectorFree(sks2[w][b]);
+    }
+    delete [] skcount[w];
+    delete [] sks1[w];
+    delete [] sks2[w];
+  }
+  delete [] skcount;
+  delete [] sks1;
+  delete [] sks2;
+  if(skweights)
+  {
+    for(int i=0;i<config->getNumBufferedFFTs(configindex);i++)
+      delete [] skweights[i];
+    delete [] skweights;
+  }
+  skwindow = 0;
+  numskwindows = 0;
+  skcount = 0;
+  sks1 = 0;
+  sks2 = 0;
+  skweights = 0;
+}
+
+void Mode::exciseRFI(int numffts)
+{
+  int status, numwindows, first, last, numexcised;
+  double m, sigma, lower, upper, skvalue;
+  f32 excisedfraction;
+  cf32 * autocorr;
+
+  if(skwindow == 0)
+    return;
+
+  for(int i=0;i<numffts;i++)
+  {
+    for(int b=0;b<numrecordedbands;b++)
+      skweights[i][b] = perbandweights ? perbandweights[i][b] : dataweight[i];
+  }
+
+  //a short window left over at the end of the buffer is folded into the one before
+  numwindows = (numffts + skwindow - 1)/skwindow;
+  if(numwindows > 1 && numffts - (numwindows-1)*skwindow < skwindow/2)
+  {
+    for(int b=0;b<numrecordedbands;b++)
+    {
+      status = vectorAdd_f32_I(sks1[numwindows-1][b], sks1[numwindows-2][b], recordedbandchannels);
+      if(status != vecNoErr)
+        cerror << startl << "Error trying to merge kurtosis windows!" << endl;
+      status = vectorAdd_f32_I(sks2[numwindows-1][b], sks2[numwindows-2][b], recordedbandchannels);
+      if(status != vecNoErr)
+        cerror << startl << "Error trying to merge kurtosis windows!" << endl;
+      skcount[numwindows-2][b] += skcount[numwindows-1][b];
+    }
+    numwindows--;
+  }
+
+  for(int w=0;w<numwindows;w++)
+  {
+    first = w*skwindow;
+    last = (w == numwindows-1) ? numffts : first + skwindow;
+    for(int b=0;b<numrecordedbands;b++)
+    {
+      if(dumpkurtosis)
+      {
+        status = vectorAdd_f32_I(sks1[w][b], s1[b], recordedbandchannels);
+        if(status != vecNoErr)
+          cerror << startl << "Error in kurtosis s1 accumulation!" << endl;
+        status = vectorAdd_f32_I(sks2[w][b], s2[b], recordedbandchannels);
+        if(status != vecNoErr)
+          cerror << startl << "Error in kurtosis s2 accumulation!" << endl;
+      }
+      if(skcount[w][b] < MIN_SK_WINDOW)
+        continue;
+
+      //SK = (M+1)/(M-1) (M s2/s1^2 - 1) is 1 for Gaussian noise, with the variance below (Nita & Gary 2010)
+      m = skcount[w][b];
+      sigma = sqrt(4.0*m*m/((m - 1.0)*(m + 2.0)*(m + 3.0)));
+      lower = 1.0 - skthreshold*sigma;
+      upper = 1.0 + skthreshold*sigma;
+      autocorr = autocorrelations[0][b];
+      numexcised = 0;
+      for(int c=0;c<recordedbandchannels;c++)
+      {
+        if(!(sks1[w][b][c] > 0.0))
+          continue;
+        skvalue = ((m + 1.0)/(m - 1.0))*(m*sks2[w][b][c]/((double)sks1[w][b][c]*sks1[w][b][c]) - 1.0);
+        if(skvalue >= lower && skvalue <= upper)
+          continue;
+        numexcised++;
+        for(int i=first;i<last;i++)
+        {
+          autocorr[c].re -= fftoutputs[b][i][c].re*fftoutputs[b][i][c].re + fftoutputs[b][i][c].im*fftoutputs[b][i][c].im;
+          fftoutputs[b][i][c].re = 0.0;
+          fftoutputs[b][i][c].im = 0.0;
+          conjfftoutputs[b][i][c].re = 0.0;
+          conjfftoutputs[b][i][c].im = 0.0;
+        }
+      }
+      if(numexcised > 0)
+      {
+        excisedfraction = ((f32)numexcised)/recordedbandchannels;
+        for(int i=first;i<last;i++)
+        {
+          weights[0][b] -= skweights[i][b]*excisedfraction;
+          skweights[i][b] *= 1.0 - excisedfraction;
+        }
+      }
+    }
+  }
+
+  //start afresh for the next batch of FFTs
+  for(int w=0;w<numskwindows;w++)
+  {
+    for(int b=0;b<numrecordedbands;b++)
+    {
+      skcount[w][b] = 0;
+      vectorZero_f32(sks1[w][b], recordedbandchannels);
+      vectorZero_f32(sks2[w][b], recordedbandchannels);
+    }
+  }
+}
+
 void Mode::setOffsets(int scan, int seconds, int ns)
 {
   bool foundok;
@@ -1547,6 +1761,7 @@ void Mode::setOffsets(int scan, int seconds, int ns)
   if (usecomplex) timespan/=2;
   foundok = model->calculateDelayInterpolator(currentscan, (double)offsetseconds + ((double)offsetns)/1000000000.0, timespan, blockspersend, config->getDModelFileIndex(configindex, datastreamindex), srcindex, 2, interpolator);
   interpolator[2] -= 1000000*intclockseconds;
+  delaymodel.setPolynomial(interpolator);
 
   if(!foundok) {
     cerror << startl << "Could not find a Model interpolator for scan " << scan << " offsetseconds " << seconds << " offsetns " << ns << " - will torch this subint!" << endl;
@@ -30,6 +30,7 @@
 #include "architecture.h"
 #include "configuration.h"
 #include "pcal.h"
+#include "delayrecurrence.h"
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
@@ -140,6 +141,29 @@ Mode(Configuration * conf, int confindex, int dsindex, int recordedbandchan, int
   */
   bool calculateAndAverageKurtosis(int numblocks, int maxchannels);
 
+ /**
+  * Turns spectral kurtosis RFI excision on or off.  When on, process() accumulates the power sums of
+  * each recorded band over windows of consecutive FFTs, and exciseRFI() must then be called once the
+  * buffered FFTs have all been processed, before they are cross-multiplied
+  * @param window The number of FFTs in each SK estimate (limited to the number of buffered FFTs)
+  * @param threshold Channels whose SK departs from 1 by more than this many standard deviations are excised (0 turns excision off)
+  */
+  void setRFIExcision(int window, float threshold);
+
+ /**
+  * Computes the spectral kurtosis of every channel in each window of the FFTs just processed, and zeroes
+  * the channels whose SK is out of bounds for that window, removing them from the autocorrelations too.
+  * Each band's data weight is reduced by the fraction of its channels excised, so the loss shows up in
+  * the baseline weights; the visibilities of a band are still normalised by that single weight, so
+  * channels that were kept end up scaled up by the same small fraction.  Cross-polarisation
+  * autocorrelations are left as they are.  Also adds the power sums into the kurtosis being dumped, if any
+  * @param numffts The number of FFTs processed into the buffer (subloop indices 0 to numffts-1)
+  */
+  void exciseRFI(int numffts);
+
+  ///Smallest number of FFTs a spectral kurtosis estimate will be made from
+  static const int MIN_SK_WINDOW = 8;
+
  /**
   * Grabs the pointer to an autocorrelation array
   * @param crosspol Whether to return the crosspolarisation autocorrelation for this band
@@ -165,7 +189,7 @@ Mode(Configuration * conf, int confindex, int dsindex, int recordedbandchan, int
   * @param outputband The band index
   * @param subloopindex The index into the number of buffered FFTs that were processed in one batch
   */
-  inline f32 getDataWeight(int outputband, int subloopindex) const { return perbandweights ? perbandweights[subloopindex][outputband] : dataweight[subloopindex]; }
+  inline f32 getDataWeight(int outputband, int subloopindex) const { return skweights ? skweights[subloopindex][outputband] : (perbandweights ? perbandweights[subloopindex][outputband] : dataweight[subloopindex]); }
 
  /**
   * Gets the expected decorrelation ("van Vleck correction" ) for a given number of bits.
@@ -265,6 +289,8 @@ protected:
   s16 *   linearunpacked;
   f32 **  unpackedarrays;
   cf32 **  unpackedcomplexarrays;
+  s8 **   unpackedbytearrays;    //if not 0, unpack() filled these (one byte per sample) instead of unpackedarrays
+  f32     unpackedbytelevels[16]; //the value of each byte v of unpackedbytearrays, at v & 15
   cf32*** fftoutputs;
   cf32*** conjfftoutputs;
   f32 **  weights;
@@ -278,6 +304,7 @@ protected:
   vecHintAlg hint;
   Model * model;
   f64 * interpolator;
+  DelayRecurrence delaymodel; //steps interpolator from one FFT to the next
 
   //new arrays for strided complex multiply for fringe rotation and fractional sample correction
   cf32 * complexrotator;
@@ -339,19 +366,46 @@ protected:
 
   //kurtosis-specific variables
   bool dumpkurtosis;
-  f32 *  kscratch; //[recordedbandchannels]
   f32 ** s1; //[numrecordedbands][recordedbandchannels]
   f32 ** s2; //[numrecordedbands][recordedbandchannels]
   f32 ** sk; //[numrecordedbands][recordedbandchannels]
 
+  //spectral kurtosis RFI excision
+  int skwindow, numskwindows; //skwindow == 0 means excision is off
+  float skthreshold;
+  int ** skcount; //[numskwindows][numrecordedbands] FFTs with valid data in each window
+  f32 *** sks1; //[numskwindows][numrecordedbands][recordedbandchannels]
+  f32 *** sks2; //[numskwindows][numrecordedbands][recordedbandchannels]
+  f32 ** skweights; //[numbufferedffts][numrecordedbands] data weights after excision, once exciseRFI has run
+
   // Linear to circular conversion
 
   cf32 *phasecorrA, *phasecorrconjA, *phasecorrB, *phasecorrconjB; // 90 degrees + phase correction
   cf32 * tmpvec; 
 
 private:
+ /**
+  * Applies the fractional sample correction to one band's spectrum and forms its conjugate (and,
+  * if requested, accumulates the autocorrelation) in a single pass over cache-sized tiles of channels,
+  * so each channel is loaded from memory once rather than once per operation
+  * @param spectrum The uncorrected spectrum in sky frequency order (may be the same array as fftout)
+  * @param fracsamprotator The fractional sample correction to apply
+  * @param fftout The corrected spectrum is written here
+  * @param conjfftout The conjugate of the corrected spectrum is written here
+  * @param autocorr The autocorrelation to accumulate into, or 0 if it is accumulated elsewhere
+  * @param ks1 The power of each channel is added to this for the spectral kurtosis, or 0 not to
+  * @param ks2 The squared power of each channel is added to this, if ks1 is not 0
+  */
+  void correctAndConjugate(const cf32 * spectrum, const cf32 * fracsamprotator, cf32 * fftout, cf32 * conjfftout, cf32 * autocorr, f32 * ks1, f32 * ks2);
+
+  ///Frees the spectral kurtosis excision arrays
+  void freeRFIExcision();
+
   ///Array containing decorrelation percentages for a given number of bits
   static const float decorrelationpercentage[];
+
+  ///Number of channels handled per tile by correctAndConjugate: five arrays of this many cf32 fit comfortably in L1
+  static const int CORRECTION_TILE_CHANNELS = 512;
 };
 
 /** 
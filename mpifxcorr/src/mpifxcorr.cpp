@@ -306,6 +306,9 @@ int main(int argc, char *argv[])
   generateIdentifier(argv[1], difxMessageID);
   difxMessageInit(myID, difxMessageID);
   difxMessageSetInputFilename(argv[1]);
+  //send messages from a queue, so the Core and Visibility threads never wait on the network; DIFX_MESSAGE_SEND_QUEUE=0 sends directly
+  if(isDifxMessageInUse() && getenv("DIFX_MESSAGE_SEND_QUEUE") == 0)
+    difxMessageSendQueueStart(256);
   if(myID == 0)
   {
     if(isDifxMessageInUse() && !nocommandthread)
@@ -315,6 +318,9 @@ int main(int argc, char *argv[])
   }
 
   cinfo << startl << "MPI Process " << myID << " is running on host " << processor_name << endl;
+#if(ARCH == GENERIC)
+  cverbose << startl << "Generic vector kernels are using " << simdLevelName(simdGetLevel()) << " instructions" << endl;
+#endif
  
   for(int i=2;i<argc;i++)
   {
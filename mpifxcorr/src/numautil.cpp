@@ -0,0 +1,187 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include "numautil.h"
+#include "alert.h"
+
+//memory policy modes and flags from linux/mempolicy.h
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1<<1)
+#endif
+
+static const char * NODEDIR = "/sys/devices/system/node";
+
+//parses a cpulist such as "0-7,16-23" into a cpu_set_t
+static bool parseCPUList(const char * list, cpu_set_t * cpus)
+{
+  const char * c = list;
+  char * end;
+  long first, last;
+
+  CPU_ZERO(cpus);
+  while(*c != 0 && *c != '\n')
+  {
+    first = strtol(c, &end, 10);
+    if(end == c)
+      return false;
+    last = first;
+    c = end;
+    if(*c == '-')
+    {
+      c++;
+      last = strtol(c, &end, 10);
+      if(end == c)
+        return false;
+      c = end;
+    }
+    for(long i=first;i<=last && i<CPU_SETSIZE;i++)
+      CPU_SET(i, cpus);
+    if(*c == ',')
+      c++;
+  }
+
+  return true;
+}
+
+NumaTopology::NumaTopology()
+{
+  cpu_set_t allowed, nodeset;
+  DIR * dir;
+  struct dirent * entry;
+  std::vector<int> ids;
+  char filename[256], list[4096];
+  FILE * f;
+  int id;
+
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+  {
+    CPU_ZERO(&allowed);
+    for(int i=0;i<CPU_SETSIZE;i++)
+      CPU_SET(i, &allowed);
+  }
+
+  dir = opendir(NODEDIR);
+  if(dir != 0)
+  {
+    while((entry = readdir(dir)) != 0)
+    {
+      if(strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name+4, "%d", &id) == 1)
+        ids.push_back(id);
+    }
+    closedir(dir);
+  }
+  for(size_t i=0;i<ids.size();i++)
+  {
+    //keep the nodes in order of id
+    for(size_t j=i+1;j<ids.size();j++)
+    {
+      if(ids[j] < ids[i])
+      {
+        id = ids[i];
+        ids[i] = ids[j];
+        ids[j] = id;
+      }
+    }
+    snprintf(filename, 256, "%s/node%d/cpulist", NODEDIR, ids[i]);
+    f = fopen(filename, "r");
+    if(f == 0)
+      continue;
+    if(fgets(list, 4096, f) != 0 && parseCPUList(list, &nodeset))
+    {
+      CPU_AND(&nodeset, &nodeset, &allowed);
+      if(CPU_COUNT(&nodeset) > 0)
+      {
+        nodeids.push_back(ids[i]);
+        nodecpus.push_back(nodeset);
+      }
+    }
+    fclose(f);
+  }
+
+  //no NUMA information: one node with everything we are allowed to use
+  if(nodeids.empty())
+  {
+    nodeids.push_back(0);
+    nodecpus.push_back(allowed);
+  }
+}
+
+bool NumaTopology::setPolicy(void * buffer, size_t bytes, int mode, const std::vector<int> & nodes) const
+{
+  unsigned long mask[16];
+  const unsigned long maxnode = 8*sizeof(mask);
+  uintptr_t pagesize, start, end;
+
+  memset(mask, 0, sizeof(mask));
+  for(size_t i=0;i<nodes.size();i++)
+  {
+    if(nodes[i] < 0 || (unsigned long)nodes[i] >= maxnode)
+      return false;
+    mask[nodes[i]/(8*sizeof(unsigned long))] |= 1UL << (nodes[i]%(8*sizeof(unsigned long)));
+  }
+
+  //mbind works on whole pages: only the pages entirely within the buffer are placed
+  pagesize = sysconf(_SC_PAGESIZE);
+  start = ((uintptr_t)buffer + pagesize - 1) & ~(pagesize - 1);
+  end = ((uintptr_t)buffer + bytes) & ~(pagesize - 1);
+  if(end <= start)
+    return true;
+
+  if(syscall(SYS_mbind, (void *)start, end - start, mode, mask, maxnode + 1, MPOL_MF_MOVE) != 0)
+  {
+    cwarn << startl << "Could not set the NUMA memory policy of a " << bytes << " byte buffer: " << strerror(errno) << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool NumaTopology::interleave(void * buffer, size_t bytes) const
+{
+  if(getNumNodes() < 2)
+    return true;
+
+  return setPolicy(buffer, bytes, MPOL_INTERLEAVE, nodeids);
+}
+
+bool NumaTopology::bind(void * buffer, size_t bytes, int node) const
+{
+  return setPolicy(buffer, bytes, MPOL_BIND, std::vector<int>(1, nodeids[node]));
+}
+
+std::string NumaTopology::describeCPUs(const cpu_set_t * cpus)
+{
+  std::string description;
+  char range[32];
+  int first;
+
+  for(int i=0;i<CPU_SETSIZE;i++)
+  {
+    if(!CPU_ISSET(i, cpus))
+      continue;
+    first = i;
+    while(i+1 < CPU_SETSIZE && CPU_ISSET(i+1, cpus))
+      i++;
+    if(i == first)
+      snprintf(range, 32, "%d", first);
+    else
+      snprintf(range, 32, "%d-%d", first, i);
+    if(!description.empty())
+      description += ",";
+    description += range;
+  }
+
+  return description;
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
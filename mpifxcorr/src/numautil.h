@@ -0,0 +1,64 @@
+/** \file numautil.h
+ *  \brief Discovery of the NUMA layout of the node and placement of threads and buffers on it
+ *
+ * The layout is read from /sys/devices/system/node, restricted to the CPUs this process may run
+ * on (so that binding by mpirun is honoured), and memory policies are set with the mbind system
+ * call directly, so no NUMA library is needed at build or run time.  On a machine without NUMA
+ * information everything is treated as a single node.
+ */
+
+#ifndef NUMAUTIL_H
+#define NUMAUTIL_H
+
+#include <sched.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+@class NumaTopology
+@brief The NUMA nodes (with their CPUs) available to this process
+*/
+class NumaTopology{
+public:
+  NumaTopology();
+
+  ///@return The number of nodes that have at least one CPU this process may use
+  inline int getNumNodes() const { return (int)nodeids.size(); }
+
+  ///@return The system id of the given (usable) node
+  inline int getNodeId(int node) const { return nodeids[node]; }
+
+  ///@return The CPUs of the given (usable) node that this process may use
+  inline const cpu_set_t * getNodeCPUs(int node) const { return &(nodecpus[node]); }
+
+ /**
+  * Spreads threads over the nodes in contiguous groups, so that neighbouring threads share a node
+  * @return The (usable) node index for thread threadid of numthreads
+  */
+  inline int getNodeForThread(int threadid, int numthreads) const { return (threadid*getNumNodes())/numthreads; }
+
+ /**
+  * Interleaves the pages of a buffer over all usable nodes, moving any pages already touched
+  * @return True on success (always true on a single node, where there is nothing to do)
+  */
+  bool interleave(void * buffer, size_t bytes) const;
+
+ /**
+  * Binds the pages of a buffer to one node, moving any pages already touched
+  * @return True on success
+  */
+  bool bind(void * buffer, size_t bytes, int node) const;
+
+  ///@return A description of a set of CPUs in the usual list format, eg "0-7,16-23"
+  static std::string describeCPUs(const cpu_set_t * cpus);
+
+private:
+  bool setPolicy(void * buffer, size_t bytes, int mode, const std::vector<int> & nodes) const;
+
+  std::vector<int> nodeids;
+  std::vector<cpu_set_t> nodecpus;
+};
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
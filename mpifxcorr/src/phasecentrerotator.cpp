@@ -0,0 +1,110 @@
+#include <math.h>
+#include "phasecentrerotator.h"
+#include "alert.h"
+
+PhaseCentreRotator::PhaseCentreRotator(int maxrotatestridelength, int maxxmacstridelength)
+  : maxrotatestridelength(maxrotatestridelength), maxxmacstridelength(maxxmacstridelength), rotatestridelength(maxrotatestridelength),
+    lofrequency(0.0), firstchanneloffset(0.0), channelbandwidth(0.0), delay(0.0), shifted(false), nextchannel(-1)
+{
+  carried[0] = step[0] = 1.0;
+  carried[1] = step[1] = 0.0;
+  fine = vectorAlloc_cf32(maxrotatestridelength);
+  rotator = vectorAlloc_cf32(maxxmacstridelength);
+}
+
+PhaseCentreRotator::~PhaseCentreRotator()
+{
+  vectorFree(fine);
+  vectorFree(rotator);
+}
+
+void PhaseCentreRotator::setBand(f64 lofrequency, f64 firstchanneloffset, f64 channelbandwidth, int rotatestridelength)
+{
+  this->lofrequency = lofrequency;
+  this->firstchanneloffset = firstchanneloffset;
+  this->channelbandwidth = channelbandwidth;
+  if(rotatestridelength > maxrotatestridelength)
+  {
+    csevere << startl << "Rotate stride length " << rotatestridelength << " exceeds the " << maxrotatestridelength << " allocated for phase centre rotators" << endl;
+    rotatestridelength = maxrotatestridelength;
+  }
+  this->rotatestridelength = rotatestridelength;
+  shifted = false;
+}
+
+void PhaseCentreRotator::setDelay(f64 delay)
+{
+  f64 turns, re, im, stepre, stepim, tmp;
+
+  this->delay = delay;
+  shifted = fabs(delay) > 1.0e-20;
+  nextchannel = -1;
+  if(!shifted)
+    return;
+
+  //the rotation across one rotate stride, by repeated multiplication with the phasor of one channel
+  turns = delay*channelbandwidth;
+  turns -= floor(turns);
+  stepre = cos(TWO_PI*turns);
+  stepim = sin(TWO_PI*turns);
+  re = 1.0;
+  im = 0.0;
+  for(int c=0;c<rotatestridelength;c++)
+  {
+    fine[c].re = re;
+    fine[c].im = im;
+    tmp = re*stepre - im*stepim;
+    im = re*stepim + im*stepre;
+    re = tmp;
+  }
+
+  //and the advance from one rotate stride to the next
+  turns = delay*channelbandwidth*rotatestridelength;
+  turns -= floor(turns);
+  step[0] = cos(TWO_PI*turns);
+  step[1] = sin(TWO_PI*turns);
+}
+
+void PhaseCentreRotator::position(int channel)
+{
+  f64 turns;
+
+  turns = delay*lofrequency;
+  turns -= floor(turns);
+  turns += delay*(firstchanneloffset + channel*channelbandwidth);
+  turns -= floor(turns);
+  carried[0] = cos(TWO_PI*turns);
+  carried[1] = sin(TWO_PI*turns);
+  nextchannel = channel;
+}
+
+void PhaseCentreRotator::generate(int firstchannel, int length)
+{
+  int status, count;
+  f64 tmp;
+  cf32 phasor;
+
+  if(!shifted)
+    return;
+  if(length > maxxmacstridelength)
+  {
+    csevere << startl << "Stride length " << length << " exceeds the " << maxxmacstridelength << " allocated for phase centre rotators" << endl;
+    length = maxxmacstridelength;
+  }
+  if(nextchannel != firstchannel)
+    position(firstchannel);
+  for(int c=0;c<length;c+=rotatestridelength)
+  {
+    count = length - c < rotatestridelength ? length - c : rotatestridelength;
+    phasor.re = carried[0];
+    phasor.im = carried[1];
+    status = vectorMulC_cf32(fine, phasor, rotator + c, count);
+    if(status != vecNoErr)
+      csevere << startl << "Error generating the phase centre rotator!!!" << status << endl;
+    tmp = carried[0]*step[0] - carried[1]*step[1];
+    carried[1] = carried[0]*step[1] + carried[1]*step[0];
+    carried[0] = tmp;
+    nextchannel += rotatestridelength;
+  }
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
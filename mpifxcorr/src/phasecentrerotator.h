@@ -0,0 +1,78 @@
+/** \file phasecentrerotator.h
+ *  \brief Fringe rotators for shifting a baseline/band to other phase centres, by phasor recurrence
+ */
+
+#ifndef PHASECENTREROTATOR_H
+#define PHASECENTREROTATOR_H
+
+#include "architecture.h"
+
+/**
+@class PhaseCentreRotator
+@brief Generates the per-channel phase rotator of a phase centre, a cross-multiply stride at a time
+
+Core::uvshiftAndAverageBaselineFreq shifts the visibilities of a baseline and band to each phase centre by
+multiplying channel n by exp(2 pi i tau (f0 + n df)), where tau is the differential delay of the centre (us),
+f0 the frequency of channel 0 relative to the band edge and df the channel width (MHz).  The phase is linear
+in n, so the rotator of a stride of channels is the product of a table of exp(2 pi i tau c df) for the c in
+one rotate stride (the same for every rotate stride, and built by complex multiplication) and one phasor per
+rotate stride, which is carried from stride to stride in double precision.  Only three sin/cos evaluations
+per phase centre are needed, however many channels there are.
+
+The rotator of one stride is generated just before the stride is used, so it is in cache for every
+polarisation product and pulsar bin of the stride.  Strides are expected in increasing order; any other
+channel is positioned exactly, as in DelayRecurrence.
+*/
+class PhaseCentreRotator{
+public:
+ /**
+  * Allocates the tables
+  * @param maxrotatestridelength The longest rotate stride in any configuration
+  * @param maxxmacstridelength The longest cross-multiply stride in any configuration
+  */
+  PhaseCentreRotator(int maxrotatestridelength, int maxxmacstridelength);
+  ~PhaseCentreRotator();
+
+ /**
+  * Starts a new baseline/band
+  * @param lofrequency The band edge frequency (MHz)
+  * @param firstchanneloffset The frequency of channel 0 relative to the band edge (MHz); -(channels-1)*df for a lower sideband
+  * @param channelbandwidth The channel width df (MHz)
+  * @param rotatestridelength The number of channels sharing one carried phasor (should divide the cross-multiply stride)
+  */
+  void setBand(f64 lofrequency, f64 firstchanneloffset, f64 channelbandwidth, int rotatestridelength);
+
+ /**
+  * Starts a new phase centre of the current band
+  * @param delay The differential delay (us)
+  */
+  void setDelay(f64 delay);
+
+  ///@return True if the delay is large enough that the visibilities need rotating at all
+  inline bool isShifted() const { return shifted; }
+
+ /**
+  * Generates the rotator for one stride
+  * @param firstchannel The first channel of the stride (a multiple of the rotate stride length)
+  * @param length The stride length
+  */
+  void generate(int firstchannel, int length);
+
+  ///@return The rotator generated last, for the channels of its stride
+  inline const cf32 * getRotator() const { return rotator; }
+
+private:
+  void position(int channel);
+
+  int maxrotatestridelength, maxxmacstridelength, rotatestridelength;
+  f64 lofrequency, firstchanneloffset, channelbandwidth, delay;
+  bool shifted;
+  int nextchannel;     //the first channel of the next rotate stride, for which carried is valid
+  f64 carried[2];      //the phasor of the next rotate stride
+  f64 step[2];         //the phasor advance per rotate stride
+  cf32 * fine;         //[maxrotatestridelength] rotation across one rotate stride
+  cf32 * rotator;      //[maxxmacstridelength]
+};
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -0,0 +1,118 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "binsegments.h"
+#include "vectorsimd.h"
+#include "testutil.h"
+
+// Puts the channels of a band into pulsar bins as a dispersed pulse would (the phase sweeps across the band
+// as 1/f^2), finds the runs of channels in the same bin and checks that they cover every channel exactly once,
+// do not cross a cross-multiply stride, and that accumulating the product of two spectra run by run gives the
+// same bins as the channel by channel scatter Core used to do.
+
+static void check(int numchannels, int stridelength, int numbins, double dmturns)
+{
+  int numstrides = (numchannels + stridelength - 1)/stridelength;
+  s32 * bins = new s32[numchannels];
+  BinSegment * segments = new BinSegment[getMaxBinSegments(numchannels, stridelength)];
+  int * firstsegment = new int[numstrides + 1];
+  cf32 * a = new cf32[numchannels];
+  cf32 * b = new cf32[numchannels];
+  cf32 * reference = new cf32[numbins*numchannels];
+  cf32 * segmented = new cf32[numbins*numchannels];
+  int numsegments, covered = 0;
+
+  for(int c=0;c<numchannels;c++)
+  {
+    double f = 1.0 + 0.5*c/numchannels;
+    double phase = 0.37 + dmturns/(f*f);
+    bins[c] = (int)((phase - floor(phase))*numbins) % numbins;
+    a[c].re = (f32)rand()/RAND_MAX - 0.5f;
+    a[c].im = (f32)rand()/RAND_MAX - 0.5f;
+    b[c].re = (f32)rand()/RAND_MAX - 0.5f;
+    b[c].im = (f32)rand()/RAND_MAX - 0.5f;
+  }
+  numsegments = findBinSegments(bins, numchannels, stridelength, segments, firstsegment);
+
+  if(firstsegment[0] != 0 || firstsegment[numstrides] != numsegments || segments[numsegments].start != numchannels)
+  {
+    testFail() << numchannels << " channels, stride " << stridelength << ", " << numbins << " bins: runs not closed properly" << std::endl;
+  }
+  for(int x=0;x<numstrides;x++)
+  {
+    for(int s=firstsegment[x];s<firstsegment[x+1];s++)
+    {
+      int end = segments[s+1].start;
+      if(segments[s].start != covered || end <= segments[s].start || segments[s].start/stridelength != x || (end-1)/stridelength != x ||
+         (s > firstsegment[x] && segments[s-1].bin == segments[s].bin))
+      {
+        testFail() << numchannels << " channels, stride " << stridelength << ", " << numbins << " bins: run " << s << " (" << segments[s].start << " to " << end << ") is misplaced" << std::endl;
+        break;
+      }
+      for(int c=segments[s].start;c<end;c++)
+      {
+        if(bins[c] != segments[s].bin)
+        {
+          testFail() << numchannels << " channels, stride " << stridelength << ", " << numbins << " bins: channel " << c << " is in bin " << bins[c] << " not " << segments[s].bin << std::endl;
+          break;
+        }
+      }
+      covered = end;
+    }
+  }
+  if(covered != numchannels)
+  {
+    testFail() << numchannels << " channels, stride " << stridelength << ", " << numbins << " bins: only " << covered << " channels covered" << std::endl;
+  }
+
+  memset(reference, 0, sizeof(cf32)*numbins*numchannels);
+  memset(segmented, 0, sizeof(cf32)*numbins*numchannels);
+  for(int c=0;c<numchannels;c++)
+  {
+    reference[bins[c]*numchannels + c].re += a[c].re*b[c].re - a[c].im*b[c].im;
+    reference[bins[c]*numchannels + c].im += a[c].re*b[c].im + a[c].im*b[c].re;
+  }
+  for(int s=0;s<numsegments;s++)
+    simdAddProduct_32fc(&(a[segments[s].start]), &(b[segments[s].start]), &(segmented[segments[s].bin*numchannels + segments[s].start]), segments[s+1].start - segments[s].start);
+  for(int i=0;i<numbins*numchannels;i++)
+  {
+    if(fabs(reference[i].re - segmented[i].re) > 1e-6 || fabs(reference[i].im - segmented[i].im) > 1e-6)
+    {
+      testFail() << numchannels << " channels, stride " << stridelength << ", " << numbins << " bins: accumulation differs in bin " << i/numchannels << " channel " << i%numchannels << std::endl;
+      break;
+    }
+  }
+
+  delete [] bins;
+  delete [] segments;
+  delete [] firstsegment;
+  delete [] a;
+  delete [] b;
+  delete [] reference;
+  delete [] segmented;
+}
+
+int main(int argc, const char** argv)
+{
+  const int channels[] = { 1, 100, 1024, 4096 };
+  const int strides[] = { 1, 64, 100, 4096 };
+  const int bins[] = { 1, 8, 1024 };
+  const double dmturns[] = { 0.0, 0.3, 40.0 };
+  int numcases = 0;
+
+  srand(11);
+  for(int c=0;c<4;c++)
+    for(int s=0;s<4;s++)
+      for(int b=0;b<3;b++)
+        for(int d=0;d<3;d++)
+        {
+          check(channels[c], strides[s], bins[b], dmturns[d]);
+          numcases++;
+        }
+
+  if(testFailures() == 0)
+    std::cout << "Bin runs are correct for all " << numcases << " cases" << std::endl;
+
+  return testExitStatus();
+}
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "vdifcornerturn.h"
+#include "vectorsimd.h"
+#include "testutil.h"
+
+// Checks the swap network corner turners used by VDIFMuxer against the sample-at-a-time
+// reference for every supported thread count and sample size, at every SIMD level this CPU has.
+// Word counts that are not a multiple of the vector width and unaligned thread data are included.
+// Exits with a non-zero status if any output word differs.
+
+static const int MAX_THREADS = 32;
+
+static void check(int numthreads, int bitspersample, int level, int words, int misalign, u8 ** threaddata)
+{
+  CornerTurnPlan plan;
+  const u8 * threads[MAX_THREADS];
+  u8 * reference = new u8[4*words*numthreads];
+  u8 * output = new u8[4*words*numthreads + 4];
+  u8 * out = output + misalign;
+
+  if(!cornerTurnMakePlan(&plan, numthreads, bitspersample))
+  {
+    testFail() << "no plan for " << numthreads << " threads of " << bitspersample << " bit data" << std::endl;
+    return;
+  }
+  for(int j=0;j<numthreads;j++)
+    threads[j] = threaddata[j] + misalign;
+  cornerTurnGeneric(reference, threads, words, numthreads, bitspersample);
+  memset(output, 0xA5, 4*words*numthreads + 4);
+  cornerTurnGetKernel(level)(out, threads, words, &plan);
+
+  for(int i=0;i<words*numthreads;i++)
+  {
+    if(memcmp(out + 4*i, reference + 4*i, 4) != 0)
+    {
+      testFail() << numthreads << " threads of " << bitspersample << " bit data, " << words << " words, level " << simdLevelName(level) << ", offset " << misalign << ": output word " << i << " differs" << std::endl;
+      break;
+    }
+  }
+
+  delete [] reference;
+  delete [] output;
+}
+
+int main(int argc, const char** argv)
+{
+  const int bits[] = { 1, 2, 4, 8, 16 };
+  const int wordcounts[] = { 1, 3, 15, 16, 17, 2000, 2003 };
+  const int maxwords = 2003;
+  CornerTurnPlan plan;
+  u8 * threaddata[MAX_THREADS];
+
+  srand(42);
+  for(int j=0;j<MAX_THREADS;j++)
+  {
+    threaddata[j] = new u8[4*maxwords + 4];
+    for(int i=0;i<4*maxwords + 4;i++)
+      threaddata[j][i] = rand() & 0xFF;
+  }
+
+  for(int level=SIMD_GENERIC;level<=simdDetectLevel();level++)
+  {
+    for(unsigned int b=0;b<sizeof(bits)/sizeof(bits[0]);b++)
+    {
+      for(int n=2;n*bits[b]<=32;n*=2)
+      {
+        for(unsigned int w=0;w<sizeof(wordcounts)/sizeof(wordcounts[0]);w++)
+        {
+          check(n, bits[b], level, wordcounts[w], 0, threaddata);
+          check(n, bits[b], level, wordcounts[w], 1, threaddata);
+        }
+      }
+    }
+  }
+
+  // combinations the network does not cover must be refused
+  if(cornerTurnMakePlan(&plan, 1, 2) || cornerTurnMakePlan(&plan, 3, 2) || cornerTurnMakePlan(&plan, 4, 3) || cornerTurnMakePlan(&plan, 4, 16) || cornerTurnMakePlan(&plan, 64, 1))
+  {
+    testFail() << "a plan was made for an unsupported combination" << std::endl;
+  }
+
+  for(int j=0;j<MAX_THREADS;j++)
+    delete [] threaddata[j];
+
+  if(testFailures() == 0)
+    std::cout << "All corner turners agree with the reference up to " << simdLevelName(simdDetectLevel()) << std::endl;
+
+  return testExitStatus();
+}
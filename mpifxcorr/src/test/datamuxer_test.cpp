@@ -0,0 +1,109 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "datamuxer.h"
+#include "vdifio.h"
+#include "testutil.h"
+
+// Runs the same synthetic multi-thread VDIF through VDIFMuxer with the demultiplexing done on the
+// calling thread alone and shared among several mux workers (DIFX_MUX_WORKERS), and checks that the
+// multiplexed output is identical.  Some frames are dropped and one is repeated so that the invalid
+// frame and duplicate frame paths are exercised too.
+
+static const int FRAMEBYTES = 1032;
+static const int FRAMESPERSECOND = 10000;
+static const int FRAMESPERTHREAD = 40;   // per segment
+static const int NUMSEGMENTS = 12;
+
+// Fills one segment of the demux buffer with interleaved frames and returns the number of bytes used
+static int fillsegment(u8 * buffer, int segmentbytes, int numthreads, int bitspersample, long long firstframe)
+{
+  int bytes = 0;
+  char stationid[] = "Tt";
+
+  for(int f=0;f<FRAMESPERTHREAD;f++)
+  {
+    long long frame = firstframe + f;
+    for(int t=0;t<numthreads;t++)
+    {
+      // drop a frame now and then, and once send one twice
+      if((frame*numthreads + t) % 97 == 13)
+        continue;
+      int copies = ((frame*numthreads + t) % 211 == 7) ? 2 : 1;
+      for(int c=0;c<copies && bytes + FRAMEBYTES <= segmentbytes;c++)
+      {
+        vdif_header * header = (vdif_header *)(buffer + bytes);
+        unsigned int * words = (unsigned int *)(buffer + bytes + VDIF_HEADER_BYTES);
+        createVDIFHeader(header, FRAMEBYTES - VDIF_HEADER_BYTES, t, bitspersample, 1, 0, stationid);
+        setVDIFFrameSecond(header, frame/FRAMESPERSECOND);
+        setVDIFFrameNumber(header, frame%FRAMESPERSECOND);
+        for(int i=0;i<(FRAMEBYTES - VDIF_HEADER_BYTES)/4;i++)
+          words[i] = (unsigned int)(frame*2654435761u + i*40503u + t*977u + c);
+        bytes += FRAMEBYTES;
+      }
+    }
+  }
+  // pad with the frames that follow so the segment is full, as a file read would
+  while(bytes + FRAMEBYTES <= segmentbytes)
+  {
+    memcpy(buffer + bytes, buffer + bytes - FRAMEBYTES, FRAMEBYTES);
+    setVDIFFrameNumber((vdif_header *)(buffer + bytes), (getVDIFFrameNumber((vdif_header *)(buffer + bytes)) + 1) % FRAMESPERSECOND);
+    bytes += FRAMEBYTES;
+  }
+
+  return bytes;
+}
+
+// Multiplexes NUMSEGMENTS segments, appending the output to result
+static void runmuxer(int numthreads, int bitspersample, std::string & result)
+{
+  int threadmap[16];
+
+  for(int t=0;t<numthreads;t++)
+    threadmap[t] = t;
+  VDIFMuxer vdifmuxer(0, 0, 0, numthreads, FRAMEBYTES, FRAMESPERTHREAD*numthreads, FRAMESPERSECOND, bitspersample, threadmap);
+  DataMuxer * muxer = &vdifmuxer;
+  u8 * output = new u8[muxer->getSegmentBytes()];
+
+  for(int s=0;s<NUMSEGMENTS;s++)
+  {
+    int bytes = fillsegment(muxer->getCurrentDemuxBuffer(), muxer->getSegmentBytes(), numthreads, bitspersample, (long long)s*FRAMESPERTHREAD);
+    if(s == 0)
+      muxer->initialise();
+    muxer->incrementReadCounter();
+    muxer->deinterlace(bytes);
+    // the payload of frames marked invalid is left as it was
+    memset(output, 0, muxer->getSegmentBytes());
+    int validbytes = muxer->multiplex(output);
+    result.append((const char *)output, validbytes);
+  }
+
+  delete [] output;
+}
+
+int main(int argc, const char** argv)
+{
+  const int cases[][2] = { {2, 2}, {4, 2}, {8, 2}, {16, 2}, {4, 4}, {8, 1}, {2, 8}, {3, 2} };
+  const int numcases = sizeof(cases)/sizeof(cases[0]);
+
+  for(int c=0;c<numcases;c++)
+  {
+    std::string serial, parallel;
+
+    unsetenv("DIFX_MUX_WORKERS");
+    runmuxer(cases[c][0], cases[c][1], serial);
+    setenv("DIFX_MUX_WORKERS", "4", 1);
+    runmuxer(cases[c][0], cases[c][1], parallel);
+
+    if(serial.size() == 0 || serial != parallel)
+    {
+      testFail() << cases[c][0] << " threads of " << cases[c][1] << " bit data: " << serial.size() << " bytes multiplexed serially, " << parallel.size() << " in parallel, " << (serial == parallel ? "identical" : "differing") << std::endl;
+    }
+  }
+
+  if(testFailures() == 0)
+    std::cout << "Parallel demultiplexing matches serial for all " << numcases << " cases" << std::endl;
+
+  return testExitStatus();
+}
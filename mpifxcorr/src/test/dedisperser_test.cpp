@@ -0,0 +1,125 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include "dedisperser.h"
+#include "testutil.h"
+
+// Streams random spectra through StreamDedisperser and checks every output sample against a direct
+// sum over the channels with the delays it reports, with and without DMs sharing the dedispersion
+// within subbands.  Then streams a single dispersed pulse and checks that it comes out at the right
+// DM and time, with (nearly) all of its power when each DM is dedispersed separately.
+
+static void checkexact(int numchannels, int numsubbands, int dmspergroup, int blocklength)
+{
+  const int numdms = 21, numspectra = 3000;
+  std::vector<double> freqs(numchannels), dms(numdms);
+  std::vector<f32> spectra((size_t)numspectra*numchannels);
+  int checked = 0;
+
+  for(int c=0;c<numchannels;c++)
+    freqs[c] = 1464.0 - c*64.0/numchannels;   //decreasing, as in a lower sideband band
+  for(int d=0;d<numdms;d++)
+    dms[d] = 5.0*d;
+  for(size_t i=0;i<spectra.size();i++)
+    spectra[i] = (f32)(rand() % 17);
+
+  StreamDedisperser dedisperser(numchannels, &freqs[0], 0.0001, numdms, &dms[0], numsubbands, dmspergroup, blocklength);
+  if(!dedisperser.initialisedOK())
+  {
+    testFail() << "dedisperser with " << numsubbands << " subbands did not initialise" << std::endl;
+    return;
+  }
+  for(int t=0;t<numspectra;t++)
+  {
+    if(!dedisperser.addSpectrum(&spectra[(size_t)t*numchannels]))
+      continue;
+    for(int d=0;d<numdms;d++)
+    {
+      const f32 * out = dedisperser.getDedispersed(d);
+      for(int i=0;i<blocklength;i++)
+      {
+        long long sample = dedisperser.getOutputStart() + i;
+        f32 expected = 0.0;
+        for(int c=0;c<numchannels;c++)
+        {
+          long long s = sample + dedisperser.getDelay(d, c);
+          if(s >= 0)
+            expected += spectra[s*numchannels + c];
+        }
+        if(out[i] != expected)
+        {
+          testFail() << numsubbands << " subbands, " << dmspergroup << " DMs per group: DM " << dms[d] << " sample " << sample << " is " << out[i] << " not " << expected << std::endl;
+          return;
+        }
+        checked++;
+      }
+    }
+  }
+  if(checked == 0 || dedisperser.getDelay(numdms-1, numchannels-1) == 0)
+  {
+    testFail() << numsubbands << " subbands, " << dmspergroup << " DMs per group: nothing was checked" << std::endl;
+  }
+}
+
+static void checkpulse(int dmspergroup, double minfraction)
+{
+  const int numchannels = 256, numdms = 101, pulsesample = 5000, numspectra = 20000, blocklength = 512;
+  const double tsamp = 0.0005, pulsedm = 57.0;
+  std::vector<double> freqs(numchannels), dms(numdms);
+  std::vector<f32> spectrum(numchannels);
+  double topfreq = 1500.0, best = 0.0;
+  long long bestsample = -1;
+  int bestdm = -1;
+
+  for(int c=0;c<numchannels;c++)
+    freqs[c] = 1200.0 + (c + 0.5)*300.0/numchannels;
+  topfreq = freqs[numchannels-1];
+  for(int d=0;d<numdms;d++)
+    dms[d] = d;
+
+  StreamDedisperser dedisperser(numchannels, &freqs[0], tsamp, numdms, &dms[0], 16, dmspergroup, blocklength);
+  for(int t=0;t<numspectra;t++)
+  {
+    for(int c=0;c<numchannels;c++)
+    {
+      double delay = StreamDedisperser::DISPERSION_CONSTANT*pulsedm*(1.0/(freqs[c]*freqs[c]) - 1.0/(topfreq*topfreq))/tsamp;
+      spectrum[c] = (t == pulsesample + (int)floor(delay + 0.5)) ? 1.0 : 0.0;
+    }
+    if(!dedisperser.addSpectrum(&spectrum[0]))
+      continue;
+    for(int d=0;d<numdms;d++)
+    {
+      for(int i=0;i<blocklength;i++)
+      {
+        if(dedisperser.getDedispersed(d)[i] > best)
+        {
+          best = dedisperser.getDedispersed(d)[i];
+          bestdm = d;
+          bestsample = dedisperser.getOutputStart() + i;
+        }
+      }
+    }
+  }
+  if(fabs(dms[bestdm] - pulsedm) > 2.0 || bestsample != pulsesample || best < minfraction*numchannels)
+  {
+    testFail() << dmspergroup << " DMs per group: pulse at DM " << pulsedm << " sample " << pulsesample << " found at DM " << (bestdm >= 0 ? dms[bestdm] : -1.0) << " sample " << bestsample << " with " << best << " of " << numchannels << std::endl;
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  srand(5);
+  checkexact(64, 64, 1, 256);
+  checkexact(64, 8, 1, 100);
+  checkexact(64, 8, 4, 256);
+  checkexact(60, 7, 3, 37);
+  checkexact(64, 1, 21, 64);
+  checkpulse(1, 1.0);
+  checkpulse(8, 0.5);   //the pulse is one sample wide, so smearing within the subbands costs it a lot
+
+  if(testFailures() == 0)
+    std::cout << "Dedispersion matches the direct sums, and the test pulse was found" << std::endl;
+
+  return testExitStatus();
+}
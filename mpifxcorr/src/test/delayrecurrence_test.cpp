@@ -0,0 +1,91 @@
+#include <iostream>
+#include <cmath>
+#include <cfloat>
+#include <cstdlib>
+#include "delayrecurrence.h"
+#include "testutil.h"
+
+// Checks the incremental delay generator used by Mode::process against direct evaluation
+// of the quadratic interpolator, in the way Mode used to compute the values per FFT.
+// Exits with a non-zero status if any value differs by more than the rounding allowance.
+
+static void compare(const char * what, int index, double expected, double got, double scale)
+{
+  // each incremental step may add one rounding at the scale of the polynomial's terms, and there
+  // are at most RESYNC_INTERVAL steps before an exact resync; allow a generous factor on top of that
+  double allowance = 8.0*DelayRecurrence::RESYNC_INTERVAL*DBL_EPSILON*scale;
+
+  if(fabs(expected - got) > allowance)
+  {
+    testFail() << what << " at index " << index << ": expected " << expected << ", got " << got << " (difference " << expected - got << ", allowance " << allowance << ")" << std::endl;
+  }
+}
+
+static void check(const double * p, int index, const DelayRecurrence & recurrence)
+{
+  double scale = fabs(p[0])*(index+1)*(index+1) + fabs(p[1])*(index+1) + fabs(p[2]) + 1.0;
+
+  compare("delay at start", index, p[0]*index*index + p[1]*index + p[2], recurrence.delayAtStart(), scale);
+  compare("delay at centre", index, p[0]*(index+0.5)*(index+0.5) + p[1]*(index+0.5) + p[2], recurrence.delayAtCentre(), scale);
+  compare("delay at end", index, p[0]*(index+1)*(index+1) + p[1]*(index+1) + p[2], recurrence.delayAtEnd(), scale);
+  compare("slope at start", index, p[1] + index*p[0]*2.0, recurrence.slopeAtStart(), scale);
+}
+
+int main(int argc, const char** argv)
+{
+  // typical interpolators (microseconds, per FFT) from short-FFT to long-FFT jobs, plus an extreme one
+  const double polynomials[][3] = {
+    { 1.3e-15, 2.7e-6, 21345.678912345 },
+    { -4.1e-13, -1.9e-4, -8765.4321098765 },
+    { 2.2e-11, 3.1e-3, 3.25 },
+    { 0.0, 0.0, 0.0 },
+    { 1.0e-6, -0.5, 65432.1 }
+  };
+  const int numpolynomials = sizeof(polynomials)/sizeof(polynomials[0]);
+  const int numffts = 200000;
+  DelayRecurrence recurrence;
+
+  for(int p=0;p<numpolynomials;p++)
+  {
+    recurrence.setPolynomial(polynomials[p]);
+
+    // a whole subint in order, as a single thread processes it
+    for(int i=0;i<numffts;i++)
+    {
+      recurrence.moveTo(i);
+      check(polynomials[p], i, recurrence);
+    }
+
+    // a thread's share of a subint, in buffered chunks that skip the other threads' FFTs
+    recurrence.setPolynomial(polynomials[p]);
+    for(int start=17;start<numffts;start+=1000)
+    {
+      for(int i=start;i<start+250;i++)
+      {
+        recurrence.moveTo(i);
+        check(polynomials[p], i, recurrence);
+      }
+    }
+
+    // revisiting an index and going backwards must also give the exact values
+    for(int i=100;i>=0;i-=7)
+    {
+      recurrence.moveTo(i);
+      check(polynomials[p], i, recurrence);
+      recurrence.moveTo(i);
+      check(polynomials[p], i, recurrence);
+    }
+  }
+
+  // a new polynomial must take effect even if the next index follows on from the last one
+  recurrence.setPolynomial(polynomials[0]);
+  recurrence.moveTo(0);
+  recurrence.setPolynomial(polynomials[1]);
+  recurrence.moveTo(1);
+  check(polynomials[1], 1, recurrence);
+
+  if(testFailures() == 0)
+    std::cout << "All incremental delays agree with the polynomial" << std::endl;
+
+  return testExitStatus();
+}
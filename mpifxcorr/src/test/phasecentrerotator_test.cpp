@@ -0,0 +1,97 @@
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "phasecentrerotator.h"
+#include "testutil.h"
+
+// Checks the phase centre rotators against the rotation Core::uvshiftAndAverageBaselineFreq used to
+// compute directly (a fine rotator across one rotate stride times a coarse one per rotate stride, each
+// from sin/cos of the phase in turns), evaluated here in double precision, for upper and lower sideband
+// bands, many centres including unshifted ones, and strides visited out of order.
+
+// The old rotator for channel n: the chanfreqs of Core, times the delay, plus the edge turns
+static void reference(double delay, double lofrequency, bool lsb, int numchannels, int rotatestridelen, double channelbandwidth, int n, double * re, double * im)
+{
+  int numsteps = numchannels/rotatestridelen, c = n%rotatestridelen, j = n/rotatestridelen;
+  double edgeturns, fineturns, coarseturns, turns;
+
+  edgeturns = delay*lofrequency;
+  edgeturns -= floor(edgeturns);
+  if(lsb)
+  {
+    fineturns = delay*(-(rotatestridelen-(c+1))*channelbandwidth) + edgeturns;
+    coarseturns = delay*(-(numsteps-(j+1))*rotatestridelen*channelbandwidth);
+  }
+  else
+  {
+    fineturns = delay*c*channelbandwidth + edgeturns;
+    coarseturns = delay*j*rotatestridelen*channelbandwidth;
+  }
+  turns = fineturns + coarseturns;
+  turns -= floor(turns);
+  *re = cos(TWO_PI*turns);
+  *im = sin(TWO_PI*turns);
+}
+
+static void check(bool lsb, double lofrequency, int numchannels, int rotatestridelen, int xmacstridelen, int numcentres)
+{
+  const double bandwidth = 64.0;
+  double channelbandwidth = bandwidth/numchannels, re, im, worst = 0.0;
+  std::vector<int> order;
+  PhaseCentreRotator rotator(rotatestridelen, xmacstridelen);
+  int numstrides = numchannels/xmacstridelen;
+
+  //every stride in order, then a few out of order
+  for(int x=0;x<numstrides;x++)
+    order.push_back(x);
+  order.push_back(numstrides/2);
+  order.push_back(0);
+  order.push_back(numstrides-1);
+  order.push_back(1);
+
+  rotator.setBand(lofrequency, lsb ? -(numchannels-1)*channelbandwidth : 0.0, channelbandwidth, rotatestridelen);
+  for(int s=0;s<numcentres;s++)
+  {
+    double delay = (s%7 == 3) ? 0.0 : (rand()/(double)RAND_MAX - 0.5)*0.05;   //up to +-25 ns, with some centres unshifted
+    rotator.setDelay(delay);
+    if(rotator.isShifted() != (delay != 0.0))
+    {
+      testFail() << "centre " << s << " with delay " << delay << " is " << (rotator.isShifted() ? "" : "not ") << "shifted" << std::endl;
+    }
+    if(!rotator.isShifted())
+      continue;
+    for(size_t i=0;i<order.size();i++)
+    {
+      int x = order[i];
+      rotator.generate(x*xmacstridelen, xmacstridelen);
+      const cf32 * r = rotator.getRotator();
+      for(int c=0;c<xmacstridelen;c++)
+      {
+        reference(delay, lofrequency, lsb, numchannels, rotatestridelen, channelbandwidth, x*xmacstridelen + c, &re, &im);
+        double error = fabs(r[c].re - re) + fabs(r[c].im - im);
+        if(error > worst)
+          worst = error;
+      }
+    }
+  }
+  if(worst > 2.0e-6)
+  {
+    testFail() << (lsb ? "LSB" : "USB") << " band at " << lofrequency << " MHz, " << numchannels << " channels, rotate stride " << rotatestridelen << ", xmac stride " << xmacstridelen << ": rotators differ by up to " << worst << std::endl;
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  srand(3);
+  check(false, 1658.99, 4096, 64, 256, 10);
+  check(true, 1658.99, 4096, 64, 256, 10);
+  check(false, 86242.0, 8192, 32, 128, 300);
+  check(true, 22230.0, 1024, 16, 64, 1000);
+  check(false, 4980.0, 512, 512, 512, 40);
+
+  if(testFailures() == 0)
+    std::cout << "Phase centre rotators match the direct evaluation" << std::endl;
+
+  return testExitStatus();
+}
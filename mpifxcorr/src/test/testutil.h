@@ -0,0 +1,52 @@
+/** \file testutil.h
+ *  \brief Failure counting and reporting shared by the make check tests
+ */
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <iostream>
+#include <cstdlib>
+
+/// Failures past this many are still counted but no longer described
+static const int MAX_REPORTED_FAILURES = 10;
+
+/// The number of failures counted so far by testFail()
+inline int & testFailures()
+{
+  static int failures = 0;
+
+  return failures;
+}
+
+/**
+ * Counts a failure and starts the line describing it
+ * @return The stream to finish the description on (with std::endl); it discards everything once MAX_REPORTED_FAILURES have been described
+ */
+inline std::ostream & testFail()
+{
+  static std::ostream discard(0);
+
+  if(++testFailures() > MAX_REPORTED_FAILURES)
+    return discard;
+
+  return std::cout << "FAIL: ";
+}
+
+/**
+ * Reports the number of failures, if there were any
+ * @return The exit status for main: EXIT_FAILURE if anything failed, otherwise EXIT_SUCCESS
+ */
+inline int testExitStatus()
+{
+  if(testFailures() > 0)
+  {
+    std::cout << testFailures() << " failures" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -0,0 +1,133 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "viswriter.h"
+#include "testutil.h"
+
+// Queues many small integrations to a few files through VisWriter, as Visibility::writedifx does,
+// with a single block so that formatting has to wait for the I/O thread, and checks that each file
+// ends up holding exactly what was queued for it, in order, and that append() predicted where each
+// piece would land.  One file already has content when the writer first sees it.  Finally checks that
+// nothing is written to an index whose data file cannot be written.
+
+static const int NUMFILES = 3;
+static const int NUMINTEGRATIONS = 50;
+static const long long BLOCKBYTES = 1 << 16;
+
+static std::string readfile(const std::string & filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  std::stringstream contents;
+
+  contents << in.rdbuf();
+
+  return contents.str();
+}
+
+int main(int argc, const char** argv)
+{
+  char dirtemplate[] = "/tmp/viswriter_testXXXXXX";
+  std::string filenames[NUMFILES], expected[NUMFILES];
+
+  if(mkdtemp(dirtemplate) == 0)
+  {
+    testFail() << "cannot create a temporary directory" << std::endl;
+    return testExitStatus();
+  }
+  for(int f=0;f<NUMFILES;f++)
+  {
+    std::ostringstream name;
+    name << dirtemplate << "/file" << f;
+    filenames[f] = name.str();
+  }
+  expected[0] = "# already here\n";
+  std::ofstream(filenames[0].c_str()) << expected[0];
+
+  {
+    VisWriter writer(1, BLOCKBYTES, 7);
+
+    if(!writer.initialisedOK())
+    {
+      testFail() << "the writer did not start" << std::endl;
+      return testExitStatus();
+    }
+    srand(3);
+    for(int i=0;i<NUMINTEGRATIONS;i++)
+    {
+      char * block = writer.getBlock();
+      long long used = 0;
+
+      for(int f=0;f<NUMFILES;f++)
+      {
+        int bytes = rand() % (BLOCKBYTES/(2*NUMFILES));
+        long long predicted;
+
+        for(int b=0;b<bytes;b++)
+          block[used + b] = (char)(rand() & 0xFF);
+        predicted = writer.append(filenames[f].c_str(), used, bytes);
+        if(predicted != (long long)expected[f].size())
+        {
+          testFail() << "integration " << i << " file " << f << " predicted at " << predicted << " rather than " << expected[f].size() << std::endl;
+        }
+        expected[f].append(block + used, bytes);
+        used += bytes;
+      }
+
+      std::ostringstream line;
+      line << "integration " << i << "\n";
+      writer.appendCopy(filenames[i%NUMFILES].c_str(), line.str().c_str(), line.str().size());
+      expected[i%NUMFILES] += line.str();
+      writer.submitBlock();
+      if(writer.getNumQueued() > writer.getNumBlocks())
+      {
+        testFail() << writer.getNumQueued() << " blocks queued with only " << writer.getNumBlocks() << std::endl;
+      }
+    }
+    writer.drain();
+    if(writer.getNumQueued() != 0)
+    {
+      testFail() << "blocks still queued after drain()" << std::endl;
+    }
+  }
+
+  {
+    std::string baddata = std::string(dirtemplate) + "/missing/data";
+    std::string index = std::string(dirtemplate) + "/index";
+    VisWriter writer(1, BLOCKBYTES, 0);
+
+    for(int i=0;i<3;i++)
+    {
+      char * block = writer.getBlock();
+
+      memset(block, i, 16);
+      writer.append(baddata.c_str(), 0, 16);
+      writer.appendCopy(index.c_str(), "entry\n", 6, baddata.c_str());
+      writer.submitBlock();
+    }
+    writer.drain();
+    if(access(index.c_str(), F_OK) == 0)
+    {
+      testFail() << "the index of an unwritable data file was written" << std::endl;
+      unlink(index.c_str());
+    }
+  }
+
+  for(int f=0;f<NUMFILES;f++)
+  {
+    if(readfile(filenames[f]) != expected[f])
+    {
+      testFail() << filenames[f] << " does not hold what was queued for it" << std::endl;
+    }
+    unlink(filenames[f].c_str());
+  }
+  rmdir(dirtemplate);
+
+  if(testFailures() == 0)
+    std::cout << "All " << NUMINTEGRATIONS << " integrations were written where expected" << std::endl;
+
+  return testExitStatus();
+}
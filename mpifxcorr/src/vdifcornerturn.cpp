@@ -0,0 +1,241 @@
+#include <string.h>
+#include "vdifcornerturn.h"
+#include "vectorsimd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CORNERTURN_X86 1
+#include <immintrin.h>
+#define CORNERTURN_TARGET_SSE42  __attribute__((target("sse4.2")))
+#define CORNERTURN_TARGET_AVX2   __attribute__((target("avx2")))
+#define CORNERTURN_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define CORNERTURN_X86 0
+#endif
+
+static int log2int(int x)
+{
+  int l = 0;
+
+  while((1 << l) < x)
+    l++;
+
+  return ((1 << l) == x) ? l : -1;
+}
+
+bool cornerTurnMakePlan(CornerTurnPlan * plan, int numthreads, int bitspersample)
+{
+  int q = log2int(numthreads);
+  int b = log2int(bitspersample);
+  int n, p, blockbits, lo, hi;
+  int cur[5], target[5];
+
+  memset(plan, 0, sizeof(CornerTurnPlan));
+  if(q < 1 || b < 0 || bitspersample > 16 || numthreads*bitspersample > 32)
+    return false;
+  plan->numthreads = numthreads;
+  plan->bitspersample = bitspersample;
+  n = 5 - b;          // index bits of a sample within a word
+  p = n - q;          // index bits of a time step within a thread's block
+  blockbits = bitspersample << p;
+
+  // block transpose between words: word r block c <-> word r^h block c^h
+  for(int h=1;h<numthreads;h*=2)
+  {
+    u32 mask = 0;
+    for(int c=0;c<numthreads;c++)
+    {
+      if((c & h) == 0)
+        mask |= (u32)(((1ULL << blockbits) - 1) << (c*blockbits));
+    }
+    plan->wordstride[plan->numwordstages] = h;
+    plan->wordshift[plan->numwordstages] = h*blockbits;
+    plan->wordmask[plan->numwordstages] = mask;
+    plan->numwordstages++;
+  }
+
+  // within a word the sample index is now (thread << p) | time; it must become (time << q) | thread.
+  // Label the index bits 0..n-1 by what they hold, then swap index bit pairs until they are in place.
+  for(int i=0;i<n;i++)
+  {
+    cur[i] = i;                              // time bits 0..p-1, then thread bits
+    target[i] = (i < q) ? p + i : i - q;     // thread bits first, then time bits
+  }
+  for(lo=0;lo<n;lo++)
+  {
+    if(cur[lo] == target[lo])
+      continue;
+    for(hi=lo+1;cur[hi]!=target[lo];hi++);
+    // samples with index bit lo set and bit hi clear swap with those the other way round
+    u32 mask = 0;
+    for(int s=0;s<(1<<n);s++)
+    {
+      if(((s >> lo) & 1) && !((s >> hi) & 1))
+        mask |= (u32)(((1ULL << bitspersample) - 1) << (s*bitspersample));
+    }
+    plan->bitshift[plan->numbitswaps] = ((1 << hi) - (1 << lo))*bitspersample;
+    plan->bitmask[plan->numbitswaps] = mask;
+    plan->numbitswaps++;
+    cur[hi] = cur[lo];
+    cur[lo] = target[lo];
+  }
+
+  return true;
+}
+
+void cornerTurnGeneric(u8 * output, const u8 * const * threads, int wordsperthread, int numthreads, int bitspersample)
+{
+  const unsigned int activemask = (1<<bitspersample) - 1;
+  const int samplesperoutputword = (32/bitspersample)/numthreads;
+  unsigned int * outputwordptr = (unsigned int *)output;
+  unsigned int copyword, threadword;
+
+  //loop over all the samples and copy them in
+  for(int i=0;i<wordsperthread;i++) {
+    for(int j=0;j<numthreads;j++) {
+      copyword = 0;
+      for(int k=0;k<samplesperoutputword;k++) {
+        for(int l=0;l<numthreads;l++) {
+          threadword = *(const unsigned int *)(threads[l] + i*4);
+          copyword |= ((threadword >> ((j*samplesperoutputword + k)*bitspersample)) & (activemask)) << (k*numthreads + l)*bitspersample;
+        }
+      }
+      outputwordptr[i*numthreads + j] = copyword;
+    }
+  }
+}
+
+static inline u32 scalarLoad(const u32 * p) { u32 w; memcpy(&w, p, 4); return w; }
+static inline void scalarStore(u32 * p, u32 w) { memcpy(p, &w, 4); }
+
+static void scalarCornerTurn(u8 * output, const u8 * const * threads, int wordsperthread, const CornerTurnPlan * plan)
+{
+  const int numthreads = plan->numthreads;
+  u32 * out = (u32 *)output;
+  u32 v[32], t;
+  int i, j, r, s, h;
+
+  for(i=0;i<wordsperthread;i++)
+  {
+    for(j=0;j<numthreads;j++)
+      v[j] = scalarLoad((const u32 *)threads[j] + i);
+    for(s=0;s<plan->numwordstages;s++)
+    {
+      h = plan->wordstride[s];
+      for(r=0;r<numthreads;r++)
+      {
+        if(r & h)
+          continue;
+        t = ((v[r] >> plan->wordshift[s]) ^ v[r+h]) & plan->wordmask[s];
+        v[r+h] ^= t;
+        v[r] ^= t << plan->wordshift[s];
+      }
+    }
+    for(s=0;s<plan->numbitswaps;s++)
+    {
+      for(j=0;j<numthreads;j++)
+      {
+        t = ((v[j] >> plan->bitshift[s]) ^ v[j]) & plan->bitmask[s];
+        v[j] ^= t ^ (t << plan->bitshift[s]);
+      }
+    }
+    for(j=0;j<numthreads;j++)
+      scalarStore(out + i*numthreads + j, v[j]);
+  }
+}
+
+/* The kernels share one body, written in terms of the operations below on a vector of LANES
+ * consecutive words of a thread.  The words of all threads are swapped in registers, then
+ * written out in word order through a small buffer. */
+#define CORNERTURN_BODY(VEC, LANES, LOAD, STORE, SRL, SLL, AND, XOR, SET1) \
+{ \
+  const int numthreads = plan->numthreads; \
+  u32 * out = (u32 *)output; \
+  VEC v[32], t; \
+  u32 lanes[32*LANES]; \
+  int i, j, r, s, x, h; \
+  \
+  for(i=0;i+LANES<=wordsperthread;i+=LANES) \
+  { \
+    for(j=0;j<numthreads;j++) \
+      v[j] = LOAD((const u32 *)threads[j] + i); \
+    for(s=0;s<plan->numwordstages;s++) \
+    { \
+      h = plan->wordstride[s]; \
+      for(r=0;r<numthreads;r++) \
+      { \
+        if(r & h) \
+          continue; \
+        t = AND(XOR(SRL(v[r], plan->wordshift[s]), v[r+h]), SET1(plan->wordmask[s])); \
+        v[r+h] = XOR(v[r+h], t); \
+        v[r] = XOR(v[r], SLL(t, plan->wordshift[s])); \
+      } \
+    } \
+    for(s=0;s<plan->numbitswaps;s++) \
+    { \
+      for(j=0;j<numthreads;j++) \
+      { \
+        t = AND(XOR(SRL(v[j], plan->bitshift[s]), v[j]), SET1(plan->bitmask[s])); \
+        v[j] = XOR(v[j], XOR(t, SLL(t, plan->bitshift[s]))); \
+      } \
+    } \
+    for(j=0;j<numthreads;j++) \
+      STORE(lanes + j*LANES, v[j]); \
+    for(x=0;x<LANES;x++) \
+      for(j=0;j<numthreads;j++) \
+        out[(i+x)*numthreads + j] = lanes[j*LANES + x]; \
+  } \
+  if(i < wordsperthread) \
+  { \
+    const u8 * tailthreads[32]; \
+    for(j=0;j<numthreads;j++) \
+      tailthreads[j] = threads[j] + i*4; \
+    scalarCornerTurn(output + i*numthreads*4, tailthreads, wordsperthread - i, plan); \
+  } \
+}
+
+#if CORNERTURN_X86
+#define SSE_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define SSE_STORE(p, a) _mm_storeu_si128((__m128i *)(p), a)
+#define SSE_SRL(a, n) _mm_srl_epi32(a, _mm_cvtsi32_si128(n))
+#define SSE_SLL(a, n) _mm_sll_epi32(a, _mm_cvtsi32_si128(n))
+CORNERTURN_TARGET_SSE42 static void sse42CornerTurn(u8 * output, const u8 * const * threads, int wordsperthread, const CornerTurnPlan * plan)
+CORNERTURN_BODY(__m128i, 4, SSE_LOAD, SSE_STORE, SSE_SRL, SSE_SLL, _mm_and_si128, _mm_xor_si128, _mm_set1_epi32)
+
+#define AVX2_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define AVX2_STORE(p, a) _mm256_storeu_si256((__m256i *)(p), a)
+#define AVX2_SRL(a, n) _mm256_srl_epi32(a, _mm_cvtsi32_si128(n))
+#define AVX2_SLL(a, n) _mm256_sll_epi32(a, _mm_cvtsi32_si128(n))
+CORNERTURN_TARGET_AVX2 static void avx2CornerTurn(u8 * output, const u8 * const * threads, int wordsperthread, const CornerTurnPlan * plan)
+CORNERTURN_BODY(__m256i, 8, AVX2_LOAD, AVX2_STORE, AVX2_SRL, AVX2_SLL, _mm256_and_si256, _mm256_xor_si256, _mm256_set1_epi32)
+
+#define AVX512_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define AVX512_STORE(p, a) _mm512_storeu_si512((void *)(p), a)
+//the zero-masking shifts, with every lane selected, keep GCC 12 from warning about the undefined pass-through vector
+#define AVX512_SRL(a, n) _mm512_maskz_srl_epi32((__mmask16)0xFFFF, a, _mm_cvtsi32_si128(n))
+#define AVX512_SLL(a, n) _mm512_maskz_sll_epi32((__mmask16)0xFFFF, a, _mm_cvtsi32_si128(n))
+CORNERTURN_TARGET_AVX512 static void avx512CornerTurn(u8 * output, const u8 * const * threads, int wordsperthread, const CornerTurnPlan * plan)
+CORNERTURN_BODY(__m512i, 16, AVX512_LOAD, AVX512_STORE, AVX512_SRL, AVX512_SLL, _mm512_and_si512, _mm512_xor_si512, _mm512_set1_epi32)
+#endif
+
+CornerTurnKernel cornerTurnGetKernel(int level)
+{
+  if(level > simdDetectLevel())
+    level = simdDetectLevel();
+
+#if CORNERTURN_X86
+  switch(level)
+  {
+    case SIMD_AVX512:
+      return avx512CornerTurn;
+    case SIMD_AVX2:
+      return avx2CornerTurn;
+    case SIMD_SSE42:
+      return sse42CornerTurn;
+    default:
+      break;
+  }
+#endif
+
+  return scalarCornerTurn;
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
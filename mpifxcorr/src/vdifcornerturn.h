@@ -0,0 +1,59 @@
+/** \file vdifcornerturn.h
+ *  \brief Corner turning of multi-thread VDIF payloads into single-thread sample order
+ *
+ * The corner turn takes the same 32 bit word from each of a power of two number of threads and
+ * interleaves their samples so that the output holds one sample from every thread per time step.
+ * Seen as a bit matrix this is a fixed permutation, which is done here as a short sequence of
+ * masked swaps: first between the words of different threads (a block transpose), then within
+ * each word.  The swaps use only shifts, ands and xors, so the same network runs on plain 32 bit
+ * integers or on SSE, AVX2 and AVX-512 registers holding consecutive words of each thread, with
+ * the implementation chosen at run time as for the kernels in vectorsimd.h.
+ * cornerTurnGeneric() moves one sample at a time and is the reference for the others.
+ */
+
+#ifndef VDIFCORNERTURN_H
+#define VDIFCORNERTURN_H
+
+#include "architecture.h"
+
+/// The swaps that make up the corner turn for one thread count and sample size
+typedef struct {
+  int numthreads, bitspersample;
+  int numwordstages;        // swaps between the words of different threads
+  int wordstride[5];        // ... of word r with word r+wordstride, for r without the wordstride bit
+  unsigned int wordshift[5];
+  u32 wordmask[5];
+  int numbitswaps;          // swaps within each output word
+  unsigned int bitshift[5];
+  u32 bitmask[5];
+} CornerTurnPlan;
+
+/// A corner turner: wordsperthread words from each of plan->numthreads threads to numthreads*wordsperthread output words
+typedef void (*CornerTurnKernel)(u8 * output, const u8 * const * threads, int wordsperthread, const CornerTurnPlan * plan);
+
+/**
+ * Works out the swaps needed
+ * @param plan The plan to fill in
+ * @param numthreads The number of threads (a power of two, at least 2)
+ * @param bitspersample 1, 2, 4, 8 or 16, with numthreads*bitspersample no more than 32
+ * @return False if the combination is not supported, in which case cornerTurnGeneric() must be used
+ */
+bool cornerTurnMakePlan(CornerTurnPlan * plan, int numthreads, int bitspersample);
+
+/**
+ * Returns the corner turner for a SIMD level (see vectorsimd.h), clamped to what the CPU supports
+ */
+CornerTurnKernel cornerTurnGetKernel(int level);
+
+/**
+ * Corner turns one sample at a time; handles any combination for which a whole number of time steps fits in a word
+ * @param output Destination for numthreads*wordsperthread words
+ * @param threads The data of each thread
+ * @param wordsperthread The number of 32 bit words to take from each thread
+ * @param numthreads The number of threads
+ * @param bitspersample The number of bits per sample
+ */
+void cornerTurnGeneric(u8 * output, const u8 * const * threads, int wordsperthread, int numthreads, int bitspersample);
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -26,6 +26,7 @@
 //============================================================================
 
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <unistd.h>
@@ -42,6 +43,18 @@
 // Uncomment below if the read buffer locks are to be debugged
 // #define DEBUGLOCKS
 
+// Size of the individual reads queued by asyncreadthreadfunction()
+static const unsigned int AsyncReadChunkBytes = 1 << 20;
+
+static double readclock()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+
+	return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
 /* TODO: 
    - make use of activesec and activescan
  */
@@ -85,11 +98,35 @@ VDIFDataStream::VDIFDataStream(const Configuration * conf, int snum, int id, int
 
 	readbufferslots = 8;
 
+	// Optionally read files with several reads in flight, bypassing the page cache where possible
+	readqueuedepth = 0;
+	asyncreader = 0;
+	useasyncread = false;
+	if(getenv("DIFX_READ_QUEUE_DEPTH"))
+	{
+		readqueuedepth = atoi(getenv("DIFX_READ_QUEUE_DEPTH"));
+		if(readqueuedepth < 0)
+		{
+			cwarn << startl << "DIFX_READ_QUEUE_DEPTH was set to " << getenv("DIFX_READ_QUEUE_DEPTH") << "; reading files one slot at a time" << endl;
+			readqueuedepth = 0;
+		}
+	}
+
 	readbufferslotsize = (bufferfactor/numsegments)*conf->getMaxDataBytes(streamnum)*21LL/10LL;
 	readbufferslotsize -= (readbufferslotsize % conf->getFrameBytes(0, streamnum));	// always read in chunks of frame size
+	if(readqueuedepth > 0)
+	{
+		// direct reads need whole blocks; vdifmux does not need the slots to hold whole frames
+		readbufferslotsize -= (readbufferslotsize % AsyncFileReader::DIRECT_ALIGNMENT);
+	}
 	readbuffersize = readbufferslots * readbufferslotsize;
 	readbufferleftover = 0;
-	readbuffer = new unsigned char[readbuffersize];
+	readbufferstartskip = 0;
+	if(posix_memalign(reinterpret_cast<void **>(&readbuffer), AsyncFileReader::DIRECT_ALIGNMENT, readbuffersize) != 0)
+	{
+		cfatal << startl << "Cannot allocate " << readbuffersize << " bytes for the read buffer!" << endl;
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
 
 	estimatedbytes += readbuffersize;
 
@@ -173,9 +210,13 @@ VDIFDataStream::~VDIFDataStream()
 	{
 		delete switchedpower;
 	}
+	if(asyncreader)
+	{
+		delete asyncreader;
+	}
 	if(readbuffer)
 	{
-		delete [] readbuffer;
+		free(readbuffer);
 	}
 }
 
@@ -303,9 +344,19 @@ void VDIFDataStream::startReaderThread()
 void VDIFDataStream::readthreadfunction()
 {
 	bool endofscan = false;
+	long long totalbytes = 0;
+	double t0, t, waitseconds = 0.0;
+
+	if(useasyncread)
+	{
+		asyncreadthreadfunction();
+
+		return;
+	}
 
 	// Lock for readbufferweriteslot=1 shall be set at this point by startReaderThread()
 
+	t0 = readclock();
 	while(keepreading && !endofscan)
 	{
 		int bytes, curslot;
@@ -318,6 +369,7 @@ void VDIFDataStream::readthreadfunction()
 		{
 			input.read(reinterpret_cast<char *>(readbuffer) + readbufferwriteslot*readbufferslotsize, readbufferslotsize);
 			bytes = input.gcount();
+			totalbytes += bytes;
 		}
 
 		if(bytes < readbufferslotsize)
@@ -336,12 +388,136 @@ void VDIFDataStream::readthreadfunction()
 			// Note: we always save slot 0 for wrap-around
 			readbufferwriteslot = 1;
 		}
+		t = readclock();
 		lockSlot(readbufferwriteslot, 2);
+		waitseconds += readclock() - t;
 		unlockSlot(curslot, 2);
 	}
 	unlockAllSlots(2);
 	
 	// No locks shall be set at this point
+
+	t = readclock() - t0;
+	reportReadRate(totalbytes, t - waitseconds, t);
+}
+
+// Reads the file in chunks with up to readqueuedepth reads in flight.  Once all the chunks of a slot have been
+// queued, reading continues into the next slot so the queue stays full across slot boundaries.  As in
+// readthreadfunction(), a slot stays locked until its data are complete and the following slot is locked, so
+// at most two slots are held at once.
+void VDIFDataStream::asyncreadthreadfunction()
+{
+	const unsigned int chunkbytes = readbufferslotsize < AsyncReadChunkBytes ? readbufferslotsize : AsyncReadChunkBytes;
+	const int chunksperslot = (readbufferslotsize + chunkbytes - 1)/chunkbytes;
+	int curslot, fillslot, fillchunk, donechunks;
+	unsigned int offset, wanted;
+	long long bytes, slotbytes, totalbytes;
+	bool endofscan, endoffile;
+	double t0, t, waitseconds;
+
+	// Lock for readbufferweriteslot=1 shall be set at this point by startReaderThread()
+
+	curslot = fillslot = readbufferwriteslot;
+	fillchunk = donechunks = 0;
+	slotbytes = totalbytes = 0;
+	endofscan = endoffile = false;
+	waitseconds = 0.0;
+	t0 = readclock();
+
+	while(keepreading && !endofscan)
+	{
+		// keep the queue full, running at most one slot ahead of the slot being completed
+		while(!endoffile && asyncreader->pending() < asyncreader->getQueueDepth())
+		{
+			if(fillchunk == chunksperslot)
+			{
+				if(fillslot != curslot)
+				{
+					break;
+				}
+				fillslot = (curslot + 1 < readbufferslots) ? curslot + 1 : 1;	// slot 0 is kept for wrap-around
+				t = readclock();
+				lockSlot(fillslot, 2);
+				waitseconds += readclock() - t;
+				fillchunk = 0;
+			}
+			offset = fillchunk*chunkbytes;
+			wanted = (readbufferslotsize - offset < chunkbytes) ? readbufferslotsize - offset : chunkbytes;
+			asyncreader->submit(reinterpret_cast<char *>(readbuffer) + fillslot*readbufferslotsize + offset, wanted);
+			++fillchunk;
+		}
+
+		// reads complete in order, so this one belongs to curslot
+		offset = donechunks*chunkbytes;
+		wanted = (readbufferslotsize - offset < chunkbytes) ? readbufferslotsize - offset : chunkbytes;
+		bytes = asyncreader->waitOldest();
+		if(!endoffile)
+		{
+			if(bytes > 0)
+			{
+				slotbytes += bytes;
+				totalbytes += bytes;
+			}
+			if(bytes < wanted)
+			{
+				endoffile = true;
+			}
+		}
+		++donechunks;
+
+		if(endoffile)
+		{
+			lastslot = curslot;
+			endindex = lastslot*readbufferslotsize + slotbytes; // No data in this slot from here to end
+			cverbose << startl << "At end of scan: shortening read to only " << slotbytes << " bytes " << "(was " << readbufferslotsize << ")" << endl;
+			endofscan = true;
+		}
+		else if(donechunks == chunksperslot)
+		{
+			if(fillslot == curslot)
+			{
+				fillslot = (curslot + 1 < readbufferslots) ? curslot + 1 : 1;
+				t = readclock();
+				lockSlot(fillslot, 2);
+				waitseconds += readclock() - t;
+				fillchunk = 0;
+			}
+			unlockSlot(curslot, 2);
+			curslot = fillslot;
+			donechunks = 0;
+			slotbytes = 0;
+		}
+	}
+
+	// any reads still in flight land beyond the end of the data or in slots that will not be used
+	asyncreader->close();
+	unlockAllSlots(2);
+
+	// No locks shall be set at this point
+
+	t = readclock() - t0;
+	reportReadRate(totalbytes, t - waitseconds, t);
+}
+
+void VDIFDataStream::reportReadRate(long long bytes, double seconds, double totalseconds)
+{
+	if(bytes <= 0 || totalseconds <= 0.0)
+	{
+		return;
+	}
+	if(seconds <= 0.0)
+	{
+		seconds = totalseconds;
+	}
+
+	if(useasyncread)
+	{
+		cinfo << startl << "Read " << bytes/1000000 << " MB at " << bytes/(1.0e6*seconds) << " MB/s while reading (" << bytes/(1.0e6*totalseconds) << " MB/s overall) with up to " << asyncreader->getQueueDepth() << " reads in flight, " << (asyncreader->isDirect() ? "direct" : "through the page cache") << " using " << (asyncreader->usesIOUring() ? "io_uring" : "a thread pool") << endl;
+	}
+	else
+	{
+		cinfo << startl << "Read " << bytes/1000000 << " MB at " << bytes/(1.0e6*seconds) << " MB/s while reading (" << bytes/(1.0e6*totalseconds) << " MB/s overall) one slot at a time" << endl;
+	}
 }
 
 // this function needs to be rewritten for subclasses.
@@ -661,6 +837,24 @@ void VDIFDataStream::initialiseFile(int configindex, int fileindex)
 		cverbose << startl << "Not doing peek/seek on file due to setting of DIFX_FILE_CHECK_LEVEL env var." << endl;
 	}
 
+	// Hand the reading over to the asynchronous reader from the current position in the file
+	useasyncread = false;
+	readbufferstartskip = 0;
+	if(readqueuedepth > 0 && input.good())
+	{
+		long long position = input.tellg();
+
+		if(asyncreader == 0)
+		{
+			asyncreader = new AsyncFileReader(readqueuedepth);
+		}
+		if(position >= 0 && asyncreader->open(datafilenames[configindex][fileindex].c_str(), position, true))
+		{
+			useasyncread = true;
+			readbufferstartskip = asyncreader->getStartSkip();
+		}
+	}
+
 	lockstart = lockend = lastslot = -1;
 
 	// cause reading thread to go ahead and start filling buffers
@@ -695,7 +889,7 @@ int VDIFDataStream::dataRead(int buffersegment)
 	if(lockstart == -1)
 	{
 		// first decoding of scan
-		muxindex = readbufferslotsize;	// start at beginning of slot 1 (second slot)
+		muxindex = readbufferslotsize + readbufferstartskip;	// start at beginning of slot 1 (second slot), past any alignment padding
 		lockstart = lockend = 1;
 		lockSlot(lockstart);
 	}
@@ -30,6 +30,7 @@
 #include <vdifio.h>
 #include <pthread.h>
 #include "datastream.h"
+#include "asyncread.h"
 
 /**
 @class VDIFDataStream 
@@ -90,6 +91,20 @@ protected:
 
   void readthreadfunction();
 
+ /**
+  * Fills the read buffer slots as readthreadfunction() does, but with several reads in flight
+  * at once through the AsyncFileReader; used when DIFX_READ_QUEUE_DEPTH is set
+  */
+  void asyncreadthreadfunction();
+
+ /**
+  * Logs the read bandwidth achieved for the file just read
+  * @param bytes The number of bytes read
+  * @param seconds The time taken, excluding time spent waiting for buffer space
+  * @param totalseconds The time taken overall
+  */
+  void reportReadRate(long long bytes, double seconds, double totalseconds);
+
   virtual void diskToMemory(int buffersegment);
 
   virtual int testForSync(int configindex, int buffersegment);
@@ -105,6 +120,7 @@ protected:
   int readbufferslots;
   unsigned int readbufferslotsize;
   int readbufferleftover;
+  int readbufferstartskip;  // bytes at the start of slot 1 that precede the first wanted byte
   int minleftoverdata;
   int nSort, nGap;  // muxer tuning parameters
   struct vdif_mux vm;
@@ -128,6 +144,10 @@ protected:
   bool readfail;
   double vdifmjd;
 
+  AsyncFileReader *asyncreader;
+  int readqueuedepth;  // reads in flight for asyncreadthreadfunction(); 0 uses readthreadfunction()
+  bool useasyncread;  // the current file is read with asyncreader
+
   int nGapWarn;
   int nExcessWarn;
 };
@@ -59,12 +59,47 @@ VDIFNetworkDataStream::VDIFNetworkDataStream(const Configuration * conf, int snu
 	readbufferslots = 8;
 	readbufferslotsize = (bufferfactor/numsegments)*conf->getMaxDataBytes(streamnum)*21LL/10LL;
 	readbufferslotsize -= (readbufferslotsize % config->getFrameBytes(0, streamnum)); // make it a multiple of frame size
-	readbuffersize = readbufferslots * readbufferslotsize;
-	// Note: the read buffer is allocated in vdiffile.cpp by VDIFDataStream::initialse()
-	// the above values override defaults for file-based VDIF
+	// the above values override defaults for file-based VDIF, which may have sized the read buffer for direct file reads
+	int slotsbytes = readbufferslots * static_cast<int>(readbufferslotsize);
+	if(slotsbytes != readbuffersize)
+	{
+		readbuffersize = slotsbytes;
+		free(readbuffer);
+		if(posix_memalign(reinterpret_cast<void **>(&readbuffer), AsyncFileReader::DIRECT_ALIGNMENT, readbuffersize) != 0)
+		{
+			cfatal << startl << "Cannot allocate " << readbuffersize << " bytes for the read buffer!" << endl;
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+	}
 
 	estimatedbytes += readbuffersize;	// add back the buffer size calculated here.
 
+	// raw sockets (and, if asked for, UDP) are read a batch of packets per system call
+	packetreceiver = 0;
+	memset(&lastpacketstats, 0, sizeof(lastpacketstats));
+	if(raw || udp)
+	{
+		const char *batchenv = getenv("DIFX_NETWORK_BATCH");
+		int batch = VDIFPacketReceiver::DEFAULT_BATCH;
+		int stripbytes = 0;
+
+		if(batchenv)
+		{
+			batch = atoi(batchenv);
+		}
+		if(raw)
+		{
+// FIXME: add new param 'networkStripBytes' to v2d? Current mpifxcorr sets tcpwindowsize to 1024 times .input TCP WINDOW (KB); v2d UDP_MTU (or windowSize) gets reintepreted here as bytes to strip, documented but kind of misnomer for windowSize!
+			stripbytes = abs(tcpwindowsizebytes/1024);
+		}
+		if(raw || (batchenv && batch > 0))
+		{
+			// for UDP each datagram must then hold exactly one frame
+			packetreceiver = new VDIFPacketReceiver(config->getFrameBytes(0, streamnum) + stripbytes, stripbytes, batch);
+			cinfo << startl << "VDIFNetworkDataStream: receiving up to " << batch << " packets of " << config->getFrameBytes(0, streamnum) + stripbytes << " bytes per call (stripping " << stripbytes << " bytes)" << endl;
+		}
+	}
+
 	cinfo << startl << "VDIFNetworkDataStream::VDIFNetworkDataStream: Set readbuffersize to " << readbuffersize << endl;
 	cinfo << startl << "mdb = " << conf->getMaxDataBytes(streamnum) << "  rbslots=" << readbufferslots << "  readbufferslotsize=" << readbufferslotsize << endl;
 
@@ -115,94 +150,64 @@ VDIFNetworkDataStream::~VDIFNetworkDataStream()
 	}
 	delete [] networkthreadmutex;
 	pthread_barrier_destroy(&networkthreadbarrier);
+	delete packetreceiver;
 }
 
-int VDIFNetworkDataStream::readrawnetworkVDIF(int sock, char* ptr, int bytestoread, unsigned int* nread, int packetsize, int stripbytes)
+int VDIFNetworkDataStream::readrawnetworkVDIF(int sock, char* ptr, int bytestoread, unsigned int* nread)
 {
-	const int MaxPacketSize = 20000;
-	int length;
-	int goodbytes = packetsize - stripbytes;
-	char *ptr0 = ptr;
-	char *end = ptr + bytestoread - goodbytes;
-	char workbuffer[MaxPacketSize];
-	const vdif_header *vh;
+	int status, seconds;
 
-	vh = reinterpret_cast<const vdif_header *>(workbuffer + stripbytes);
+	struct timespec ck;
 
-	if(packetsize > MaxPacketSize)
-	{
-		cfatal << startl << "Error: readrawnetworkVDIF wants to read packets of size " << packetsize << " where MaxPacketSize=" << MaxPacketSize << endl;
-		MPI_Abort(MPI_COMM_WORLD, 1);
-	}
+	status = packetreceiver->receive(sock, ptr, bytestoread, nread, framespersecond);
 
-	*nread = 0;
-
-	while(ptr <= end)
+	if(packetreceiver->takeTenSecondMark(&seconds, &ck))
 	{
-		length = recvfrom(sock, workbuffer, MaxPacketSize, 0, 0, 0);
-		if(length <= 0)
+		/* first frame of the 10 second interval.  Compare with local clock time, as taken on arrival, for kicks */
+		double deltat;		// [sec]
+
+		deltat = (ck.tv_sec % 10) - (seconds % 10);
+		deltat += ck.tv_nsec*1.0e-9;
+		if(deltat < -3.0)
 		{
-			// timeout on read?
-			break;
+			deltat += 10.0;
 		}
-		else if(length == packetsize)
+		if(deltat > 5)
 		{
-			memcpy(ptr, workbuffer + stripbytes, goodbytes);
-			ptr += goodbytes;
-
-			if( (vh->frame == 0) && (vh->threadid == 0) && (vh->seconds % 10 == 0) )
-			{
-				/* first frame of the 10 second interval.  Compare with local clock time for kicks */
-				struct timespec ck;
-				double deltat;		// [sec]
-
-#ifdef __MACH__                 // OS X does not have clock_gettime, use gettimeofday
-				struct timeval now;
-				int status;
-				status = gettimeofday(&now, NULL);
-				ck.tv_sec = now.tv_sec;
-				ck.tv_nsec = now.tv_usec*1000;
-#else
-				clock_gettime(CLOCK_REALTIME, &ck);
-#endif
-				deltat = (ck.tv_sec % 10) - (vh->seconds % 10);
-				deltat += ck.tv_nsec*1.0e-9;
-				if(deltat < -3.0)
-				{
-					deltat += 10.0;
-				}
-				if(deltat > 5)
-				{
-					deltat -= 10.0;
-				}
-				int p = cinfo.precision();
-				cinfo.precision(6);
-				cinfo << startl << "VDIF clock is " << deltat << " seconds behind system clock for antenna " << stationname << endl;
-				cinfo.precision(p);
-			}
+			deltat -= 10.0;
 		}
+		int p = cinfo.precision();
+		cinfo.precision(6);
+		cinfo << startl << "VDIF clock is " << deltat << " seconds behind system clock for antenna " << stationname << endl;
+		cinfo.precision(p);
 	}
 
-	if(nread)
+	return status;
+}
+
+void VDIFNetworkDataStream::sendDiagnostics()
+{
+	VDIFPacketStats now;
+
+	DataStream::sendDiagnostics();
+	if(!packetreceiver)
 	{
-		*nread = ptr - ptr0;
+		return;
 	}
 
-	return 1;
+	packetreceiver->getStats(&now);
+	difxMessageSendDifxDiagnosticPacketStats(now.received - lastpacketstats.received, now.lost - lastpacketstats.lost, now.outoforder - lastpacketstats.outoforder, now.duplicate - lastpacketstats.duplicate, now.wrongsize - lastpacketstats.wrongsize);
+	if(now.lost != lastpacketstats.lost || now.outoforder != lastpacketstats.outoforder || now.duplicate != lastpacketstats.duplicate || now.wrongsize != lastpacketstats.wrongsize)
+	{
+		cverbose << startl << "Packets in the last second: " << now.received - lastpacketstats.received << " received, " << now.lost - lastpacketstats.lost << " lost, " << now.outoforder - lastpacketstats.outoforder << " out of order, " << now.duplicate - lastpacketstats.duplicate << " duplicated, " << now.wrongsize - lastpacketstats.wrongsize << " of the wrong size" << endl;
+	}
+	lastpacketstats = now;
 }
 
 // this function implements the network reader.  It is continuously either filling data into a ring buffer or waiting for a mutex to clear.
 void VDIFNetworkDataStream::networkthreadfunction()
 {
 	int lockmod = readbufferslots-1;	// used to team up slots 0 and readbufferslots-1
-	int packetsize;				// for raw packets; reject all packets not this size
-	int stripbytes;				// for raw packets; strip this many bytes from beginning of RX packets
-
-// FIXME: add new param 'networkStripBytes' to v2d? Current mpifxcorr sets tcpwindowsize to 1024 times .input TCP WINDOW (KB); v2d UDP_MTU (or windowSize) gets reintepreted here as bytes to strip, documented but kind of misnomer for windowSize!
-	stripbytes = abs(tcpwindowsizebytes/1024);
-	packetsize = config->getFrameBytes(0, streamnum) + stripbytes;
-	if(raw)
-		cinfo << startl << "stripbytes=" << stripbytes << " packetsize=" << packetsize << endl;
 
 	for(;;)
 	{
@@ -227,15 +232,15 @@ void VDIFNetworkDataStream::networkthreadfunction()
 			int status = 0;
 
 			// This is where the actual read from the network happens
-			if(tcp || udp)
+			if(packetreceiver)
 			{
-				// TCP or regular UDP
-				status = readnetwork(socketnumber, (char *)(readbuffer + readbufferwriteslot*readbufferslotsize), readbufferslotsize, &bytes);
+				// Raw socket, or UDP a frame per datagram
+				status = readrawnetworkVDIF(socketnumber, (char *)(readbuffer + readbufferwriteslot*readbufferslotsize), readbufferslotsize, &bytes);
 			}
-			else if(raw)
+			else if(tcp || udp)
 			{
-				// Raw socket or trimmed UDP
-				status = readrawnetworkVDIF(socketnumber, (char *)(readbuffer + readbufferwriteslot*readbufferslotsize), readbufferslotsize, &bytes, packetsize, stripbytes);
+				// TCP or regular UDP
+				status = readnetwork(socketnumber, (char *)(readbuffer + readbufferwriteslot*readbufferslotsize), readbufferslotsize, &bytes);
 			}
 
 			if(bytes == 0)
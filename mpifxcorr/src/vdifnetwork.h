@@ -35,6 +35,7 @@
 #include "config.h"
 
 #include "vdiffile.h"
+#include "vdifpacketreceiver.h"
 #include <difxmessage.h>
 
 #ifdef __APPLE__
@@ -50,9 +51,10 @@ public:
 protected:
 	virtual int dataRead(int buffersegment);
 	static void *launchnetworkthreadfunction(void *self);
-	int readrawnetworkVDIF(int sock, char* ptr, int bytestoread, unsigned int* nread, int packetsize, int stripbytes);
+	int readrawnetworkVDIF(int sock, char* ptr, int bytestoread, unsigned int* nread);
 	void networkthreadfunction();
 	virtual void loopnetworkread();
+	virtual void sendDiagnostics();
 
 private:
 	int readbufferslots;
@@ -69,6 +71,10 @@ private:
 	// network parameters
 	int sock;
 	int skipbytes;		// number of bytes to trim off beginning of packets
+
+	// batched packet reception (raw sockets, or UDP if DIFX_NETWORK_BATCH is set); 0 for stream reads
+	VDIFPacketReceiver *packetreceiver;
+	VDIFPacketStats lastpacketstats;
 };
 
 #endif
@@ -0,0 +1,187 @@
+#include <cstring>
+#include <cstdlib>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <vdifio.h>
+#include "vdifpacketreceiver.h"
+
+// VDIF thread ids are 10 bits
+static const int MaxVDIFThreads = 1024;
+
+VDIFPacketReceiver::VDIFPacketReceiver(int packetsize, int stripbytes, int batch) :
+	packetsize(packetsize), stripbytes(stripbytes), batch(batch), lastserial(MaxVDIFThreads, -1)
+{
+	if(this->batch < 1)
+	{
+		this->batch = 1;
+	}
+	goodbytes = packetsize - stripbytes;
+	msgs = calloc(this->batch, sizeof(struct mmsghdr));
+	iovs = calloc(2*this->batch, sizeof(struct iovec));
+	stripscratch = (char *)malloc(stripbytes > 0 ? stripbytes : 1);
+	memset(&stats, 0, sizeof(stats));
+	tensecondmark = false;
+	tensecondseconds = 0;
+	tensecondtime.tv_sec = 0;
+	tensecondtime.tv_nsec = 0;
+}
+
+VDIFPacketReceiver::~VDIFPacketReceiver()
+{
+	free(msgs);
+	free(iovs);
+	free(stripscratch);
+}
+
+void VDIFPacketReceiver::countSequence(const char *frame, int framespersecond)
+{
+	const vdif_header *vh = reinterpret_cast<const vdif_header *>(frame);
+	long long serial, last;
+
+	if(vh->frame == 0 && vh->threadid == 0 && vh->seconds % 10 == 0)
+	{
+		// note the arrival time now, rather than after the rest of the buffer has been filled
+#ifdef __MACH__                 // OS X does not have clock_gettime, use gettimeofday
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		tensecondtime.tv_sec = now.tv_sec;
+		tensecondtime.tv_nsec = now.tv_usec*1000;
+#else
+		clock_gettime(CLOCK_REALTIME, &tensecondtime);
+#endif
+		tensecondmark = true;
+		tensecondseconds = vh->seconds;
+	}
+
+	if(framespersecond <= 0)
+	{
+		return;
+	}
+
+	serial = (long long)(vh->seconds)*framespersecond + vh->frame;
+	last = lastserial[vh->threadid];
+	if(last < 0 || serial > last + framespersecond || serial < last - framespersecond)
+	{
+		// first frame of this thread, or a jump of more than a second (eg a new scan): just resynchronise
+		lastserial[vh->threadid] = serial;
+	}
+	else if(serial > last)
+	{
+		__sync_add_and_fetch(&stats.lost, serial - last - 1);
+		lastserial[vh->threadid] = serial;
+	}
+	else if(serial == last)
+	{
+		__sync_add_and_fetch(&stats.duplicate, 1);
+	}
+	else
+	{
+		// a late arrival: it was counted as lost when the sequence skipped over it
+		__sync_add_and_fetch(&stats.outoforder, 1);
+		if(stats.lost > 0)
+		{
+			__sync_sub_and_fetch(&stats.lost, 1);
+		}
+	}
+}
+
+int VDIFPacketReceiver::receive(int sock, char *ptr, int bytestoread, unsigned int *nread, int framespersecond)
+{
+	struct mmsghdr *msg = (struct mmsghdr *)msgs;
+	struct iovec *iov = (struct iovec *)iovs;
+	char *ptr0 = ptr;
+	char *end = ptr + bytestoread;
+	int n, nwanted, nrecv;
+	long long nwrong;
+
+	*nread = 0;
+
+	while(end - ptr >= goodbytes)
+	{
+		nwanted = (end - ptr)/goodbytes;
+		if(nwanted > batch)
+		{
+			nwanted = batch;
+		}
+		for(n = 0; n < nwanted; ++n)
+		{
+			iov[2*n].iov_base = stripscratch;
+			iov[2*n].iov_len = stripbytes;
+			iov[2*n+1].iov_base = ptr + n*goodbytes;
+			iov[2*n+1].iov_len = goodbytes;
+			memset(&msg[n].msg_hdr, 0, sizeof(struct msghdr));
+			if(stripbytes > 0)
+			{
+				msg[n].msg_hdr.msg_iov = iov + 2*n;
+				msg[n].msg_hdr.msg_iovlen = 2;
+			}
+			else
+			{
+				msg[n].msg_hdr.msg_iov = iov + 2*n + 1;
+				msg[n].msg_hdr.msg_iovlen = 1;
+			}
+		}
+
+		// block (subject to the socket timeout) for the first packet only, then take whatever else is queued
+		nrecv = recvmmsg(sock, msg, nwanted, MSG_WAITFORONE, 0);
+		if(nrecv <= 0)
+		{
+			// timeout on read?
+			break;
+		}
+
+		// accept the packets of the right size, closing up any holes left by the others
+		char *dest = ptr;
+		nwrong = 0;
+		for(n = 0; n < nrecv; ++n)
+		{
+			if((int)msg[n].msg_len != packetsize || (msg[n].msg_hdr.msg_flags & MSG_TRUNC))
+			{
+				++nwrong;
+				continue;
+			}
+			if(dest != ptr + n*goodbytes)
+			{
+				memmove(dest, ptr + n*goodbytes, goodbytes);
+			}
+			countSequence(dest, framespersecond);
+			dest += goodbytes;
+		}
+		__sync_add_and_fetch(&stats.received, nrecv - nwrong);
+		if(nwrong > 0)
+		{
+			__sync_add_and_fetch(&stats.wrongsize, nwrong);
+		}
+		ptr = dest;
+	}
+
+	*nread = ptr - ptr0;
+
+	return 1;
+}
+
+void VDIFPacketReceiver::getStats(VDIFPacketStats *s) const
+{
+	VDIFPacketStats *live = const_cast<VDIFPacketStats *>(&stats);
+
+	s->received = __sync_add_and_fetch(&live->received, 0);
+	s->wrongsize = __sync_add_and_fetch(&live->wrongsize, 0);
+	s->lost = __sync_add_and_fetch(&live->lost, 0);
+	s->outoforder = __sync_add_and_fetch(&live->outoforder, 0);
+	s->duplicate = __sync_add_and_fetch(&live->duplicate, 0);
+}
+
+bool VDIFPacketReceiver::takeTenSecondMark(int *seconds, struct timespec *received)
+{
+	if(!tensecondmark)
+	{
+		return false;
+	}
+	tensecondmark = false;
+	*seconds = tensecondseconds;
+	*received = tensecondtime;
+
+	return true;
+}
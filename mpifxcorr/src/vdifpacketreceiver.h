@@ -0,0 +1,77 @@
+/** \file vdifpacketreceiver.h
+ *  \brief Batched reception of VDIF packets straight into a read buffer, with sequence statistics
+ *
+ * Each call to receive() asks the kernel for up to a batch of packets at once with recvmmsg(),
+ * scattering the payload of each packet directly to its place in the destination buffer (any
+ * leading bytes to be stripped go to a small scratch area), so there is one system call per batch
+ * and no staging copy.  Packets of the wrong size are discarded and the hole they leave closed up.
+ * The VDIF headers of accepted packets are used to count lost, out of order and duplicate packets
+ * for each VDIF thread.
+ */
+
+#ifndef VDIFPACKETRECEIVER_H
+#define VDIFPACKETRECEIVER_H
+
+#include <vector>
+#include <time.h>
+
+/// Cumulative packet counts kept by a VDIFPacketReceiver
+typedef struct {
+	long long received;	// packets accepted into the buffer
+	long long wrongsize;	// packets discarded because they were not exactly one frame
+	long long lost;		// gaps in the frame sequence of a VDIF thread (less any late arrivals)
+	long long outoforder;	// packets earlier in the sequence than one already received
+	long long duplicate;	// packets repeating the frame just received
+} VDIFPacketStats;
+
+class VDIFPacketReceiver
+{
+public:
+	/**
+	 * @param packetsize The size of every packet to accept, including stripbytes
+	 * @param stripbytes The number of bytes to remove from the start of each packet (eg the protocol headers seen by a raw socket)
+	 * @param batch The largest number of packets to receive in one system call
+	 */
+	VDIFPacketReceiver(int packetsize, int stripbytes, int batch);
+	~VDIFPacketReceiver();
+
+	/**
+	 * Fills a buffer with packet payloads until it is full or the socket times out
+	 * @param sock The socket to read from
+	 * @param ptr The destination
+	 * @param bytestoread The size of the destination
+	 * @param nread Set to the number of bytes written
+	 * @param framespersecond Frames per second per VDIF thread, used to place frames in sequence (0 if not yet known)
+	 * @return 1 (errors and timeouts simply end the read early, as for the other network readers)
+	 */
+	int receive(int sock, char *ptr, int bytestoread, unsigned int *nread, int framespersecond);
+
+	/// Copies the cumulative counts; safe to call from a thread other than the receiving one
+	void getStats(VDIFPacketStats *stats) const;
+
+	/**
+	 * Reports (once) that the first frame of thread 0 in a 10 second period was received, for clock comparisons
+	 * @param seconds Set to the VDIF seconds of that frame
+	 * @param received Set to the system clock time at which the frame was taken from the socket
+	 * @return true if such a frame has been received since the last call
+	 */
+	bool takeTenSecondMark(int *seconds, struct timespec *received);
+
+	/// Packets per system call used when none is specified
+	static const int DEFAULT_BATCH = 64;
+
+private:
+	void countSequence(const char *frame, int framespersecond);
+
+	int packetsize, stripbytes, goodbytes, batch;
+	void *msgs;			// struct mmsghdr[batch]
+	void *iovs;			// struct iovec[2*batch]
+	char *stripscratch;		// destination for the stripped bytes of every packet
+	std::vector<long long> lastserial;	// last frame serial number seen for each VDIF thread id
+	VDIFPacketStats stats;
+	bool tensecondmark;
+	int tensecondseconds;
+	struct timespec tensecondtime;
+};
+
+#endif
@@ -0,0 +1,1011 @@
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <strings.h>
+#include "vectorsimd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#define SIMD_TARGET_SSE42  __attribute__((target("sse4.2")))
+#define SIMD_TARGET_AVX2   __attribute__((target("avx2,fma")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#else
+#define SIMD_X86 0
+#endif
+
+/* Scalar reference kernels.  These are the same loops as the generic* functions in
+ * architecture.h, and are also used to finish off the last few elements that do not fill
+ * a complete vector register in the SIMD kernels below. */
+
+static vecStatus scalarAddProduct_32fc(const cf32 * src1, const cf32 * src2, cf32 * accumulator, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    accumulator[i].re += src1[i].re*src2[i].re - src1[i].im*src2[i].im;
+    accumulator[i].im += src1[i].re*src2[i].im + src1[i].im*src2[i].re;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarMul_32fc(const cf32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  f32 re;
+  for(int i=0;i<length;i++)
+  {
+    re = src1[i].re*src2[i].re - src1[i].im*src2[i].im;
+    dest[i].im = src1[i].re*src2[i].im + src1[i].im*src2[i].re;
+    dest[i].re = re;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarMul_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return scalarMul_32fc(src, srcdest, srcdest, length);
+}
+
+static vecStatus scalarMulC_32fc(const cf32 * src, const cf32 val, cf32 * dest, int length)
+{
+  f32 re;
+  for(int i=0;i<length;i++)
+  {
+    re = src[i].re*val.re - src[i].im*val.im;
+    dest[i].im = src[i].re*val.im + src[i].im*val.re;
+    dest[i].re = re;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarMulC_32fc_I(const cf32 val, cf32 * srcdest, int length)
+{
+  return scalarMulC_32fc(srcdest, val, srcdest, length);
+}
+
+static vecStatus scalarMul_32f32fc(const f32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    dest[i].re = src1[i]*src2[i].re;
+    dest[i].im = src1[i]*src2[i].im;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarConj_32fc(const cf32 * src, cf32 * dest, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    dest[i].re = src[i].re;
+    dest[i].im = -src[i].im;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarConj_32fc_I(cf32 * srcdest, int length)
+{
+  return scalarConj_32fc(srcdest, srcdest, length);
+}
+
+static vecStatus scalarAdd_32f_I(const f32 * src, f32 * srcdest, int length)
+{
+  for(int i=0;i<length;i++)
+    srcdest[i] += src[i];
+  return vecNoErr;
+}
+
+static vecStatus scalarAdd_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return scalarAdd_32f_I((const f32*)src, (f32*)srcdest, 2*length);
+}
+
+static vecStatus scalarMulC_32f_I(const f32 val, f32 * srcdest, int length)
+{
+  for(int i=0;i<length;i++)
+    srcdest[i] *= val;
+  return vecNoErr;
+}
+
+static vecStatus scalarRealToCplx_32f(const f32 * real, const f32 * imag, cf32 * complx, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    complx[i].re = real ? real[i] : 0.0f;
+    complx[i].im = imag ? imag[i] : 0.0f;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarReal_32fc(const cf32 * src, f32 * real, int length)
+{
+  for(int i=0;i<length;i++)
+    real[i] = src[i].re;
+  return vecNoErr;
+}
+
+static vecStatus scalarConvert_16s32f(const s16 * src, f32 * dest, int length)
+{
+  for(int i=0;i<length;i++)
+    dest[i] = src[i];
+  return vecNoErr;
+}
+
+/* Packed 16 bit complex kernels for the reduced precision cross-multiply.  Complex values
+ * are stored as interleaved (re,im) pairs; the integer products and sums are exact so long
+ * as the inputs are limited to +-32767 and the caller leaves enough headroom in the s32
+ * accumulators. */
+
+static vecStatus scalarAddProduct_16sc32sc(const s16 * src1, const s16 * src2, s32 * accumulator, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    s32 ar = src1[2*i], ai = src1[2*i+1];
+    s32 br = src2[2*i], bi = src2[2*i+1];
+    accumulator[2*i]   += ar*br - ai*bi;
+    accumulator[2*i+1] += ar*bi + ai*br;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarConvertScaleAdd_32s32f(const s32 * src, const f32 scale, f32 * srcdest, int length)
+{
+  for(int i=0;i<length;i++)
+    srcdest[i] += scale*(f32)src[i];
+  return vecNoErr;
+}
+
+static vecStatus scalarConvertScale_32f16s(const f32 * src, const f32 scale, s16 * dest, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    long v = lrintf(src[i]*scale);
+    if(v > 32767)
+      v = 32767;
+    if(v < -32767)
+      v = -32767;
+    dest[i] = (s16)v;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarMaxAbs_32f(const f32 * src, int length, f32 * max)
+{
+  f32 m = 0.0f;
+  for(int i=0;i<length;i++)
+  {
+    if(fabsf(src[i]) > m)
+      m = fabsf(src[i]);
+  }
+  *max = m;
+  return vecNoErr;
+}
+
+static vecStatus scalarAddPowerMoments_32fc(const cf32 * src, f32 * s1, f32 * s2, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    f32 p = src[i].re*src[i].re + src[i].im*src[i].im;
+    s1[i] += p;
+    s2[i] += p*p;
+  }
+  return vecNoErr;
+}
+
+static vecStatus scalarMulLevels_8s32fc(const s8 * src1, const f32 * levels, const cf32 * src2, cf32 * dest, int length)
+{
+  for(int i=0;i<length;i++)
+  {
+    f32 v = levels[src1[i] & 15];
+    dest[i].re = v*src2[i].re;
+    dest[i].im = v*src2[i].im;
+  }
+  return vecNoErr;
+}
+
+static const SimdKernelTable scalarKernels = {
+  "generic",
+  scalarAddProduct_32fc, scalarMul_32fc, scalarMul_32fc_I, scalarMulC_32fc, scalarMulC_32fc_I,
+  scalarMul_32f32fc, scalarConj_32fc, scalarConj_32fc_I, scalarAdd_32f_I, scalarAdd_32fc_I,
+  scalarMulC_32f_I, scalarRealToCplx_32f, scalarReal_32fc, scalarConvert_16s32f,
+  scalarAddProduct_16sc32sc, scalarConvertScaleAdd_32s32f, scalarConvertScale_32f16s, scalarMaxAbs_32f,
+  scalarAddPowerMoments_32fc, scalarMulLevels_8s32fc
+};
+
+#if SIMD_X86
+
+/* SSE4.2 kernels: 2 complex values per register.  The complex multiply is
+ * (a.re*b.re - a.im*b.im, a.re*b.im + a.im*b.re) = addsub(a*dup(b.re), swap(a)*dup(b.im)) */
+
+SIMD_TARGET_SSE42 static inline __m128 sse42CMul(__m128 a, __m128 b)
+{
+  __m128 bre = _mm_moveldup_ps(b);
+  __m128 bim = _mm_movehdup_ps(b);
+  __m128 aswap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1));
+  return _mm_addsub_ps(_mm_mul_ps(a, bre), _mm_mul_ps(aswap, bim));
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42AddProduct_32fc(const cf32 * src1, const cf32 * src2, cf32 * accumulator, int length)
+{
+  int i;
+  for(i=0;i<length-1;i+=2)
+  {
+    __m128 p = sse42CMul(_mm_loadu_ps((const f32*)(src1+i)), _mm_loadu_ps((const f32*)(src2+i)));
+    _mm_storeu_ps((f32*)(accumulator+i), _mm_add_ps(_mm_loadu_ps((const f32*)(accumulator+i)), p));
+  }
+  return scalarAddProduct_32fc(src1+i, src2+i, accumulator+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Mul_32fc(const cf32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-1;i+=2)
+    _mm_storeu_ps((f32*)(dest+i), sse42CMul(_mm_loadu_ps((const f32*)(src1+i)), _mm_loadu_ps((const f32*)(src2+i))));
+  return scalarMul_32fc(src1+i, src2+i, dest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Mul_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return sse42Mul_32fc(src, srcdest, srcdest, length);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42MulC_32fc(const cf32 * src, const cf32 val, cf32 * dest, int length)
+{
+  int i;
+  __m128 v = _mm_setr_ps(val.re, val.im, val.re, val.im);
+  for(i=0;i<length-1;i+=2)
+    _mm_storeu_ps((f32*)(dest+i), sse42CMul(_mm_loadu_ps((const f32*)(src+i)), v));
+  return scalarMulC_32fc(src+i, val, dest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42MulC_32fc_I(const cf32 val, cf32 * srcdest, int length)
+{
+  return sse42MulC_32fc(srcdest, val, srcdest, length);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Mul_32f32fc(const f32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+  {
+    __m128 r = _mm_loadu_ps(src1+i);
+    _mm_storeu_ps((f32*)(dest+i), _mm_mul_ps(_mm_unpacklo_ps(r, r), _mm_loadu_ps((const f32*)(src2+i))));
+    _mm_storeu_ps((f32*)(dest+i+2), _mm_mul_ps(_mm_unpackhi_ps(r, r), _mm_loadu_ps((const f32*)(src2+i+2))));
+  }
+  return scalarMul_32f32fc(src1+i, src2+i, dest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Conj_32fc(const cf32 * src, cf32 * dest, int length)
+{
+  int i;
+  __m128 sign = _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f);
+  for(i=0;i<length-1;i+=2)
+    _mm_storeu_ps((f32*)(dest+i), _mm_xor_ps(_mm_loadu_ps((const f32*)(src+i)), sign));
+  return scalarConj_32fc(src+i, dest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Conj_32fc_I(cf32 * srcdest, int length)
+{
+  return sse42Conj_32fc(srcdest, srcdest, length);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Add_32f_I(const f32 * src, f32 * srcdest, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+    _mm_storeu_ps(srcdest+i, _mm_add_ps(_mm_loadu_ps(srcdest+i), _mm_loadu_ps(src+i)));
+  return scalarAdd_32f_I(src+i, srcdest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Add_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return sse42Add_32f_I((const f32*)src, (f32*)srcdest, 2*length);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42MulC_32f_I(const f32 val, f32 * srcdest, int length)
+{
+  int i;
+  __m128 v = _mm_set1_ps(val);
+  for(i=0;i<length-3;i+=4)
+    _mm_storeu_ps(srcdest+i, _mm_mul_ps(_mm_loadu_ps(srcdest+i), v));
+  return scalarMulC_32f_I(val, srcdest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42RealToCplx_32f(const f32 * real, const f32 * imag, cf32 * complx, int length)
+{
+  int i;
+  __m128 zero = _mm_setzero_ps();
+  for(i=0;i<length-3;i+=4)
+  {
+    __m128 re = real ? _mm_loadu_ps(real+i) : zero;
+    __m128 im = imag ? _mm_loadu_ps(imag+i) : zero;
+    _mm_storeu_ps((f32*)(complx+i), _mm_unpacklo_ps(re, im));
+    _mm_storeu_ps((f32*)(complx+i+2), _mm_unpackhi_ps(re, im));
+  }
+  return scalarRealToCplx_32f(real ? real+i : 0, imag ? imag+i : 0, complx+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Real_32fc(const cf32 * src, f32 * real, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+    _mm_storeu_ps(real+i, _mm_shuffle_ps(_mm_loadu_ps((const f32*)(src+i)), _mm_loadu_ps((const f32*)(src+i+2)), _MM_SHUFFLE(2,0,2,0)));
+  return scalarReal_32fc(src+i, real+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42Convert_16s32f(const s16 * src, f32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+    _mm_storeu_ps(dest+i, _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(src+i)))));
+  return scalarConvert_16s32f(src+i, dest+i, length-i);
+}
+
+/* For the packed 16 bit complex product, pmaddwd gives re = a.re*b.re + a.im*(-b.im) and
+ * im = a.re*b.im + a.im*b.re directly from (a.re,a.im) and a sign-flipped or swapped b */
+
+SIMD_TARGET_SSE42 static vecStatus sse42AddProduct_16sc32sc(const s16 * src1, const s16 * src2, s32 * accumulator, int length)
+{
+  int i;
+  const __m128i swap = _mm_setr_epi8(2,3,0,1, 6,7,4,5, 10,11,8,9, 14,15,12,13);
+  const __m128i negim = _mm_setr_epi16(1,-1,1,-1,1,-1,1,-1);
+  for(i=0;i<length-3;i+=4)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src1+2*i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src2+2*i));
+    __m128i re = _mm_madd_epi16(a, _mm_sign_epi16(b, negim));
+    __m128i im = _mm_madd_epi16(a, _mm_shuffle_epi8(b, swap));
+    __m128i * acc = (__m128i*)(accumulator+2*i);
+    _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc), _mm_unpacklo_epi32(re, im)));
+    _mm_storeu_si128(acc+1, _mm_add_epi32(_mm_loadu_si128(acc+1), _mm_unpackhi_epi32(re, im)));
+  }
+  return scalarAddProduct_16sc32sc(src1+2*i, src2+2*i, accumulator+2*i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42ConvertScaleAdd_32s32f(const s32 * src, const f32 scale, f32 * srcdest, int length)
+{
+  int i;
+  __m128 v = _mm_set1_ps(scale);
+  for(i=0;i<length-3;i+=4)
+    _mm_storeu_ps(srcdest+i, _mm_add_ps(_mm_loadu_ps(srcdest+i), _mm_mul_ps(v, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(src+i))))));
+  return scalarConvertScaleAdd_32s32f(src+i, scale, srcdest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42ConvertScale_32f16s(const f32 * src, const f32 scale, s16 * dest, int length)
+{
+  int i;
+  __m128 v = _mm_set1_ps(scale);
+  __m128i lim = _mm_set1_epi32(32767);
+  __m128i neglim = _mm_set1_epi32(-32767);
+  for(i=0;i<length-7;i+=8)
+  {
+    __m128i x0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src+i), v));
+    __m128i x1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src+i+4), v));
+    x0 = _mm_max_epi32(_mm_min_epi32(x0, lim), neglim);
+    x1 = _mm_max_epi32(_mm_min_epi32(x1, lim), neglim);
+    _mm_storeu_si128((__m128i*)(dest+i), _mm_packs_epi32(x0, x1));
+  }
+  return scalarConvertScale_32f16s(src+i, scale, dest+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42MaxAbs_32f(const f32 * src, int length, f32 * max)
+{
+  int i;
+  f32 m[4], tail;
+  __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 vmax = _mm_setzero_ps();
+  for(i=0;i<length-3;i+=4)
+    vmax = _mm_max_ps(vmax, _mm_and_ps(_mm_loadu_ps(src+i), absmask));
+  _mm_storeu_ps(m, vmax);
+  scalarMaxAbs_32f(src+i, length-i, &tail);
+  scalarMaxAbs_32f(m, 4, max);
+  if(tail > *max)
+    *max = tail;
+  return vecNoErr;
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42AddPowerMoments_32fc(const cf32 * src, f32 * s1, f32 * s2, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+  {
+    __m128 a = _mm_loadu_ps((const f32*)(src+i));
+    __m128 b = _mm_loadu_ps((const f32*)(src+i+2));
+    __m128 p = _mm_hadd_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b));
+    _mm_storeu_ps(s1+i, _mm_add_ps(_mm_loadu_ps(s1+i), p));
+    _mm_storeu_ps(s2+i, _mm_add_ps(_mm_loadu_ps(s2+i), _mm_mul_ps(p, p)));
+  }
+  return scalarAddPowerMoments_32fc(src+i, s1+i, s2+i, length-i);
+}
+
+SIMD_TARGET_SSE42 static vecStatus sse42MulLevels_8s32fc(const s8 * src1, const f32 * levels, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  u32 u;
+  u8 bytes[4][16];
+  __m128i plane[4], mask = _mm_set1_epi8(0x0F);
+  __m128 r[4];
+
+  //byte b of each level, so that four shuffles look up 16 samples
+  for(int k=0;k<16;k++)
+  {
+    memcpy(&u, levels+k, sizeof(u));
+    for(int b=0;b<4;b++)
+      bytes[b][k] = (u >> (8*b)) & 0xFF;
+  }
+  for(int b=0;b<4;b++)
+    plane[b] = _mm_loadu_si128((const __m128i*)bytes[b]);
+  for(i=0;i<length-15;i+=16)
+  {
+    __m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src1+i)), mask);
+    __m128i b0 = _mm_shuffle_epi8(plane[0], idx);
+    __m128i b1 = _mm_shuffle_epi8(plane[1], idx);
+    __m128i b2 = _mm_shuffle_epi8(plane[2], idx);
+    __m128i b3 = _mm_shuffle_epi8(plane[3], idx);
+    __m128i lo = _mm_unpacklo_epi8(b0, b1);
+    __m128i hi = _mm_unpacklo_epi8(b2, b3);
+    r[0] = _mm_castsi128_ps(_mm_unpacklo_epi16(lo, hi));
+    r[1] = _mm_castsi128_ps(_mm_unpackhi_epi16(lo, hi));
+    lo = _mm_unpackhi_epi8(b0, b1);
+    hi = _mm_unpackhi_epi8(b2, b3);
+    r[2] = _mm_castsi128_ps(_mm_unpacklo_epi16(lo, hi));
+    r[3] = _mm_castsi128_ps(_mm_unpackhi_epi16(lo, hi));
+    for(int k=0;k<4;k++)
+    {
+      _mm_storeu_ps((f32*)(dest+i+4*k), _mm_mul_ps(_mm_unpacklo_ps(r[k], r[k]), _mm_loadu_ps((const f32*)(src2+i+4*k))));
+      _mm_storeu_ps((f32*)(dest+i+4*k+2), _mm_mul_ps(_mm_unpackhi_ps(r[k], r[k]), _mm_loadu_ps((const f32*)(src2+i+4*k+2))));
+    }
+  }
+  return scalarMulLevels_8s32fc(src1+i, levels, src2+i, dest+i, length-i);
+}
+
+static const SimdKernelTable sse42Kernels = {
+  "sse42",
+  sse42AddProduct_32fc, sse42Mul_32fc, sse42Mul_32fc_I, sse42MulC_32fc, sse42MulC_32fc_I,
+  sse42Mul_32f32fc, sse42Conj_32fc, sse42Conj_32fc_I, sse42Add_32f_I, sse42Add_32fc_I,
+  sse42MulC_32f_I, sse42RealToCplx_32f, sse42Real_32fc, sse42Convert_16s32f,
+  sse42AddProduct_16sc32sc, sse42ConvertScaleAdd_32s32f, sse42ConvertScale_32f16s, sse42MaxAbs_32f,
+  sse42AddPowerMoments_32fc, sse42MulLevels_8s32fc
+};
+
+/* AVX2 kernels: 4 complex values per register, complex multiply via fmaddsub.  The upper halves of
+ * the registers are cleared before the last few elements are handed to an SSE or scalar kernel, as
+ * the compiler does not do so when it turns that call into a jump, and legacy SSE instructions
+ * executed with them dirty are very slow - which matters when called on runs of only a few values */
+
+SIMD_TARGET_AVX2 static inline __m256 avx2CMul(__m256 a, __m256 b)
+{
+  __m256 bre = _mm256_moveldup_ps(b);
+  __m256 bim = _mm256_movehdup_ps(b);
+  __m256 aswap = _mm256_permute_ps(a, _MM_SHUFFLE(2,3,0,1));
+  return _mm256_fmaddsub_ps(a, bre, _mm256_mul_ps(aswap, bim));
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2AddProduct_32fc(const cf32 * src1, const cf32 * src2, cf32 * accumulator, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+  {
+    __m256 p = avx2CMul(_mm256_loadu_ps((const f32*)(src1+i)), _mm256_loadu_ps((const f32*)(src2+i)));
+    _mm256_storeu_ps((f32*)(accumulator+i), _mm256_add_ps(_mm256_loadu_ps((const f32*)(accumulator+i)), p));
+  }
+  _mm256_zeroupper();
+  return scalarAddProduct_32fc(src1+i, src2+i, accumulator+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Mul_32fc(const cf32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+    _mm256_storeu_ps((f32*)(dest+i), avx2CMul(_mm256_loadu_ps((const f32*)(src1+i)), _mm256_loadu_ps((const f32*)(src2+i))));
+  _mm256_zeroupper();
+  return scalarMul_32fc(src1+i, src2+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Mul_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return avx2Mul_32fc(src, srcdest, srcdest, length);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2MulC_32fc(const cf32 * src, const cf32 val, cf32 * dest, int length)
+{
+  int i;
+  __m256 v = _mm256_setr_ps(val.re, val.im, val.re, val.im, val.re, val.im, val.re, val.im);
+  for(i=0;i<length-3;i+=4)
+    _mm256_storeu_ps((f32*)(dest+i), avx2CMul(_mm256_loadu_ps((const f32*)(src+i)), v));
+  _mm256_zeroupper();
+  return scalarMulC_32fc(src+i, val, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2MulC_32fc_I(const cf32 val, cf32 * srcdest, int length)
+{
+  return avx2MulC_32fc(srcdest, val, srcdest, length);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Mul_32f32fc(const f32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-3;i+=4)
+  {
+    __m128 r = _mm_loadu_ps(src1+i);
+    __m256 rr = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(r, r)), _mm_unpackhi_ps(r, r), 1);
+    _mm256_storeu_ps((f32*)(dest+i), _mm256_mul_ps(rr, _mm256_loadu_ps((const f32*)(src2+i))));
+  }
+  _mm256_zeroupper();
+  return scalarMul_32f32fc(src1+i, src2+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Conj_32fc(const cf32 * src, cf32 * dest, int length)
+{
+  int i;
+  __m256 sign = _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f);
+  for(i=0;i<length-3;i+=4)
+    _mm256_storeu_ps((f32*)(dest+i), _mm256_xor_ps(_mm256_loadu_ps((const f32*)(src+i)), sign));
+  _mm256_zeroupper();
+  return scalarConj_32fc(src+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Conj_32fc_I(cf32 * srcdest, int length)
+{
+  return avx2Conj_32fc(srcdest, srcdest, length);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Add_32f_I(const f32 * src, f32 * srcdest, int length)
+{
+  int i;
+  for(i=0;i<length-7;i+=8)
+    _mm256_storeu_ps(srcdest+i, _mm256_add_ps(_mm256_loadu_ps(srcdest+i), _mm256_loadu_ps(src+i)));
+  _mm256_zeroupper();
+  return scalarAdd_32f_I(src+i, srcdest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Add_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return avx2Add_32f_I((const f32*)src, (f32*)srcdest, 2*length);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2MulC_32f_I(const f32 val, f32 * srcdest, int length)
+{
+  int i;
+  __m256 v = _mm256_set1_ps(val);
+  for(i=0;i<length-7;i+=8)
+    _mm256_storeu_ps(srcdest+i, _mm256_mul_ps(_mm256_loadu_ps(srcdest+i), v));
+  _mm256_zeroupper();
+  return scalarMulC_32f_I(val, srcdest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2RealToCplx_32f(const f32 * real, const f32 * imag, cf32 * complx, int length)
+{
+  int i;
+  __m256 zero = _mm256_setzero_ps();
+  for(i=0;i<length-7;i+=8)
+  {
+    __m256 re = real ? _mm256_loadu_ps(real+i) : zero;
+    __m256 im = imag ? _mm256_loadu_ps(imag+i) : zero;
+    __m256 lo = _mm256_unpacklo_ps(re, im); // 0,1 | 4,5
+    __m256 hi = _mm256_unpackhi_ps(re, im); // 2,3 | 6,7
+    _mm256_storeu_ps((f32*)(complx+i), _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps((f32*)(complx+i+4), _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  _mm256_zeroupper();
+  return scalarRealToCplx_32f(real ? real+i : 0, imag ? imag+i : 0, complx+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Real_32fc(const cf32 * src, f32 * real, int length)
+{
+  int i;
+  for(i=0;i<length-7;i+=8)
+  {
+    __m256 s = _mm256_shuffle_ps(_mm256_loadu_ps((const f32*)(src+i)), _mm256_loadu_ps((const f32*)(src+i+4)), _MM_SHUFFLE(2,0,2,0));
+    _mm256_storeu_ps(real+i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(s), _MM_SHUFFLE(3,1,2,0))));
+  }
+  _mm256_zeroupper();
+  return scalarReal_32fc(src+i, real+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2Convert_16s32f(const s16 * src, f32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-7;i+=8)
+    _mm256_storeu_ps(dest+i, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src+i)))));
+  _mm256_zeroupper();
+  return scalarConvert_16s32f(src+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2AddProduct_16sc32sc(const s16 * src1, const s16 * src2, s32 * accumulator, int length)
+{
+  int i;
+  const __m256i swap = _mm256_setr_epi8(2,3,0,1, 6,7,4,5, 10,11,8,9, 14,15,12,13, 2,3,0,1, 6,7,4,5, 10,11,8,9, 14,15,12,13);
+  const __m256i negim = _mm256_setr_epi16(1,-1,1,-1,1,-1,1,-1,1,-1,1,-1,1,-1,1,-1);
+  for(i=0;i<length-7;i+=8)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src1+2*i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src2+2*i));
+    __m256i re = _mm256_madd_epi16(a, _mm256_sign_epi16(b, negim));
+    __m256i im = _mm256_madd_epi16(a, _mm256_shuffle_epi8(b, swap));
+    __m256i lo = _mm256_unpacklo_epi32(re, im); // 0,1 | 4,5
+    __m256i hi = _mm256_unpackhi_epi32(re, im); // 2,3 | 6,7
+    __m256i * acc = (__m256i*)(accumulator+2*i);
+    _mm256_storeu_si256(acc, _mm256_add_epi32(_mm256_loadu_si256(acc), _mm256_permute2x128_si256(lo, hi, 0x20)));
+    _mm256_storeu_si256(acc+1, _mm256_add_epi32(_mm256_loadu_si256(acc+1), _mm256_permute2x128_si256(lo, hi, 0x31)));
+  }
+  _mm256_zeroupper();
+  return sse42AddProduct_16sc32sc(src1+2*i, src2+2*i, accumulator+2*i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2ConvertScaleAdd_32s32f(const s32 * src, const f32 scale, f32 * srcdest, int length)
+{
+  int i;
+  __m256 v = _mm256_set1_ps(scale);
+  for(i=0;i<length-7;i+=8)
+    _mm256_storeu_ps(srcdest+i, _mm256_fmadd_ps(v, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(src+i))), _mm256_loadu_ps(srcdest+i)));
+  _mm256_zeroupper();
+  return scalarConvertScaleAdd_32s32f(src+i, scale, srcdest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2ConvertScale_32f16s(const f32 * src, const f32 scale, s16 * dest, int length)
+{
+  int i;
+  __m256 v = _mm256_set1_ps(scale);
+  __m256i lim = _mm256_set1_epi32(32767);
+  __m256i neglim = _mm256_set1_epi32(-32767);
+  for(i=0;i<length-15;i+=16)
+  {
+    __m256i x0 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(src+i), v));
+    __m256i x1 = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(src+i+8), v));
+    x0 = _mm256_max_epi32(_mm256_min_epi32(x0, lim), neglim);
+    x1 = _mm256_max_epi32(_mm256_min_epi32(x1, lim), neglim);
+    //packs works within each 128 bit lane, so put the 64 bit quarters back in order afterwards
+    _mm256_storeu_si256((__m256i*)(dest+i), _mm256_permute4x64_epi64(_mm256_packs_epi32(x0, x1), _MM_SHUFFLE(3,1,2,0)));
+  }
+  _mm256_zeroupper();
+  return sse42ConvertScale_32f16s(src+i, scale, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2MaxAbs_32f(const f32 * src, int length, f32 * max)
+{
+  int i;
+  f32 m[8], tail;
+  __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 vmax = _mm256_setzero_ps();
+  for(i=0;i<length-7;i+=8)
+    vmax = _mm256_max_ps(vmax, _mm256_and_ps(_mm256_loadu_ps(src+i), absmask));
+  _mm256_storeu_ps(m, vmax);
+  scalarMaxAbs_32f(src+i, length-i, &tail);
+  scalarMaxAbs_32f(m, 8, max);
+  if(tail > *max)
+    *max = tail;
+  return vecNoErr;
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2AddPowerMoments_32fc(const cf32 * src, f32 * s1, f32 * s2, int length)
+{
+  int i;
+  for(i=0;i<length-7;i+=8)
+  {
+    __m256 a = _mm256_loadu_ps((const f32*)(src+i));
+    __m256 b = _mm256_loadu_ps((const f32*)(src+i+4));
+    //hadd works within each 128 bit lane, so put the 64 bit quarters back in order afterwards
+    __m256 p = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+    p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), _MM_SHUFFLE(3,1,2,0)));
+    _mm256_storeu_ps(s1+i, _mm256_add_ps(_mm256_loadu_ps(s1+i), p));
+    _mm256_storeu_ps(s2+i, _mm256_fmadd_ps(p, p, _mm256_loadu_ps(s2+i)));
+  }
+  _mm256_zeroupper();
+  return sse42AddPowerMoments_32fc(src+i, s1+i, s2+i, length-i);
+}
+
+SIMD_TARGET_AVX2 static vecStatus avx2MulLevels_8s32fc(const s8 * src1, const f32 * levels, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  const __m256 levlo = _mm256_loadu_ps(levels);
+  const __m256 levhi = _mm256_loadu_ps(levels+8);
+  const __m256i dup0 = _mm256_setr_epi32(0,0,1,1,2,2,3,3);
+  const __m256i dup1 = _mm256_setr_epi32(4,4,5,5,6,6,7,7);
+  for(i=0;i<length-7;i+=8)
+  {
+    __m256i idx = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(src1+i)));
+    //the permutes use the low 3 bits of each index, and bit 3 (shifted up to the sign) picks the upper 8 levels
+    __m256 v = _mm256_blendv_ps(_mm256_permutevar8x32_ps(levlo, idx), _mm256_permutevar8x32_ps(levhi, idx), _mm256_castsi256_ps(_mm256_slli_epi32(idx, 28)));
+    _mm256_storeu_ps((f32*)(dest+i), _mm256_mul_ps(_mm256_permutevar8x32_ps(v, dup0), _mm256_loadu_ps((const f32*)(src2+i))));
+    _mm256_storeu_ps((f32*)(dest+i+4), _mm256_mul_ps(_mm256_permutevar8x32_ps(v, dup1), _mm256_loadu_ps((const f32*)(src2+i+4))));
+  }
+  _mm256_zeroupper();
+  return sse42MulLevels_8s32fc(src1+i, levels, src2+i, dest+i, length-i);
+}
+
+static const SimdKernelTable avx2Kernels = {
+  "avx2",
+  avx2AddProduct_32fc, avx2Mul_32fc, avx2Mul_32fc_I, avx2MulC_32fc, avx2MulC_32fc_I,
+  avx2Mul_32f32fc, avx2Conj_32fc, avx2Conj_32fc_I, avx2Add_32f_I, avx2Add_32fc_I,
+  avx2MulC_32f_I, avx2RealToCplx_32f, avx2Real_32fc, avx2Convert_16s32f,
+  avx2AddProduct_16sc32sc, avx2ConvertScaleAdd_32s32f, avx2ConvertScale_32f16s, avx2MaxAbs_32f,
+  avx2AddPowerMoments_32fc, avx2MulLevels_8s32fc
+};
+
+/* AVX-512 kernels: 8 complex values per register */
+
+//GCC 12 implements many unmasked AVX-512 intrinsics as masked ones with an undefined pass-through vector, which
+//-Wall reports as possibly uninitialised once inlined here; the zero-masking forms with every lane selected avoid that
+#define AVX512_ALL ((__mmask16)0xFFFF)
+
+SIMD_TARGET_AVX512 static inline __m512 avx512CMul(__m512 a, __m512 b)
+{
+  __m512 bre = _mm512_maskz_moveldup_ps(AVX512_ALL, b);
+  __m512 bim = _mm512_maskz_movehdup_ps(AVX512_ALL, b);
+  __m512 aswap = _mm512_maskz_permute_ps(AVX512_ALL, a, _MM_SHUFFLE(2,3,0,1));
+  return _mm512_fmaddsub_ps(a, bre, _mm512_mul_ps(aswap, bim));
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512AddProduct_32fc(const cf32 * src1, const cf32 * src2, cf32 * accumulator, int length)
+{
+  int i;
+  for(i=0;i<length-7;i+=8)
+  {
+    __m512 p = avx512CMul(_mm512_loadu_ps((const f32*)(src1+i)), _mm512_loadu_ps((const f32*)(src2+i)));
+    _mm512_storeu_ps((f32*)(accumulator+i), _mm512_add_ps(_mm512_loadu_ps((const f32*)(accumulator+i)), p));
+  }
+  return avx2AddProduct_32fc(src1+i, src2+i, accumulator+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Mul_32fc(const cf32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-7;i+=8)
+    _mm512_storeu_ps((f32*)(dest+i), avx512CMul(_mm512_loadu_ps((const f32*)(src1+i)), _mm512_loadu_ps((const f32*)(src2+i))));
+  return avx2Mul_32fc(src1+i, src2+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Mul_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return avx512Mul_32fc(src, srcdest, srcdest, length);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512MulC_32fc(const cf32 * src, const cf32 val, cf32 * dest, int length)
+{
+  int i;
+  double pair;
+  memcpy(&pair, &val, sizeof(pair));
+  __m512 v = _mm512_castpd_ps(_mm512_set1_pd(pair));
+  for(i=0;i<length-7;i+=8)
+    _mm512_storeu_ps((f32*)(dest+i), avx512CMul(_mm512_loadu_ps((const f32*)(src+i)), v));
+  return avx2MulC_32fc(src+i, val, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512MulC_32fc_I(const cf32 val, cf32 * srcdest, int length)
+{
+  return avx512MulC_32fc(srcdest, val, srcdest, length);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Mul_32f32fc(const f32 * src1, const cf32 * src2, cf32 * dest, int length)
+{
+  int i;
+  const __m512i dup = _mm512_setr_epi32(0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7);
+  for(i=0;i<length-7;i+=8)
+  {
+    __m512 rr = _mm512_maskz_permutexvar_ps(AVX512_ALL, dup, _mm512_maskz_loadu_ps(0x00FF, src1+i));
+    _mm512_storeu_ps((f32*)(dest+i), _mm512_mul_ps(rr, _mm512_loadu_ps((const f32*)(src2+i))));
+  }
+  return avx2Mul_32f32fc(src1+i, src2+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Conj_32fc(const cf32 * src, cf32 * dest, int length)
+{
+  int i;
+  const __m512i sign = _mm512_set1_epi64(0x8000000000000000LL);
+  for(i=0;i<length-7;i+=8)
+    _mm512_storeu_si512((void*)(dest+i), _mm512_xor_si512(_mm512_loadu_si512((const void*)(src+i)), sign));
+  return avx2Conj_32fc(src+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Conj_32fc_I(cf32 * srcdest, int length)
+{
+  return avx512Conj_32fc(srcdest, srcdest, length);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Add_32f_I(const f32 * src, f32 * srcdest, int length)
+{
+  int i;
+  for(i=0;i<length-15;i+=16)
+    _mm512_storeu_ps(srcdest+i, _mm512_add_ps(_mm512_loadu_ps(srcdest+i), _mm512_loadu_ps(src+i)));
+  return avx2Add_32f_I(src+i, srcdest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Add_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{
+  return avx512Add_32f_I((const f32*)src, (f32*)srcdest, 2*length);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512MulC_32f_I(const f32 val, f32 * srcdest, int length)
+{
+  int i;
+  __m512 v = _mm512_set1_ps(val);
+  for(i=0;i<length-15;i+=16)
+    _mm512_storeu_ps(srcdest+i, _mm512_mul_ps(_mm512_loadu_ps(srcdest+i), v));
+  return avx2MulC_32f_I(val, srcdest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512RealToCplx_32f(const f32 * real, const f32 * imag, cf32 * complx, int length)
+{
+  int i;
+  __m512 zero = _mm512_setzero_ps();
+  const __m512i lo = _mm512_setr_epi32(0,16,1,17,2,18,3,19,4,20,5,21,6,22,7,23);
+  const __m512i hi = _mm512_setr_epi32(8,24,9,25,10,26,11,27,12,28,13,29,14,30,15,31);
+  for(i=0;i<length-15;i+=16)
+  {
+    __m512 re = real ? _mm512_loadu_ps(real+i) : zero;
+    __m512 im = imag ? _mm512_loadu_ps(imag+i) : zero;
+    _mm512_storeu_ps((f32*)(complx+i), _mm512_permutex2var_ps(re, lo, im));
+    _mm512_storeu_ps((f32*)(complx+i+8), _mm512_permutex2var_ps(re, hi, im));
+  }
+  return avx2RealToCplx_32f(real ? real+i : 0, imag ? imag+i : 0, complx+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Real_32fc(const cf32 * src, f32 * real, int length)
+{
+  int i;
+  const __m512i even = _mm512_setr_epi32(0,2,4,6,8,10,12,14,16,18,20,22,24,26,28,30);
+  for(i=0;i<length-15;i+=16)
+    _mm512_storeu_ps(real+i, _mm512_permutex2var_ps(_mm512_loadu_ps((const f32*)(src+i)), even, _mm512_loadu_ps((const f32*)(src+i+8))));
+  return avx2Real_32fc(src+i, real+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512Convert_16s32f(const s16 * src, f32 * dest, int length)
+{
+  int i;
+  for(i=0;i<length-15;i+=16)
+    _mm512_storeu_ps(dest+i, _mm512_maskz_cvtepi32_ps(AVX512_ALL, _mm512_maskz_cvtepi16_epi32(AVX512_ALL, _mm256_loadu_si256((const __m256i*)(src+i)))));
+  return avx2Convert_16s32f(src+i, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512ConvertScaleAdd_32s32f(const s32 * src, const f32 scale, f32 * srcdest, int length)
+{
+  int i;
+  __m512 v = _mm512_set1_ps(scale);
+  for(i=0;i<length-15;i+=16)
+    _mm512_storeu_ps(srcdest+i, _mm512_fmadd_ps(v, _mm512_maskz_cvtepi32_ps(AVX512_ALL, _mm512_loadu_si512((const void*)(src+i))), _mm512_loadu_ps(srcdest+i)));
+  return avx2ConvertScaleAdd_32s32f(src+i, scale, srcdest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512ConvertScale_32f16s(const f32 * src, const f32 scale, s16 * dest, int length)
+{
+  int i;
+  __m512 v = _mm512_set1_ps(scale);
+  __m512i neglim = _mm512_set1_epi32(-32767);
+  for(i=0;i<length-15;i+=16)
+  {
+    //the saturating down-conversion takes care of the upper limit
+    __m512i x = _mm512_maskz_max_epi32(AVX512_ALL, _mm512_maskz_cvtps_epi32(AVX512_ALL, _mm512_mul_ps(_mm512_loadu_ps(src+i), v)), neglim);
+    _mm512_mask_cvtsepi32_storeu_epi16(dest+i, AVX512_ALL, x);
+  }
+  return avx2ConvertScale_32f16s(src+i, scale, dest+i, length-i);
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512MaxAbs_32f(const f32 * src, int length, f32 * max)
+{
+  int i;
+  f32 tail, lanes[16];
+  __m512 vmax = _mm512_setzero_ps();
+  for(i=0;i<length-15;i+=16)
+    vmax = _mm512_maskz_max_ps(AVX512_ALL, vmax, _mm512_abs_ps(_mm512_loadu_ps(src+i)));
+  avx2MaxAbs_32f(src+i, length-i, &tail);
+  _mm512_storeu_ps(lanes, vmax);
+  *max = tail;
+  for(int l=0;l<16;l++)
+  {
+    if(lanes[l] > *max)
+      *max = lanes[l];
+  }
+  return vecNoErr;
+}
+
+SIMD_TARGET_AVX512 static vecStatus avx512AddPowerMoments_32fc(const cf32 * src, f32 * s1, f32 * s2, int length)
+{
+  int i;
+  const __m512i even = _mm512_setr_epi32(0,2,4,6,8,10,12,14,16,18,20,22,24,26,28,30);
+  const __m512i odd = _mm512_setr_epi32(1,3,5,7,9,11,13,15,17,19,21,23,25,27,29,31);
+  for(i=0;i<length-15;i+=16)
+  {
+    __m512 a = _mm512_loadu_ps((const f32*)(src+i));
+    __m512 b = _mm512_loadu_ps((const f32*)(src+i+8));
+    __m512 re = _mm512_permutex2var_ps(a, even, b);
+    __m512 im = _mm512_permutex2var_ps(a, odd, b);
+    __m512 p = _mm512_fmadd_ps(re, re, _mm512_mul_ps(im, im));
+    _mm512_storeu_ps(s1+i, _mm512_add_ps(_mm512_loadu_ps(s1+i), p));
+    _mm512_storeu_ps(s2+i, _mm512_fmadd_ps(p, p, _mm512_loadu_ps(s2+i)));
+  }
+  return avx2AddPowerMoments_32fc(src+i, s1+i, s2+i, length-i);
+}
+
+//the 512 bit pmaddwd needs AVX512BW, so the packed complex product stays at AVX2 width, as does the byte level lookup
+static const SimdKernelTable avx512Kernels = {
+  "avx512",
+  avx512AddProduct_32fc, avx512Mul_32fc, avx512Mul_32fc_I, avx512MulC_32fc, avx512MulC_32fc_I,
+  avx512Mul_32f32fc, avx512Conj_32fc, avx512Conj_32fc_I, avx512Add_32f_I, avx512Add_32fc_I,
+  avx512MulC_32f_I, avx512RealToCplx_32f, avx512Real_32fc, avx512Convert_16s32f,
+  avx2AddProduct_16sc32sc, avx512ConvertScaleAdd_32s32f, avx512ConvertScale_32f16s, avx512MaxAbs_32f,
+  avx512AddPowerMoments_32fc, avx2MulLevels_8s32fc
+};
+
+static const SimdKernelTable * const kernelTables[SIMD_NUMLEVELS] = { &scalarKernels, &sse42Kernels, &avx2Kernels, &avx512Kernels };
+
+#else
+
+static const SimdKernelTable * const kernelTables[SIMD_NUMLEVELS] = { &scalarKernels, &scalarKernels, &scalarKernels, &scalarKernels };
+
+#endif /* SIMD_X86 */
+
+static const char * const levelNames[SIMD_NUMLEVELS] = { "generic", "sse42", "avx2", "avx512" };
+
+const SimdKernelTable * simdKernels = &scalarKernels;
+static int currentLevel = SIMD_GENERIC;
+
+int simdDetectLevel()
+{
+#if SIMD_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return SIMD_AVX512;
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return SIMD_AVX2;
+  if(__builtin_cpu_supports("sse4.2"))
+    return SIMD_SSE42;
+#endif
+  return SIMD_GENERIC;
+}
+
+int simdSetLevel(int level)
+{
+  int maxlevel = simdDetectLevel();
+
+  if(level < SIMD_GENERIC)
+    level = SIMD_GENERIC;
+  if(level > maxlevel)
+    level = maxlevel;
+  currentLevel = level;
+  simdKernels = kernelTables[level];
+
+  return level;
+}
+
+int simdGetLevel()
+{
+  return currentLevel;
+}
+
+const SimdKernelTable * simdGetKernels(int level)
+{
+  if(level < SIMD_GENERIC || level > simdDetectLevel())
+    return &scalarKernels;
+  return kernelTables[level];
+}
+
+const char * simdLevelName(int level)
+{
+  if(level < SIMD_GENERIC || level >= SIMD_NUMLEVELS)
+    return "unknown";
+  return levelNames[level];
+}
+
+int simdParseLevel(const char * name)
+{
+  for(int i=0;i<SIMD_NUMLEVELS;i++)
+  {
+    if(strcasecmp(name, levelNames[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+//select the best kernels before main() runs, honouring DIFX_SIMD if set
+static int initialiseSimdLevel()
+{
+  int level = simdDetectLevel();
+  const char * requested = getenv("DIFX_SIMD");
+
+  if(requested && simdParseLevel(requested) >= 0 && simdParseLevel(requested) < level)
+    level = simdParseLevel(requested);
+  return simdSetLevel(level);
+}
+
+const int simdInitialLevel = initialiseSimdLevel();
+// vim: shiftwidth=2:softtabstop=2:expandtab
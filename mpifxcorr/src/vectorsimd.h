@@ -0,0 +1,157 @@
+/** \file vectorsimd.h
+ *  \brief SIMD (SSE4.2/AVX2/AVX-512) kernels with runtime CPU dispatch for the generic (non-IPP) build
+ *
+ * The kernels here are selected once per process according to the capabilities of the CPU
+ * (optionally capped by the DIFX_SIMD environment variable, which may be set to one of
+ * generic, sse42, avx2 or avx512).  In the generic build architecture.h maps the
+ * corresponding vector* macros onto these functions; in the IPP build they are compiled
+ * but only used for benchmarking.
+ */
+
+#ifndef VECTORSIMD_H
+#define VECTORSIMD_H
+
+#include "architecture.h"
+
+/// Instruction set levels understood by the dispatcher, in increasing order of capability
+enum SimdLevel { SIMD_GENERIC = 0, SIMD_SSE42 = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3, SIMD_NUMLEVELS = 4 };
+
+/// Table of kernel implementations for one instruction set level
+typedef struct {
+  const char * name;
+  vecStatus (*addProduct_32fc)(const cf32 * src1, const cf32 * src2, cf32 * accumulator, int length);
+  vecStatus (*mul_32fc)(const cf32 * src1, const cf32 * src2, cf32 * dest, int length);
+  vecStatus (*mul_32fc_I)(const cf32 * src, cf32 * srcdest, int length);
+  vecStatus (*mulC_32fc)(const cf32 * src, const cf32 val, cf32 * dest, int length);
+  vecStatus (*mulC_32fc_I)(const cf32 val, cf32 * srcdest, int length);
+  vecStatus (*mul_32f32fc)(const f32 * src1, const cf32 * src2, cf32 * dest, int length);
+  vecStatus (*conj_32fc)(const cf32 * src, cf32 * dest, int length);
+  vecStatus (*conj_32fc_I)(cf32 * srcdest, int length);
+  vecStatus (*add_32f_I)(const f32 * src, f32 * srcdest, int length);
+  vecStatus (*add_32fc_I)(const cf32 * src, cf32 * srcdest, int length);
+  vecStatus (*mulC_32f_I)(const f32 val, f32 * srcdest, int length);
+  vecStatus (*realToCplx_32f)(const f32 * real, const f32 * imag, cf32 * complx, int length);
+  vecStatus (*real_32fc)(const cf32 * src, f32 * real, int length);
+  vecStatus (*convert_16s32f)(const s16 * src, f32 * dest, int length);
+  //packed 16 bit complex (interleaved re,im) support for the reduced precision cross-multiply
+  vecStatus (*addProduct_16sc32sc)(const s16 * src1, const s16 * src2, s32 * accumulator, int length);
+  vecStatus (*convertScaleAdd_32s32f)(const s32 * src, const f32 scale, f32 * srcdest, int length);
+  vecStatus (*convertScale_32f16s)(const f32 * src, const f32 scale, s16 * dest, int length);
+  vecStatus (*maxAbs_32f)(const f32 * src, int length, f32 * max);
+  //spectral kurtosis accumulation
+  vecStatus (*addPowerMoments_32fc)(const cf32 * src, f32 * s1, f32 * s2, int length);
+  //fringe rotation straight from one byte per sample
+  vecStatus (*mulLevels_8s32fc)(const s8 * src1, const f32 * levels, const cf32 * src2, cf32 * dest, int length);
+} SimdKernelTable;
+
+/// The table currently in use; always valid (starts out as the scalar table)
+extern const SimdKernelTable * simdKernels;
+
+/**
+ * Returns the highest level supported by the CPU this process is running on
+ */
+int simdDetectLevel();
+
+/**
+ * Selects the kernels of the given level (clamped to what the CPU supports)
+ * @return The level actually selected
+ */
+int simdSetLevel(int level);
+
+/**
+ * Returns the level currently selected
+ */
+int simdGetLevel();
+
+/**
+ * Returns the kernel table for a given level, or the scalar table if the CPU does not support it
+ */
+const SimdKernelTable * simdGetKernels(int level);
+
+/**
+ * Returns a printable name for the given level
+ */
+const char * simdLevelName(int level);
+
+/**
+ * Parses a level name (as accepted in DIFX_SIMD)
+ * @return The level, or -1 if the name is not recognised
+ */
+int simdParseLevel(const char * name);
+
+//the dispatched kernels themselves
+inline vecStatus simdAddProduct_32fc(const cf32 * src1, const cf32 * src2, cf32 * accumulator, int length)
+{ return simdKernels->addProduct_32fc(src1, src2, accumulator, length); }
+inline vecStatus simdMul_32fc(const cf32 * src1, const cf32 * src2, cf32 * dest, int length)
+{ return simdKernels->mul_32fc(src1, src2, dest, length); }
+inline vecStatus simdMul_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{ return simdKernels->mul_32fc_I(src, srcdest, length); }
+inline vecStatus simdMulC_32fc(const cf32 * src, const cf32 val, cf32 * dest, int length)
+{ return simdKernels->mulC_32fc(src, val, dest, length); }
+inline vecStatus simdMulC_32fc_I(const cf32 val, cf32 * srcdest, int length)
+{ return simdKernels->mulC_32fc_I(val, srcdest, length); }
+inline vecStatus simdMul_32f32fc(const f32 * src1, const cf32 * src2, cf32 * dest, int length)
+{ return simdKernels->mul_32f32fc(src1, src2, dest, length); }
+inline vecStatus simdConj_32fc(const cf32 * src, cf32 * dest, int length)
+{ return simdKernels->conj_32fc(src, dest, length); }
+inline vecStatus simdConj_32fc_I(cf32 * srcdest, int length)
+{ return simdKernels->conj_32fc_I(srcdest, length); }
+inline vecStatus simdAdd_32f_I(const f32 * src, f32 * srcdest, int length)
+{ return simdKernels->add_32f_I(src, srcdest, length); }
+inline vecStatus simdAdd_32fc_I(const cf32 * src, cf32 * srcdest, int length)
+{ return simdKernels->add_32fc_I(src, srcdest, length); }
+inline vecStatus simdMulC_32f_I(const f32 val, f32 * srcdest, int length)
+{ return simdKernels->mulC_32f_I(val, srcdest, length); }
+inline vecStatus simdRealToCplx_32f(const f32 * real, const f32 * imag, cf32 * complx, int length)
+{ return simdKernels->realToCplx_32f(real, imag, complx, length); }
+inline vecStatus simdReal_32fc(const cf32 * src, f32 * real, int length)
+{ return simdKernels->real_32fc(src, real, length); }
+inline vecStatus simdConvert_16s32f(const s16 * src, f32 * dest, int length)
+{ return simdKernels->convert_16s32f(src, dest, length); }
+
+/**
+ * Complex multiply-accumulate of packed 16 bit complex vectors into 32 bit integer accumulators.
+ * All arrays hold interleaved (re,im) pairs and length counts complex values.  The result is
+ * exact provided no input component is -32768 and the accumulators have not overflowed.
+ */
+inline vecStatus simdAddProduct_16sc32sc(const s16 * src1, const s16 * src2, s32 * accumulator, int length)
+{ return simdKernels->addProduct_16sc32sc(src1, src2, accumulator, length); }
+/// srcdest[i] += scale*src[i]: widens integer accumulators into a float accumulator
+inline vecStatus simdConvertScaleAdd_32s32f(const s32 * src, const f32 scale, f32 * srcdest, int length)
+{ return simdKernels->convertScaleAdd_32s32f(src, scale, srcdest, length); }
+/// dest[i] = round(scale*src[i]), saturated to +-32767
+inline vecStatus simdConvertScale_32f16s(const f32 * src, const f32 scale, s16 * dest, int length)
+{ return simdKernels->convertScale_32f16s(src, scale, dest, length); }
+/// Largest absolute value in src (0 for an empty vector)
+inline vecStatus simdMaxAbs_32f(const f32 * src, int length, f32 * max)
+{ return simdKernels->maxAbs_32f(src, length, max); }
+/// s1[i] += |src[i]|^2 and s2[i] += |src[i]|^4 in a single pass: the power sums behind spectral kurtosis
+inline vecStatus simdAddPowerMoments_32fc(const cf32 * src, f32 * s1, f32 * s2, int length)
+{ return simdKernels->addPowerMoments_32fc(src, s1, s2, length); }
+/**
+ * dest[i] = levels[src1[i] & 15]*src2[i]: converts bytes holding small signed integers (as decoded by
+ * mark5_stream_decode_int8) to their 16 quantisation levels and multiplies by a complex vector, so the
+ * fringe rotation of real data reads one byte per sample rather than a float.  Gives exactly what
+ * simdMul_32f32fc gives for the floats.
+ */
+inline vecStatus simdMulLevels_8s32fc(const s8 * src1, const f32 * levels, const cf32 * src2, cf32 * dest, int length)
+{ return simdKernels->mulLevels_8s32fc(src1, levels, src2, dest, length); }
+
+//copy and zero need no dispatch: the C library versions are already vectorised
+inline vecStatus simdCopy_32f(const f32 * src, f32 * dest, int length)
+{ memcpy(dest, src, length*sizeof(f32)); return vecNoErr; }
+inline vecStatus simdCopy_32fc(const cf32 * src, cf32 * dest, int length)
+{ memcpy(dest, src, length*sizeof(cf32)); return vecNoErr; }
+inline vecStatus simdCopy_16s(const s16 * src, s16 * dest, int length)
+{ memcpy(dest, src, length*sizeof(s16)); return vecNoErr; }
+inline vecStatus simdZero_32f(f32 * dest, int length)
+{ memset(dest, 0, length*sizeof(f32)); return vecNoErr; }
+inline vecStatus simdZero_32s(s32 * dest, int length)
+{ memset(dest, 0, length*sizeof(s32)); return vecNoErr; }
+inline vecStatus simdZero_16s(s16 * dest, int length)
+{ memset(dest, 0, length*sizeof(s16)); return vecNoErr; }
+inline vecStatus simdZero_32fc(cf32 * dest, int length)
+{ memset(dest, 0, length*sizeof(cf32)); return vecNoErr; }
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -43,8 +43,8 @@
 #include <difxmessage.h>
 #include "alert.h"
 
-Visibility::Visibility(Configuration * conf, int id, int numvis, char * dbuffer, int dbufferlen, int eseconds, int scan, int scanstartsec, int startns, const string * pnames)
-  : config(conf), visID(id), currentscan(scan), currentstartseconds(scanstartsec), currentstartns(startns), numvisibilities(numvis), executeseconds(eseconds), todiskbufferlength(dbufferlen), polnames(pnames), todiskbuffer(dbuffer)
+Visibility::Visibility(Configuration * conf, int id, int numvis, VisWriter * vwriter, int dbufferlen, int eseconds, int scan, int scanstartsec, int startns, const string * pnames)
+  : config(conf), visID(id), currentscan(scan), currentstartseconds(scanstartsec), currentstartns(startns), numvisibilities(numvis), executeseconds(eseconds), todiskbufferlength(dbufferlen), polnames(pnames), writer(vwriter), todiskbuffer(0)
 {
   int status, binloop, maxbinloop = 1;
 
@@ -87,6 +87,8 @@ Visibility::Visibility(Configuration * conf, int id, int numvis, char * dbuffer,
   }
   todiskmemptrs = new int[maxfiles];
   estimatedbytes += maxfiles*4;
+  writeindex = (config->getOutputFormat() == Configuration::DIFX) && Configuration::writeVisIndex();
+  indexentries = new vector<IndexEntry>[maxfiles];
 
   //set up the initial time period this Visibility will be responsible for
   offsetns = offsetns + offsetnsperintegration;
@@ -184,6 +186,7 @@ Visibility::~Visibility()
     delete [] binscales;
     vectorFree(binweightdivisor);
   }
+  delete [] indexentries;
 }
 
 bool Visibility::addData(cf32* subintresults)
@@ -786,14 +789,16 @@ void Visibility::writeascii(int dumpmjd, double dumpseconds)
 void Visibility::writedifx(int dumpmjd, double dumpseconds)
 {
   ofstream output;
-  ofstream pcaloutput;
   char filename[256];
+  char datafilename[256];
   char pcalfilename[256];
   char pcalstr[256];
   string pcalline;
   int binloop, freqindex, baselinefreqindex, numpolproducts, resultindex, coreindex, coreoffset, freqchannels;
   int year, month, day;
   int ant1index, ant2index, sourceindex, baselinenumber, numfiles, filecount;
+  unsigned int crossentries = 0;
+  long long fileoffset;
   float tonefreq;
   float currentweight;
   double scanoffsetsecs, pcalmjd;
@@ -814,6 +819,7 @@ void Visibility::writedifx(int dumpmjd, double dumpseconds)
     binloop = 1;
 
   numfiles = binloop*model->getNumPhaseCentres(currentscan);
+  todiskbuffer = writer->getBlock();
   for(int f=0;f<numfiles;f++)
   {
     todiskmemptrs[f] = f*(todiskbufferlength/numfiles);
@@ -878,6 +884,8 @@ void Visibility::writedifx(int dumpmjd, double dumpseconds)
                 currentweight = baselineweights[i][freqindex][b][k]*baselineshiftdecorrs[i][freqindex][s];
               else
                 currentweight = baselineweights[i][freqindex][b][k];
+              if(writeindex)
+                addIndexEntry(filecount, todiskmemptrs[filecount] - filecount*(todiskbufferlength/numfiles), baselinenumber, sourceindex, freqindex, polpair, b, freqchannels);
               writeDiFXHeader(&output, baselinenumber, dumpmjd, dumpseconds, currentconfigindex, sourceindex, freqindex, polpair, b, 0, currentweight, buvw, filecount);
 
               //close, reopen in binary and write the binary data, then close again
@@ -901,27 +909,28 @@ void Visibility::writedifx(int dumpmjd, double dumpseconds)
     }//for(freqs)
   }//for(baselines)
 
-  //now write all the different files out to disk, one hit per file
+  //now queue all the different files for writing, one hit per file
   filecount = 0;
   for(int s=0;s<model->getNumPhaseCentres(currentscan);s++)
   {
     for(int b=0;b<binloop;b++)
     {
       sprintf(filename, "%s/DIFX_%05d_%06d.s%04d.b%04d", config->getOutputFilename().c_str(), expermjd, experseconds, s, b);
-      output.open(filename, ios::app);
-      output.write(&(todiskbuffer[filecount*(todiskbufferlength/numfiles)]), todiskmemptrs[filecount]-filecount*(todiskbufferlength/numfiles));
-      output.close();
-      if(!output)
-         csevere << startl << "Error trying to write more data to " << filename << " : " << strerror(errno) << "!!" << endl;
+      fileoffset = writer->append(filename, filecount*(todiskbufferlength/numfiles), todiskmemptrs[filecount]-filecount*(todiskbufferlength/numfiles));
+      //the records land after whatever is already in (or queued for) the file
+      for(vector<IndexEntry>::iterator e=indexentries[filecount].begin(); e!=indexentries[filecount].end(); e++)
+        e->offset += fileoffset;
       filecount++;
     }
   }
+  crossentries = indexentries[0].size();
 
   if(model->getNumPhaseCentres(currentscan) == 1)
     sourceindex = model->getPhaseCentreSourceIndex(currentscan, 0);
   else
     sourceindex = model->getPointingCentreSourceIndex(currentscan);
-  todiskmemptrs[0] = 0;
+  //the autocorrelations have their own part of the block, as the cross-correlations may not have been written yet
+  todiskmemptrs[0] = todiskbufferlength;
 
   //now each autocorrelation visibility point if necessary
   if(config->writeAutoCorrs(currentconfigindex))
@@ -959,6 +968,8 @@ void Visibility::writedifx(int dumpmjd, double dumpseconds)
                 polpair[1] = polpair[0];
               else
                 polpair[1] = config->getOppositePol(polpair[0]);
+              if(writeindex)
+                addIndexEntry(0, todiskmemptrs[0] - todiskbufferlength, baselinenumber, sourceindex, freqindex, polpair, 0, freqchannels);
               writeDiFXHeader(&output, baselinenumber, dumpmjd, dumpseconds, currentconfigindex, sourceindex, freqindex, polpair, 0, 0, autocorrweights[i][j][k], buvw, 0);
 
               //open, write the binary data and close
@@ -974,15 +985,29 @@ void Visibility::writedifx(int dumpmjd, double dumpseconds)
     }
   }
 
-  if(todiskmemptrs[0] > 0)
+  if(todiskmemptrs[0] > todiskbufferlength)
   {
-    //write out the autocorrelations, all in one hit
+    //queue the autocorrelations, all in one hit
     sprintf(filename, "%s/DIFX_%05d_%06d.s%04d.b%04d", config->getOutputFilename().c_str(), expermjd, experseconds, 0, 0);
-    output.open(filename, ios::app);
-    output.write(todiskbuffer, todiskmemptrs[0]);
-    output.close();
-    if(!output)
-      csevere << startl << "Error trying to write more data to " << filename << " : " << strerror(errno) << "!!" << endl;
+    fileoffset = writer->append(filename, todiskbufferlength, todiskmemptrs[0]-todiskbufferlength);
+    for(vector<IndexEntry>::iterator e=indexentries[0].begin()+crossentries; e!=indexentries[0].end(); e++)
+      e->offset += fileoffset;
+  }
+
+  //and the index of each file, now that all of this integration's records are in place
+  if(writeindex)
+  {
+    filecount = 0;
+    for(int s=0;s<model->getNumPhaseCentres(currentscan);s++)
+    {
+      for(int b=0;b<binloop;b++)
+      {
+        sprintf(datafilename, "%s/DIFX_%05d_%06d.s%04d.b%04d", config->getOutputFilename().c_str(), expermjd, experseconds, s, b);
+        sprintf(filename, "%s/INDEX_%05d_%06d.s%04d.b%04d", config->getOutputFilename().c_str(), expermjd, experseconds, s, b);
+        writeIndex(filename, datafilename, filecount, dumpmjd, dumpseconds);
+        filecount++;
+      }
+    }
   }
 
 
@@ -1076,22 +1101,24 @@ The four columns are:
       if(nonzero) // If at least one tone had non-zero amplitude, write the line to the file
       {
         sprintf(pcalfilename, "%s/PCAL_%05d_%06d_%s", config->getOutputFilename().c_str(), config->getStartMJD(), config->getStartSeconds(), config->getDStationName(currentconfigindex, i).c_str());
-        pcaloutput.open(pcalfilename, ios::app);
-        pcaloutput << pcalline << endl;
-        pcaloutput.close();
-        if(!pcaloutput)
-          csevere << startl << "Error trying to write more PCAL data to " << pcalfilename << " : " << strerror(errno) << "!!" << endl;
+        pcalline += "\n";
+        writer->appendCopy(pcalfilename, pcalline.c_str(), pcalline.length());
       }
     }
   }
+
+  //everything for this integration is formatted; hand it over to be written while the next one is accumulated
+  writer->submitBlock();
+  todiskbuffer = 0;
 }
 
 void Visibility::multicastweights()
 {
   float *weight;
   double mjd;
-  int dumpmjd, intsec, freqindex, weightcount;
+  int dumpmjd, intsec, freqindex, weightcount, queued;
   double dumpseconds;
+  char statusmessage[64];
 
   if(currentscan >= model->getNumScans() || (model->getScanStartSec(currentscan, expermjd, experseconds) + currentstartseconds) >= executeseconds || currentsubints == 0)
   {
@@ -1133,7 +1160,13 @@ void Visibility::multicastweights()
 
   mjd = dumpmjd + dumpseconds/86400.0;
 
-  difxMessageSendDifxStatus3(DIFX_STATE_RUNNING, "", mjd, numdatastreams, weight, expermjd + experseconds/86400.0, expermjd + (experseconds + executeseconds)/86400.0);
+  //let the operator see output backing up before the visibility buffer runs out
+  queued = writer->getNumQueued();
+  if(queued > 1)
+    sprintf(statusmessage, "%d integrations waiting to be written", queued);
+  else
+    statusmessage[0] = 0;
+  difxMessageSendDifxStatus3(DIFX_STATE_RUNNING, statusmessage, mjd, numdatastreams, weight, expermjd + experseconds/86400.0, expermjd + (experseconds + executeseconds)/86400.0);
 
   delete [] weight;
 } 
@@ -1222,6 +1255,41 @@ void Visibility::writeDiFXHeader(ofstream * output, int baselinenum, int dumpmjd
   todiskmemptrs[filecount] += 3*8;
 }
 
+void Visibility::addIndexEntry(int filecount, int bufferoffset, int baselinenum, int sourceindex, int freqindex, const char polproduct[3], int pulsarbin, int numchannels)
+{
+  IndexEntry entry;
+
+  entry.offset = bufferoffset;
+  entry.baseline = baselinenum;
+  entry.freqindex = freqindex;
+  entry.sourceindex = sourceindex;
+  entry.pulsarbin = pulsarbin;
+  entry.numchannels = numchannels;
+  entry.polpair[0] = polproduct[0];
+  entry.polpair[1] = polproduct[1];
+  entry.pad[0] = entry.pad[1] = 0;
+  indexentries[filecount].push_back(entry);
+}
+
+void Visibility::writeIndex(const char * filename, const char * datafilename, int filecount, int dumpmjd, double dumpseconds)
+{
+  char header[24];
+  int numentries = indexentries[filecount].size();
+
+  if(numentries == 0)
+    return;
+
+  *((unsigned int*)(&(header[0]))) = INDEX_SYNC_WORD;
+  *((int*)(&(header[4]))) = INDEX_VERSION;
+  *((int*)(&(header[8]))) = dumpmjd;
+  *((int*)(&(header[12]))) = numentries;
+  memcpy(&(header[16]), &dumpseconds, 8);
+
+  writer->appendCopy(filename, header, 24, datafilename);
+  writer->appendCopy(filename, (const char *)(&(indexentries[filecount][0])), numentries*sizeof(IndexEntry), datafilename);
+  indexentries[filecount].clear();
+}
+
 void Visibility::changeConfig(int configindex)
 {
   int pulsarwidth;
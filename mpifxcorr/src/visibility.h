@@ -28,8 +28,10 @@
 #define VISIBILITY_H
 
 #include <string>
+#include <vector>
 #include "architecture.h"
 #include "datastream.h"
+#include "viswriter.h"
 
 /**
 @class Visibility 
@@ -48,8 +50,8 @@ public:
   * @param conf The configuration object, containing all information about the duration and setup of this correlation
   * @param id This Datastream's MPI id
   * @param numvis The number of Visibilities in the array
-  * @param dbuffer A buffer to use when writing to disk (one shared between all visibilities)
-  * @param dbufferlen The length of the disk writing buffer
+  * @param vwriter The writer that DiFX format output is formatted for and queued to (one shared between all visibilities)
+  * @param dbufferlen The length of the part of each of vwriter's blocks used for cross-correlations; autocorrelations follow it
   * @param eseconds The length of the correlation, in seconds
   * @param scan The scan on which we will start
   * @param scanstartsec The number of seconds from the start of this scan
@@ -57,7 +59,7 @@ public:
   * @param pnames The names of the polarisation products eg {RR, LL, RL, LR} or {XX, YY, XY, YX}
   */
 
-  Visibility(Configuration * conf, int id, int numvis, char * dbuffer, int dbufferlen, int eseconds, int scan, int scanstartsec, int startns, const string * pnames);
+  Visibility(Configuration * conf, int id, int numvis, VisWriter * vwriter, int dbufferlen, int eseconds, int scan, int scanstartsec, int startns, const string * pnames);
 
   ~Visibility();
 
@@ -137,6 +139,12 @@ public:
   ///Version of the binary header
   static const int BINARY_HEADER_VERSION = 1;
 
+  ///Sync word at the start of each integration's block in a visibility index file
+  static const unsigned int INDEX_SYNC_WORD = 0xFF01FF01;
+
+  ///Version of the visibility index file layout
+  static const int INDEX_VERSION = 1;
+
   void copyVisData(char **buf, int *bufsize, int *nbuf);
 
 private:
@@ -177,7 +185,7 @@ private:
   void writeascii(int dumpmjd, double dumpseconds);
 
 /**
-  * Writes the visibilities to disk in DiFX format (binary with inserted ascii headers)
+  * Formats the visibilities in DiFX format (binary headers and data) into a writer block and queues it for disk
   */
   void writedifx(int dumpmjd, double dumpseconds);
 
@@ -186,12 +194,38 @@ private:
   */
   void writeDiFXHeader(ofstream * output, int baselinenum, int dumpmjd, double dumpseconds, int configindex, int sourceindex, int freqindex, const char polproduct[3], int pulsarbin, int flag, float weight, double buvw[3], int filecount);
 
+ /**
+  * Notes the position in todiskbuffer of the record about to be written for file filecount, for the visibility index
+  */
+  void addIndexEntry(int filecount, int bufferoffset, int baselinenum, int sourceindex, int freqindex, const char polproduct[3], int pulsarbin, int numchannels);
+
+ /**
+  * Queues this integration's block for the index file that accompanies a DiFX output file.  Each block is a
+  * 24 byte header (INDEX_SYNC_WORD, INDEX_VERSION, mjd, number of entries, seconds as a double) followed by
+  * one 32 byte IndexEntry per record, so a reader can find any time, baseline or band without parsing the
+  * visibilities.  The records are in the order they appear in the DiFX file.
+  * @param filename The index file
+  * @param datafilename The DiFX file it indexes; the index is no longer written if writing to that fails
+  * @param filecount Which of this integration's files (phase centre and pulsar bin) the index is for
+  * @param dumpmjd The MJD of this integration
+  * @param dumpseconds The seconds of this integration
+  */
+  void writeIndex(const char * filename, const char * datafilename, int filecount, int dumpmjd, double dumpseconds);
+
+  ///One record in the visibility index: where its header starts in the DiFX file, and what it holds
+  typedef struct {
+    long long offset;
+    int baseline, freqindex, sourceindex, pulsarbin, numchannels;
+    char polpair[2];
+    char pad[2];
+  } IndexEntry;
+
   Configuration * config;
   int visID, expermjd, experseconds, currentscan, currentstartseconds, currentstartns, offsetns, offsetnsperintegration, subintsthisintegration, subintns, numvisibilities, numdatastreams, numbaselines, currentsubints, resultlength, currentconfigindex, maxproducts, executeseconds, autocorrwidth, todiskbufferlength, maxfiles;
   long long estimatedbytes;
   double fftsperintegration, meansubintsperintegration;
   const string * polnames;
-  bool first, pulsarbinon, configuredok;
+  bool first, pulsarbinon, configuredok, writeindex;
   int portnum;
   char * hostname;
   cf32 ** autocorrcalibs;	//[numdatastreams][numzoombands+numrecbands] - mean autocorr of a band
@@ -201,8 +235,10 @@ private:
   f32 ***  baselineshiftdecorrs;
   std::string * telescopenames;
   cf32 * results;
-  char * todiskbuffer;
+  VisWriter * writer;
+  char * todiskbuffer;  //the writer block being formatted
   int * todiskmemptrs;
+  std::vector<IndexEntry> * indexentries; //[maxfiles], offsets relative to the file's part of todiskbuffer until queued
   f32 * floatresults;
   f32 *** binweightsums;
   cf32 *** binscales;
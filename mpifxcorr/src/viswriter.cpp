@@ -0,0 +1,271 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "viswriter.h"
+#include "alert.h"
+
+const size_t VisWriter::BLOCK_ALIGNMENT;
+const int VisWriter::MAX_OPEN_FILES;
+
+VisWriter::VisWriter(int numblocks, long long blockbytes, int syncinterval)
+  : numblocks(numblocks < 1 ? 1 : numblocks), syncinterval(syncinterval < 0 ? 0 : syncinterval), currentblock(-1),
+    numqueued(0), numwritten(0), blockbytes(blockbytes), stopping(false), initialisedok(true)
+{
+  blocks = new Block[this->numblocks];
+  for(int i=0;i<this->numblocks;i++)
+  {
+    if(posix_memalign((void **)&(blocks[i].data), BLOCK_ALIGNMENT, blockbytes) != 0)
+    {
+      cfatal << startl << "Failed to allocate " << blockbytes << " bytes for visibility output block " << i << endl;
+      blocks[i].data = 0;
+      initialisedok = false;
+      continue;
+    }
+    freeblocks.push_back(i);
+  }
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&blockqueued, 0);
+  pthread_cond_init(&blockwritten, 0);
+  if(pthread_create(&writethread, 0, VisWriter::launchWriteThread, this) != 0)
+  {
+    cfatal << startl << "Cannot create the visibility output thread!" << endl;
+    initialisedok = false;
+  }
+}
+
+VisWriter::~VisWriter()
+{
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_signal(&blockqueued);
+  pthread_mutex_unlock(&lock);
+  if(initialisedok)
+    pthread_join(writethread, 0);
+
+  closeFiles();
+  for(int i=0;i<numblocks;i++)
+    free(blocks[i].data);
+  delete [] blocks;
+  pthread_cond_destroy(&blockwritten);
+  pthread_cond_destroy(&blockqueued);
+  pthread_mutex_destroy(&lock);
+}
+
+char * VisWriter::getBlock()
+{
+  Block * block;
+
+  if(currentblock >= 0)
+    return blocks[currentblock].data;
+
+  pthread_mutex_lock(&lock);
+  if(freeblocks.empty())
+  {
+    cwarn << startl << "All " << numblocks << " visibility output blocks are waiting to be written - output is being held up by the disk" << endl;
+    while(freeblocks.empty())
+      pthread_cond_wait(&blockwritten, &lock);
+  }
+  currentblock = freeblocks.back();
+  freeblocks.pop_back();
+  pthread_mutex_unlock(&lock);
+
+  block = &(blocks[currentblock]);
+  block->copies.clear();
+  block->segments.clear();
+
+  return block->data;
+}
+
+long long VisWriter::append(const char * filename, long long offset, long long bytes, const char * datafilename)
+{
+  Segment segment;
+  long long fileoffset;
+  struct stat st;
+  std::map<std::string, long long>::iterator length;
+
+  //work out where this will land from what has been queued for the file so far
+  length = filelengths.find(filename);
+  if(length == filelengths.end())
+  {
+    fileoffset = (stat(filename, &st) == 0) ? st.st_size : 0;
+    length = filelengths.insert(std::make_pair(std::string(filename), fileoffset)).first;
+  }
+  fileoffset = length->second;
+  if(bytes <= 0)
+    return fileoffset;
+  length->second += bytes;
+
+  segment.filename = filename;
+  if(datafilename)
+    segment.datafilename = datafilename;
+  segment.copied = false;
+  segment.offset = offset;
+  segment.bytes = bytes;
+  blocks[currentblock].segments.push_back(segment);
+
+  return fileoffset;
+}
+
+long long VisWriter::appendCopy(const char * filename, const char * data, long long bytes, const char * datafilename)
+{
+  Block * block = &(blocks[currentblock]);
+  long long fileoffset;
+
+  fileoffset = append(filename, block->copies.size(), bytes, datafilename);
+  if(bytes > 0)
+  {
+    block->segments.back().copied = true;
+    block->copies.append(data, bytes);
+  }
+
+  return fileoffset;
+}
+
+void VisWriter::submitBlock()
+{
+  if(currentblock < 0)
+    return;
+
+  pthread_mutex_lock(&lock);
+  queuedblocks.push_back(currentblock);
+  numqueued++;
+  pthread_cond_signal(&blockqueued);
+  pthread_mutex_unlock(&lock);
+  currentblock = -1;
+}
+
+void VisWriter::drain()
+{
+  pthread_mutex_lock(&lock);
+  while(numqueued > 0)
+    pthread_cond_wait(&blockwritten, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+int VisWriter::getNumQueued()
+{
+  int n;
+
+  pthread_mutex_lock(&lock);
+  n = numqueued;
+  pthread_mutex_unlock(&lock);
+
+  return n;
+}
+
+void * VisWriter::launchWriteThread(void * writer)
+{
+  ((VisWriter *)writer)->writeLoop();
+
+  return 0;
+}
+
+void VisWriter::writeLoop()
+{
+  int b;
+
+  pthread_mutex_lock(&lock);
+  while(true)
+  {
+    while(queuedblocks.empty() && !stopping)
+      pthread_cond_wait(&blockqueued, &lock);
+    if(queuedblocks.empty())
+      break;
+    b = queuedblocks.front();
+    pthread_mutex_unlock(&lock);
+
+    writeBlock(&(blocks[b]));
+
+    pthread_mutex_lock(&lock);
+    queuedblocks.erase(queuedblocks.begin());
+    freeblocks.push_back(b);
+    numqueued--;
+    pthread_cond_broadcast(&blockwritten);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+void VisWriter::writeBlock(Block * block)
+{
+  const char * data;
+  long long remaining;
+  ssize_t n;
+  int fd;
+
+  //the offsets handed out by append() assume every earlier segment made it to disk, so after an error nothing
+  //more is written to that file (or to any file that refers into it)
+  for(std::vector<Segment>::const_iterator s=block->segments.begin(); s!=block->segments.end(); s++)
+  {
+    if(failedfiles.count(s->filename) > 0 || (!s->datafilename.empty() && failedfiles.count(s->datafilename) > 0))
+      continue;
+    fd = getFile(s->filename);
+    if(fd < 0)
+    {
+      failedfiles.insert(s->filename);
+      continue;
+    }
+    data = s->copied ? block->copies.data() + s->offset : block->data + s->offset;
+    remaining = s->bytes;
+    while(remaining > 0)
+    {
+      n = write(fd, data, remaining);
+      if(n < 0 && errno == EINTR)
+        continue;
+      if(n <= 0)
+      {
+        csevere << startl << "Error trying to write more data to " << s->filename << " : " << strerror(errno) << "!! No more will be written to it" << endl;
+        failedfiles.insert(s->filename);
+        break;
+      }
+      data += n;
+      remaining -= n;
+    }
+  }
+
+  numwritten++;
+  if(syncinterval > 0 && numwritten % syncinterval == 0)
+  {
+    for(std::map<std::string, int>::const_iterator f=openfiles.begin(); f!=openfiles.end(); f++)
+    {
+      if(fdatasync(f->second) != 0)
+        csevere << startl << "Error trying to sync " << f->first << " : " << strerror(errno) << "!!" << endl;
+    }
+  }
+}
+
+int VisWriter::getFile(const std::string & filename)
+{
+  std::map<std::string, int>::const_iterator f;
+  int fd;
+
+  f = openfiles.find(filename);
+  if(f != openfiles.end())
+    return f->second;
+
+  if((int)openfiles.size() >= MAX_OPEN_FILES)
+    closeFiles();
+  fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if(fd < 0)
+  {
+    csevere << startl << "Error trying to open " << filename << " for writing : " << strerror(errno) << "!! No more will be written to it" << endl;
+    return -1;
+  }
+  openfiles[filename] = fd;
+
+  return fd;
+}
+
+void VisWriter::closeFiles()
+{
+  for(std::map<std::string, int>::const_iterator f=openfiles.begin(); f!=openfiles.end(); f++)
+  {
+    if(syncinterval > 0 && fdatasync(f->second) != 0)
+      csevere << startl << "Error trying to sync " << f->first << " : " << strerror(errno) << "!!" << endl;
+    close(f->second);
+  }
+  openfiles.clear();
+}
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -0,0 +1,120 @@
+/** \file viswriter.h
+ *  \brief Appends formatted visibility output to disk from a thread of its own
+ *
+ * The FxManager write thread formats each integration (record headers, visibilities, index and
+ * pulse cal lines) into one of a small pool of page-aligned blocks and queues it here; a dedicated
+ * I/O thread then appends each file's part of the block with a single write() while the next
+ * integration is being formatted into another block.  A slow or stalled filesystem therefore only
+ * holds up the formatting once every block is queued, and getNumQueued() shows how close that is.
+ * Files are kept open between integrations, and can be fdatasync()ed every so many integrations.
+ */
+
+#ifndef VISWRITER_H
+#define VISWRITER_H
+
+#include <pthread.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+@class VisWriter
+@brief Queue of formatted integrations and the thread that writes them out
+*/
+class VisWriter{
+public:
+ /**
+  * Allocates the blocks and starts the I/O thread
+  * @param numblocks The number of integrations that can be formatted or queued at once (2 for double buffering)
+  * @param blockbytes The size of each block
+  * @param syncinterval fdatasync() the files written every this many integrations (0 to leave it to the OS)
+  */
+  VisWriter(int numblocks, long long blockbytes, int syncinterval);
+
+  ///Writes out anything still queued, then stops the I/O thread and closes the files
+  ~VisWriter();
+
+ /**
+  * Takes a free block to format the next integration into, waiting for the I/O thread if none is free
+  * @return The block, of getBlockBytes() bytes
+  */
+  char * getBlock();
+
+ /**
+  * Arranges for part of the current block to be appended to a file when the block is written
+  * @param filename The file to append to (created if necessary)
+  * @param offset The offset of the data within the block
+  * @param bytes The number of bytes
+  * @param datafilename If given, the data is dropped once a write to this file has failed, so that e.g. an index
+  *                     never refers to records missing from its data file
+  * @return The offset in the file at which the data will land
+  */
+  long long append(const char * filename, long long offset, long long bytes, const char * datafilename = 0);
+
+ /**
+  * As append(), for data held outside the block, which is copied
+  */
+  long long appendCopy(const char * filename, const char * data, long long bytes, const char * datafilename = 0);
+
+  ///Queues the current block for writing; it must not be touched again
+  void submitBlock();
+
+  ///Waits until everything queued has been written
+  void drain();
+
+  ///@return The number of integrations formatted and waiting to be (or being) written
+  int getNumQueued();
+
+  ///@return False if the blocks could not all be allocated or the I/O thread started
+  inline bool initialisedOK() const { return initialisedok; }
+
+  ///@return The number of blocks
+  inline int getNumBlocks() const { return numblocks; }
+
+  ///@return The size of each block in bytes
+  inline long long getBlockBytes() const { return blockbytes; }
+
+  ///Alignment of the blocks
+  static const size_t BLOCK_ALIGNMENT = 4096;
+
+  ///Files kept open at most; beyond this they are all closed and reopened as needed
+  static const int MAX_OPEN_FILES = 256;
+
+private:
+  struct Segment
+  {
+    std::string filename;
+    std::string datafilename; //skip this segment if writing to that file has failed (empty for none)
+    bool copied;              //data in the block's copy area rather than the block itself
+    long long offset, bytes;
+  };
+
+  struct Block
+  {
+    char * data;
+    std::string copies;
+    std::vector<Segment> segments;
+  };
+
+  static void * launchWriteThread(void * writer);
+  void writeLoop();
+  void writeBlock(Block * block);
+  int getFile(const std::string & filename);
+  void closeFiles();
+
+  int numblocks, syncinterval, currentblock, numqueued, numwritten;
+  long long blockbytes;
+  bool stopping, initialisedok;
+  Block * blocks;
+  std::vector<int> freeblocks, queuedblocks;
+  std::map<std::string, long long> filelengths;   //used by the formatting thread only
+  std::map<std::string, int> openfiles;           //used by the I/O thread only
+  std::set<std::string> failedfiles;              //files no longer written after an error, used by the I/O thread only
+  pthread_t writethread;
+  pthread_mutex_t lock;
+  pthread_cond_t blockqueued, blockwritten;
+};
+
+#endif
+// vim: shiftwidth=2:softtabstop=2:expandtab
@@ -0,0 +1,191 @@
+// Benchmark of the corner turners used by VDIFMuxer to interleave multi-thread VDIF.
+// For each supported thread count and sample size the sample-at-a-time reference
+// (cornerTurnGeneric) is timed along with the swap network at every SIMD level
+// supported by this CPU and, where vdifio has one, the vdifio corner turner for the
+// same case.  Every result is compared word for word with the reference and the
+// program exits with a non-zero status if any differ.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include <vdifio.h>
+#include "architecture.h"
+#include "vdifcornerturn.h"
+
+static const int MAX_THREADS = 32;
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+// The implementations compared; level >= 0 is a swap network kernel, -1 the reference, -2 vdifio
+typedef struct
+{
+  int level;
+  CornerTurnKernel kernel;
+  void (*vdifioturner)(unsigned char *, const unsigned char * const *, int);
+} Impl;
+
+static void run(const Impl *impl, u8 *output, const u8 * const *threads, int wordsperthread, const CornerTurnPlan *plan)
+{
+  if(impl->level == -1)
+  {
+    cornerTurnGeneric(output, threads, wordsperthread, plan->numthreads, plan->bitspersample);
+  }
+  else if(impl->level == -2)
+  {
+    impl->vdifioturner(output, threads, 4*wordsperthread*plan->numthreads);
+  }
+  else
+  {
+    impl->kernel(output, threads, wordsperthread, plan);
+  }
+}
+
+static long long countwrong(const u8 *a, const u8 *b, int words)
+{
+  long long n = 0;
+
+  for(int i = 0; i < words; ++i)
+  {
+    if(memcmp(a + 4*i, b + 4*i, 4) != 0)
+    {
+      ++n;
+    }
+  }
+
+  return n;
+}
+
+int main(int argc, char **argv)
+{
+  int framebytes = 8000;
+  double seconds = 0.2;
+  int maxlevel = simdDetectLevel();
+  const int bits[] = { 1, 2, 4, 8, 16 };
+  u8 *threaddata[MAX_THREADS];
+  u8 *output, *reference;
+  long long totalwrong = 0;
+
+  if(argc > 1)
+  {
+    if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+    {
+      printf("Usage: %s [<payload bytes> [<seconds per test>]]\n", argv[0]);
+      printf("  payload bytes : VDIF payload size of each input thread (default %d)\n", framebytes);
+      printf("  seconds       : time to spend on each case/implementation (default %.1f)\n", seconds);
+
+      return EXIT_SUCCESS;
+    }
+    framebytes = atoi(argv[1]);
+  }
+  if(argc > 2)
+  {
+    seconds = atof(argv[2]);
+  }
+  if(framebytes < 4 || framebytes % 4 != 0 || seconds <= 0.0)
+  {
+    fprintf(stderr, "Error: payload bytes must be a positive multiple of 4\n");
+
+    return EXIT_FAILURE;
+  }
+
+  const int wordsperthread = framebytes/4;
+  srand(1);
+  for(int t = 0; t < MAX_THREADS; ++t)
+  {
+    threaddata[t] = (u8 *)malloc(framebytes);
+    for(int i = 0; i < framebytes; ++i)
+    {
+      threaddata[t][i] = rand() & 0xFF;
+    }
+  }
+  output = (u8 *)malloc(framebytes*MAX_THREADS);
+  reference = (u8 *)malloc(framebytes*MAX_THREADS);
+
+  printf("%d byte payloads per thread; CPU supports up to %s; VDIFMuxer uses %s\n", framebytes, simdLevelName(maxlevel), simdLevelName(simdGetLevel()));
+  printf("%-7s %-4s %-9s %10s %9s %10s\n", "Threads", "Bits", "Impl", "Mbps", "Speedup", "Wrong");
+
+  for(unsigned int bi = 0; bi < sizeof(bits)/sizeof(bits[0]); ++bi)
+  {
+    for(int nt = 2; nt*bits[bi] <= 32; nt *= 2)
+    {
+      CornerTurnPlan plan;
+      Impl impls[SIMD_NUMLEVELS + 2];
+      int nimpl = 0;
+      double referencerate = 0.0;
+
+      if(!cornerTurnMakePlan(&plan, nt, bits[bi]))
+      {
+        continue;
+      }
+      impls[nimpl].level = -1;
+      ++nimpl;
+      for(int level = SIMD_GENERIC; level <= maxlevel; ++level)
+      {
+        impls[nimpl].level = level;
+        impls[nimpl].kernel = cornerTurnGetKernel(level);
+        ++nimpl;
+      }
+      impls[nimpl].vdifioturner = getCornerTurner(nt, bits[bi]);
+      if(impls[nimpl].vdifioturner)
+      {
+        impls[nimpl].level = -2;
+        ++nimpl;
+      }
+
+      run(&impls[0], reference, (const u8 * const *)threaddata, wordsperthread, &plan);
+      for(int k = 0; k < nimpl; ++k)
+      {
+        const char *name = (impls[k].level == -1) ? "reference" : (impls[k].level == -2) ? "vdifio" : simdLevelName(impls[k].level);
+        long long calls = 0, wrong;
+        double t0, t, rate;
+
+        memset(output, 0, framebytes*nt);
+        run(&impls[k], output, (const u8 * const *)threaddata, wordsperthread, &plan);
+        wrong = countwrong(output, reference, wordsperthread*nt);
+        totalwrong += wrong;
+
+        t0 = now();
+        do
+        {
+          for(int i = 0; i < 20; ++i)
+          {
+            run(&impls[k], output, (const u8 * const *)threaddata, wordsperthread, &plan);
+          }
+          calls += 20;
+          t = now() - t0;
+        } while(t < seconds);
+
+        rate = 8.0e-6*calls*framebytes*nt/t;
+        if(k == 0)
+        {
+          referencerate = rate;
+        }
+        printf("%-7d %-4d %-9s %10.0f %8.2fx %10lld\n", nt, bits[bi], name, rate, rate/referencerate, wrong);
+      }
+    }
+  }
+
+  for(int t = 0; t < MAX_THREADS; ++t)
+  {
+    free(threaddata[t]);
+  }
+  free(output);
+  free(reference);
+
+  if(totalwrong > 0)
+  {
+    printf("Error: %lld output words differ from the reference\n", totalwrong);
+
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,520 @@
+// Streaming transient search on the filterbank rings written by mpifxcorr Cores.
+// Run mpifxcorr with DIFX_FILTERBANK_RING=/dev/shm/<name> and each Core writes
+// the band-averaged autocorrelation spectrum of every datastream and band, at the
+// autocorrelation averaging time, to the ring /dev/shm/<name>.<core index>.  This
+// program follows any number of those rings, puts the records back in time order
+// (allowing them a reorder window, since the Cores work on different stretches of
+// time at once), averages the polarisations and datastreams into one spectrum per
+// time sample with the channels in frequency order, normalises each channel by its
+// running mean and rms, and dedisperses the result over a range of trial DMs with
+// StreamDedisperser.  The brightest boxcar-filtered candidate in each block of
+// output above the S/N threshold is printed.  The latency is the reorder window
+// plus the dispersion delay across the band at the highest DM plus one block.
+//
+// usage: dedisperse_stream [options] <ring file> [<ring file> ...]
+//   -d min,max,step   trial DMs (pc/cm^3) [0,100,1]
+//   -s subbands       number of subbands [16]
+//   -g dms            trial DMs that share the dedispersion within subbands [1]
+//   -b samples        output block length [1024]
+//   -n snr            S/N threshold for reporting a candidate [7]
+//   -w samples        widest boxcar tried (powers of 2 up to this) [16]
+//   -r seconds        reorder window [2]
+//   -x datastream     use only this datastream [all]
+//   -t seconds        flush and exit after this long with no new records [never]
+//   -a                start from the oldest records still in the rings, not the newest
+//   -v                report progress every block
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/time.h>
+#include "architecture.h"
+#include "filterbankring.h"
+#include "dedisperser.h"
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+static volatile sig_atomic_t keeprunning = 1;
+
+static void stop(int signum)
+{
+  keeprunning = 0;
+}
+
+static const int WARMUP_SAMPLES = 64;        // channel statistics are cumulative until this many samples are in
+static const int NORMALISE_SAMPLES = 1024;   // and then decay with this time constant
+static const int POLL_MICROSECONDS = 2000;
+
+typedef std::vector<char> RawRecord;
+
+// A distinct band: the same sky frequencies from different datastreams or polarisations share one
+struct Band
+{
+  double freq, bandwidth;
+  int lowersideband, numchannels;
+  std::vector<int> channelindex;   // where each of its channels sits in the merged spectrum
+
+  bool matches(const FilterbankRecord * r) const
+  {
+    return fabs(r->freq - freq) < 1.0e-6 && fabs(r->bandwidth - bandwidth) < 1.0e-6 && r->lowersideband == lowersideband && r->numchannels == numchannels;
+  }
+  double channelFreq(int c) const
+  {
+    return lowersideband ? freq - (c+0.5)*bandwidth/numchannels : freq + (c+0.5)*bandwidth/numchannels;
+  }
+};
+
+struct Options
+{
+  double dmmin, dmmax, dmstep, snr, window, idle;
+  int numsubbands, dmspergroup, blocklength, maxwidth, datastream;
+  bool fromstart, verbose;
+};
+
+class Search
+{
+public:
+  Search(const Options & o) : opts(o), dedisperser(0), started(false), t0(0.0), tsamp(0.0), newestsample(0), nextsample(0), basesample(0), numsamples(0),
+                              numrecords(0), numlate(0), numunmatched(0), numempty(0), numcandidates(0) {}
+  ~Search() { delete dedisperser; }
+
+  void addRecord(const FilterbankRecord * r)
+  {
+    RawRecord raw((const char *)r, (const char *)(r->data + r->numchannels));
+    double t = r->mjd*86400.0 + r->seconds;
+
+    numrecords++;
+    if(!started)
+    {
+      //collect a reorder window's worth of records to learn the bands and the sample time from
+      learning.push_back(raw);
+      learnmin = learning.size() == 1 || t < learnmin ? t : learnmin;
+      learnmax = learning.size() == 1 || t > learnmax ? t : learnmax;
+      if(learnmax - learnmin >= opts.window)
+        start();
+      return;
+    }
+    queue(raw);
+  }
+
+  // Outputs every sample more than the reorder window older than the newest (or all of them)
+  void release(bool all)
+  {
+    if(!started)
+    {
+      if(!all || learning.empty())
+        return;
+      start();
+    }
+    while(!pending.empty() && (all || pending.begin()->first < newestsample - windowsamples))
+    {
+      long long s = pending.begin()->first;
+      if(s - nextsample > maxgap)
+      {
+        printf("Gap of %lld samples; restarting the dedispersion\n", s - nextsample);
+        restart(s);
+      }
+      while(nextsample < s)
+        emit(0);
+      emit(&(pending.begin()->second));
+      pending.erase(pending.begin());
+    }
+  }
+
+  void summary() const
+  {
+    printf("%lld records in %lld samples of %.3f ms: %lld arrived too late, %lld were of unknown bands, %lld had no data; %lld candidates\n",
+           numrecords, numsamples, tsamp*1000.0, numlate, numunmatched, numempty, numcandidates);
+  }
+
+private:
+  void start()
+  {
+    std::vector<std::pair<double, int> > order;   // (frequency, channel) over all bands
+    std::vector<double> freqs;
+    std::vector<f64> dms;
+    int total = 0, numdms;
+
+    started = true;
+    tsamp = 0.0;
+    for(size_t i=0;i<learning.size();i++)
+    {
+      const FilterbankRecord * r = (const FilterbankRecord *)&(learning[i][0]);
+      if(r->width > tsamp)
+        tsamp = r->width;
+    }
+    t0 = learnmax;
+    for(size_t i=0;i<learning.size();i++)
+    {
+      const FilterbankRecord * r = (const FilterbankRecord *)&(learning[i][0]);
+      if(r->width > 0.9*tsamp && r->mjd*86400.0 + r->seconds < t0)
+        t0 = r->mjd*86400.0 + r->seconds;
+      if(r->numchannels == 0)
+        continue;
+      bool known = false;
+      for(size_t b=0;b<bands.size();b++)
+        known = known || bands[b].matches(r);
+      if(!known)
+      {
+        Band band;
+        band.freq = r->freq;
+        band.bandwidth = r->bandwidth;
+        band.lowersideband = r->lowersideband;
+        band.numchannels = r->numchannels;
+        bands.push_back(band);
+      }
+    }
+    if(bands.empty() || tsamp <= 0.0)
+    {
+      printf("No usable filterbank records seen yet; waiting for more\n");
+      started = false;
+      return;
+    }
+
+    //merge the channels of all bands, highest frequency first
+    for(size_t b=0;b<bands.size();b++)
+    {
+      bands[b].channelindex.resize(bands[b].numchannels);
+      for(int c=0;c<bands[b].numchannels;c++)
+        order.push_back(std::pair<double, int>(-bands[b].channelFreq(c), total++));
+    }
+    std::sort(order.begin(), order.end());
+    numchannels = total;
+    freqs.resize(numchannels);
+    for(int i=0;i<numchannels;i++)
+    {
+      int c = order[i].second;
+      freqs[i] = -order[i].first;
+      for(size_t b=0;b<bands.size();b++)
+      {
+        if(c < bands[b].numchannels)
+        {
+          bands[b].channelindex[c] = i;
+          break;
+        }
+        c -= bands[b].numchannels;
+      }
+    }
+    printf("%d bands merged into %d channels from %.3f to %.3f MHz, %.3f ms samples\n", (int)bands.size(), numchannels, freqs[numchannels-1], freqs[0], tsamp*1000.0);
+
+    numdms = (int)floor((opts.dmmax - opts.dmmin)/opts.dmstep + 1.0e-6) + 1;
+    for(int d=0;d<numdms;d++)
+      dms.push_back(opts.dmmin + d*opts.dmstep);
+    trialdms = dms;
+    chanfreqs = freqs;
+    spectrum.resize(numchannels);
+    counts.resize(numchannels);
+    mean.assign(numchannels, 0.0);
+    var.assign(numchannels, 0.0);
+    windowsamples = (long long)ceil(opts.window/tsamp);
+
+    //map the learning records onto samples and queue them up
+    nextsample = newestsample = -(1LL << 62);
+    for(size_t i=0;i<learning.size();i++)
+      queue(learning[i]);
+    learning.clear();
+    restart(pending.empty() ? 0 : pending.begin()->first);
+  }
+
+  void restart(long long sample)
+  {
+    delete dedisperser;
+    dedisperser = new StreamDedisperser(numchannels, &chanfreqs[0], tsamp, (int)trialdms.size(), &trialdms[0], opts.numsubbands, opts.dmspergroup, opts.blocklength);
+    if(!dedisperser->initialisedOK())
+    {
+      fprintf(stderr, "Could not set up the dedispersion\n");
+      exit(EXIT_FAILURE);
+    }
+    printf("Dedispersing at %d DMs from %.2f to %.2f: delay across the band up to %d samples, latency %.2f s\n",
+           (int)trialdms.size(), trialdms.front(), trialdms.back(), dedisperser->getMaxDelay(), opts.window + (dedisperser->getMaxDelay() + opts.blocklength)*tsamp);
+    maxgap = dedisperser->getMaxDelay() + opts.blocklength;
+    nextsample = sample;
+    basesample = sample;
+    numnormalised = 0;
+  }
+
+  void queue(const RawRecord & raw)
+  {
+    const FilterbankRecord * r = (const FilterbankRecord *)&(raw[0]);
+    long long s = llround((r->mjd*86400.0 + r->seconds - t0)/tsamp);
+
+    if(s < nextsample)
+    {
+      numlate++;
+      return;
+    }
+    if(s > newestsample)
+      newestsample = s;
+    pending[s].push_back(raw);
+  }
+
+  // Averages the records for one sample into the merged spectrum, normalises and dedisperses it
+  void emit(const std::vector<RawRecord> * records)
+  {
+    double alpha;
+
+    std::fill(spectrum.begin(), spectrum.end(), 0.0f);
+    std::fill(counts.begin(), counts.end(), 0);
+    for(size_t i=0;records && i<records->size();i++)
+    {
+      const FilterbankRecord * r = (const FilterbankRecord *)&((*records)[i][0]);
+      size_t b;
+      if(r->numchannels == 0)
+      {
+        numempty++;
+        continue;
+      }
+      for(b=0;b<bands.size();b++)
+      {
+        if(bands[b].matches(r))
+          break;
+      }
+      if(b == bands.size())
+      {
+        numunmatched++;
+        continue;
+      }
+      for(int c=0;c<r->numchannels;c++)
+      {
+        spectrum[bands[b].channelindex[c]] += r->data[c];
+        counts[bands[b].channelindex[c]]++;
+      }
+    }
+
+    //missing channels come out as zero; the rest are normalised by their running statistics, which they then update
+    alpha = numnormalised < WARMUP_SAMPLES ? 1.0/(numnormalised + 1) : 1.0/NORMALISE_SAMPLES;
+    for(int c=0;c<numchannels;c++)
+    {
+      if(counts[c] == 0)
+        continue;
+      double x = spectrum[c]/counts[c];
+      double delta = x - mean[c];
+      spectrum[c] = var[c] > 0.0 ? delta/sqrt(var[c]) : 0.0;
+      mean[c] += alpha*delta;
+      var[c] = numnormalised == 0 ? 0.0 : (1.0 - alpha)*(var[c] + alpha*delta*delta);
+    }
+    if(records)
+      numnormalised++;
+    numsamples++;
+    nextsample++;
+
+    if(dedisperser->addSpectrum(&spectrum[0]))
+      search();
+  }
+
+  // Boxcar-filters each DM's block of output and reports the brightest candidate, if bright enough
+  void search()
+  {
+    long long outputstart = dedisperser->getOutputStart();
+    int blocklength = dedisperser->getBlockLength();
+    int first = 0;
+    double bestsnr = 0.0, bestdm = 0.0;
+    long long bestsample = 0;
+    int bestwidth = 0;
+    std::vector<double> cumulative(blocklength + 1);
+
+    //skip output built from incomplete sums or unsettled channel statistics
+    if(outputstart + blocklength <= WARMUP_SAMPLES)
+      return;
+    if(outputstart < WARMUP_SAMPLES)
+      first = (int)(WARMUP_SAMPLES - outputstart);
+    for(int d=0;d<dedisperser->getNumDMs();d++)
+    {
+      const f32 * series = dedisperser->getDedispersed(d);
+      double sum = 0.0, sumsq = 0.0, mu, rms;
+      int n = blocklength - first;
+
+      cumulative[first] = 0.0;
+      for(int i=first;i<blocklength;i++)
+      {
+        sum += series[i];
+        sumsq += series[i]*series[i];
+        cumulative[i+1] = sum;
+      }
+      mu = sum/n;
+      rms = sqrt(sumsq/n - mu*mu);
+      if(rms <= 0.0)
+        continue;
+      for(int w=1;w<=opts.maxwidth && w<=n;w*=2)
+      {
+        for(int i=first;i+w<=blocklength;i++)
+        {
+          double snr = (cumulative[i+w] - cumulative[i] - w*mu)/(rms*sqrt((double)w));
+          if(snr > bestsnr)
+          {
+            bestsnr = snr;
+            bestdm = trialdms[d];
+            bestsample = outputstart + i;
+            bestwidth = w;
+          }
+        }
+      }
+    }
+    if(opts.verbose)
+      printf("Block to MJD %.9f searched; %lld samples pending\n", (t0 + (basesample + outputstart + blocklength)*tsamp)/86400.0, (long long)pending.size());
+    if(bestsnr >= opts.snr)
+    {
+      numcandidates++;
+      printf("Candidate at MJD %.9f DM %.2f width %d samples (%.3f ms) S/N %.1f\n", (t0 + (basesample + bestsample + 0.5*(bestwidth-1))*tsamp)/86400.0, bestdm, bestwidth, bestwidth*tsamp*1000.0, bestsnr);
+      fflush(stdout);
+    }
+  }
+
+  Options opts;
+  StreamDedisperser * dedisperser;
+  bool started;
+  std::vector<RawRecord> learning;
+  double learnmin, learnmax;
+  double t0, tsamp;                // the time of sample 0 (s since MJD 0) and the sample time
+  std::vector<Band> bands;
+  int numchannels;
+  std::vector<double> chanfreqs;
+  std::vector<f64> trialdms;
+  std::vector<f32> spectrum;
+  std::vector<int> counts;
+  std::vector<double> mean, var;
+  long long numnormalised;
+  std::map<long long, std::vector<RawRecord> > pending;
+  long long newestsample, nextsample, basesample, windowsamples, maxgap, numsamples;
+  long long numrecords, numlate, numunmatched, numempty, numcandidates;
+};
+
+static void usage(const char * program)
+{
+  fprintf(stderr, "usage: %s [-d min,max,step] [-s subbands] [-g dmspergroup] [-b blocklength] [-n snr] [-w maxwidth] [-r window] [-x datastream] [-t idle] [-a] [-v] <ring file> [<ring file> ...]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+  Options opts;
+  std::vector<FilterbankRing *> rings;
+  std::vector<long long> next;
+  std::vector<char> buffer;
+  FilterbankRecord * record;
+  long long numlost = 0;
+  double lastrecord;
+  int opt;
+
+  opts.dmmin = 0.0;
+  opts.dmmax = 100.0;
+  opts.dmstep = 1.0;
+  opts.numsubbands = 16;
+  opts.dmspergroup = 1;
+  opts.blocklength = 1024;
+  opts.snr = 7.0;
+  opts.maxwidth = 16;
+  opts.window = 2.0;
+  opts.datastream = -1;
+  opts.idle = 0.0;
+  opts.fromstart = false;
+  opts.verbose = false;
+  while((opt = getopt(argc, argv, "d:s:g:b:n:w:r:x:t:av")) != -1)
+  {
+    switch(opt)
+    {
+      case 'd':
+        if(sscanf(optarg, "%lf,%lf,%lf", &opts.dmmin, &opts.dmmax, &opts.dmstep) != 3 || opts.dmstep <= 0.0 || opts.dmmax < opts.dmmin)
+        {
+          fprintf(stderr, "Bad DM range %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 's': opts.numsubbands = atoi(optarg); break;
+      case 'g': opts.dmspergroup = atoi(optarg); break;
+      case 'b': opts.blocklength = atoi(optarg); break;
+      case 'n': opts.snr = atof(optarg); break;
+      case 'w': opts.maxwidth = atoi(optarg); break;
+      case 'r': opts.window = atof(optarg); break;
+      case 'x': opts.datastream = atoi(optarg); break;
+      case 't': opts.idle = atof(optarg); break;
+      case 'a': opts.fromstart = true; break;
+      case 'v': opts.verbose = true; break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if(optind >= argc)
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for(int i=optind;i<argc;i++)
+  {
+    FilterbankRing * ring = new FilterbankRing(argv[i]);
+    if(!ring->initialisedOK())
+      return EXIT_FAILURE;
+    rings.push_back(ring);
+    next.push_back(opts.fromstart ? std::max(0LL, ring->getNumClaimed() - ring->getNumSlots()) : ring->getNumClaimed());
+    if((int)buffer.size() < ring->getRecordBytes())
+      buffer.resize(ring->getRecordBytes());
+  }
+  record = (FilterbankRecord *)&(buffer[0]);
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  Search search(opts);
+  lastrecord = now();
+  while(keeprunning)
+  {
+    bool gotone = false;
+    for(size_t i=0;i<rings.size();i++)
+    {
+      long long claimed = rings[i]->getNumClaimed();
+      if(claimed - next[i] > rings[i]->getNumSlots())
+      {
+        numlost += claimed - rings[i]->getNumSlots() - next[i];
+        next[i] = claimed - rings[i]->getNumSlots();
+      }
+      while(next[i] < claimed)
+      {
+        int status = rings[i]->read(next[i], record);
+        if(status == FilterbankRing::READ_PENDING && claimed - next[i] < rings[i]->getNumSlots()/2)
+          break;   //still being written; later records wait for it
+        if(status == FilterbankRing::READ_OK)
+        {
+          if(opts.datastream < 0 || record->datastream == opts.datastream)
+            search.addRecord(record);
+          gotone = true;
+        }
+        else
+          numlost++;
+        next[i]++;
+      }
+    }
+    if(gotone)
+    {
+      search.release(false);
+      lastrecord = now();
+    }
+    else
+    {
+      if(opts.idle > 0.0 && now() - lastrecord > opts.idle)
+        break;
+      usleep(POLL_MICROSECONDS);
+    }
+  }
+  search.release(true);
+  search.summary();
+  if(numlost > 0)
+    printf("%lld records were overwritten before they could be read\n", numlost);
+
+  for(size_t i=0;i<rings.size();i++)
+    delete rings[i];
+
+  return EXIT_SUCCESS;
+}
@@ -7,6 +7,22 @@
 #define UNIT_INT 0
 #define UNIT_SEC 1
 
+/* Transports, as selected for mpifxcorr with DIFX_DATA_TRANSPORT (plus the plain blocking send) */
+#define MODE_SSEND      0
+#define MODE_ISSEND     1
+#define MODE_PERSISTENT 2
+#define MODE_PUT        3
+
+/* Number of blocks in flight for the non-blocking transports, as in the Core receive ring */
+#define NUM_SLOTS 4
+
+static const char modeNames[][12] = { "ssend", "issend", "persistent", "put" };
+
+static int done(int i, int n, int nunit, double t0, int v)
+{
+	return ((nunit == UNIT_INT) && (i >= n)) || ((nunit == UNIT_SEC) && ((MPI_Wtime()-t0) >= n)) || (v != MPI_SUCCESS);
+}
+
 void senddata(int rank, int n, int nunit, int s, char *buffer, MPI_Comm comm)
 {
 	int i = 0, v;
@@ -48,6 +64,194 @@ void recvdata(int rank, int n, int nunit, int s, char *buffer, MPI_Comm comm)
 	}
 }
 
+/* Sender side of the non-blocking transports: up to NUM_SLOTS blocks in flight, each slot reused only once its send
+ * has completed (or, for put, once the receiver has handed the slot back).  As in the datastreams, persistent sends
+ * are created once per slot, and puts are flushed (and their control messages sent) only when the sender would
+ * otherwise have to wait.  Returns the number of blocks sent. */
+int sendring(int rank, int n, int nunit, int s, char *buffer, int mode, MPI_Win win, MPI_Comm comm)
+{
+	MPI_Request datareq[NUM_SLOTS], ctrlreq[NUM_SLOTS], creditreq;
+	int ctrl[NUM_SLOTS], credit, flag;
+	int i = 0, v = MPI_SUCCESS, slot, unflushed = 0;
+	double t0 = MPI_Wtime();
+
+	for(slot = 0; slot < NUM_SLOTS; slot++)
+	{
+		datareq[slot] = MPI_REQUEST_NULL;
+		ctrlreq[slot] = MPI_REQUEST_NULL;
+		if(mode == MODE_PERSISTENT)
+		{
+			MPI_Send_init(buffer + (size_t)slot*s, s, MPI_CHAR, rank+1, 0, comm, &datareq[slot]);
+		}
+	}
+	while(!done(i, n, nunit, t0, v))
+	{
+		slot = i % NUM_SLOTS;
+		MPI_Wait(&datareq[slot], MPI_STATUS_IGNORE);
+		MPI_Wait(&ctrlreq[slot], MPI_STATUS_IGNORE);
+		switch(mode)
+		{
+		case MODE_ISSEND:
+			v = MPI_Issend(buffer + (size_t)slot*s, s, MPI_CHAR, rank+1, 0, comm, &datareq[slot]);
+			break;
+		case MODE_PERSISTENT:
+			v = MPI_Start(&datareq[slot]);
+			break;
+		case MODE_PUT:
+			if(i >= NUM_SLOTS)
+			{
+				/* wait for the receiver to hand back the slot, flushing first if it may be waiting on us */
+				MPI_Iprobe(rank+1, 2, comm, &flag, MPI_STATUS_IGNORE);
+				if(!flag && unflushed > 0)
+				{
+					MPI_Win_flush(rank+1, win);
+					for(; unflushed > 0; unflushed--)
+					{
+						MPI_Isend(&ctrl[(i-unflushed)%NUM_SLOTS], 1, MPI_INT, rank+1, 1, comm, &ctrlreq[(i-unflushed)%NUM_SLOTS]);
+					}
+				}
+				MPI_Recv(&credit, 1, MPI_INT, rank+1, 2, comm, MPI_STATUS_IGNORE);
+				MPI_Wait(&ctrlreq[slot], MPI_STATUS_IGNORE);
+			}
+			v = MPI_Put(buffer + (size_t)slot*s, s, MPI_CHAR, rank+1, (MPI_Aint)slot*s, s, MPI_CHAR, win);
+			unflushed++;
+			break;
+		}
+		ctrl[slot] = i;
+		if(mode != MODE_PUT)
+		{
+			MPI_Isend(&ctrl[slot], 1, MPI_INT, rank+1, 1, comm, &ctrlreq[slot]);
+		}
+		i++;
+	}
+	if(unflushed > 0)
+	{
+		MPI_Win_flush(rank+1, win);
+		for(; unflushed > 0; unflushed--)
+		{
+			MPI_Isend(&ctrl[(i-unflushed)%NUM_SLOTS], 1, MPI_INT, rank+1, 1, comm, &ctrlreq[(i-unflushed)%NUM_SLOTS]);
+		}
+	}
+	for(slot = 0; slot < NUM_SLOTS; slot++)
+	{
+		MPI_Wait(&datareq[slot], MPI_STATUS_IGNORE);
+		MPI_Wait(&ctrlreq[slot], MPI_STATUS_IGNORE);
+		if(mode == MODE_PERSISTENT)
+		{
+			MPI_Request_free(&datareq[slot]);
+		}
+	}
+	/* tell the receiver how many blocks were sent, and collect any credits it still sends */
+	MPI_Send(&i, 1, MPI_INT, rank+1, 3, comm);
+	if(mode == MODE_PUT)
+	{
+		for(;;)
+		{
+			MPI_Irecv(&credit, 1, MPI_INT, rank+1, 2, comm, &creditreq);
+			MPI_Wait(&creditreq, MPI_STATUS_IGNORE);
+			if(credit < 0)
+			{
+				break;
+			}
+		}
+	}
+
+	return i;
+}
+
+void recvring(int rank, int s, char *buffer, int mode, MPI_Win win, MPI_Comm comm)
+{
+	MPI_Request datareq[NUM_SLOTS], ctrlreq[NUM_SLOTS], stopreq, creditreq = MPI_REQUEST_NULL;
+	int ctrl[NUM_SLOTS], credit = 0, stop = 0, stopped = 0, flag, slot, i = 0;
+	size_t stotal = 0;
+	double t0 = MPI_Wtime();
+	double dt, t = t0;
+
+	for(slot = 0; slot < NUM_SLOTS; slot++)
+	{
+		datareq[slot] = MPI_REQUEST_NULL;
+		if(mode == MODE_PERSISTENT)
+		{
+			MPI_Recv_init(buffer + (size_t)slot*s, s, MPI_CHAR, rank-1, 0, comm, &datareq[slot]);
+			MPI_Start(&datareq[slot]);
+		}
+		else if(mode == MODE_ISSEND)
+		{
+			MPI_Irecv(buffer + (size_t)slot*s, s, MPI_CHAR, rank-1, 0, comm, &datareq[slot]);
+		}
+		MPI_Irecv(&ctrl[slot], 1, MPI_INT, rank-1, 1, comm, &ctrlreq[slot]);
+	}
+	MPI_Irecv(&stop, 1, MPI_INT, rank-1, 3, comm, &stopreq);
+	for(;;)
+	{
+		slot = i % NUM_SLOTS;
+		/* the control message is the last thing sent for each block; the stop message carries the number of blocks */
+		flag = 0;
+		while(!flag)
+		{
+			MPI_Test(&ctrlreq[slot], &flag, MPI_STATUS_IGNORE);
+			if(!flag && !stopped)
+			{
+				MPI_Test(&stopreq, &stopped, MPI_STATUS_IGNORE);
+			}
+			if(!flag && stopped && i >= stop)
+			{
+				break;
+			}
+		}
+		if(!flag)
+		{
+			break;
+		}
+		MPI_Wait(&datareq[slot], MPI_STATUS_IGNORE);
+		if(mode == MODE_PUT)
+		{
+			MPI_Win_sync(win);
+		}
+		dt = MPI_Wtime() - t;
+		t  = MPI_Wtime();
+		stotal += s;
+		printf("[%d] Recvd %d (%s) : %.2f Mbps curr : %.2f Mbps mean\n", rank, i, modeNames[mode], 8e-6*s/dt, 8e-6*stotal/(t-t0));
+		i++;
+		/* hand the slot back */
+		if(mode == MODE_PERSISTENT)
+		{
+			MPI_Start(&datareq[slot]);
+		}
+		else if(mode == MODE_ISSEND)
+		{
+			MPI_Irecv(buffer + (size_t)slot*s, s, MPI_CHAR, rank-1, 0, comm, &datareq[slot]);
+		}
+		else
+		{
+			MPI_Wait(&creditreq, MPI_STATUS_IGNORE);
+			credit = i;
+			MPI_Isend(&credit, 1, MPI_INT, rank-1, 2, comm, &creditreq);
+		}
+		MPI_Irecv(&ctrl[slot], 1, MPI_INT, rank-1, 1, comm, &ctrlreq[slot]);
+	}
+	for(slot = 0; slot < NUM_SLOTS; slot++)
+	{
+		MPI_Cancel(&ctrlreq[slot]);
+		MPI_Wait(&ctrlreq[slot], MPI_STATUS_IGNORE);
+		if(datareq[slot] != MPI_REQUEST_NULL)
+		{
+			MPI_Cancel(&datareq[slot]);
+			MPI_Wait(&datareq[slot], MPI_STATUS_IGNORE);
+		}
+		if(mode == MODE_PERSISTENT)
+		{
+			MPI_Request_free(&datareq[slot]);
+		}
+	}
+	if(mode == MODE_PUT)
+	{
+		MPI_Wait(&creditreq, MPI_STATUS_IGNORE);
+		credit = -1;
+		MPI_Send(&credit, 1, MPI_INT, rank-1, 2, comm);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	MPI_Comm world, return_comm;
@@ -57,8 +261,12 @@ int main(int argc, char **argv)
 	long long BufferSize = 1<<26;
 	int NumSends = 256;
 	int NumSendsUnit = UNIT_INT;
+	int Mode = MODE_SSEND;
+	int NumSent;
+	MPI_Win win = MPI_WIN_NULL;
+	clock_t c0;
 	double t0;
-	double dt;
+	double dt, cpu;
 
 	MPI_Init(&argc, &argv);
 	world = MPI_COMM_WORLD;
@@ -74,10 +282,12 @@ int main(int argc, char **argv)
 	{
 		printf("Sorry, must run with even number of processes\n");
 		printf("This program should be invoked in a manner similar to:\n");
-		printf("mpirun -H host1,host2,...,hostN %s [<numSends>|<timeSend>s] [<sendSizeMByte>]\n", argv[0]);
+		printf("mpirun -H host1,host2,...,hostN %s [<numSends>|<timeSend>s] [<sendSizeMByte>] [<transport>]\n", argv[0]);
 		printf("  where\n"
-		       "    numSends : number of blocks to send (e.g., %d), or\n"
-		       "    timeSend : duration in seconds to send (e.g., 100s)\n", NumSends);
+		       "    numSends  : number of blocks to send (e.g., %d), or\n"
+		       "    timeSend  : duration in seconds to send (e.g., 100s)\n"
+		       "    transport : ssend (blocking, default), or as for DIFX_DATA_TRANSPORT in mpifxcorr:\n"
+		       "                issend, persistent or put (these keep %d blocks in flight)\n", NumSends, NUM_SLOTS);
 		MPI_Barrier(world);
 		MPI_Finalize();
 
@@ -96,37 +306,95 @@ int main(int argc, char **argv)
 	{
 		BufferSize = atoll(argv[2])*1048576;
 	}
+	if (argc > 3)
+	{
+		for(Mode = MODE_PUT; Mode > MODE_SSEND; Mode--)
+		{
+			if(strcmp(argv[3], modeNames[Mode]) == 0)
+			{
+				break;
+			}
+		}
+		if(Mode == MODE_SSEND && strcmp(argv[3], modeNames[MODE_SSEND]) != 0)
+		{
+			printf("Unknown transport %s; using %s\n", argv[3], modeNames[MODE_SSEND]);
+		}
+	}
 
-	printf("[%d] Starting\n", rank);
+	printf("[%d] Starting (%s)\n", rank, modeNames[Mode]);
 
-	buffer = (char *)malloc(BufferSize);
+	if(Mode == MODE_PUT)
+	{
+		/* the receivers expose their slots in a window, as the Cores do */
+		MPI_Win_allocate((rank % 2 == 0) ? 0 : NUM_SLOTS*BufferSize, 1, MPI_INFO_NULL, world, &buffer, &win);
+		MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+		if(rank % 2 == 0)
+		{
+			buffer = (char *)malloc(NUM_SLOTS*BufferSize);
+		}
+	}
+	else
+	{
+		buffer = (char *)malloc((Mode == MODE_SSEND) ? BufferSize : NUM_SLOTS*BufferSize);
+	}
 
 	MPI_Barrier(world);
 
 	t0 = MPI_Wtime();
+	c0 = clock();
+	NumSent = NumSends;
 
 	if(rank % 2 == 0)
 	{
-		senddata(rank, NumSends, NumSendsUnit, BufferSize, buffer, world);
+		if(Mode == MODE_SSEND)
+		{
+			senddata(rank, NumSends, NumSendsUnit, BufferSize, buffer, world);
+		}
+		else
+		{
+			NumSent = sendring(rank, NumSends, NumSendsUnit, BufferSize, buffer, Mode, win, world);
+		}
 	}
 	else
 	{
-		recvdata(rank, NumSends, NumSendsUnit, BufferSize, buffer, world);
+		if(Mode == MODE_SSEND)
+		{
+			recvdata(rank, NumSends, NumSendsUnit, BufferSize, buffer, world);
+		}
+		else
+		{
+			recvring(rank, BufferSize, buffer, Mode, win, world);
+		}
 	}
 
 	dt = MPI_Wtime() - t0;
+	cpu = (double)(clock() - c0)/CLOCKS_PER_SEC;
 
-	MPI_Finalize();
+	printf("[%d] %s CPU time %.2f s for %.1f s wallclock (%.0f%%)\n", rank, (rank % 2 == 0) ? "Sender" : "Receiver", cpu, dt, 100.0*cpu/dt);
 
-	free(buffer);
+	if(Mode == MODE_PUT)
+	{
+		MPI_Win_unlock_all(win);
+		if(rank % 2 == 0)
+		{
+			free(buffer);
+		}
+		MPI_Win_free(&win);
+	}
+	else
+	{
+		free(buffer);
+	}
+
+	MPI_Finalize();
 
 	printf("[%d] Done\n", rank);
 
 	if(rank == 0)
 	{
-		printf("Total memory transferred = %lld bytes in %.1f seconds\n", NumSends*BufferSize, dt);
+		printf("Total memory transferred = %lld bytes in %.1f seconds using %s\n", NumSent*BufferSize, dt, modeNames[Mode]);
 	
-		printf("Transfer rate was %f Mbps\n", NumSends*BufferSize*8.0/1000000.0/dt);
+		printf("Transfer rate was %f Mbps\n", NumSent*BufferSize*8.0/1000000.0/dt);
 	}
 
 	return EXIT_SUCCESS;
@@ -0,0 +1,173 @@
+// Micro-benchmark of shifting one baseline/band to many phase centres, as in
+// Core::uvshiftAndAverageBaselineFreq.  The old way builds a fine and a coarse
+// rotator for each centre from sin/cos of every phase, and then streams all the
+// polarisation products through two multiplies and an add, once per centre.
+// The new way (PhaseCentreRotator) builds each centre's rotator by phasor
+// recurrence, a stride at a time just before it is used, and shifts each product
+// with one fused multiply-accumulate straight into the results.  The time per
+// centre should stay nearly flat as the number of centres grows.  The results of
+// the two are compared.
+//
+// usage: phasecentrespeed [numchannels [numpolproducts [xmacstridelength [rotatestridelength]]]]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <sys/time.h>
+#include "architecture.h"
+#include "phasecentrerotator.h"
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+// The visibilities are laid out as in the thread results, [stride][polproduct][channel within stride],
+// and the output as in the Core results, [centre][polproduct][channel]
+
+// The old path: sin/cos rotators per centre, then rotate and add each product separately
+static void direct(const cf32 *vis, const double *delays, int numcentres, double lofrequency, double channelbandwidth, int numchannels, int numproducts, int xmaclen, int rotatelen, f64 *chanfreqs, f32 *argument, cf32 *rotator, cf32 *rotated, cf32 *results)
+{
+  int numstrides = numchannels/xmaclen, rotatesperstride = xmaclen/rotatelen;
+  int rotatorlength = rotatelen + numstrides*rotatesperstride;
+
+  for(int c=0;c<rotatelen;c++)
+    chanfreqs[c] = c*channelbandwidth;
+  for(int c=0;c<numstrides*rotatesperstride;c++)
+    chanfreqs[rotatelen+c] = c*rotatelen*channelbandwidth;
+  for(int s=0;s<numcentres;s++)
+  {
+    double edgeturns = delays[s]*lofrequency, turns;
+    edgeturns -= floor(edgeturns);
+    for(int r=0;r<rotatorlength;r++)
+    {
+      turns = delays[s]*chanfreqs[r] + (r < rotatelen ? edgeturns : 0.0);
+      argument[r] = (turns-floor(turns))*TWO_PI;
+    }
+    vectorSinCos_f32(argument, &(argument[rotatorlength]), &(argument[2*rotatorlength]), rotatorlength);
+    vectorRealToComplex_f32(&(argument[2*rotatorlength]), &(argument[rotatorlength]), rotator, rotatorlength);
+    for(int x=0;x<numstrides;x++)
+    {
+      for(int k=0;k<numproducts;k++)
+      {
+        const cf32 *src = vis + (x*numproducts + k)*xmaclen;
+        for(int r=0;r<rotatesperstride;r++)
+        {
+          vectorMul_cf32(rotator, &(src[r*rotatelen]), &(rotated[r*rotatelen]), rotatelen);
+          vectorMulC_cf32_I(rotator[rotatelen+r+x*rotatesperstride], &(rotated[r*rotatelen]), rotatelen);
+        }
+        vectorAdd_cf32_I(rotated, results + (s*numproducts + k)*numchannels + x*xmaclen, xmaclen);
+      }
+    }
+  }
+}
+
+// The new path, as Core now does it
+static void batched(const cf32 *vis, const double *delays, int numcentres, double lofrequency, double channelbandwidth, int numchannels, int numproducts, int xmaclen, int rotatelen, PhaseCentreRotator *rotator, cf32 *results)
+{
+  int numstrides = numchannels/xmaclen;
+
+  rotator->setBand(lofrequency, 0.0, channelbandwidth, rotatelen);
+  for(int s=0;s<numcentres;s++)
+  {
+    rotator->setDelay(delays[s]);
+    for(int x=0;x<numstrides;x++)
+    {
+      rotator->generate(x*xmaclen, xmaclen);
+      for(int k=0;k<numproducts;k++)
+        vectorAddProduct_cf32(vis + (x*numproducts + k)*xmaclen, rotator->getRotator(), results + (s*numproducts + k)*numchannels + x*xmaclen, xmaclen);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const int centrecounts[] = { 1, 4, 16, 64, 256, 1024 };
+  const int numcounts = sizeof(centrecounts)/sizeof(centrecounts[0]);
+  const int maxcentres = centrecounts[numcounts-1];
+  int numchannels = argc > 1 ? atoi(argv[1]) : 4096;
+  int numproducts = argc > 2 ? atoi(argv[2]) : 4;
+  int xmaclen = argc > 3 ? atoi(argv[3]) : 128;
+  int rotatelen = argc > 4 ? atoi(argv[4]) : 32;
+  double lofrequency = 1650.0, channelbandwidth;
+  double *delays;
+  cf32 *vis, *rotator, *rotated, *results[2];
+  f64 *chanfreqs;
+  f32 *argument;
+  PhaseCentreRotator *phasecentrerotator;
+
+  if(numchannels < 1 || numproducts < 1 || xmaclen < 1 || rotatelen < 1 || numchannels%xmaclen != 0 || xmaclen%rotatelen != 0)
+  {
+    fprintf(stderr, "usage: %s [numchannels [numpolproducts [xmacstridelength [rotatestridelength]]]]\n", argv[0]);
+    fprintf(stderr, "the xmac stride must divide the channels, and the rotate stride the xmac stride\n");
+
+    return EXIT_FAILURE;
+  }
+  channelbandwidth = 64.0/numchannels;
+
+  vis = vectorAlloc_cf32(numchannels*numproducts);
+  rotator = vectorAlloc_cf32(rotatelen + numchannels/rotatelen);
+  rotated = vectorAlloc_cf32(xmaclen);
+  chanfreqs = vectorAlloc_f64(rotatelen + numchannels/rotatelen);
+  argument = vectorAlloc_f32(3*(rotatelen + numchannels/rotatelen));
+  delays = new double[maxcentres];
+  for(int i=0;i<2;i++)
+    results[i] = vectorAlloc_cf32((size_t)maxcentres*numproducts*numchannels);
+  phasecentrerotator = new PhaseCentreRotator(rotatelen, xmaclen);
+  srand(29);
+  for(int c=0;c<numchannels*numproducts;c++)
+  {
+    vis[c].re = (f32)rand()/RAND_MAX - 0.5f;
+    vis[c].im = (f32)rand()/RAND_MAX - 0.5f;
+  }
+  for(int s=0;s<maxcentres;s++)
+    delays[s] = ((f64)rand()/RAND_MAX - 0.5)*0.02;   // up to +-10 ns from the pointing centre
+
+  printf("%d channels, %d polarisation products, xmac stride %d, rotate stride %d\n\n", numchannels, numproducts, xmaclen, rotatelen);
+  printf("%8s %18s %18s %8s %12s\n", "centres", "direct(ns/centre)", "batched(ns/centre)", "speedup", "maxdiff");
+  for(int n=0;n<numcounts;n++)
+  {
+    int numcentres = centrecounts[n];
+    int repeats = 1 + 2048/numcentres;
+    double t[2], diff = 0.0;
+
+    for(int method=0;method<2;method++)
+    {
+      double t0;
+
+      vectorZero_cf32(results[method], (size_t)numcentres*numproducts*numchannels);
+      t0 = now();
+      for(int r=0;r<repeats;r++)
+      {
+        if(method == 0)
+          direct(vis, delays, numcentres, lofrequency, channelbandwidth, numchannels, numproducts, xmaclen, rotatelen, chanfreqs, argument, rotator, rotated, results[0]);
+        else
+          batched(vis, delays, numcentres, lofrequency, channelbandwidth, numchannels, numproducts, xmaclen, rotatelen, phasecentrerotator, results[1]);
+      }
+      t[method] = (now() - t0)/repeats;
+    }
+    for(size_t i=0;i<(size_t)numcentres*numproducts*numchannels;i++)
+    {
+      double d = (fabs(results[0][i].re - results[1][i].re) + fabs(results[0][i].im - results[1][i].im))/repeats;
+      if(d > diff)
+        diff = d;
+    }
+    printf("%8d %18.1f %18.1f %7.2fx %12.3g\n", numcentres, 1.0e9*t[0]/numcentres, 1.0e9*t[1]/numcentres, t[0]/t[1], diff);
+  }
+
+  vectorFree(vis);
+  vectorFree(rotator);
+  vectorFree(rotated);
+  vectorFree(chanfreqs);
+  vectorFree(argument);
+  for(int i=0;i<2;i++)
+    vectorFree(results[i]);
+  delete [] delays;
+  delete phasecentrerotator;
+
+  return EXIT_SUCCESS;
+}
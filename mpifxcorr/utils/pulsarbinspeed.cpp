@@ -0,0 +1,205 @@
+// Micro-benchmark of the pulsar binning cross-multiply in Core::processdata.
+// The channels of a band are put in bins as a dispersed pulse would (the pulse
+// phase sweeps across the band as 1/f^2), and one FFT's worth of products is
+// accumulated into the bins both the old way (multiply into scratch, then add
+// each channel into its bin) and by runs of channels (findBinSegments, then one
+// vectorAddProduct_cf32 per run), and as Core does it, choosing between the two
+// for each stride with useBinSegments.  Both the full binned case and a gated,
+// scrunched case (most bins with zero weight) are timed, and the results checked
+// against each other.
+//
+// usage: pulsarbinspeed [numchannels [numbins [stridelength [turns across band]]]]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sys/time.h>
+#include "architecture.h"
+#include "binsegments.h"
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+static const int NUMPATTERNS = 64;   // different sets of bins cycled through, so the pulse drifts
+
+// The accumulators are laid out as in Core: [stride][bin][channel within stride]
+
+// The old path for one stride: multiply into scratch, then add each channel into its bin
+static void scatterStride(const cf32 *vis1, const cf32 *vis2, const s32 *bins, const f32 *binweights, bool scrunch, int numchannels, int numbins, int stridelength, int x, bool skipgated, cf32 *scratch, cf32 *accum, f64 *weights)
+{
+  int xmacstart = x*stridelength;
+  int remain = numchannels - xmacstart < stridelength ? numchannels - xmacstart : stridelength;
+
+  vectorMul_cf32(&(vis1[xmacstart]), &(vis2[xmacstart]), scratch, remain);
+  for(int l=0;l<remain;l++)
+  {
+    int destbin = bins[xmacstart + l];
+    if(skipgated && scrunch && binweights[destbin] == 0.0)
+      continue;
+    accum[(x*numbins + destbin)*stridelength + l].re += scratch[l].re;
+    accum[(x*numbins + destbin)*stridelength + l].im += scratch[l].im;
+    weights[destbin] += scrunch ? binweights[destbin] : 1.0;
+  }
+}
+
+// The run path for one stride
+static void segmentedStride(const cf32 *vis1, const cf32 *vis2, const f32 *binweights, bool scrunch, int numbins, int stridelength, int x, const BinSegment *segments, const int *firstsegment, cf32 *accum, f64 *weights)
+{
+  for(int s=firstsegment[x];s<firstsegment[x+1];s++)
+  {
+    int destbin = segments[s].bin;
+    int start = segments[s].start;
+    int l = start - x*stridelength;
+    int seglength = segments[s+1].start - start;
+    if(scrunch && binweights[destbin] == 0.0)
+      continue;
+    vectorAddProduct_cf32(&(vis1[start]), &(vis2[start]), &(accum[(x*numbins + destbin)*stridelength + l]), seglength);
+    weights[destbin] += (scrunch ? binweights[destbin] : 1.0)*seglength;
+  }
+}
+
+// method 0 scatters every stride, 1 uses runs for every stride and 2 chooses for each stride as Core does
+static void crossMultiply(int method, const cf32 *vis1, const cf32 *vis2, const s32 *bins, const f32 *binweights, bool scrunch, int numchannels, int numbins, int stridelength, BinSegment *segments, int *firstsegment, cf32 *scratch, cf32 *accum, f64 *weights)
+{
+  int numstrides = (numchannels + stridelength - 1)/stridelength;
+
+  if(method > 0)
+    findBinSegments(bins, numchannels, stridelength, segments, firstsegment);
+  for(int x=0;x<numstrides;x++)
+  {
+    int remain = numchannels - x*stridelength < stridelength ? numchannels - x*stridelength : stridelength;
+    if(method == 0 || (method == 2 && !useBinSegments(firstsegment[x+1] - firstsegment[x], remain)))
+      scatterStride(vis1, vis2, bins, binweights, scrunch, numchannels, numbins, stridelength, x, method == 2, scratch, accum, weights);
+    else
+      segmentedStride(vis1, vis2, binweights, scrunch, numbins, stridelength, x, segments, firstsegment, accum, weights);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int numchannels = argc > 1 ? atoi(argv[1]) : 4096;
+  int numbins = argc > 2 ? atoi(argv[2]) : 1024;
+  int stridelength = argc > 3 ? atoi(argv[3]) : 128;
+  double turns = argc > 4 ? atof(argv[4]) : 3.0;
+  int numffts = 4000;
+  int numstrides, numsegments = 0;
+  cf32 *vis1, *vis2, *scratch, *accum[3];
+  f64 *weights[3];
+  f32 *binweights;
+  s32 *bins;
+  BinSegment *segments;
+  int *firstsegment;
+
+  if(numchannels < 1 || numbins < 1 || stridelength < 1)
+  {
+    fprintf(stderr, "usage: %s [numchannels [numbins [stridelength [turns across band]]]]\n", argv[0]);
+
+    return EXIT_FAILURE;
+  }
+  numstrides = (numchannels + stridelength - 1)/stridelength;
+
+  vis1 = vectorAlloc_cf32(numchannels);
+  vis2 = vectorAlloc_cf32(numchannels);
+  scratch = vectorAlloc_cf32(stridelength);
+  bins = vectorAlloc_s32(NUMPATTERNS*numchannels);
+  binweights = vectorAlloc_f32(numbins);
+  segments = new BinSegment[getMaxBinSegments(numchannels, stridelength)];
+  firstsegment = new int[numstrides + 1];
+  for(int i=0;i<3;i++)
+  {
+    accum[i] = vectorAlloc_cf32(numstrides*numbins*stridelength);
+    weights[i] = vectorAlloc_f64(numbins);
+  }
+  srand(17);
+  for(int c=0;c<numchannels;c++)
+  {
+    vis1[c].re = (f32)rand()/RAND_MAX - 0.5f;
+    vis1[c].im = (f32)rand()/RAND_MAX - 0.5f;
+    vis2[c].re = (f32)rand()/RAND_MAX - 0.5f;
+    vis2[c].im = (f32)rand()/RAND_MAX - 0.5f;
+  }
+  // move the pulse on a little each FFT, as Polyco::getBins would
+  for(int n=0;n<NUMPATTERNS;n++)
+  {
+    double offset = (double)n/NUMPATTERNS;
+    for(int c=0;c<numchannels;c++)
+    {
+      double f = 1.0 + 0.5*c/numchannels;
+      double phase = offset + turns/(f*f);
+      bins[n*numchannels + c] = (int)((phase - floor(phase))*numbins) % numbins;
+    }
+  }
+  // a gate covering the first eighth of the bins
+  for(int b=0;b<numbins;b++)
+    binweights[b] = (b < (numbins + 7)/8) ? 1.0f : 0.0f;
+
+  printf("%d channels, %d bins, stride %d, pulse phase sweeping %.2f turns across the band\n\n", numchannels, numbins, stridelength, turns);
+  printf("%-18s %12s %12s %8s %12s %8s %12s\n", "case", "scatter(ns)", "runs(ns)", "speedup", "chosen(ns)", "speedup", "maxdiff");
+  for(int gated=0;gated<2;gated++)
+  {
+    double t[3], diff = 0.0;
+
+    for(int method=0;method<3;method++)
+    {
+      double t0;
+
+      vectorZero_cf32(accum[method], numstrides*numbins*stridelength);
+      for(int b=0;b<numbins;b++)
+        weights[method][b] = 0.0;
+      t0 = now();
+      for(int n=0;n<numffts;n++)
+      {
+        const s32 *fftbins = &(bins[(n%NUMPATTERNS)*numchannels]);
+        crossMultiply(method, vis1, vis2, fftbins, binweights, gated, numchannels, numbins, stridelength, segments, firstsegment, scratch, accum[method], weights[method]);
+      }
+      t[method] = now() - t0;
+    }
+    numsegments = findBinSegments(bins, numchannels, stridelength, segments, firstsegment);
+
+    for(int b=0;b<numbins;b++)
+    {
+      // the old scrunched path added gated-out bins too, but with zero weight
+      if(gated && binweights[b] == 0.0)
+        continue;
+      for(int c=0;c<numchannels;c++)
+      {
+        int i = ((c/stridelength)*numbins + b)*stridelength + c%stridelength;
+        for(int method=1;method<3;method++)
+        {
+          double d = fabs(accum[0][i].re - accum[method][i].re) + fabs(accum[0][i].im - accum[method][i].im);
+          if(d > diff)
+            diff = d;
+        }
+      }
+      for(int method=1;method<3;method++)
+      {
+        if(fabs(weights[0][b] - weights[method][b]) > 1e-6*numffts*numchannels)
+          diff = HUGE_VAL;
+      }
+    }
+    printf("%-18s %12.1f %12.1f %7.2fx %12.1f %7.2fx %12.3g\n", gated ? "gated, scrunched" : "all bins", 1.0e9*t[0]/numffts, 1.0e9*t[1]/numffts, t[0]/t[1], 1.0e9*t[2]/numffts, t[0]/t[2], diff);
+  }
+  printf("\n%d runs of channels in the first FFT (%.1f channels per run)\n", numsegments, (double)numchannels/numsegments);
+
+  vectorFree(vis1);
+  vectorFree(vis2);
+  vectorFree(scratch);
+  vectorFree(bins);
+  vectorFree(binweights);
+  for(int i=0;i<3;i++)
+  {
+    vectorFree(accum[i]);
+    vectorFree(weights[i]);
+  }
+  delete [] segments;
+  delete [] firstsegment;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+// Loopback benchmark of VDIF packet reception over UDP.
+// A sender thread streams VDIF frames to a local port as fast as it can while the
+// receiver fills buffers either one packet per recvfrom() call followed by a copy
+// into the buffer (as the plain UDP reader does), or in batches with the
+// VDIFPacketReceiver used by the network datastreams.  The packet rate achieved
+// and the sequence statistics of each method are printed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vdifio.h>
+#include "vdifpacketreceiver.h"
+
+typedef struct
+{
+  int port;
+  int framebytes;
+  int framespersecond;
+  int nthread;
+  volatile int stop;
+  long long sent;
+} SenderInfo;
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+static void *sender(void *arg)
+{
+  SenderInfo *info = (SenderInfo *)arg;
+  struct sockaddr_in addr;
+  char *frame;
+  char stationid[] = "Tt";
+  vdif_header *vh;
+  int sock, f = 0, s = 0, t = 0;
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(info->port);
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  frame = (char *)calloc(info->framebytes, 1);
+  vh = (vdif_header *)frame;
+  createVDIFHeader(vh, info->framebytes - VDIF_HEADER_BYTES, 0, 2, 1, 0, stationid);
+  info->sent = 0;
+  while(!info->stop)
+  {
+    setVDIFThreadID(vh, t);
+    setVDIFFrameNumber(vh, f);
+    setVDIFFrameSecond(vh, s);
+    if(sendto(sock, frame, info->framebytes, 0, (struct sockaddr *)&addr, sizeof(addr)) == info->framebytes)
+    {
+      ++info->sent;
+    }
+    if(++t == info->nthread)
+    {
+      t = 0;
+      if(++f == info->framespersecond)
+      {
+        f = 0;
+        ++s;
+      }
+    }
+  }
+  close(sock);
+  free(frame);
+
+  return 0;
+}
+
+static int openReceiver(int *port)
+{
+  struct sockaddr_in addr;
+  struct timeval tv;
+  socklen_t len = sizeof(addr);
+  int sock, bufsize = 32*1024*1024;
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = 0;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    perror("bind");
+    exit(EXIT_FAILURE);
+  }
+  getsockname(sock, (struct sockaddr *)&addr, &len);
+  *port = ntohs(addr.sin_port);
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+  tv.tv_sec = 0;
+  tv.tv_usec = 100000;
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  return sock;
+}
+
+// one packet per system call, staged then copied into the buffer
+static int receiveSingly(int sock, char *ptr, int bytestoread, int framebytes, char *staging, long long *npackets)
+{
+  int nread = 0, n;
+
+  while(bytestoread - nread >= framebytes)
+  {
+    n = recvfrom(sock, staging, framebytes, 0, 0, 0);
+    if(n <= 0)
+    {
+      break;
+    }
+    if(n != framebytes)
+    {
+      continue;
+    }
+    memcpy(ptr + nread, staging, framebytes);
+    nread += framebytes;
+    ++*npackets;
+  }
+
+  return nread;
+}
+
+static void runTest(const char *name, int batch, int framebytes, int nthread, double seconds)
+{
+  const int framespersecond = 25600;
+  const int bufferbytes = 1024*framebytes;
+  SenderInfo info;
+  pthread_t tid;
+  VDIFPacketReceiver *receiver = 0;
+  VDIFPacketStats stats;
+  char *buffer, *staging;
+  unsigned int nread;
+  long long npackets = 0;
+  double t0, t;
+
+  info.framebytes = framebytes;
+  info.framespersecond = framespersecond;
+  info.nthread = nthread;
+  info.stop = 0;
+  int sock = openReceiver(&info.port);
+  buffer = (char *)malloc(bufferbytes);
+  staging = (char *)malloc(framebytes);
+  if(batch > 0)
+  {
+    receiver = new VDIFPacketReceiver(framebytes, 0, batch);
+  }
+
+  pthread_create(&tid, 0, sender, &info);
+  t0 = now();
+  do
+  {
+    if(receiver)
+    {
+      receiver->receive(sock, buffer, bufferbytes, &nread, framespersecond);
+    }
+    else
+    {
+      receiveSingly(sock, buffer, bufferbytes, framebytes, staging, &npackets);
+    }
+    t = now() - t0;
+  } while(t < seconds);
+  info.stop = 1;
+  pthread_join(tid, 0);
+
+  if(receiver)
+  {
+    receiver->getStats(&stats);
+    npackets = stats.received;
+    printf("%-10s %6d %12.0f %10.3f %11.2f%% %10lld %10lld %10lld\n", name, batch, npackets/t, 8.0e-9*npackets*framebytes/t,
+      100.0*npackets/(info.sent > 0 ? info.sent : 1), stats.lost, stats.outoforder, stats.duplicate);
+    delete receiver;
+  }
+  else
+  {
+    printf("%-10s %6d %12.0f %10.3f %11.2f%% %10s %10s %10s\n", name, 1, npackets/t, 8.0e-9*npackets*framebytes/t,
+      100.0*npackets/(info.sent > 0 ? info.sent : 1), "-", "-", "-");
+  }
+
+  close(sock);
+  free(buffer);
+  free(staging);
+}
+
+int main(int argc, char **argv)
+{
+  int framebytes = 8032;
+  int nthread = 1;
+  double seconds = 2.0;
+  const int batches[] = { 8, 32, 64, 256 };
+
+  if(argc > 1)
+  {
+    if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+    {
+      printf("Usage: %s [<frame bytes> [<threads> [<seconds per test>]]]\n", argv[0]);
+      printf("  frame bytes : VDIF frame size including header (default %d)\n", framebytes);
+      printf("  threads     : number of VDIF threads interleaved by the sender (default %d)\n", nthread);
+      printf("  seconds     : time to spend on each test (default %.1f)\n", seconds);
+
+      return EXIT_SUCCESS;
+    }
+    framebytes = atoi(argv[1]);
+  }
+  if(argc > 2)
+  {
+    nthread = atoi(argv[2]);
+  }
+  if(argc > 3)
+  {
+    seconds = atof(argv[3]);
+  }
+  if(framebytes <= VDIF_HEADER_BYTES || framebytes > 65000 || framebytes % 8 != 0 || nthread < 1 || nthread > 1024 || seconds <= 0.0)
+  {
+    fprintf(stderr, "Error: frame bytes must be a multiple of 8 between %d and 65000, threads between 1 and 1024\n", VDIF_HEADER_BYTES);
+
+    return EXIT_FAILURE;
+  }
+
+  printf("%d byte VDIF frames over UDP loopback, %d thread(s), %.1f s per test\n", framebytes, nthread, seconds);
+  printf("%-10s %6s %12s %10s %12s %10s %10s %10s\n", "Method", "Batch", "Packets/s", "Gbps", "Delivered", "Lost", "OutOfOrder", "Duplicate");
+  runTest("recvfrom", 0, framebytes, nthread, seconds);
+  for(unsigned int b = 0; b < sizeof(batches)/sizeof(batches[0]); ++b)
+  {
+    runTest("recvmmsg", batches[b], framebytes, nthread, seconds);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+// Micro-benchmark of the vector kernels used in the correlator inner loops.
+// Each kernel is timed for the scalar generic implementation, for every SIMD
+// level supported by this CPU, and for the vector* macro itself (IPP in an
+// IPP build, the dispatched SIMD kernel in a generic build).  Results are
+// checked against the scalar implementation.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sys/time.h>
+#include "architecture.h"
+
+static double now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+
+  return tv.tv_sec + 1.0e-6*tv.tv_usec;
+}
+
+static void fill(f32 *v, int n, unsigned int seed)
+{
+  srand(seed);
+  for(int i = 0; i < n; ++i)
+  {
+    v[i] = (f32)rand()/RAND_MAX - 0.5f;
+  }
+}
+
+static double maxdiff(const f32 *a, const f32 *b, int n)
+{
+  double m = 0.0;
+
+  for(int i = 0; i < n; ++i)
+  {
+    double d = fabs(a[i] - b[i]);
+    if(d > m)
+    {
+      m = d;
+    }
+  }
+
+  return m;
+}
+
+enum Kernel { K_ADDPRODUCT, K_MUL, K_MULC, K_MUL_F32CF32, K_CONJ, K_REALTOCPLX, K_ADD, K_POWERMOMENTS, K_MULLEVELS, K_NUMKERNELS };
+static const char kernelNames[K_NUMKERNELS][20] = { "AddProduct_cf32", "Mul_cf32", "MulC_cf32_I", "Mul_f32cf32", "Conj_cf32", "RealToComplex_f32", "Add_cf32_I", "AddPowerMoments", "MulLevels_s8cf32" };
+
+// Set the destination up as each kernel expects it (in-place kernels start from a copy of a)
+static void prepare(int k, const cf32 *a, cf32 *out, int n)
+{
+  if(k == K_MULC)
+  {
+    vectorCopy_cf32(a, out, n);
+  }
+  else
+  {
+    vectorZero_cf32(out, n);
+  }
+}
+
+// Run one kernel once; tab == 0 means use the vector* macro.  AddPowerMoments accumulates into
+// the two halves of out and has no single vector* equivalent, so the macro line times the
+// separate magnitude/square/add passes it replaces, using scratch.  Likewise MulLevels, which
+// rotates bytes of quantised samples, is compared with Mul_f32cf32 on the same samples as floats.
+static void runkernel(int k, const SimdKernelTable *tab, const cf32 *a, const cf32 *b, const f32 *r, const s8 *q, const f32 *levels, const f32 *ql, cf32 *out, f32 *scratch, int n)
+{
+  cf32 c;
+
+  c.re = 0.6f;
+  c.im = -0.8f;
+  if(tab)
+  {
+    switch(k)
+    {
+      case K_ADDPRODUCT: tab->addProduct_32fc(a, b, out, n); break;
+      case K_MUL:        tab->mul_32fc(a, b, out, n); break;
+      case K_MULC:       tab->mulC_32fc_I(c, out, n); break;
+      case K_MUL_F32CF32: tab->mul_32f32fc(r, b, out, n); break;
+      case K_CONJ:       tab->conj_32fc(a, out, n); break;
+      case K_REALTOCPLX: tab->realToCplx_32f(r, r+n, out, n); break;
+      case K_ADD:        tab->add_32fc_I(a, out, n); break;
+      case K_POWERMOMENTS: tab->addPowerMoments_32fc(a, (f32 *)out, (f32 *)out + n, n); break;
+      case K_MULLEVELS:  tab->mulLevels_8s32fc(q, levels, b, out, n); break;
+    }
+  }
+  else
+  {
+    switch(k)
+    {
+      case K_ADDPRODUCT: vectorAddProduct_cf32(a, b, out, n); break;
+      case K_MUL:        vectorMul_cf32(a, b, out, n); break;
+      case K_MULC:       vectorMulC_cf32_I(c, out, n); break;
+      case K_MUL_F32CF32: vectorMul_f32cf32(r, b, out, n); break;
+      case K_CONJ:       vectorConj_cf32(a, out, n); break;
+      case K_REALTOCPLX: vectorRealToComplex_f32(r, r+n, out, n); break;
+      case K_ADD:        vectorAdd_cf32_I(a, out, n); break;
+      case K_POWERMOMENTS:
+        vectorMagnitude_cf32(a, scratch, n);
+        vectorSquare_f32_I(scratch, n);
+        vectorAdd_f32_I(scratch, (f32 *)out, n);
+        vectorSquare_f32_I(scratch, n);
+        vectorAdd_f32_I(scratch, (f32 *)out + n, n);
+        break;
+      case K_MULLEVELS:  vectorMul_f32cf32(ql, b, out, n); break;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int length = 4096;
+  double seconds = 0.2;
+  int maxlevel = simdDetectLevel();
+  cf32 *a, *b, *out, *ref;
+  f32 *r, *scratch, *ql;
+  s8 *q;
+  //as decoded from 2 bit samples, at the byte value & 15
+  const f32 levels[16] = { 0.0f, 1.0f, 0.0f, 3.3359f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -3.3359f, 0.0f, -1.0f };
+
+  if(argc > 1)
+  {
+    if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+    {
+      printf("Usage: %s [<length> [<seconds per test>]]\n", argv[0]);
+      printf("  length  : number of complex elements per call (default %d)\n", length);
+      printf("  seconds : time to spend on each kernel/implementation (default %.1f)\n", seconds);
+
+      return EXIT_SUCCESS;
+    }
+    length = atoi(argv[1]);
+  }
+  if(argc > 2)
+  {
+    seconds = atof(argv[2]);
+  }
+  if(length < 1)
+  {
+    fprintf(stderr, "Error: length must be positive\n");
+
+    return EXIT_FAILURE;
+  }
+
+  a   = vectorAlloc_cf32(length);
+  b   = vectorAlloc_cf32(length);
+  out = vectorAlloc_cf32(length);
+  ref = vectorAlloc_cf32(length);
+  r   = vectorAlloc_f32(2*length);
+  scratch = vectorAlloc_f32(length);
+  q   = (s8 *)vectorAlloc_u8(length);
+  ql  = vectorAlloc_f32(length);
+  fill((f32 *)a, 2*length, 1);
+  fill((f32 *)b, 2*length, 2);
+  fill(r, 2*length, 3);
+  for(int i = 0; i < length; ++i)
+  {
+    q[i] = 2*(rand() % 4) - 3;
+    ql[i] = levels[q[i] & 15];
+  }
+
+  printf("Vector length %d complex; CPU supports up to %s; vector* macros use %s\n", length, simdLevelName(maxlevel),
+#if(ARCH == INTEL)
+    "IPP"
+#else
+    simdLevelName(simdGetLevel())
+#endif
+    );
+  printf("%-18s %-8s %12s %9s %12s\n", "Kernel", "Impl", "Melem/s", "Speedup", "Max error");
+
+  for(int k = 0; k < K_NUMKERNELS; ++k)
+  {
+    double scalarrate = 0.0;
+
+    // reference result
+    prepare(k, a, ref, length);
+    runkernel(k, simdGetKernels(SIMD_GENERIC), a, b, r, q, levels, ql, ref, scratch, length);
+
+    for(int level = SIMD_GENERIC; level <= maxlevel+1; ++level)
+    {
+      // level maxlevel+1 denotes the vector* macro
+      const SimdKernelTable *tab = (level <= maxlevel) ? simdGetKernels(level) : 0;
+      const char *name = tab ? simdLevelName(level) : "vector*";
+      long long calls = 0;
+      double t0, t;
+      double rate;
+
+      prepare(k, a, out, length);
+      runkernel(k, tab, a, b, r, q, levels, ql, out, scratch, length);
+      double err = maxdiff((const f32 *)out, (const f32 *)ref, 2*length);
+
+      t0 = now();
+      do
+      {
+        for(int i = 0; i < 100; ++i)
+        {
+          if(k == K_ADDPRODUCT || k == K_ADD || k == K_POWERMOMENTS)
+          {
+            // keep the accumulators bounded
+            if((calls + i) % 64 == 0)
+            {
+              vectorZero_cf32(out, length);
+            }
+          }
+          runkernel(k, tab, a, b, r, q, levels, ql, out, scratch, length);
+        }
+        calls += 100;
+        t = now() - t0;
+      } while(t < seconds);
+
+      rate = 1.0e-6*calls*length/t;
+      if(level == SIMD_GENERIC)
+      {
+        scalarrate = rate;
+      }
+      printf("%-18s %-8s %12.1f %8.2fx %12.3g\n", kernelNames[k], name, rate, rate/scalarrate, err);
+    }
+  }
+
+  vectorFree(a);
+  vectorFree(b);
+  vectorFree(out);
+  vectorFree(ref);
+  vectorFree(r);
+  vectorFree(scratch);
+  vectorFree((u8 *)q);
+  vectorFree(ql);
+
+  return EXIT_SUCCESS;
+}